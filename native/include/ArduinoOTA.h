@@ -0,0 +1,39 @@
+// Host shim: ArduinoOTA. Network OTA is not simulated; callbacks are stored
+// so the firmware's setup code links unchanged.
+#pragma once
+#include <functional>
+#include "Arduino.h"
+#include "Update.h"
+
+typedef enum
+{
+  OTA_AUTH_ERROR,
+  OTA_BEGIN_ERROR,
+  OTA_CONNECT_ERROR,
+  OTA_RECEIVE_ERROR,
+  OTA_END_ERROR
+} ota_error_t;
+
+class ArduinoOTAClass
+{
+public:
+  typedef std::function<void(void)> THandlerFunction;
+  typedef std::function<void(ota_error_t)> THandlerFunction_Error;
+  typedef std::function<void(unsigned int, unsigned int)> THandlerFunction_Progress;
+
+  ArduinoOTAClass &onStart(THandlerFunction fn) { start_ = fn; return *this; }
+  ArduinoOTAClass &onEnd(THandlerFunction fn) { end_ = fn; return *this; }
+  ArduinoOTAClass &onError(THandlerFunction_Error fn) { error_ = fn; return *this; }
+  ArduinoOTAClass &onProgress(THandlerFunction_Progress fn) { progress_ = fn; return *this; }
+  ArduinoOTAClass &setHostname(const char *) { return *this; }
+  void begin() {}
+  void end() {}
+  void handle() {}
+  int getCommand() { return U_FLASH; }
+
+private:
+  THandlerFunction start_, end_;
+  THandlerFunction_Error error_;
+  THandlerFunction_Progress progress_;
+};
+extern ArduinoOTAClass ArduinoOTA;
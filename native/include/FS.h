@@ -0,0 +1,44 @@
+// Host shim: Arduino FS backed by a host directory.
+#pragma once
+#include <memory>
+#include "Arduino.h"
+
+namespace fs
+{
+class File : public Stream
+{
+public:
+  File() {}
+  explicit File(FILE *fp) : fp_(fp, fclose) {}
+  using Print::write;
+  size_t write(const uint8_t *buf, size_t size) override { return fp_ ? fwrite(buf, 1, size, fp_.get()) : 0; }
+  int available() override;
+  int read() override { return fp_ ? fgetc(fp_.get()) : -1; }
+  size_t read(uint8_t *buf, size_t size) { return fp_ ? fread(buf, 1, size, fp_.get()) : 0; }
+  bool seek(uint32_t pos) { return fp_ && fseek(fp_.get(), pos, SEEK_SET) == 0; }
+  size_t size();
+  void close() { fp_.reset(); }
+  explicit operator bool() const { return (bool)fp_; }
+
+private:
+  std::shared_ptr<FILE> fp_;
+};
+
+class FS
+{
+public:
+  explicit FS(const char *root = nullptr) : root_(root) {}
+  File open(const char *path, const char *mode = "r");
+  File open(const String &path, const char *mode = "r") { return open(path.c_str(), mode); }
+  bool exists(const char *path);
+  bool exists(const String &path) { return exists(path.c_str()); }
+  bool remove(const char *path);
+  bool remove(const String &path) { return remove(path.c_str()); }
+
+protected:
+  String fullPath(const char *path);
+  const char *root_;
+};
+} // namespace fs
+using fs::File;
+using fs::FS;
@@ -0,0 +1,37 @@
+// Host shim: Arduino HTTPClient (plain http:// only) over POSIX sockets.
+#pragma once
+#include <vector>
+#include "Arduino.h"
+#include "WiFiClient.h"
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+class HTTPClient
+{
+public:
+  bool begin(const String &url);
+  void end();
+  void setTimeout(uint16_t ms) { timeout_ms_ = ms; }
+  void setConnectTimeout(int32_t ms) { connect_timeout_ms_ = ms; }
+  void setReuse(bool) {}
+  void addHeader(const String &name, const String &value);
+  int GET();
+  int POST(uint8_t *payload, size_t size);
+  int POST(const String &payload) { return POST((uint8_t *)payload.c_str(), payload.length()); }
+  String getString() { return body_; }
+  static String errorToString(int error);
+
+private:
+  int request(const char *method, const uint8_t *payload, size_t size);
+  String host_, path_;
+  uint16_t port_ = 80;
+  String headers_;
+  String body_;
+  uint16_t timeout_ms_ = 5000;
+  int32_t connect_timeout_ms_ = 5000;
+};
@@ -0,0 +1,33 @@
+// Host shim: Arduino IPAddress.
+#pragma once
+#include <cstdint>
+#include "WString.h"
+
+class IPAddress
+{
+public:
+  IPAddress() : addr_(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr_(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+  IPAddress(uint32_t a) : addr_(a) {}
+  operator uint32_t() const { return addr_; }
+  uint8_t operator[](int i) const { return (addr_ >> (8 * i)) & 0xFF; }
+  bool operator==(const IPAddress &o) const { return addr_ == o.addr_; }
+  bool fromString(const char *s)
+  {
+    unsigned a, b, c, d;
+    if (sscanf(s, "%u.%u.%u.%u", &a, &b, &c, &d) != 4)
+      return false;
+    *this = IPAddress(a, b, c, d);
+    return true;
+  }
+  bool fromString(const String &s) { return fromString(s.c_str()); }
+  String toString() const
+  {
+    char b[16];
+    snprintf(b, sizeof(b), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(b);
+  }
+
+private:
+  uint32_t addr_;
+};
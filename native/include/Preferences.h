@@ -0,0 +1,38 @@
+// Host shim: Arduino Preferences (NVS) stored as one file per key under
+// NATIVE_NVS_DIR (default ./sim_nvs).
+#pragma once
+#include "Arduino.h"
+
+class Preferences
+{
+public:
+  bool begin(const char *name, bool readOnly = false);
+  void end() {}
+  bool clear();
+  bool remove(const char *key);
+  bool isKey(const char *key);
+  size_t putBytes(const char *key, const void *value, size_t len);
+  size_t getBytes(const char *key, void *buf, size_t maxLen);
+  size_t getBytesLength(const char *key);
+  size_t putString(const char *key, const char *value) { return putBytes(key, value, strlen(value) + 1); }
+  size_t putString(const char *key, const String &value) { return putString(key, value.c_str()); }
+  String getString(const char *key, const String &def = String());
+  size_t putUInt(const char *key, uint32_t v) { return putBytes(key, &v, sizeof(v)); }
+  uint32_t getUInt(const char *key, uint32_t def = 0)
+  {
+    uint32_t v = def;
+    return getBytes(key, &v, sizeof(v)) == sizeof(v) ? v : def;
+  }
+  size_t putInt(const char *key, int32_t v) { return putBytes(key, &v, sizeof(v)); }
+  int32_t getInt(const char *key, int32_t def = 0)
+  {
+    int32_t v = def;
+    return getBytes(key, &v, sizeof(v)) == sizeof(v) ? v : def;
+  }
+  size_t putBool(const char *key, bool v) { return putUInt(key, v); }
+  bool getBool(const char *key, bool def = false) { return getUInt(key, def) != 0; }
+
+private:
+  String path(const char *key);
+  String ns_;
+};
@@ -0,0 +1,83 @@
+// Host shim: Arduino Print/Stream.
+#pragma once
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "WString.h"
+#include "IPAddress.h"
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) { return write(&c, 1); }
+  virtual size_t write(const uint8_t *buf, size_t size) = 0;
+  size_t write(const char *buf, size_t size) { return write((const uint8_t *)buf, size); }
+  size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+  size_t print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+  size_t print(const char *s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int v) { return print(String(v)); }
+  size_t print(unsigned int v) { return print(String(v)); }
+  size_t print(long v) { return print(String(v)); }
+  size_t print(unsigned long v) { return print(String(v)); }
+  size_t print(double v, int d = 2) { return print(String(v, d)); }
+  size_t print(const IPAddress &ip) { return print(ip.toString()); }
+  template <class T>
+  size_t println(const T &v) { return print(v) + print("\r\n"); }
+  size_t println() { return print("\r\n"); }
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+  {
+    char b[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(b, sizeof(b), fmt, ap);
+    va_end(ap);
+    if (n < 0)
+      return 0;
+    return write((const uint8_t *)b, (size_t)n < sizeof(b) ? n : sizeof(b) - 1);
+  }
+  virtual void flush() {}
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() { return -1; }
+  virtual size_t readBytes(uint8_t *buf, size_t len)
+  {
+    size_t n = 0;
+    int c;
+    while (n < len && (c = read()) >= 0)
+      buf[n++] = (uint8_t)c;
+    return n;
+  }
+  size_t readBytes(char *buf, size_t len) { return readBytes((uint8_t *)buf, len); }
+  void setTimeout(unsigned long ms) { timeout_ = ms; }
+  String readString()
+  {
+    String s;
+    int c;
+    while ((c = read()) >= 0)
+      s += (char)c;
+    return s;
+  }
+
+protected:
+  unsigned long timeout_ = 1000;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+  void begin(unsigned long) {}
+  void setDebugOutput(bool) {}
+  size_t write(const uint8_t *buf, size_t size) override { return fwrite(buf, 1, size, stdout); }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  void flush() override { fflush(stdout); }
+};
+extern HardwareSerial Serial;
@@ -0,0 +1,14 @@
+// Host shim: SPIFFS mapped onto a host directory (NATIVE_SPIFFS_DIR, default ./sim_spiffs).
+#pragma once
+#include "FS.h"
+
+class SPIFFSFS : public fs::FS
+{
+public:
+  bool begin(bool formatOnFail = false, const char *basePath = "/spiffs", uint8_t maxOpenFiles = 10,
+             const char *partitionLabel = nullptr);
+  void end() {}
+  size_t totalBytes();
+  size_t usedBytes();
+};
+extern SPIFFSFS SPIFFS;
@@ -0,0 +1,61 @@
+// Host shim: TFT_eSPI drawing calls are accepted and discarded.
+#pragma once
+#include "Arduino.h"
+
+#define TFT_BLACK 0x0000
+#define TFT_BLUE 0x001F
+#define TFT_RED 0xF800
+#define TFT_GREEN 0x07E0
+#define TFT_CYAN 0x07FF
+#define TFT_MAGENTA 0xF81F
+#define TFT_YELLOW 0xFFE0
+#define TFT_WHITE 0xFFFF
+#ifndef TFT_WIDTH
+#define TFT_WIDTH 80
+#endif
+#ifndef TFT_HEIGHT
+#define TFT_HEIGHT 160
+#endif
+
+class TFT_eSPI : public Print
+{
+public:
+  void begin() {}
+  void init() {}
+  void setRotation(uint8_t r) { rotation_ = r; }
+  int16_t width() const { return rotation_ & 1 ? TFT_HEIGHT : TFT_WIDTH; }
+  int16_t height() const { return rotation_ & 1 ? TFT_WIDTH : TFT_HEIGHT; }
+  void fillScreen(uint32_t) {}
+  void invertDisplay(bool) {}
+  void setTextFont(uint8_t) {}
+  void setTextSize(uint8_t) {}
+  void setCursor(int16_t, int16_t) {}
+  void setTextColor(uint16_t) {}
+  void setTextColor(uint16_t, uint16_t) {}
+  void setSwapBytes(bool) {}
+  void drawRect(int32_t, int32_t, int32_t, int32_t, uint32_t) {}
+  void fillRect(int32_t, int32_t, int32_t, int32_t, uint32_t) {}
+  int16_t drawString(const String &, int32_t, int32_t) { return 0; }
+  int16_t textWidth(const String &s) { return 6 * s.length(); }
+  int16_t fontHeight() { return 8; }
+  void setViewport(int32_t, int32_t, int32_t, int32_t, bool = true) {}
+  void resetViewport() {}
+  void startWrite() {}
+  void endWrite() {}
+  void setAddrWindow(int32_t, int32_t, int32_t, int32_t) {}
+  void pushColors(uint16_t *, uint32_t, bool = true) {}
+  void pushImage(int32_t, int32_t, int32_t, int32_t, const uint16_t *) {}
+  bool initDMA(bool = false) { return true; }
+  void deInitDMA() {}
+  void pushImageDMA(int32_t x, int32_t y, int32_t w, int32_t h, uint16_t *data, uint16_t * = nullptr)
+  {
+    pushImage(x, y, w, h, data);
+  }
+  bool dmaBusy() { return false; }
+  void dmaWait() {}
+  using Print::write;
+  size_t write(const uint8_t *, size_t size) override { return size; }
+
+private:
+  uint8_t rotation_ = 0;
+};
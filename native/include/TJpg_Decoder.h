@@ -0,0 +1,50 @@
+// Host shim: TJpg_Decoder parses the SOF size and never calls back.
+#pragma once
+#include "Arduino.h"
+
+enum JRESULT
+{
+  JDR_OK = 0,
+  JDR_INTR,
+  JDR_INP,
+  JDR_MEM1,
+  JDR_MEM2,
+  JDR_PAR,
+  JDR_FMT1,
+  JDR_FMT2,
+  JDR_FMT3
+};
+
+typedef bool (*SketchCallback)(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *data);
+
+class TJpg_Decoder
+{
+public:
+  void setJpgScale(uint8_t scale) { scale_ = scale; }
+  void setSwapBytes(bool) {}
+  void setCallback(SketchCallback cb) { cb_ = cb; }
+  JRESULT getJpgSize(uint16_t *w, uint16_t *h, const uint8_t *data, uint32_t len)
+  {
+    for (uint32_t i = 0; i + 8 < len; i++)
+    {
+      if (data[i] == 0xFF && (data[i + 1] == 0xC0 || data[i + 1] == 0xC1))
+      {
+        *h = (data[i + 5] << 8) | data[i + 6];
+        *w = (data[i + 7] << 8) | data[i + 8];
+        return JDR_OK;
+      }
+    }
+    return JDR_FMT1;
+  }
+  JRESULT drawJpg(int32_t, int32_t, const uint8_t *data, uint32_t len)
+  {
+    uint16_t w, h;
+    return getJpgSize(&w, &h, data, len);
+  }
+
+private:
+  uint8_t scale_ = 1;
+  SketchCallback cb_ = nullptr;
+};
+
+extern TJpg_Decoder TJpgDec;
@@ -0,0 +1,34 @@
+// Host shim: Arduino Update writing into a file-backed OTA slot image
+// (NATIVE_OTA_SLOT, default ./sim_ota_slot.bin).
+#pragma once
+#include "Arduino.h"
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+#define U_FLASH 0
+#define U_SPIFFS 100
+#define U_AUTH 200
+
+class UpdateClass
+{
+public:
+  bool begin(size_t size = UPDATE_SIZE_UNKNOWN, int command = U_FLASH);
+  size_t write(uint8_t *data, size_t len);
+  bool end(bool evenIfRemaining = false);
+  void abort();
+  bool hasError() { return error_ != 0; }
+  uint8_t getError() { return error_; }
+  const char *errorString();
+  void printError(Print &out) { out.println(errorString()); }
+  bool isRunning() { return running_; }
+  size_t progress() { return progress_; }
+  size_t size() { return size_; }
+  size_t remaining() { return size_ - progress_; }
+
+private:
+  FILE *fp_ = nullptr;
+  bool running_ = false;
+  uint8_t error_ = 0;
+  size_t progress_ = 0;
+  size_t size_ = 0;
+};
+extern UpdateClass Update;
@@ -0,0 +1,110 @@
+// Host shim: Arduino WebServer (synchronous, one request per handleClient()).
+#pragma once
+#include <functional>
+#include <vector>
+#include "Arduino.h"
+#include "WiFi.h"
+
+enum HTTPMethod
+{
+  HTTP_ANY,
+  HTTP_GET,
+  HTTP_HEAD,
+  HTTP_POST,
+  HTTP_PUT,
+  HTTP_PATCH,
+  HTTP_DELETE,
+  HTTP_OPTIONS
+};
+enum HTTPUploadStatus
+{
+  UPLOAD_FILE_START,
+  UPLOAD_FILE_WRITE,
+  UPLOAD_FILE_END,
+  UPLOAD_FILE_ABORTED
+};
+
+#define HTTP_UPLOAD_BUFLEN 1436
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+#define CONTENT_LENGTH_NOT_SET ((size_t)-2)
+
+typedef struct
+{
+  HTTPUploadStatus status;
+  String filename;
+  String name;
+  String type;
+  size_t totalSize;
+  size_t currentSize;
+  uint8_t buf[HTTP_UPLOAD_BUFLEN];
+} HTTPUpload;
+
+class WebServer
+{
+public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  WebServer(int port = 80) : port_(port), server_(port) {}
+  void begin();
+  void close();
+  void stop() { close(); }
+  void handleClient();
+  void on(const String &uri, THandlerFunction fn) { on(uri, HTTP_ANY, fn); }
+  void on(const String &uri, HTTPMethod method, THandlerFunction fn) { on(uri, method, fn, nullptr); }
+  void on(const String &uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn);
+  void onNotFound(THandlerFunction fn) { not_found_ = fn; }
+  void collectHeaders(const char *keys[], size_t count);
+
+  String uri() { return uri_; }
+  HTTPMethod method() { return method_; }
+  WiFiClient &client() { return client_; }
+  HTTPUpload &upload() { return upload_; }
+  String arg(const String &name);
+  String arg(int i);
+  String argName(int i);
+  int args() { return (int)args_.size(); }
+  bool hasArg(const String &name);
+  String header(const String &name);
+  bool hasHeader(const String &name);
+
+  void send(int code, const char *content_type = nullptr, const String &content = String(""));
+  void send(int code, const String &content_type, const String &content) { send(code, content_type.c_str(), content); }
+  void send(int code, const char *content_type, const char *content) { send(code, content_type, String(content)); }
+  void send_P(int code, PGM_P content_type, PGM_P content, size_t len);
+  void setContentLength(size_t len) { content_length_ = len; }
+  void sendHeader(const String &name, const String &value, bool first = false);
+  void sendContent(const String &content) { sendContent(content.c_str(), content.length()); }
+  void sendContent(const char *content, size_t len);
+
+private:
+  struct Route
+  {
+    String uri;
+    HTTPMethod method;
+    THandlerFunction fn;
+    THandlerFunction ufn;
+  };
+  struct KV
+  {
+    String k;
+    String v;
+  };
+  bool parseRequest();
+  bool parseMultipart(const Route &r, const String &boundary, size_t length);
+  void sendHeaders(int code, const char *content_type, size_t len);
+
+  int port_;
+  WiFiServer server_;
+  WiFiClient client_;
+  std::vector<Route> routes_;
+  THandlerFunction not_found_;
+  String uri_;
+  HTTPMethod method_ = HTTP_GET;
+  std::vector<KV> args_;
+  std::vector<KV> headers_;
+  std::vector<String> collect_;
+  std::vector<KV> out_headers_;
+  HTTPUpload upload_;
+  size_t content_length_ = CONTENT_LENGTH_NOT_SET;
+  bool chunked_ = false;
+};
@@ -0,0 +1,54 @@
+// Host shim: Arduino WiFiClient over a POSIX TCP socket. Copies share the
+// socket, as on the device.
+#pragma once
+#include <memory>
+#include "Arduino.h"
+
+class WiFiClient : public Stream
+{
+public:
+  WiFiClient();
+  explicit WiFiClient(int fd);
+  ~WiFiClient();
+  int connect(IPAddress ip, uint16_t port);
+  int connect(const char *host, uint16_t port);
+  int connect(const char *host, uint16_t port, int32_t timeout_ms);
+  using Print::write;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t size);
+  int peek() override;
+  uint8_t connected();
+  void stop();
+  int fd() const;
+  int setNoDelay(bool nodelay);
+  IPAddress remoteIP() const;
+  uint16_t remotePort() const;
+  explicit operator bool() { return connected(); }
+  bool operator==(const WiFiClient &o) const { return sock_ == o.sock_; }
+
+private:
+  struct Socket;
+  std::shared_ptr<Socket> sock_;
+};
+
+class WiFiServer
+{
+public:
+  WiFiServer(uint16_t port = 80, uint8_t max_clients = 4) : port_(port) { (void)max_clients; }
+  ~WiFiServer() { end(); }
+  void begin(uint16_t port = 0);
+  WiFiClient available();
+  WiFiClient accept() { return available(); }
+  bool hasClient();
+  void setNoDelay(bool) {}
+  void end();
+  void close() { end(); }
+  void stop() { end(); }
+  explicit operator bool() { return fd_ >= 0; }
+
+private:
+  uint16_t port_;
+  int fd_ = -1;
+};
@@ -0,0 +1,39 @@
+// Host shim: Arduino WiFiUDP over a POSIX datagram socket.
+#pragma once
+#include <vector>
+#include "Arduino.h"
+
+class WiFiUDP : public Stream
+{
+public:
+  ~WiFiUDP() { stop(); }
+  uint8_t begin(uint16_t port);
+  uint8_t begin(IPAddress ip, uint16_t port) { (void)ip; return begin(port); }
+  uint8_t beginMulticast(IPAddress group, uint16_t port);
+  void stop();
+  int beginPacket(IPAddress ip, uint16_t port);
+  int beginPacket(const char *host, uint16_t port);
+  int beginMulticastPacket();
+  int endPacket();
+  using Print::write;
+  size_t write(const uint8_t *buf, size_t size) override;
+  int parsePacket();
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t len);
+  int read(char *buf, size_t len) { return read((uint8_t *)buf, len); }
+  IPAddress remoteIP() { return remote_ip_; }
+  uint16_t remotePort() { return remote_port_; }
+
+private:
+  int fd_ = -1;
+  IPAddress remote_ip_;
+  uint16_t remote_port_ = 0;
+  IPAddress tx_ip_;
+  uint16_t tx_port_ = 0;
+  IPAddress mcast_ip_;
+  uint16_t mcast_port_ = 0;
+  std::vector<uint8_t> tx_;
+  std::vector<uint8_t> rx_;
+  size_t rx_pos_ = 0;
+};
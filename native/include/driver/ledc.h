@@ -0,0 +1,16 @@
+// Host shim: LEDC enums referenced by camera_config_t.
+#pragma once
+typedef enum
+{
+  LEDC_TIMER_0,
+  LEDC_TIMER_1,
+  LEDC_TIMER_2,
+  LEDC_TIMER_3
+} ledc_timer_t;
+typedef enum
+{
+  LEDC_CHANNEL_0,
+  LEDC_CHANNEL_1,
+  LEDC_CHANNEL_2,
+  LEDC_CHANNEL_3
+} ledc_channel_t;
@@ -0,0 +1,6 @@
+// Host shim: LEDC PWM is a no-op off the device.
+#pragma once
+#include <cstdint>
+inline double ledcSetup(uint8_t, double freq, uint8_t) { return freq; }
+inline void ledcAttachPin(uint8_t, uint8_t) {}
+inline void ledcWrite(uint8_t, uint32_t) {}
@@ -0,0 +1,7 @@
+// Host shim: placement attributes are no-ops off the device.
+#pragma once
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define EXT_RAM_ATTR
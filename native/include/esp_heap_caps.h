@@ -0,0 +1,14 @@
+// Host shim: capability-aware allocation maps onto malloc.
+#pragma once
+#include <cstddef>
+#include <cstdlib>
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_DEFAULT (1 << 12)
+inline void *heap_caps_malloc(size_t size, unsigned) { return malloc(size); }
+inline void *heap_caps_calloc(size_t n, size_t size, unsigned) { return calloc(n, size); }
+inline void heap_caps_free(void *p) { free(p); }
+size_t heap_caps_get_free_size(unsigned caps);
+size_t heap_caps_get_largest_free_block(unsigned caps);
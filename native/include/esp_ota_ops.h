@@ -0,0 +1,5 @@
+// Host shim: the running app is the "app0" partition file (esp_partition.h).
+#pragma once
+#include "esp_partition.h"
+
+const esp_partition_t *esp_ota_get_running_partition(void);
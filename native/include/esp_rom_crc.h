@@ -0,0 +1,5 @@
+// Host shim: ROM CRC32 (little-endian, same as esp_rom_crc32_le).
+#pragma once
+#include <cstddef>
+#include <cstdint>
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
@@ -0,0 +1,5 @@
+// Host shim: monotonic microsecond clock.
+#pragma once
+#include <cstdint>
+int64_t esp_timer_get_time();
+uint32_t esp_random();
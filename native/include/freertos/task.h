@@ -0,0 +1,23 @@
+// Host shim: FreeRTOS tasks as detached pthreads.
+#pragma once
+#include <sched.h>
+#include "FreeRTOS.h"
+
+typedef struct shim_task *TaskHandle_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core);
+inline BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                              UBaseType_t prio, TaskHandle_t *handle)
+{
+  return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, handle, tskNO_AFFINITY);
+}
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+#define taskYIELD() sched_yield()
+void vTaskDelayUntil(TickType_t *prev, TickType_t inc);
+TickType_t xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
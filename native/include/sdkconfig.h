@@ -0,0 +1,3 @@
+// Host shim: no target-specific sdkconfig off the device.
+#pragma once
+#define CONFIG_IDF_TARGET_ESP32 1
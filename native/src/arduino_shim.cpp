@@ -0,0 +1,87 @@
+// Host shim: Arduino core, esp_timer, ROM CRC and system calls.
+#include <chrono>
+#include <random>
+#include <thread>
+#include "Arduino.h"
+#include "esp_rom_crc.h"
+#include "esp_sntp.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static const auto boot_time = std::chrono::steady_clock::now();
+
+int64_t esp_timer_get_time()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot_time).count();
+}
+
+unsigned long millis() { return (unsigned long)(esp_timer_get_time() / 1000); }
+unsigned long micros() { return (unsigned long)esp_timer_get_time(); }
+void delay(uint32_t ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+void yield() { std::this_thread::yield(); }
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+bool psramFound() { return true; }
+void *ps_malloc(size_t size) { return malloc(size); }
+
+static sntp_sync_time_cb_t sntp_cb = nullptr;
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t cb) { sntp_cb = cb; }
+
+void configTime(long, int, const char *, const char *, const char *)
+{
+  if (sntp_cb)
+  {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    sntp_cb(&tv);
+  }
+}
+
+uint32_t esp_random()
+{
+  static std::mt19937 rng(std::random_device{}());
+  return rng();
+}
+
+size_t heap_caps_get_free_size(unsigned caps) { return (caps & MALLOC_CAP_SPIRAM) ? 4u << 20 : 160u << 10; }
+size_t heap_caps_get_largest_free_block(unsigned caps) { return heap_caps_get_free_size(caps) / 2; }
+
+void EspClass::restart()
+{
+  Serial.println("ESP.restart()");
+  fflush(stdout);
+  exit(0);
+}
+uint32_t EspClass::getFreeHeap() { return heap_caps_get_free_size(MALLOC_CAP_INTERNAL); }
+uint32_t EspClass::getMinFreeHeap() { return getFreeHeap(); }
+uint32_t EspClass::getFreePsram() { return heap_caps_get_free_size(MALLOC_CAP_SPIRAM); }
+uint32_t EspClass::getPsramSize() { return 4u << 20; }
+uint32_t EspClass::getSketchSize() { return 0; }
+uint32_t EspClass::getFreeSketchSpace() { return 0x1D0000; }
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+  static uint32_t table[256];
+  if (!table[1])
+  {
+    for (uint32_t i = 0; i < 256; i++)
+    {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++)
+      {
+        c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+  }
+  crc = ~crc;
+  while (len--)
+  {
+    crc = table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+#include "TJpg_Decoder.h"
+TJpg_Decoder TJpgDec;
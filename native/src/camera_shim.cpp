@@ -0,0 +1,440 @@
+// Host shim: the camera driver replays JPEG files from NATIVE_FRAMES_DIR
+// (default ./sim_frames, sorted by name, looping) at NATIVE_FPS frames per
+// second (default 25). Without files it encodes a synthetic frame at the
+// sensor's current framesize: a grey field with a bright band that moves one
+// block per frame. Frames complete on a fixed cadence from init, and fb_get()
+// returns the newest completed one, as with CAMERA_GRAB_LATEST.
+#include <dirent.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Arduino.h"
+#include "esp_camera.h"
+#include "img_converters.h"
+
+#define NATIVE_FB_TIMEOUT_MS 4000
+
+const resolution_info_t resolution[FRAMESIZE_INVALID] = {
+    {96, 96, 0}, {160, 120, 0}, {176, 144, 0}, {240, 176, 0}, {240, 240, 0}, {320, 240, 0}, {400, 296, 0}, {480, 320, 0}, {640, 480, 0}, {800, 600, 0}, {1024, 768, 0}, {1280, 720, 0}, {1280, 1024, 0}, {1600, 1200, 0}, {1920, 1080, 0}, {720, 1280, 0}, {864, 1536, 0}, {2048, 1536, 0}, {2560, 1440, 0}, {2560, 1600, 0}, {1080, 1920, 0}, {2560, 1920, 0},
+};
+
+typedef std::vector<uint8_t> jpeg_t;
+
+static std::mutex cam_mutex;
+static std::condition_variable cam_cv;
+static bool cam_inited = false;
+static camera_config_t cam_config;
+static sensor_t cam_sensor;
+static std::map<int, int> cam_regs;
+static std::vector<jpeg_t> cam_files;
+static uint32_t cam_period_us = 40000;
+static int64_t cam_epoch_us = 0;
+static int64_t cam_last_frame = -1;
+static size_t cam_outstanding = 0;
+
+class bit_writer
+{
+public:
+  explicit bit_writer(jpeg_t &o) : out(o) {}
+  void put(uint32_t bits, int n)
+  {
+    while (n--)
+    {
+      acc = (acc << 1) | ((bits >> n) & 1);
+      if (++count == 8)
+      {
+        byte();
+      }
+    }
+  }
+  void flush()
+  {
+    while (count)
+    {
+      put(1, 1); // pad with ones
+    }
+  }
+
+private:
+  void byte()
+  {
+    out.push_back(acc);
+    if (acc == 0xFF)
+    {
+      out.push_back(0x00);
+    }
+    acc = 0;
+    count = 0;
+  }
+  jpeg_t &out;
+  uint8_t acc = 0;
+  int count = 0;
+};
+
+// Baseline greyscale JPEG, DC only: a 4-bit code per DC category and a
+// one-bit EOB keep the Huffman tables trivial
+static jpeg_t synth_jpeg(uint16_t w, uint16_t h, uint32_t frame)
+{
+  jpeg_t j = {0xFF, 0xD8, 0xFF, 0xDB, 0x00, 0x43, 0x00};
+  j.insert(j.end(), 64, 1);
+  const uint8_t sof[] = {0xFF, 0xC0, 0x00, 0x0B, 0x08, (uint8_t)(h >> 8), (uint8_t)h, (uint8_t)(w >> 8), (uint8_t)w, 0x01, 0x01, 0x11, 0x00};
+  j.insert(j.end(), sof, sof + sizeof(sof));
+  const uint8_t dht_dc[] = {0xFF, 0xC4, 0x00, 0x1F, 0x00, 0, 0, 0, 12, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+  j.insert(j.end(), dht_dc, dht_dc + sizeof(dht_dc));
+  const uint8_t dht_ac[] = {0xFF, 0xC4, 0x00, 0x14, 0x10, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x00};
+  j.insert(j.end(), dht_ac, dht_ac + sizeof(dht_ac));
+  const uint8_t sos[] = {0xFF, 0xDA, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3F, 0x00};
+  j.insert(j.end(), sos, sos + sizeof(sos));
+
+  int bw = (w + 7) / 8, bh = (h + 7) / 8;
+  int band = frame % bw;
+  int prev = 0;
+  bit_writer bits(j);
+  for (int by = 0; by < bh; by++)
+  {
+    for (int bx = 0; bx < bw; bx++)
+    {
+      int dc = (bx >= band && bx < band + 4) ? 576 : -512 + (by * 256) / bh;
+      int diff = dc - prev;
+      prev = dc;
+      int mag = abs(diff), cat = 0;
+      while (mag >> cat)
+      {
+        cat++;
+      }
+      bits.put(cat, 4);
+      if (cat)
+      {
+        bits.put(diff > 0 ? diff : diff - 1 + (1 << cat), cat);
+      }
+      bits.put(0, 1); // EOB
+    }
+  }
+  bits.flush();
+  j.push_back(0xFF);
+  j.push_back(0xD9);
+  return j;
+}
+
+static bool jpeg_size(const jpeg_t &j, uint16_t *w, uint16_t *h)
+{
+  for (size_t i = 2; i + 9 < j.size();)
+  {
+    if (j[i] != 0xFF)
+    {
+      return false;
+    }
+    uint8_t m = j[i + 1];
+    if (m == 0xC0 || m == 0xC1 || m == 0xC2)
+    {
+      *h = (j[i + 5] << 8) | j[i + 6];
+      *w = (j[i + 7] << 8) | j[i + 8];
+      return true;
+    }
+    i += 2 + ((j[i + 2] << 8) | j[i + 3]);
+  }
+  return false;
+}
+
+static void load_files()
+{
+  const char *dir = getenv("NATIVE_FRAMES_DIR");
+  dir = dir && *dir ? dir : "./sim_frames";
+  std::vector<std::string> names;
+  DIR *d = opendir(dir);
+  struct dirent *e;
+  while (d && (e = readdir(d)))
+  {
+    std::string n = e->d_name;
+    std::string ext = n.size() > 4 ? n.substr(n.rfind('.') + 1) : "";
+    if (ext == "jpg" || ext == "jpeg" || ext == "JPG")
+    {
+      names.push_back(std::string(dir) + "/" + n);
+    }
+  }
+  if (d)
+  {
+    closedir(d);
+  }
+  std::sort(names.begin(), names.end());
+  cam_files.clear();
+  for (const std::string &n : names)
+  {
+    FILE *fp = fopen(n.c_str(), "rb");
+    if (!fp)
+    {
+      continue;
+    }
+    jpeg_t j;
+    uint8_t buf[4096];
+    size_t r;
+    while ((r = fread(buf, 1, sizeof(buf), fp)) > 0)
+    {
+      j.insert(j.end(), buf, buf + r);
+    }
+    fclose(fp);
+    uint16_t w, h;
+    if (j.size() > 4 && j[0] == 0xFF && j[1] == 0xD8 && jpeg_size(j, &w, &h))
+    {
+      cam_files.push_back(j);
+    }
+  }
+  Serial.printf("Camera: %u frame(s) from %s\n", (unsigned)cam_files.size(), dir);
+}
+
+static int set_status(sensor_t *s, int v, uint8_t *field)
+{
+  (void)s;
+  *field = v;
+  return 0;
+}
+
+#define SETTER(name, field, type)                                             \
+  static int name(sensor_t *s, type v)                                        \
+  {                                                                           \
+    std::lock_guard<std::mutex> lk(cam_mutex);                                \
+    return set_status(s, (int)v, (uint8_t *)&s->status.field);                \
+  }
+SETTER(set_contrast, contrast, int)
+SETTER(set_brightness, brightness, int)
+SETTER(set_saturation, saturation, int)
+SETTER(set_sharpness, sharpness, int)
+SETTER(set_denoise, denoise, int)
+SETTER(set_gainceiling, gainceiling, gainceiling_t)
+SETTER(set_quality, quality, int)
+SETTER(set_colorbar, colorbar, int)
+SETTER(set_whitebal, awb, int)
+SETTER(set_gain_ctrl, agc, int)
+SETTER(set_exposure_ctrl, aec, int)
+SETTER(set_hmirror, hmirror, int)
+SETTER(set_vflip, vflip, int)
+SETTER(set_aec2, aec2, int)
+SETTER(set_awb_gain, awb_gain, int)
+SETTER(set_agc_gain, agc_gain, int)
+SETTER(set_special_effect, special_effect, int)
+SETTER(set_wb_mode, wb_mode, int)
+SETTER(set_ae_level, ae_level, int)
+SETTER(set_dcw, dcw, int)
+SETTER(set_bpc, bpc, int)
+SETTER(set_wpc, wpc, int)
+SETTER(set_raw_gma, raw_gma, int)
+SETTER(set_lenc, lenc, int)
+#undef SETTER
+
+static int set_aec_value(sensor_t *s, int v)
+{
+  std::lock_guard<std::mutex> lk(cam_mutex);
+  s->status.aec_value = v;
+  return 0;
+}
+
+static int set_framesize(sensor_t *s, framesize_t fs)
+{
+  if (fs >= FRAMESIZE_INVALID)
+  {
+    return -1;
+  }
+  std::lock_guard<std::mutex> lk(cam_mutex);
+  s->status.framesize = fs;
+  return 0;
+}
+
+static int set_pixformat(sensor_t *s, pixformat_t pf)
+{
+  std::lock_guard<std::mutex> lk(cam_mutex);
+  s->pixformat = pf;
+  return pf == PIXFORMAT_JPEG ? 0 : -1;
+}
+
+static int get_reg(sensor_t *, int reg, int mask)
+{
+  std::lock_guard<std::mutex> lk(cam_mutex);
+  return cam_regs[reg] & mask;
+}
+
+static int set_reg(sensor_t *, int reg, int mask, int value)
+{
+  std::lock_guard<std::mutex> lk(cam_mutex);
+  cam_regs[reg] = (cam_regs[reg] & ~mask) | (value & mask);
+  return 0;
+}
+
+static int set_res_raw(sensor_t *, int, int, int, int, int, int, int, int, int, int, bool, bool) { return 0; }
+static int set_pll(sensor_t *, int, int, int, int, int, int, int, int) { return 0; }
+
+static int set_xclk(sensor_t *s, int, int xclk)
+{
+  s->xclk_freq_hz = xclk * 1000000;
+  return 0;
+}
+
+static int noop(sensor_t *) { return 0; }
+
+esp_err_t esp_camera_init(const camera_config_t *config)
+{
+  std::lock_guard<std::mutex> lk(cam_mutex);
+  if (cam_inited)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  cam_config = *config;
+  load_files();
+  const char *fps = getenv("NATIVE_FPS");
+  double rate = fps ? atof(fps) : 25.0;
+  cam_period_us = rate > 0 ? (uint32_t)(1000000.0 / rate) : 0;
+
+  memset(&cam_sensor, 0, sizeof(cam_sensor));
+  cam_sensor.id.PID = OV2640_PID;
+  cam_sensor.slv_addr = 0x30;
+  cam_sensor.pixformat = config->pixel_format;
+  cam_sensor.xclk_freq_hz = config->xclk_freq_hz;
+  cam_sensor.status.framesize = config->frame_size;
+  cam_sensor.status.quality = config->jpeg_quality;
+  cam_sensor.status.awb = 1;
+  cam_sensor.status.awb_gain = 1;
+  cam_sensor.status.aec = 1;
+  cam_sensor.status.agc = 1;
+  cam_sensor.status.bpc = 0;
+  cam_sensor.status.wpc = 1;
+  cam_sensor.status.raw_gma = 1;
+  cam_sensor.status.lenc = 1;
+  cam_sensor.status.dcw = 1;
+  cam_sensor.init_status = noop;
+  cam_sensor.reset = noop;
+  cam_sensor.set_pixformat = set_pixformat;
+  cam_sensor.set_framesize = set_framesize;
+  cam_sensor.set_contrast = set_contrast;
+  cam_sensor.set_brightness = set_brightness;
+  cam_sensor.set_saturation = set_saturation;
+  cam_sensor.set_sharpness = set_sharpness;
+  cam_sensor.set_denoise = set_denoise;
+  cam_sensor.set_gainceiling = set_gainceiling;
+  cam_sensor.set_quality = set_quality;
+  cam_sensor.set_colorbar = set_colorbar;
+  cam_sensor.set_whitebal = set_whitebal;
+  cam_sensor.set_gain_ctrl = set_gain_ctrl;
+  cam_sensor.set_exposure_ctrl = set_exposure_ctrl;
+  cam_sensor.set_hmirror = set_hmirror;
+  cam_sensor.set_vflip = set_vflip;
+  cam_sensor.set_aec2 = set_aec2;
+  cam_sensor.set_awb_gain = set_awb_gain;
+  cam_sensor.set_agc_gain = set_agc_gain;
+  cam_sensor.set_aec_value = set_aec_value;
+  cam_sensor.set_special_effect = set_special_effect;
+  cam_sensor.set_wb_mode = set_wb_mode;
+  cam_sensor.set_ae_level = set_ae_level;
+  cam_sensor.set_dcw = set_dcw;
+  cam_sensor.set_bpc = set_bpc;
+  cam_sensor.set_wpc = set_wpc;
+  cam_sensor.set_raw_gma = set_raw_gma;
+  cam_sensor.set_lenc = set_lenc;
+  cam_sensor.get_reg = get_reg;
+  cam_sensor.set_reg = set_reg;
+  cam_sensor.set_res_raw = set_res_raw;
+  cam_sensor.set_pll = set_pll;
+  cam_sensor.set_xclk = set_xclk;
+
+  cam_epoch_us = esp_timer_get_time();
+  cam_last_frame = -1;
+  cam_inited = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_camera_deinit()
+{
+  std::lock_guard<std::mutex> lk(cam_mutex);
+  cam_inited = false;
+  cam_cv.notify_all();
+  return ESP_OK;
+}
+
+camera_fb_t *esp_camera_fb_get()
+{
+  std::unique_lock<std::mutex> lk(cam_mutex);
+  size_t fb_count = std::max<size_t>(cam_config.fb_count, 1);
+  // the driver blocks while every frame buffer is out with the application
+  if (!cam_cv.wait_for(lk, std::chrono::milliseconds(NATIVE_FB_TIMEOUT_MS),
+                       [fb_count] { return !cam_inited || cam_outstanding < fb_count; }) ||
+      !cam_inited)
+  {
+    return NULL;
+  }
+  int64_t now = esp_timer_get_time() - cam_epoch_us;
+  int64_t frame = cam_period_us ? now / cam_period_us : cam_last_frame + 1;
+  if (frame <= cam_last_frame)
+  {
+    frame = cam_last_frame + 1;
+    int64_t wait = frame * cam_period_us - now;
+    lk.unlock();
+    std::this_thread::sleep_for(std::chrono::microseconds(wait));
+    lk.lock();
+    if (!cam_inited)
+    {
+      return NULL;
+    }
+  }
+  cam_last_frame = frame;
+  cam_outstanding++;
+  framesize_t fs = cam_sensor.status.framesize;
+  lk.unlock();
+
+  jpeg_t j = cam_files.empty() ? synth_jpeg(resolution[fs].width, resolution[fs].height, (uint32_t)frame)
+                               : cam_files[frame % cam_files.size()];
+  camera_fb_t *fb = (camera_fb_t *)calloc(1, sizeof(camera_fb_t));
+  fb->buf = (uint8_t *)malloc(j.size());
+  memcpy(fb->buf, j.data(), j.size());
+  fb->len = j.size();
+  uint16_t w = 0, h = 0;
+  jpeg_size(j, &w, &h);
+  fb->width = w;
+  fb->height = h;
+  fb->format = PIXFORMAT_JPEG;
+  // boot-relative like the driver's, at the nominal start of the frame
+  int64_t us = cam_period_us ? cam_epoch_us + frame * cam_period_us : esp_timer_get_time();
+  fb->timestamp.tv_sec = us / 1000000;
+  fb->timestamp.tv_usec = us % 1000000;
+  return fb;
+}
+
+void esp_camera_fb_return(camera_fb_t *fb)
+{
+  if (!fb)
+  {
+    return;
+  }
+  free(fb->buf);
+  free(fb);
+  std::lock_guard<std::mutex> lk(cam_mutex);
+  cam_outstanding--;
+  cam_cv.notify_all();
+}
+
+sensor_t *esp_camera_sensor_get() { return cam_inited ? &cam_sensor : NULL; }
+
+// Frames are already JPEG; there is no decoder for the other conversions
+bool frame2jpg_cb(camera_fb_t *fb, uint8_t, jpg_out_cb cb, void *arg)
+{
+  return fb->format == PIXFORMAT_JPEG && cb(arg, 0, fb->buf, fb->len) == fb->len;
+}
+
+bool frame2jpg(camera_fb_t *fb, uint8_t, uint8_t **out, size_t *out_len)
+{
+  if (fb->format != PIXFORMAT_JPEG || !(*out = (uint8_t *)malloc(fb->len)))
+  {
+    return false;
+  }
+  memcpy(*out, fb->buf, fb->len);
+  *out_len = fb->len;
+  return true;
+}
+
+bool fmt2jpg_cb(uint8_t *, size_t, uint16_t, uint16_t, pixformat_t, uint8_t, jpg_out_cb, void *) { return false; }
+bool fmt2jpg(uint8_t *, size_t, uint16_t, uint16_t, pixformat_t, uint8_t, uint8_t **, size_t *) { return false; }
+bool fmt2bmp(uint8_t *, size_t, uint16_t, uint16_t, pixformat_t, uint8_t **, size_t *) { return false; }
+bool frame2bmp(camera_fb_t *, uint8_t **, size_t *) { return false; }
+bool jpg2rgb565(const uint8_t *, size_t, uint8_t *, jpg_scale_t) { return false; }
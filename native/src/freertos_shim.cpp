@@ -0,0 +1,300 @@
+// Host shim: FreeRTOS primitives on pthreads. Ticks are milliseconds.
+#include <pthread.h>
+#include <chrono>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+using shim_clock = std::chrono::steady_clock;
+
+static shim_clock::time_point deadline(TickType_t wait)
+{
+  if (wait == portMAX_DELAY)
+  {
+    return shim_clock::time_point::max();
+  }
+  return shim_clock::now() + std::chrono::milliseconds(wait);
+}
+
+template <class Pred>
+static bool wait_until(std::condition_variable &cv, std::unique_lock<std::mutex> &lk, TickType_t wait, Pred pred)
+{
+  if (wait == portMAX_DELAY)
+  {
+    cv.wait(lk, pred);
+    return true;
+  }
+  return cv.wait_until(lk, deadline(wait), pred);
+}
+
+static std::recursive_mutex critical_mutex;
+void vPortEnterCritical(portMUX_TYPE *) { critical_mutex.lock(); }
+void vPortExitCritical(portMUX_TYPE *) { critical_mutex.unlock(); }
+
+struct shim_task
+{
+  std::mutex m;
+  std::condition_variable cv;
+  uint32_t notify = 0;
+};
+static thread_local shim_task *current_task = nullptr;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *, uint32_t, void *arg, UBaseType_t,
+                                   TaskHandle_t *handle, BaseType_t)
+{
+  shim_task *t = new shim_task();
+  if (handle)
+  {
+    *handle = t;
+  }
+  std::thread([fn, arg, t]() {
+    current_task = t;
+    fn(arg);
+  }).detach();
+  return pdPASS;
+}
+
+
+void vTaskDelete(TaskHandle_t task)
+{
+  if (!task || task == current_task)
+  {
+    // Unwinds to the thread entry; the thread then ends
+    pthread_exit(nullptr);
+  }
+}
+
+void vTaskDelay(TickType_t ticks) { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
+
+TickType_t xTaskGetTickCount()
+{
+  static const auto start = shim_clock::now();
+  return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(shim_clock::now() - start).count();
+}
+
+void vTaskDelayUntil(TickType_t *prev, TickType_t inc)
+{
+  TickType_t now = xTaskGetTickCount();
+  *prev += inc;
+  if ((int32_t)(*prev - now) > 0)
+  {
+    vTaskDelay(*prev - now);
+  }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  if (!current_task)
+  {
+    current_task = new shim_task();
+  }
+  return current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  std::lock_guard<std::mutex> lk(task->m);
+  task->notify++;
+  task->cv.notify_all();
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+  shim_task *t = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lk(t->m);
+  wait_until(t->cv, lk, wait, [t] { return t->notify > 0; });
+  uint32_t v = t->notify;
+  if (v)
+  {
+    t->notify = clear ? 0 : v - 1;
+  }
+  return v;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
+
+struct shim_sem
+{
+  std::mutex m;
+  std::condition_variable cv;
+  UBaseType_t count;
+  UBaseType_t max;
+  bool mutex;
+  std::thread::id owner;
+  int depth = 0;
+};
+
+static shim_sem *new_sem(UBaseType_t max, UBaseType_t initial, bool mutex)
+{
+  shim_sem *s = new shim_sem();
+  s->count = initial;
+  s->max = max;
+  s->mutex = mutex;
+  return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new_sem(1, 1, true); }
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() { return new_sem(1, 1, true); }
+SemaphoreHandle_t xSemaphoreCreateBinary() { return new_sem(1, 0, false); }
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) { return new_sem(max, initial, false); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait)
+{
+  std::unique_lock<std::mutex> lk(s->m);
+  if (s->mutex && s->depth && s->owner == std::this_thread::get_id())
+  {
+    s->depth++;
+    return pdTRUE;
+  }
+  if (!wait_until(s->cv, lk, wait, [s] { return s->count > 0; }))
+  {
+    return pdFALSE;
+  }
+  s->count--;
+  if (s->mutex)
+  {
+    s->owner = std::this_thread::get_id();
+    s->depth = 1;
+  }
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+  std::lock_guard<std::mutex> lk(s->m);
+  if (s->mutex && s->depth > 1)
+  {
+    s->depth--;
+    return pdTRUE;
+  }
+  if (s->count >= s->max)
+  {
+    return pdFALSE;
+  }
+  s->depth = 0;
+  s->count++;
+  s->cv.notify_one();
+  return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t s) { delete s; }
+
+struct shim_queue
+{
+  std::mutex m;
+  std::condition_variable cv;
+  std::deque<std::vector<uint8_t>> items;
+  UBaseType_t length;
+  UBaseType_t item_size;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+  shim_queue *q = new shim_queue();
+  q->length = length;
+  q->item_size = item_size;
+  return q;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait)
+{
+  std::unique_lock<std::mutex> lk(q->m);
+  if (!wait_until(q->cv, lk, wait, [q] { return q->items.size() < q->length; }))
+  {
+    return pdFALSE;
+  }
+  const uint8_t *p = (const uint8_t *)item;
+  q->items.emplace_back(p, p + q->item_size);
+  q->cv.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t q, const void *item)
+{
+  std::lock_guard<std::mutex> lk(q->m);
+  const uint8_t *p = (const uint8_t *)item;
+  q->items.clear();
+  q->items.emplace_back(p, p + q->item_size);
+  q->cv.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait)
+{
+  std::unique_lock<std::mutex> lk(q->m);
+  if (!wait_until(q->cv, lk, wait, [q] { return !q->items.empty(); }))
+  {
+    return pdFALSE;
+  }
+  memcpy(item, q->items.front().data(), q->item_size);
+  q->items.pop_front();
+  q->cv.notify_all();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+  std::lock_guard<std::mutex> lk(q->m);
+  return q->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q)
+{
+  std::lock_guard<std::mutex> lk(q->m);
+  return q->length - q->items.size();
+}
+
+void vQueueDelete(QueueHandle_t q) { delete q; }
+
+struct shim_evg
+{
+  std::mutex m;
+  std::condition_variable cv;
+  EventBits_t bits = 0;
+};
+
+EventGroupHandle_t xEventGroupCreate() { return new shim_evg(); }
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t g, EventBits_t bits)
+{
+  std::lock_guard<std::mutex> lk(g->m);
+  g->bits |= bits;
+  g->cv.notify_all();
+  return g->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t g, EventBits_t bits)
+{
+  std::lock_guard<std::mutex> lk(g->m);
+  EventBits_t old = g->bits;
+  g->bits &= ~bits;
+  return old;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t g)
+{
+  std::lock_guard<std::mutex> lk(g->m);
+  return g->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t g, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t wait)
+{
+  std::unique_lock<std::mutex> lk(g->m);
+  auto ready = [&] { return all ? (g->bits & bits) == bits : (g->bits & bits) != 0; };
+  wait_until(g->cv, lk, wait, ready);
+  EventBits_t v = g->bits;
+  if (ready() && clear)
+  {
+    g->bits &= ~bits;
+  }
+  return v;
+}
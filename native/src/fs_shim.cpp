@@ -0,0 +1,174 @@
+// Host shim: SPIFFS and Preferences as plain files in host directories.
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include "SPIFFS.h"
+#include "Preferences.h"
+
+SPIFFSFS SPIFFS;
+
+static const char *env_dir(const char *name, const char *def)
+{
+  const char *dir = getenv(name);
+  return dir && *dir ? dir : def;
+}
+
+static bool make_dirs(const String &path)
+{
+  for (int i = path.indexOf('/', 1); i > 0; i = path.indexOf('/', i + 1))
+  {
+    mkdir(path.substring(0, i).c_str(), 0755);
+  }
+  return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+namespace fs
+{
+int File::available()
+{
+  if (!fp_)
+  {
+    return 0;
+  }
+  long pos = ftell(fp_.get());
+  return pos < 0 ? 0 : (int)(size() - pos);
+}
+
+size_t File::size()
+{
+  struct stat st;
+  if (!fp_ || fstat(fileno(fp_.get()), &st) < 0)
+  {
+    return 0;
+  }
+  fflush(fp_.get());
+  return st.st_size;
+}
+
+String FS::fullPath(const char *path) { return String(root_ ? root_ : ".") + (*path == '/' ? "" : "/") + path; }
+
+File FS::open(const char *path, const char *mode)
+{
+  String mode_b = String(mode) + "b";
+  FILE *fp = fopen(fullPath(path).c_str(), mode_b.c_str());
+  return fp ? File(fp) : File();
+}
+
+bool FS::exists(const char *path) { return access(fullPath(path).c_str(), F_OK) == 0; }
+
+bool FS::remove(const char *path) { return ::remove(fullPath(path).c_str()) == 0; }
+} // namespace fs
+
+bool SPIFFSFS::begin(bool, const char *, uint8_t, const char *)
+{
+  // a missing directory is an unformatted partition; creating it formats it
+  root_ = env_dir("NATIVE_SPIFFS_DIR", "./sim_spiffs");
+  return make_dirs(root_);
+}
+
+size_t SPIFFSFS::totalBytes() { return 190u << 10; }
+
+size_t SPIFFSFS::usedBytes()
+{
+  size_t used = 0;
+  DIR *d = root_ ? opendir(root_) : nullptr;
+  if (!d)
+  {
+    return 0;
+  }
+  struct dirent *e;
+  while ((e = readdir(d)))
+  {
+    struct stat st;
+    if (stat(fullPath(e->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+    {
+      used += st.st_size;
+    }
+  }
+  closedir(d);
+  return used;
+}
+
+bool Preferences::begin(const char *name, bool readOnly)
+{
+  ns_ = String(env_dir("NATIVE_NVS_DIR", "./sim_nvs")) + "/" + name;
+  if (readOnly)
+  {
+    // NVS refuses a read-only open of a namespace that was never written
+    return access(ns_.c_str(), F_OK) == 0;
+  }
+  return make_dirs(ns_);
+}
+
+String Preferences::path(const char *key) { return ns_ + "/" + key; }
+
+bool Preferences::clear()
+{
+  DIR *d = opendir(ns_.c_str());
+  if (!d)
+  {
+    return false;
+  }
+  struct dirent *e;
+  while ((e = readdir(d)))
+  {
+    if (e->d_name[0] != '.')
+    {
+      ::remove(path(e->d_name).c_str());
+    }
+  }
+  closedir(d);
+  return true;
+}
+
+bool Preferences::remove(const char *key) { return ::remove(path(key).c_str()) == 0; }
+
+bool Preferences::isKey(const char *key) { return access(path(key).c_str(), F_OK) == 0; }
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t len)
+{
+  FILE *fp = fopen(path(key).c_str(), "wb");
+  if (!fp)
+  {
+    return 0;
+  }
+  size_t n = fwrite(value, 1, len, fp);
+  fclose(fp);
+  return n;
+}
+
+size_t Preferences::getBytes(const char *key, void *buf, size_t maxLen)
+{
+  size_t len = getBytesLength(key);
+  if (!len || len > maxLen)
+  {
+    return 0;
+  }
+  FILE *fp = fopen(path(key).c_str(), "rb");
+  if (!fp)
+  {
+    return 0;
+  }
+  size_t n = fread(buf, 1, len, fp);
+  fclose(fp);
+  return n;
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+  struct stat st;
+  return stat(path(key).c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+String Preferences::getString(const char *key, const String &def)
+{
+  size_t len = getBytesLength(key);
+  if (!len)
+  {
+    return def;
+  }
+  std::string s(len, '\0');
+  getBytes(key, &s[0], len);
+  return String(s.c_str());
+}
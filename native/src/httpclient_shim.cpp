@@ -0,0 +1,101 @@
+// Host shim: HTTPClient for plain http:// URLs, one request per connection.
+#include <poll.h>
+#include <sys/socket.h>
+#include "HTTPClient.h"
+
+bool HTTPClient::begin(const String &url)
+{
+  if (!url.startsWith("http://"))
+  {
+    return false;
+  }
+  String rest = url.substring(7);
+  int slash = rest.indexOf('/');
+  String hostport = slash < 0 ? rest : rest.substring(0, slash);
+  path_ = slash < 0 ? String("/") : rest.substring(slash);
+  int colon = hostport.indexOf(':');
+  host_ = colon < 0 ? hostport : hostport.substring(0, colon);
+  port_ = colon < 0 ? 80 : hostport.substring(colon + 1).toInt();
+  headers_ = String();
+  body_ = String();
+  return host_.length() > 0;
+}
+
+void HTTPClient::end()
+{
+  headers_ = String();
+}
+
+void HTTPClient::addHeader(const String &name, const String &value)
+{
+  headers_ += name + ": " + value + "\r\n";
+}
+
+int HTTPClient::GET() { return request("GET", nullptr, 0); }
+
+int HTTPClient::POST(uint8_t *payload, size_t size) { return request("POST", payload, size); }
+
+int HTTPClient::request(const char *method, const uint8_t *payload, size_t size)
+{
+  WiFiClient client;
+  if (!client.connect(host_.c_str(), port_, connect_timeout_ms_))
+  {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  String head = String(method) + " " + path_ + " HTTP/1.1\r\nHost: " + host_ + "\r\n" + headers_ +
+                "Content-Length: " + String((unsigned long)size) + "\r\nConnection: close\r\n\r\n";
+  if (client.print(head) != head.length())
+  {
+    return HTTPC_ERROR_SEND_HEADER_FAILED;
+  }
+  if (size && client.write(payload, size) != size)
+  {
+    return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  }
+  // the whole response, up to the server closing the connection
+  std::string resp;
+  char buf[1024];
+  for (;;)
+  {
+    struct pollfd p = {client.fd(), POLLIN, 0};
+    if (poll(&p, 1, timeout_ms_) <= 0)
+    {
+      return resp.empty() ? HTTPC_ERROR_READ_TIMEOUT : HTTPC_ERROR_CONNECTION_LOST;
+    }
+    ssize_t n = recv(client.fd(), buf, sizeof(buf), 0);
+    if (n <= 0)
+    {
+      break;
+    }
+    resp.append(buf, n);
+  }
+  int code = 0;
+  if (sscanf(resp.c_str(), "HTTP/%*s %d", &code) != 1)
+  {
+    return HTTPC_ERROR_CONNECTION_LOST;
+  }
+  size_t body = resp.find("\r\n\r\n");
+  body_ = body == std::string::npos ? String() : String(resp.substr(body + 4));
+  return code;
+}
+
+String HTTPClient::errorToString(int error)
+{
+  switch (error)
+  {
+  case HTTPC_ERROR_CONNECTION_REFUSED:
+    return "connection refused";
+  case HTTPC_ERROR_SEND_HEADER_FAILED:
+    return "send header failed";
+  case HTTPC_ERROR_SEND_PAYLOAD_FAILED:
+    return "send payload failed";
+  case HTTPC_ERROR_NOT_CONNECTED:
+    return "not connected";
+  case HTTPC_ERROR_CONNECTION_LOST:
+    return "connection lost";
+  case HTTPC_ERROR_READ_TIMEOUT:
+    return "read Timeout";
+  default:
+    return String();
+  }
+}
@@ -0,0 +1,40 @@
+// Host entry point: the Arduino core's main task, setup() once and loop()
+// forever. NATIVE_RUN_SECONDS ends the run after that long, for CI;
+// NATIVE_WIFI_DOWN_MS boots with the AP unreachable for that long. Unit
+// tests (test/, `pio test -e native`) bring their own main().
+#include <signal.h>
+#include <thread>
+#include "Arduino.h"
+#include "WiFi.h"
+
+#ifndef PIO_UNIT_TESTING
+
+int main()
+{
+  signal(SIGPIPE, SIG_IGN);
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  const char *run = getenv("NATIVE_RUN_SECONDS");
+  unsigned long limit_ms = run ? strtoul(run, NULL, 10) * 1000 : 0;
+  const char *down = getenv("NATIVE_WIFI_DOWN_MS");
+  if (down)
+  {
+    WiFi.simSetLinkUp(false);
+    unsigned long down_ms = strtoul(down, NULL, 10);
+    std::thread([down_ms]() {
+      delay(down_ms);
+      WiFi.simSetLinkUp(true);
+    }).detach();
+  }
+  setup();
+  for (;;)
+  {
+    loop();
+    if (limit_ms && millis() >= limit_ms)
+    {
+      Serial.println("native: run time over");
+      fflush(stdout);
+      _exit(0);
+    }
+  }
+}
+#endif
@@ -0,0 +1,46 @@
+// tinfl_decompress() on zlib's raw inflate. zlib keeps its own window, so
+// the caller's circular dictionary only receives the output.
+#include "esp32/rom/miniz.h"
+#include <zlib.h>
+#include <stdlib.h>
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_next, size_t *pIn_buf_size,
+                              mz_uint8 *pOut_buf_start, mz_uint8 *pOut_buf_next, size_t *pOut_buf_size,
+                              const mz_uint32 decomp_flags)
+{
+  (void)pOut_buf_start;
+  z_stream *z = (z_stream *)r->stream;
+  if (!z)
+  {
+    z = (z_stream *)calloc(1, sizeof(z_stream));
+    if (inflateInit2(z, decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER ? 15 : -15) != Z_OK)
+    {
+      free(z);
+      return TINFL_STATUS_FAILED;
+    }
+    r->stream = z;
+  }
+  z->next_in = (Bytef *)pIn_buf_next;
+  z->avail_in = *pIn_buf_size;
+  z->next_out = pOut_buf_next;
+  z->avail_out = *pOut_buf_size;
+  int res = inflate(z, Z_NO_FLUSH);
+  *pIn_buf_size -= z->avail_in;
+  *pOut_buf_size -= z->avail_out;
+  if (res == Z_STREAM_END)
+  {
+    inflateEnd(z);
+    free(z);
+    r->stream = NULL;
+    return TINFL_STATUS_DONE;
+  }
+  if (res != Z_OK && res != Z_BUF_ERROR)
+  {
+    return TINFL_STATUS_FAILED;
+  }
+  if (!z->avail_out)
+  {
+    return TINFL_STATUS_HAS_MORE_OUTPUT;
+  }
+  return decomp_flags & TINFL_FLAG_HAS_MORE_INPUT ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED;
+}
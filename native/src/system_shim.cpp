@@ -0,0 +1,286 @@
+// Host shim: Update, partitions, deep sleep and ArduinoOTA. Flash regions are
+// files: the OTA slot is NATIVE_OTA_SLOT, other partitions live under
+// NATIVE_FLASH_DIR named after their label.
+#include <sys/stat.h>
+#include <map>
+#include <string>
+#include "ArduinoOTA.h"
+#include "Update.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_sleep.h"
+
+#define UPDATE_ERROR_OK 0
+#define UPDATE_ERROR_WRITE 1
+#define UPDATE_ERROR_SPACE 4
+#define UPDATE_ERROR_SIZE 5
+#define UPDATE_ERROR_MAGIC_BYTE 10
+#define UPDATE_ERROR_ABORT 8
+#define UPDATE_ERROR_BAD_ARGUMENT 9
+#define NATIVE_APP_SIZE 0x1D0000
+
+UpdateClass Update;
+ArduinoOTAClass ArduinoOTA;
+
+static const char *env_path(const char *name, const char *def)
+{
+  const char *p = getenv(name);
+  return p && *p ? p : def;
+}
+
+bool UpdateClass::begin(size_t size, int command)
+{
+  if (running_)
+  {
+    error_ = UPDATE_ERROR_BAD_ARGUMENT;
+    return false;
+  }
+  if (size == UPDATE_SIZE_UNKNOWN)
+  {
+    size = NATIVE_APP_SIZE;
+  }
+  if (command != U_FLASH || size > NATIVE_APP_SIZE)
+  {
+    error_ = UPDATE_ERROR_SIZE;
+    return false;
+  }
+  fp_ = fopen(env_path("NATIVE_OTA_SLOT", "./sim_ota_slot.bin"), "wb");
+  if (!fp_)
+  {
+    error_ = UPDATE_ERROR_WRITE;
+    return false;
+  }
+  error_ = UPDATE_ERROR_OK;
+  running_ = true;
+  progress_ = 0;
+  size_ = size;
+  return true;
+}
+
+size_t UpdateClass::write(uint8_t *data, size_t len)
+{
+  if (!running_ || error_)
+  {
+    return 0;
+  }
+  if (progress_ + len > size_)
+  {
+    error_ = UPDATE_ERROR_SPACE;
+    return 0;
+  }
+  // the bootloader only accepts an image that starts with ESP_IMAGE_HEADER_MAGIC
+  if (progress_ == 0 && len && data[0] != 0xE9)
+  {
+    error_ = UPDATE_ERROR_MAGIC_BYTE;
+    return 0;
+  }
+  if (fwrite(data, 1, len, fp_) != len)
+  {
+    error_ = UPDATE_ERROR_WRITE;
+    return 0;
+  }
+  progress_ += len;
+  return len;
+}
+
+bool UpdateClass::end(bool evenIfRemaining)
+{
+  if (!running_ || error_)
+  {
+    abort();
+    return false;
+  }
+  if (!evenIfRemaining && progress_ != size_)
+  {
+    error_ = UPDATE_ERROR_ABORT;
+    abort();
+    return false;
+  }
+  if (progress_ < 24)
+  {
+    error_ = UPDATE_ERROR_SIZE;
+    abort();
+    return false;
+  }
+  fclose(fp_);
+  fp_ = nullptr;
+  running_ = false;
+  return true;
+}
+
+void UpdateClass::abort()
+{
+  if (fp_)
+  {
+    fclose(fp_);
+    fp_ = nullptr;
+  }
+  if (running_ && !error_)
+  {
+    error_ = UPDATE_ERROR_ABORT;
+  }
+  running_ = false;
+}
+
+const char *UpdateClass::errorString()
+{
+  switch (error_)
+  {
+  case UPDATE_ERROR_OK:
+    return "No Error";
+  case UPDATE_ERROR_WRITE:
+    return "Flash Write Failed";
+  case UPDATE_ERROR_SPACE:
+    return "Not Enough Space";
+  case UPDATE_ERROR_SIZE:
+    return "Bad Size Given";
+  case UPDATE_ERROR_ABORT:
+    return "Update Aborted";
+  case UPDATE_ERROR_BAD_ARGUMENT:
+    return "Bad Argument";
+  case UPDATE_ERROR_MAGIC_BYTE:
+    return "Wrong Magic Byte";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+// One partition per label; size is the file size, or the table default
+static const esp_partition_t *partition(esp_partition_type_t type, const char *label, uint32_t def_size)
+{
+  static std::map<std::string, esp_partition_t> parts;
+  auto it = parts.find(label);
+  if (it != parts.end())
+  {
+    return &it->second;
+  }
+  std::string path = std::string(env_path("NATIVE_FLASH_DIR", "./sim_flash")) + "/" + label;
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0)
+  {
+    def_size = st.st_size;
+  }
+  else if (!def_size)
+  {
+    return nullptr;
+  }
+  esp_partition_t p = {};
+  p.type = type;
+  p.subtype = ESP_PARTITION_SUBTYPE_ANY;
+  p.size = def_size;
+  strncpy(p.label, label, sizeof(p.label) - 1);
+  return &(parts[label] = p);
+}
+
+static FILE *open_partition(const esp_partition_t *part, const char *mode)
+{
+  std::string dir = env_path("NATIVE_FLASH_DIR", "./sim_flash");
+  mkdir(dir.c_str(), 0755);
+  std::string path = dir + "/" + part->label;
+  FILE *fp = fopen(path.c_str(), mode);
+  if (!fp && mode[0] == 'r' && mode[1] == '+')
+  {
+    // fresh flash reads as erased
+    fp = fopen(path.c_str(), "w+b");
+    for (uint32_t i = 0; fp && i < part->size; i++)
+    {
+      fputc(0xFF, fp);
+    }
+  }
+  return fp;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t, const char *label)
+{
+  // the data partitions of the device's partition table
+  if (label && !strcmp(label, "imgstore"))
+  {
+    return partition(type, label, 0x20000);
+  }
+  return label ? partition(type, label, 0) : nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+  if (!part || offset + size > part->size)
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  FILE *fp = open_partition(part, "r+b");
+  if (!fp)
+  {
+    return ESP_FAIL;
+  }
+  fseek(fp, offset, SEEK_SET);
+  size_t n = fread(dst, 1, size, fp);
+  fclose(fp);
+  return n == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+  if (!part || offset + size > part->size)
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  FILE *fp = open_partition(part, "r+b");
+  if (!fp)
+  {
+    return ESP_FAIL;
+  }
+  // NOR flash: programming only clears bits
+  std::string cur(size, '\0');
+  fseek(fp, offset, SEEK_SET);
+  size_t n = fread(&cur[0], 1, size, fp);
+  for (size_t i = 0; i < n; i++)
+  {
+    cur[i] &= ((const char *)src)[i];
+  }
+  fseek(fp, offset, SEEK_SET);
+  n = fwrite(cur.data(), 1, size, fp);
+  fclose(fp);
+  return n == size ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+  if (!part || offset + size > part->size || (offset | size) & 0xFFF)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  FILE *fp = open_partition(part, "r+b");
+  if (!fp)
+  {
+    return ESP_FAIL;
+  }
+  std::string ff(size, '\xFF');
+  fseek(fp, offset, SEEK_SET);
+  size_t n = fwrite(ff.data(), 1, size, fp);
+  fclose(fp);
+  return n == size ? ESP_OK : ESP_FAIL;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+  return partition(ESP_PARTITION_TYPE_APP, "app0", 0);
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause()
+{
+  return getenv("NATIVE_WAKEUP_TIMER") ? ESP_SLEEP_WAKEUP_TIMER : ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+static uint64_t sleep_us;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+  sleep_us = time_in_us;
+  return ESP_OK;
+}
+
+void esp_deep_sleep_start()
+{
+  Serial.printf("esp_deep_sleep_start(): %llu us\n", (unsigned long long)sleep_us);
+  fflush(stdout);
+  exit(0);
+}
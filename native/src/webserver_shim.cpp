@@ -0,0 +1,460 @@
+// Host shim: Arduino WebServer. Each handleClient() serves at most one
+// request and then drops its reference to the connection; handlers that
+// keep a copy of client() (the stream task) keep the socket open.
+#include <poll.h>
+#include <sys/socket.h>
+#include "WebServer.h"
+
+#define NATIVE_HTTP_TIMEOUT_MS 5000
+#define NATIVE_HTTP_MAX_BODY (8u << 20)
+
+static bool read_exact(WiFiClient &c, uint8_t *dst, size_t len)
+{
+  size_t done = 0;
+  while (done < len)
+  {
+    struct pollfd p = {c.fd(), POLLIN, 0};
+    if (poll(&p, 1, NATIVE_HTTP_TIMEOUT_MS) <= 0)
+    {
+      return false;
+    }
+    ssize_t n = recv(c.fd(), dst + done, len - done, 0);
+    if (n <= 0)
+    {
+      return false;
+    }
+    done += n;
+  }
+  return true;
+}
+
+static bool read_line(WiFiClient &c, String &line)
+{
+  line = String();
+  uint8_t ch;
+  while (read_exact(c, &ch, 1))
+  {
+    if (ch == '\n')
+    {
+      line.trim();
+      return true;
+    }
+    if (line.length() > 2048)
+    {
+      return false;
+    }
+    line += (char)ch;
+  }
+  return false;
+}
+
+static String url_decode(const String &s)
+{
+  String out;
+  for (unsigned int i = 0; i < s.length(); i++)
+  {
+    char c = s[i];
+    if (c == '+')
+    {
+      out += ' ';
+    }
+    else if (c == '%' && i + 2 < s.length())
+    {
+      out += (char)strtol(s.substring(i + 1, i + 3).c_str(), nullptr, 16);
+      i += 2;
+    }
+    else
+    {
+      out += c;
+    }
+  }
+  return out;
+}
+
+static const char *status_text(int code)
+{
+  switch (code)
+  {
+  case 200:
+    return "OK";
+  case 204:
+    return "No Content";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 500:
+    return "Internal Server Error";
+  case 503:
+    return "Service Unavailable";
+  default:
+    return "";
+  }
+}
+
+void WebServer::begin() { server_.begin(port_); }
+
+void WebServer::close() { server_.end(); }
+
+void WebServer::on(const String &uri, HTTPMethod method, THandlerFunction fn, THandlerFunction ufn)
+{
+  routes_.push_back({uri, method, fn, ufn});
+}
+
+void WebServer::collectHeaders(const char *keys[], size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    collect_.push_back(keys[i]);
+  }
+}
+
+String WebServer::arg(const String &name)
+{
+  for (const KV &kv : args_)
+  {
+    if (kv.k == name)
+    {
+      return kv.v;
+    }
+  }
+  return String();
+}
+
+String WebServer::arg(int i) { return i >= 0 && i < args() ? args_[i].v : String(); }
+String WebServer::argName(int i) { return i >= 0 && i < args() ? args_[i].k : String(); }
+
+bool WebServer::hasArg(const String &name)
+{
+  for (const KV &kv : args_)
+  {
+    if (kv.k == name)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+String WebServer::header(const String &name)
+{
+  for (const KV &kv : headers_)
+  {
+    if (kv.k.equalsIgnoreCase(name))
+    {
+      return kv.v;
+    }
+  }
+  return String();
+}
+
+bool WebServer::hasHeader(const String &name)
+{
+  for (const KV &kv : headers_)
+  {
+    if (kv.k.equalsIgnoreCase(name))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void parse_args(const String &query, std::vector<String> &keys, std::vector<String> &values)
+{
+  unsigned int pos = 0;
+  while (pos < query.length())
+  {
+    int amp = query.indexOf('&', pos);
+    String pair = query.substring(pos, amp < 0 ? query.length() : amp);
+    int eq = pair.indexOf('=');
+    if (pair.length())
+    {
+      keys.push_back(url_decode(eq < 0 ? pair : pair.substring(0, eq)));
+      values.push_back(eq < 0 ? String() : url_decode(pair.substring(eq + 1)));
+    }
+    if (amp < 0)
+    {
+      break;
+    }
+    pos = amp + 1;
+  }
+}
+
+bool WebServer::parseRequest()
+{
+  String line;
+  if (!read_line(client_, line))
+  {
+    return false;
+  }
+  int sp1 = line.indexOf(' ');
+  int sp2 = line.indexOf(' ', sp1 + 1);
+  if (sp1 < 0 || sp2 < 0)
+  {
+    return false;
+  }
+  String m = line.substring(0, sp1);
+  String target = line.substring(sp1 + 1, sp2);
+  static const char *names[] = {"ANY", "GET", "HEAD", "POST", "PUT", "PATCH", "DELETE", "OPTIONS"};
+  method_ = HTTP_GET;
+  for (int i = 1; i < 8; i++)
+  {
+    if (m == names[i])
+    {
+      method_ = (HTTPMethod)i;
+    }
+  }
+  int q = target.indexOf('?');
+  uri_ = q < 0 ? target : target.substring(0, q);
+  std::vector<String> keys, values;
+  if (q >= 0)
+  {
+    parse_args(target.substring(q + 1), keys, values);
+  }
+  while (read_line(client_, line) && line.length())
+  {
+    int colon = line.indexOf(':');
+    if (colon > 0)
+    {
+      String v = line.substring(colon + 1);
+      v.trim();
+      headers_.push_back({line.substring(0, colon), v});
+    }
+  }
+  for (size_t i = 0; i < keys.size(); i++)
+  {
+    args_.push_back({keys[i], values[i]});
+  }
+  return true;
+}
+
+bool WebServer::parseMultipart(const Route &r, const String &boundary, size_t length)
+{
+  std::string body(length, '\0');
+  if (!read_exact(client_, (uint8_t *)&body[0], length))
+  {
+    return false;
+  }
+  std::string delim = "--" + std::string(boundary.c_str());
+  size_t pos = body.find(delim);
+  while (pos != std::string::npos)
+  {
+    pos += delim.size();
+    if (body.compare(pos, 2, "--") == 0)
+    {
+      break;
+    }
+    size_t head_end = body.find("\r\n\r\n", pos);
+    size_t next = head_end == std::string::npos ? head_end : body.find("\r\n" + delim, head_end);
+    if (next == std::string::npos)
+    {
+      return false;
+    }
+    String head(body.substr(pos, head_end - pos));
+    size_t data = head_end + 4;
+    String name, filename, type;
+    int i;
+    if ((i = head.indexOf("name=\"")) >= 0)
+      name = head.substring(i + 6, head.indexOf('"', i + 6));
+    if ((i = head.indexOf("filename=\"")) >= 0)
+      filename = head.substring(i + 10, head.indexOf('"', i + 10));
+    if ((i = head.indexOf("Content-Type:")) >= 0)
+    {
+      int e = head.indexOf('\r', i);
+      type = head.substring(i + 13, e < 0 ? head.length() : e);
+      type.trim();
+    }
+    if (filename.length() && r.ufn)
+    {
+      upload_.filename = filename;
+      upload_.name = name;
+      upload_.type = type;
+      upload_.totalSize = 0;
+      upload_.currentSize = 0;
+      upload_.status = UPLOAD_FILE_START;
+      r.ufn();
+      upload_.status = UPLOAD_FILE_WRITE;
+      for (size_t off = data; off < next; off += HTTP_UPLOAD_BUFLEN)
+      {
+        upload_.currentSize = std::min((size_t)HTTP_UPLOAD_BUFLEN, next - off);
+        memcpy(upload_.buf, body.data() + off, upload_.currentSize);
+        r.ufn();
+        upload_.totalSize += upload_.currentSize;
+      }
+      upload_.currentSize = 0;
+      upload_.status = UPLOAD_FILE_END;
+      r.ufn();
+    }
+    else if (!filename.length())
+    {
+      args_.push_back({name, String(body.substr(data, next - data))});
+    }
+    pos = next + 2;
+  }
+  return true;
+}
+
+void WebServer::handleClient()
+{
+  if (!server_.hasClient())
+  {
+    delay(1); // loop() would otherwise spin a host core
+    return;
+  }
+  client_ = server_.available();
+  if (!client_.connected() || !parseRequest())
+  {
+    client_ = WiFiClient();
+    args_.clear();
+    headers_.clear();
+    return;
+  }
+  const Route *route = nullptr;
+  for (const Route &r : routes_)
+  {
+    if (r.uri == uri_ && (r.method == HTTP_ANY || r.method == method_))
+    {
+      route = &r;
+      break;
+    }
+  }
+  size_t length = header("Content-Length").toInt();
+  String type = header("Content-Type");
+  if (length > NATIVE_HTTP_MAX_BODY)
+  {
+    send(400, "text/plain", "Bad Request");
+  }
+  else if (route && type.startsWith("multipart/form-data"))
+  {
+    int b = type.indexOf("boundary=");
+    if (b < 0 || !parseMultipart(*route, type.substring(b + 9), length))
+    {
+      send(400, "text/plain", "Bad Request");
+      route = nullptr;
+    }
+    else
+    {
+      route->fn();
+    }
+  }
+  else
+  {
+    if (length)
+    {
+      std::string body(length, '\0');
+      read_exact(client_, (uint8_t *)&body[0], length);
+      if (type.startsWith("application/x-www-form-urlencoded"))
+      {
+        std::vector<String> keys, values;
+        parse_args(String(body), keys, values);
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+          args_.push_back({keys[i], values[i]});
+        }
+      }
+      else
+      {
+        args_.push_back({"plain", String(body)});
+      }
+    }
+    if (route)
+    {
+      route->fn();
+    }
+    else if (not_found_)
+    {
+      not_found_();
+    }
+    else
+    {
+      send(404, "text/plain", String("Not found: ") + uri_);
+    }
+  }
+  if (chunked_)
+  {
+    client_.write("0\r\n\r\n");
+  }
+  client_ = WiFiClient();
+  args_.clear();
+  headers_.clear();
+  out_headers_.clear();
+  content_length_ = CONTENT_LENGTH_NOT_SET;
+  chunked_ = false;
+}
+
+void WebServer::sendHeaders(int code, const char *content_type, size_t len)
+{
+  String h = String("HTTP/1.1 ") + String(code) + " " + status_text(code) + "\r\n";
+  if (content_type && *content_type)
+  {
+    h += String("Content-Type: ") + content_type + "\r\n";
+  }
+  if (content_length_ == CONTENT_LENGTH_NOT_SET)
+  {
+    h += String("Content-Length: ") + String((unsigned long)len) + "\r\n";
+  }
+  else if (content_length_ != CONTENT_LENGTH_UNKNOWN)
+  {
+    h += String("Content-Length: ") + String((unsigned long)content_length_) + "\r\n";
+  }
+  else
+  {
+    chunked_ = true;
+    h += "Transfer-Encoding: chunked\r\n";
+  }
+  for (const KV &kv : out_headers_)
+  {
+    h += kv.k + ": " + kv.v + "\r\n";
+  }
+  h += "Connection: close\r\n\r\n";
+  client_.print(h);
+  out_headers_.clear();
+  content_length_ = CONTENT_LENGTH_NOT_SET;
+}
+
+void WebServer::send(int code, const char *content_type, const String &content)
+{
+  sendHeaders(code, content_type, content.length());
+  if (content.length())
+  {
+    sendContent(content.c_str(), content.length());
+  }
+}
+
+void WebServer::send_P(int code, PGM_P content_type, PGM_P content, size_t len)
+{
+  sendHeaders(code, content_type, len);
+  sendContent(content, len);
+}
+
+void WebServer::sendHeader(const String &name, const String &value, bool first)
+{
+  if (first)
+  {
+    out_headers_.insert(out_headers_.begin(), {name, value});
+  }
+  else
+  {
+    out_headers_.push_back({name, value});
+  }
+}
+
+void WebServer::sendContent(const char *content, size_t len)
+{
+  if (chunked_)
+  {
+    if (!len)
+    {
+      return;
+    }
+    char size[20];
+    snprintf(size, sizeof(size), "%zx\r\n", len);
+    client_.write(size);
+  }
+  client_.write((const uint8_t *)content, len);
+  if (chunked_)
+  {
+    client_.write("\r\n");
+  }
+}
@@ -0,0 +1,470 @@
+// Host shim: WiFi is always associated; clients, servers and UDP are POSIX
+// sockets. Listening ports are shifted by NATIVE_PORT_OFFSET (default 8000),
+// so the firmware's :80 and :81 come up as :8080 and :8081.
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <thread>
+#include <vector>
+#include "WiFi.h"
+
+#define NATIVE_IO_TIMEOUT_MS 5000
+
+WiFiClass WiFi;
+
+static bool link_up = true;
+static std::vector<WiFiEventCb> event_cbs;
+
+static void fire(arduino_event_id_t event)
+{
+  for (WiFiEventCb cb : event_cbs)
+  {
+    cb(event);
+  }
+}
+
+wl_status_t WiFiClass::begin(const char *, const char *, int32_t, const uint8_t *, bool)
+{
+  // events arrive from the WiFi task on the device, never inside begin()
+  std::thread([]() {
+    delay(10);
+    if (link_up)
+    {
+      fire(ARDUINO_EVENT_WIFI_STA_CONNECTED);
+      fire(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    }
+  }).detach();
+  return WL_DISCONNECTED;
+}
+
+bool WiFiClass::config(IPAddress, IPAddress, IPAddress, IPAddress, IPAddress) { return true; }
+
+bool WiFiClass::disconnect(bool, bool)
+{
+  fire(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+  return true;
+}
+
+bool WiFiClass::reconnect()
+{
+  begin(nullptr);
+  return true;
+}
+
+bool WiFiClass::mode(wifi_mode_t) { return true; }
+
+int WiFiClass::onEvent(WiFiEventCb cb)
+{
+  event_cbs.push_back(cb);
+  return (int)event_cbs.size();
+}
+
+wl_status_t WiFiClass::status() { return link_up ? WL_CONNECTED : WL_CONNECTION_LOST; }
+IPAddress WiFiClass::localIP() { return IPAddress(127, 0, 0, 1); }
+IPAddress WiFiClass::gatewayIP() { return IPAddress(127, 0, 0, 1); }
+IPAddress WiFiClass::subnetMask() { return IPAddress(255, 0, 0, 0); }
+IPAddress WiFiClass::dnsIP(uint8_t) { return IPAddress(127, 0, 0, 53); }
+
+uint8_t *WiFiClass::BSSID()
+{
+  static uint8_t bssid[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+  return bssid;
+}
+
+int32_t WiFiClass::channel() { return 6; }
+int8_t WiFiClass::RSSI() { return link_up ? -50 : 0; }
+String WiFiClass::SSID() { return "native"; }
+String WiFiClass::macAddress() { return "02:00:00:00:00:02"; }
+
+void WiFiClass::simSetLinkUp(bool up)
+{
+  if (up == link_up)
+  {
+    return;
+  }
+  link_up = up;
+  if (up)
+  {
+    begin(nullptr);
+  }
+  else
+  {
+    fire(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+  }
+}
+
+static uint16_t host_port(uint16_t port)
+{
+  const char *off = getenv("NATIVE_PORT_OFFSET");
+  return port + (off ? atoi(off) : 8000);
+}
+
+static bool wait_fd(int fd, short events, int timeout_ms)
+{
+  struct pollfd p = {fd, events, 0};
+  return poll(&p, 1, timeout_ms) > 0 && (p.revents & (events | POLLHUP | POLLERR));
+}
+
+struct WiFiClient::Socket
+{
+  explicit Socket(int f) : fd(f) {}
+  ~Socket()
+  {
+    if (fd >= 0)
+    {
+      ::close(fd);
+    }
+  }
+  int fd;
+  bool failed = false;
+};
+
+WiFiClient::WiFiClient() {}
+
+WiFiClient::WiFiClient(int fd) : sock_(std::make_shared<Socket>(fd))
+{
+  struct timeval tv = {NATIVE_IO_TIMEOUT_MS / 1000, 0};
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+WiFiClient::~WiFiClient() {}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+  return connect(ip.toString().c_str(), port, NATIVE_IO_TIMEOUT_MS);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port) { return connect(host, port, NATIVE_IO_TIMEOUT_MS); }
+
+int WiFiClient::connect(const char *host, uint16_t port, int32_t timeout_ms)
+{
+  stop();
+  struct addrinfo hints = {}, *res = nullptr;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  if (getaddrinfo(host, service, &hints, &res) != 0 || !res)
+  {
+    return 0;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int ok = 0;
+  if (fd >= 0)
+  {
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    if (::connect(fd, res->ai_addr, res->ai_addrlen) == 0 ||
+        (errno == EINPROGRESS && wait_fd(fd, POLLOUT, timeout_ms)))
+    {
+      int err = 0;
+      socklen_t len = sizeof(err);
+      getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+      ok = err == 0;
+    }
+    if (ok)
+    {
+      fcntl(fd, F_SETFL, 0);
+      *this = WiFiClient(fd);
+    }
+    else
+    {
+      ::close(fd);
+    }
+  }
+  freeaddrinfo(res);
+  return ok;
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t size)
+{
+  if (!sock_ || sock_->fd < 0 || sock_->failed)
+  {
+    return 0;
+  }
+  size_t done = 0;
+  while (done < size)
+  {
+    ssize_t n = send(sock_->fd, buf + done, size - done, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      sock_->failed = true; // peer gone or send timeout
+      break;
+    }
+    done += n;
+  }
+  return done;
+}
+
+int WiFiClient::available()
+{
+  int n = 0;
+  if (!sock_ || sock_->fd < 0 || ioctl(sock_->fd, FIONREAD, &n) < 0)
+  {
+    return 0;
+  }
+  return n;
+}
+
+int WiFiClient::read()
+{
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buf, size_t size)
+{
+  if (!sock_ || sock_->fd < 0)
+  {
+    return -1;
+  }
+  ssize_t n = recv(sock_->fd, buf, size, MSG_DONTWAIT);
+  return n > 0 ? (int)n : -1;
+}
+
+int WiFiClient::peek()
+{
+  uint8_t c;
+  if (!sock_ || sock_->fd < 0 || recv(sock_->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 1)
+  {
+    return -1;
+  }
+  return c;
+}
+
+uint8_t WiFiClient::connected()
+{
+  if (!sock_ || sock_->fd < 0 || sock_->failed)
+  {
+    return 0;
+  }
+  uint8_t c;
+  ssize_t n = recv(sock_->fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+  {
+    return 0;
+  }
+  return 1;
+}
+
+void WiFiClient::stop()
+{
+  if (sock_ && sock_->fd >= 0)
+  {
+    // like lwIP, stop() closes the socket for every copy
+    ::close(sock_->fd);
+    sock_->fd = -1;
+  }
+  sock_.reset();
+}
+
+int WiFiClient::fd() const { return sock_ ? sock_->fd : -1; }
+
+int WiFiClient::setNoDelay(bool nodelay)
+{
+  int v = nodelay;
+  return sock_ ? setsockopt(sock_->fd, IPPROTO_TCP, TCP_NODELAY, &v, sizeof(v)) : -1;
+}
+
+IPAddress WiFiClient::remoteIP() const
+{
+  struct sockaddr_in addr = {};
+  socklen_t len = sizeof(addr);
+  if (!sock_ || getpeername(sock_->fd, (struct sockaddr *)&addr, &len) < 0)
+  {
+    return IPAddress();
+  }
+  return IPAddress(addr.sin_addr.s_addr);
+}
+
+uint16_t WiFiClient::remotePort() const
+{
+  struct sockaddr_in addr = {};
+  socklen_t len = sizeof(addr);
+  if (!sock_ || getpeername(sock_->fd, (struct sockaddr *)&addr, &len) < 0)
+  {
+    return 0;
+  }
+  return ntohs(addr.sin_port);
+}
+
+void WiFiServer::begin(uint16_t port)
+{
+  if (port)
+  {
+    port_ = port;
+  }
+  end();
+  fd_ = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(host_port(port_));
+  if (bind(fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd_, 8) < 0)
+  {
+    Serial.printf("WiFiServer: cannot listen on %u: %s\n", host_port(port_), strerror(errno));
+    ::close(fd_);
+    fd_ = -1;
+    return;
+  }
+  fcntl(fd_, F_SETFL, O_NONBLOCK);
+  Serial.printf("WiFiServer: :%u on localhost:%u\n", port_, host_port(port_));
+}
+
+WiFiClient WiFiServer::available()
+{
+  if (fd_ < 0)
+  {
+    return WiFiClient();
+  }
+  int fd = ::accept(fd_, nullptr, nullptr);
+  return fd < 0 ? WiFiClient() : WiFiClient(fd);
+}
+
+bool WiFiServer::hasClient() { return fd_ >= 0 && wait_fd(fd_, POLLIN, 0); }
+
+void WiFiServer::end()
+{
+  if (fd_ >= 0)
+  {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+  stop();
+  fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  int one = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port ? host_port(port) : 0);
+  if (bind(fd_, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+  {
+    stop();
+    return 0;
+  }
+  fcntl(fd_, F_SETFL, O_NONBLOCK);
+  return 1;
+}
+
+uint8_t WiFiUDP::beginMulticast(IPAddress group, uint16_t port)
+{
+  if (!begin(port))
+  {
+    return 0;
+  }
+  struct ip_mreq mreq = {};
+  mreq.imr_multiaddr.s_addr = (uint32_t)group;
+  mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+  setsockopt(fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+  mcast_ip_ = group;
+  mcast_port_ = port;
+  return 1;
+}
+
+void WiFiUDP::stop()
+{
+  if (fd_ >= 0)
+  {
+    ::close(fd_);
+    fd_ = -1;
+  }
+  rx_.clear();
+  rx_pos_ = 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+  tx_ip_ = ip;
+  tx_port_ = port;
+  tx_.clear();
+  return 1;
+}
+
+int WiFiUDP::beginPacket(const char *host, uint16_t port)
+{
+  IPAddress ip;
+  if (!ip.fromString(host))
+  {
+    struct hostent *h = gethostbyname(host);
+    if (!h)
+    {
+      return 0;
+    }
+    ip = IPAddress(*(uint32_t *)h->h_addr_list[0]);
+  }
+  return beginPacket(ip, port);
+}
+
+int WiFiUDP::beginMulticastPacket() { return beginPacket(mcast_ip_, mcast_port_); }
+
+int WiFiUDP::endPacket()
+{
+  int fd = fd_ >= 0 ? fd_ : socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = (uint32_t)tx_ip_;
+  addr.sin_port = htons(tx_port_);
+  ssize_t n = sendto(fd, tx_.data(), tx_.size(), 0, (struct sockaddr *)&addr, sizeof(addr));
+  if (fd != fd_)
+  {
+    ::close(fd);
+  }
+  tx_.clear();
+  return n >= 0;
+}
+
+size_t WiFiUDP::write(const uint8_t *buf, size_t size)
+{
+  tx_.insert(tx_.end(), buf, buf + size);
+  return size;
+}
+
+int WiFiUDP::parsePacket()
+{
+  if (fd_ < 0)
+  {
+    return 0;
+  }
+  uint8_t buf[1500];
+  struct sockaddr_in addr = {};
+  socklen_t len = sizeof(addr);
+  ssize_t n = recvfrom(fd_, buf, sizeof(buf), 0, (struct sockaddr *)&addr, &len);
+  if (n <= 0)
+  {
+    return 0;
+  }
+  rx_.assign(buf, buf + n);
+  rx_pos_ = 0;
+  remote_ip_ = IPAddress(addr.sin_addr.s_addr);
+  remote_port_ = ntohs(addr.sin_port);
+  return (int)n;
+}
+
+int WiFiUDP::available() { return (int)(rx_.size() - rx_pos_); }
+
+int WiFiUDP::read() { return rx_pos_ < rx_.size() ? rx_[rx_pos_++] : -1; }
+
+int WiFiUDP::read(uint8_t *buf, size_t len)
+{
+  size_t n = std::min(len, rx_.size() - rx_pos_);
+  memcpy(buf, rx_.data() + rx_pos_, n);
+  rx_pos_ += n;
+  return (int)n;
+}
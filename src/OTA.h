@@ -1,4 +1,5 @@
 #include <ArduinoOTA.h>
+#include "quiesce.h"
 void setupOTA() {
   //Serial.begin(115200);
   //Serial.println("Booting");
@@ -11,14 +12,19 @@ void setupOTA() {
     }
     // NOTE: if updating FS this would be the place to unmount FS using FS.end()
     Serial.println("Start updating " + type);
+    quiesceEnter("ota");
   });
   ArduinoOTA.onEnd([]() {
     Serial.println("\nEnd");
+    otaFinished(true);
   });
   ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
     Serial.printf("Progress: %u%%\r", (progress / (total / 100)));
+    otaProgress(progress, total);
   });
   ArduinoOTA.onError([](ota_error_t error) {
+    otaFinished(false);
+    quiesceResume();
     Serial.printf("Error[%u]: ", error);
     if (error == OTA_AUTH_ERROR) {
       Serial.println("Auth Failed");
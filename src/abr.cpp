@@ -0,0 +1,305 @@
+#include "abr.h"
+#include <Preferences.h>
+#include "esp_camera.h"
+#include "profiles.h"
+#include "frame_source.h"
+
+typedef struct
+{
+  bool enabled;
+  uint32_t fps;
+  uint32_t kbps;
+  int qmin, qmax;
+  int fsmin, fsmax;
+} abr_config_t;
+
+typedef struct
+{
+  uint32_t ms;
+  uint8_t framesize;
+  uint8_t quality;
+  uint16_t fps10;
+  uint32_t kbps;
+  const char *why;
+} abr_decision_t;
+
+static abr_config_t abr_config;
+static bool abr_loaded = false;
+static bool attached = false;
+static portMUX_TYPE attach_mux = portMUX_INITIALIZER_UNLOCKED;
+// the ladder state below is moved by the stream task and by /control
+static SemaphoreHandle_t state_lock = NULL;
+
+static int rung = 0;
+static uint32_t window_start = 0;
+static uint32_t win_frames = 0, win_bytes = 0, win_send_us = 0, win_held = 0;
+static int down_windows = 0, up_windows = 0;
+static bool settling = false;
+// last window, for /metrics
+static float last_fps = 0;
+static uint32_t last_kbps = 0, last_link_kbps = 0, last_frame_bytes = 0;
+static float last_held = 0;
+static uint32_t changes = 0;
+static abr_decision_t decisions[ABR_LOG];
+
+static void lock_state()
+{
+  if (!state_lock)
+  {
+    SemaphoreHandle_t m = xSemaphoreCreateMutex();
+    portENTER_CRITICAL(&attach_mux);
+    if (!state_lock)
+    {
+      state_lock = m;
+      m = NULL;
+    }
+    portEXIT_CRITICAL(&attach_mux);
+    if (m)
+    {
+      vSemaphoreDelete(m);
+    }
+  }
+  xSemaphoreTake(state_lock, portMAX_DELAY);
+}
+
+// taken before SensorLock, never inside it
+class StateLock
+{
+public:
+  StateLock() { lock_state(); }
+  ~StateLock() { xSemaphoreGive(state_lock); }
+};
+
+static void load_config()
+{
+  Preferences prefs;
+  abr_config.enabled = false;
+  abr_config.fps = 15;
+  abr_config.kbps = 0;
+  abr_config.qmin = 10;
+  abr_config.qmax = 40;
+  abr_config.fsmin = FRAMESIZE_QVGA;
+  abr_config.fsmax = FRAMESIZE_SVGA;
+  if (prefs.begin("abr", true))
+  {
+    abr_config.enabled = prefs.getBool("enable", false);
+    abr_config.fps = prefs.getUInt("fps", abr_config.fps);
+    abr_config.kbps = prefs.getUInt("kbps", abr_config.kbps);
+    abr_config.qmin = prefs.getInt("qmin", abr_config.qmin);
+    abr_config.qmax = prefs.getInt("qmax", abr_config.qmax);
+    abr_config.fsmin = prefs.getInt("fsmin", abr_config.fsmin);
+    abr_config.fsmax = prefs.getInt("fsmax", abr_config.fsmax);
+    prefs.end();
+  }
+  abr_loaded = true;
+}
+
+static int per_size()
+{
+  return (abr_config.qmax - abr_config.qmin) / ABR_Q_STEP + 1;
+}
+
+static int rung_count()
+{
+  return per_size() * (abr_config.fsmax - abr_config.fsmin + 1);
+}
+
+static int rung_framesize(int r) { return abr_config.fsmax - r / per_size(); }
+static int rung_quality(int r) { return abr_config.qmin + (r % per_size()) * ABR_Q_STEP; }
+
+static void apply_rung(sensor_t *s, int r)
+{
+  int fs = rung_framesize(r);
+  int q = rung_quality(r);
+  if (camSettingGet(s, CAM_QUALITY) != q)
+  {
+    camSettingSet(s, CAM_QUALITY, q);
+  }
+  if (camSettingGet(s, CAM_FRAMESIZE) != fs)
+  {
+    camSettingSet(s, CAM_FRAMESIZE, fs);
+  }
+  rung = r;
+}
+
+static void reset_window()
+{
+  window_start = millis();
+  win_frames = win_bytes = win_send_us = win_held = 0;
+}
+
+bool abrAttach()
+{
+  StateLock state;
+  if (!abr_loaded)
+  {
+    load_config();
+  }
+  portENTER_CRITICAL(&attach_mux);
+  bool ok = abr_config.enabled && !attached;
+  attached |= ok;
+  portEXIT_CRITICAL(&attach_mux);
+  SensorLock lock;
+  sensor_t *s = esp_camera_sensor_get();
+  if (!ok || !s)
+  {
+    return ok;
+  }
+  // start from the rung nearest to what the sensor runs now
+  int fs = constrain(camSettingGet(s, CAM_FRAMESIZE), abr_config.fsmin, abr_config.fsmax);
+  int q = constrain(camSettingGet(s, CAM_QUALITY), abr_config.qmin, abr_config.qmax);
+  apply_rung(s, (abr_config.fsmax - fs) * per_size() + (q - abr_config.qmin + ABR_Q_STEP - 1) / ABR_Q_STEP);
+  down_windows = up_windows = 0;
+  settling = true;
+  reset_window();
+  return true;
+}
+
+void abrDetach()
+{
+  portENTER_CRITICAL(&attach_mux);
+  attached = false;
+  portEXIT_CRITICAL(&attach_mux);
+}
+
+static void decide(const char *why, int step)
+{
+  SensorLock lock;
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s)
+  {
+    return;
+  }
+  apply_rung(s, rung + step);
+  abr_decision_t *d = &decisions[changes++ % ABR_LOG];
+  d->ms = millis();
+  d->framesize = rung_framesize(rung);
+  d->quality = rung_quality(rung);
+  d->fps10 = (uint16_t)(last_fps * 10);
+  d->kbps = last_kbps;
+  d->why = why;
+  Serial.printf("ABR: %s -> framesize %u quality %u (%.1ffps %ukbps)\n", why, d->framesize, d->quality, last_fps, last_kbps);
+  down_windows = up_windows = 0;
+  settling = true; // the next window still has frames of the old size
+}
+
+void abrFrame(size_t len, uint32_t send_us)
+{
+  StateLock state;
+  win_frames++;
+  win_bytes += len;
+  win_send_us += send_us;
+  win_held += frameSourceOutstanding();
+  uint32_t elapsed = millis() - window_start;
+  if (elapsed < ABR_WINDOW_MS)
+  {
+    return;
+  }
+  last_fps = win_frames * 1000.0f / elapsed;
+  last_kbps = (uint32_t)((uint64_t)win_bytes * 8 / elapsed);
+  // what the link takes while the stream is writing
+  last_link_kbps = win_send_us ? (uint32_t)((uint64_t)win_bytes * 8000 / win_send_us) : 0;
+  last_frame_bytes = win_bytes / win_frames;
+  last_held = (float)win_held / win_frames;
+  float send_share = win_send_us / (elapsed * 1000.0f);
+  reset_window();
+  if (!abr_config.enabled)
+  {
+    return;
+  }
+  if (settling)
+  {
+    settling = false;
+    return;
+  }
+
+  // frames per second the link could carry at the current size, and at
+  // the next rung up (assumed about a third larger)
+  float link_fps = last_frame_bytes ? last_link_kbps * 1000.0f / 8 / last_frame_bytes : 0;
+  bool down, up;
+  const char *why;
+  if (abr_config.kbps)
+  {
+    down = last_kbps > abr_config.kbps * 11 / 10 || (send_share > 0.9f && last_link_kbps < abr_config.kbps);
+    up = last_kbps * 4 / 3 < abr_config.kbps * 9 / 10 && send_share < 0.5f;
+    why = last_kbps > abr_config.kbps ? "kbps_high" : "link_slow";
+  }
+  else
+  {
+    bool slow = last_fps < abr_config.fps * 0.9f;
+    // a slow sensor is not helped by a smaller JPEG unless the link is the limit
+    down = slow && (link_fps < abr_config.fps || last_held >= FRAME_SOURCE_SLOTS - 1);
+    up = last_fps >= abr_config.fps * 0.95f && link_fps / 1.33f >= abr_config.fps * 1.2f;
+    why = last_held >= FRAME_SOURCE_SLOTS - 1 ? "queue" : "fps_low";
+  }
+  down_windows = down ? down_windows + 1 : 0;
+  up_windows = up && !down ? up_windows + 1 : 0;
+  if (down_windows >= ABR_DOWN_WINDOWS && rung < rung_count() - 1)
+  {
+    decide(why, 1);
+  }
+  else if (up_windows >= ABR_UP_WINDOWS && rung > 0)
+  {
+    decide("headroom", -1);
+  }
+}
+
+int abrSet(const String &var, const String &value)
+{
+  StateLock state;
+  if (!abr_loaded)
+  {
+    load_config();
+  }
+  Preferences prefs;
+  if (!prefs.begin("abr", false))
+  {
+    return -1;
+  }
+  int val = value.toInt();
+  int res = 0;
+  if (var.equals("abr"))
+    prefs.putBool("enable", val != 0);
+  else if (var.equals("abr_fps") && val > 0 && val <= 60)
+    prefs.putUInt("fps", val);
+  else if (var.equals("abr_kbps") && val >= 0)
+    prefs.putUInt("kbps", val);
+  else if (var.equals("abr_qmin") && val >= 4 && val <= abr_config.qmax)
+    prefs.putInt("qmin", val);
+  else if (var.equals("abr_qmax") && val >= abr_config.qmin && val <= 63)
+    prefs.putInt("qmax", val);
+  else if (var.equals("abr_fsmin") && val >= 0 && val <= abr_config.fsmax)
+    prefs.putInt("fsmin", val);
+  else if (var.equals("abr_fsmax") && val >= abr_config.fsmin && val < FRAMESIZE_INVALID)
+    prefs.putInt("fsmax", val);
+  else
+    res = -1;
+  prefs.end();
+  load_config();
+  // the ladder may have changed under the running stream
+  rung = constrain(rung, 0, rung_count() - 1);
+  settling = true;
+  return res;
+}
+
+int abrMetricsJson(char *p, size_t len)
+{
+  StateLock state;
+  int n = snprintf(p, len,
+                   "\"abr\":{\"enabled\":%u,\"attached\":%u,\"target_fps\":%u,\"target_kbps\":%u,\"rung\":%d,\"rungs\":%d,"
+                   "\"fps\":%.1f,\"kbps\":%u,\"link_kbps\":%u,\"frame_bytes\":%u,\"held\":%.2f,\"changes\":%u,\"log\":[",
+                   abr_config.enabled, attached, abr_config.fps, abr_config.kbps, rung, abr_loaded ? rung_count() : 0,
+                   last_fps, last_kbps, last_link_kbps, last_frame_bytes, last_held, changes);
+  uint32_t first = changes > ABR_LOG ? changes - ABR_LOG : 0;
+  for (uint32_t i = first; i < changes && n < (int)len; i++)
+  {
+    const abr_decision_t *d = &decisions[i % ABR_LOG];
+    n += snprintf(p + n, len - n, "%s{\"ms\":%u,\"framesize\":%u,\"quality\":%u,\"fps\":%.1f,\"kbps\":%u,\"why\":\"%s\"}",
+                  i == first ? "" : ",", d->ms, d->framesize, d->quality, d->fps10 / 10.0f, d->kbps, d->why);
+  }
+  if (n < (int)len)
+  {
+    n += snprintf(p + n, len - n, "]}");
+  }
+  return n;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <Arduino.h>
+
+// Adaptive bitrate for the MJPEG stream. Quality and frame size form one
+// ladder, best first: every quality step at the largest allowed frame size,
+// then the next frame size down starting again at the best quality.
+// Stepping down the ladder costs quality first and frame size second.
+//
+// The stream task reports each frame; once per window the controller
+// compares what it measured against the target (fps, or kbps when abr_kbps
+// is set) and moves one rung. Thresholds differ for the two directions and
+// each needs several windows in a row, so it does not oscillate. Configured
+// through /control with the abr_* variables:
+//   abr          0/1
+//   abr_fps      target frames per second
+//   abr_kbps     target bitrate; 0 holds abr_fps instead
+//   abr_qmin     best (lowest) jpeg_quality allowed
+//   abr_qmax     worst jpeg_quality allowed
+//   abr_fsmin    smallest frame size allowed
+//   abr_fsmax    largest frame size allowed
+
+#define ABR_WINDOW_MS 1000
+#define ABR_Q_STEP 5
+#define ABR_DOWN_WINDOWS 2 // windows below target before stepping down
+#define ABR_UP_WINDOWS 5   // windows with headroom before stepping up
+#define ABR_LOG 8          // decisions kept for /metrics
+
+// Only one stream drives the controller; false if another one already does
+bool abrAttach();
+void abrDetach();
+// One frame sent: jpeg bytes and the time client.write() took
+void abrFrame(size_t len, uint32_t send_us);
+// Handle an abr* /control variable; -1 if unknown or invalid
+int abrSet(const String &var, const String &value);
+// "abr":{...}
+int abrMetricsJson(char *p, size_t len);
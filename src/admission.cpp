@@ -0,0 +1,275 @@
+#include "admission.h"
+#include <Preferences.h>
+
+typedef struct
+{
+  bool used;
+  bool preempted;
+  admit_class_t cls;
+  uint32_t fps; // asked for; 0: the sensor rate
+  uint32_t since;
+  uint32_t win_start, win_frames, win_send_us;
+  float measured_fps; // last window, 0 until there is one
+  float busy;         // share of the last window spent blocked in write()
+} admit_slot_t;
+
+// preempted slots stay taken until their task has let go of the client
+static admit_slot_t slots[ADMIT_MAX_STREAMS * 2];
+static portMUX_TYPE admit_mux = portMUX_INITIALIZER_UNLOCKED;
+static char recorder_token[33];
+static bool loaded = false;
+
+static float uplink_kbps = 0; // 0: not measured yet
+static float frame_bytes = 0;
+static uint32_t win_start = 0, win_bytes = 0, win_send_us = 0;
+static uint32_t admitted = 0, rejected = 0, preempted = 0;
+static const char *last_reason = "";
+
+static void load_config()
+{
+  Preferences prefs;
+  recorder_token[0] = 0;
+  if (prefs.begin("admit", true))
+  {
+    String token = prefs.getString("token");
+    strncpy(recorder_token, token.c_str(), sizeof(recorder_token) - 1);
+    prefs.end();
+  }
+  loaded = true;
+}
+
+admit_class_t admitClass(const String &token)
+{
+  if (!loaded)
+  {
+    load_config();
+  }
+  return recorder_token[0] && token.equals(recorder_token) ? ADMIT_RECORDER : ADMIT_VIEWER;
+}
+
+static bool active(const admit_slot_t *s)
+{
+  return s->used && !s->preempted;
+}
+
+// What an unpaced client will get: the best rate any client sees now
+static float sensor_fps()
+{
+  float fps = 0;
+  for (const admit_slot_t &s : slots)
+  {
+    if (active(&s))
+    {
+      fps = max(fps, s.measured_fps);
+    }
+  }
+  return fps;
+}
+
+// What a client asking for fps will get: nobody gets more than the sensor
+// delivers, whatever they asked for
+static float expected_fps(uint32_t fps, float sensor)
+{
+  return fps && (sensor <= 0 || fps < sensor) ? fps : sensor;
+}
+
+static float demand_kbps(float extra_fps)
+{
+  float fps = extra_fps;
+  float sensor = sensor_fps();
+  for (const admit_slot_t &s : slots)
+  {
+    if (active(&s))
+    {
+      fps += expected_fps(s.fps, sensor);
+    }
+  }
+  return fps * frame_bytes * 8 / 1000;
+}
+
+static bool fits(float fps)
+{
+  // nothing measured yet: the link has not been the limit so far
+  return uplink_kbps <= 0 || demand_kbps(fps) <= uplink_kbps * ADMIT_HEADROOM;
+}
+
+int admitStream(admit_class_t cls, uint32_t fps, const char **reason)
+{
+  bool memory = ESP.getFreeHeap() >= ADMIT_MIN_HEAP && (!psramFound() || ESP.getFreePsram() >= ADMIT_MIN_PSRAM);
+  const char *why = NULL;
+  int slot = -1;
+  portENTER_CRITICAL(&admit_mux);
+  int count = 0;
+  for (int i = 0; i < ADMIT_MAX_STREAMS * 2; i++)
+  {
+    count += active(&slots[i]);
+    if (!slots[i].used && slot < 0)
+    {
+      slot = i;
+    }
+  }
+  float want = expected_fps(fps, sensor_fps());
+  if (!memory)
+  {
+    why = "memory";
+  }
+  else if (slot < 0)
+  {
+    why = "busy";
+  }
+  else if (cls == ADMIT_VIEWER)
+  {
+    if (count >= ADMIT_MAX_STREAMS)
+    {
+      why = "full";
+    }
+    // short of its rate because the link holds it back, not the sensor
+    for (const admit_slot_t &s : slots)
+    {
+      if (!why && active(&s) && s.fps && s.measured_fps > 0 && s.measured_fps < s.fps * ADMIT_BEHIND &&
+          s.busy >= ADMIT_SATURATED)
+      {
+        why = "behind";
+      }
+    }
+    if (!why && !fits(want))
+    {
+      why = "uplink";
+    }
+  }
+  else
+  {
+    // drop viewers, newest first, until the recorder fits
+    while (count >= ADMIT_MAX_STREAMS || !fits(want))
+    {
+      admit_slot_t *victim = NULL;
+      for (admit_slot_t &s : slots)
+      {
+        if (active(&s) && s.cls == ADMIT_VIEWER && (!victim || (int32_t)(s.since - victim->since) > 0))
+        {
+          victim = &s;
+        }
+      }
+      if (!victim)
+      {
+        break;
+      }
+      victim->preempted = true;
+      preempted++;
+      count--;
+    }
+    if (count >= ADMIT_MAX_STREAMS)
+    {
+      why = "full";
+    }
+  }
+  if (why)
+  {
+    rejected++;
+    last_reason = why;
+    slot = -1;
+  }
+  else
+  {
+    admit_slot_t *s = &slots[slot];
+    memset(s, 0, sizeof(*s));
+    s->used = true;
+    s->cls = cls;
+    s->fps = fps;
+    s->since = s->win_start = millis();
+    admitted++;
+  }
+  portEXIT_CRITICAL(&admit_mux);
+  if (why)
+  {
+    Serial.printf("Stream refused: %s\n", why);
+  }
+  *reason = why;
+  return slot;
+}
+
+void admitRelease(int slot)
+{
+  portENTER_CRITICAL(&admit_mux);
+  slots[slot].used = false;
+  portEXIT_CRITICAL(&admit_mux);
+}
+
+void admitFrame(int slot, size_t len, uint32_t send_us)
+{
+  uint32_t now = millis();
+  portENTER_CRITICAL(&admit_mux);
+  admit_slot_t *s = &slots[slot];
+  s->win_frames++;
+  s->win_send_us += send_us;
+  if (now - s->win_start >= ADMIT_WINDOW_MS)
+  {
+    s->measured_fps = s->win_frames * 1000.0f / (now - s->win_start);
+    s->busy = min(s->win_send_us / 1000.0f / (now - s->win_start), 1.0f);
+    s->win_start = now;
+    s->win_frames = s->win_send_us = 0;
+  }
+  frame_bytes = frame_bytes > 0 ? frame_bytes * 0.9f + len * 0.1f : len;
+  win_bytes += len;
+  win_send_us += send_us;
+  uint32_t elapsed = now - win_start;
+  if (elapsed >= ADMIT_WINDOW_MS)
+  {
+    // writes that overlap in time count once: busy is at most the window
+    float busy_ms = min(win_send_us / 1000.0f, (float)elapsed);
+    if (busy_ms >= elapsed * ADMIT_MIN_BUSY)
+    {
+      float kbps = win_bytes * 8 / busy_ms;
+      uplink_kbps = uplink_kbps > 0 ? uplink_kbps * 0.7f + kbps * 0.3f : kbps;
+    }
+    win_start = now;
+    win_bytes = win_send_us = 0;
+  }
+  portEXIT_CRITICAL(&admit_mux);
+}
+
+bool admitPreempted(int slot)
+{
+  return slots[slot].preempted;
+}
+
+int admitSet(const String &var, const String &value)
+{
+  Preferences prefs;
+  if (!var.equals("admit_token") || value.length() >= sizeof(recorder_token) || !prefs.begin("admit", false))
+  {
+    return -1;
+  }
+  prefs.putString("token", value);
+  prefs.end();
+  load_config();
+  return 0;
+}
+
+int admitMetricsJson(char *p, size_t len)
+{
+  portENTER_CRITICAL(&admit_mux);
+  admit_slot_t copy[ADMIT_MAX_STREAMS * 2];
+  memcpy(copy, slots, sizeof(copy));
+  float uplink = uplink_kbps, demand = demand_kbps(0), bytes = frame_bytes;
+  portEXIT_CRITICAL(&admit_mux);
+  int n = snprintf(p, len,
+                   "\"admission\":{\"uplink_kbps\":%.0f,\"demand_kbps\":%.0f,\"frame_bytes\":%.0f,\"admitted\":%u,"
+                   "\"rejected\":%u,\"preempted\":%u,\"last_reason\":\"%s\",\"clients\":[",
+                   uplink, demand, bytes, admitted, rejected, preempted, last_reason);
+  bool first = true;
+  for (const admit_slot_t &s : copy)
+  {
+    if (active(&s) && n < (int)len)
+    {
+      n += snprintf(p + n, len - n, "%s{\"class\":\"%s\",\"fps\":%u,\"measured_fps\":%.1f,\"busy\":%.2f}",
+                    first ? "" : ",", s.cls == ADMIT_RECORDER ? "recorder" : "viewer", s.fps, s.measured_fps, s.busy);
+      first = false;
+    }
+  }
+  if (n < (int)len)
+  {
+    n += snprintf(p + n, len - n, "]}");
+  }
+  return n;
+}
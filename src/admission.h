@@ -0,0 +1,48 @@
+#pragma once
+#include <Arduino.h>
+
+// Admission control for /stream. Every client holds a slot with the frame
+// rate it asked for (?fps=N; 0 takes whatever the sensor delivers). The
+// uplink is measured from the stream writes themselves: once a second, the
+// bytes all streams sent over the time they spent blocked in write(), when
+// that was long enough to say the link was the limit. A new client is
+// turned away with 503 and Retry-After when the demand of all clients at
+// the measured frame size would exceed that throughput (with headroom),
+// when a client is already falling behind its rate because the link holds
+// it back (it spends most of its time blocked in write(); a sensor slower
+// than the rate asked for does not count), or when heap or PSRAM run low.
+// A paced client's demand is capped at the rate the sensor delivers.
+//
+// Clients presenting the recorder token (?token=, set with /control
+// admit_token) get in ahead of viewers: when one does not fit, viewers are
+// dropped, newest first, to make room.
+
+#define ADMIT_MAX_STREAMS 4
+#define ADMIT_HEADROOM 0.8f          // share of the measured uplink to hand out
+#define ADMIT_BEHIND 0.9f            // below this share of its fps a client is behind
+#define ADMIT_SATURATED 0.5f         // ... if it spent this share of the time in write()
+#define ADMIT_MIN_HEAP (40 * 1024)   // stream task stack and socket buffers
+#define ADMIT_MIN_PSRAM (256 * 1024) // frame conversions
+#define ADMIT_MIN_BUSY 0.1f          // share of a window spent writing to count as a measurement
+#define ADMIT_WINDOW_MS 1000
+#define ADMIT_RETRY_S 10
+
+typedef enum
+{
+  ADMIT_VIEWER,
+  ADMIT_RECORDER,
+} admit_class_t;
+
+// Class of a client by the token it presented
+admit_class_t admitClass(const String &token);
+// A slot for a new client, or -1 with the reason it was turned away
+int admitStream(admit_class_t cls, uint32_t fps, const char **reason);
+void admitRelease(int slot);
+// One frame sent: jpeg bytes and the time client.write() took
+void admitFrame(int slot, size_t len, uint32_t send_us);
+// True once the slot was given up for a recorder; the stream should end
+bool admitPreempted(int slot);
+// Handle the admit_token /control variable
+int admitSet(const String &var, const String &value);
+// "admission":{...}
+int admitMetricsJson(char *p, size_t len);
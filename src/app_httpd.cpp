@@ -19,6 +19,29 @@
 #include "esp32-hal-ledc.h"
 #include "sdkconfig.h"
 #include "camera_index.h"
+#include "reg_batch.h"
+#include "profiles.h"
+#include "sensor_traits.h"
+#include "boot_timing.h"
+#include "wifi_conn.h"
+#include "timelapse.h"
+#include "img_store.h"
+#include "frame_source.h"
+#include "abr.h"
+#include "cam_sync.h"
+#include "wall_clock.h"
+#include "admission.h"
+#include "mcast.h"
+#include "ctrl_channel.h"
+#include "motion.h"
+#include "frame_sig.h"
+#include "simulcast.h"
+#include "roi_crop.h"
+#include "preview.h"
+#include "tft.h"
+#include "fw_update.h"
+#include "quiesce.h"
+#include "trace.h"
 #include <WebServer.h>
 #include <Update.h>
 #include "FS.h"
@@ -37,6 +60,8 @@
 
 int led_duty = 0;
 bool isStreaming = false;
+static int stream_count = 0;
+static portMUX_TYPE stream_mux = portMUX_INITIALIZER_UNLOCKED;
 
 #endif
 
@@ -46,7 +71,12 @@ WebServer serverStream(81); // 流服务器监听81端口
 #define PART_BOUNDARY "123456789000000000000987654321"
 static const char *_STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
 static const char *_STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
-static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %d.%06d\r\n\r\n";
+static const char *_STREAM_END = "\r\n--" PART_BOUNDARY "--\r\n";
+static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %d.%06d\r\n"
+                                  "X-Frame-Seq: %u\r\nX-Queue-Us: %u\r\nX-Latency-Us: %u\r\n\r\n";
+static const char *_STREAM_HEARTBEAT = "Content-Type: text/plain\r\nContent-Length: 0\r\nX-Frame-Seq: %u\r\n"
+                                       "X-Unchanged: %u\r\n\r\n";
+#define STREAM_MAX_FAILED 10 // frames in a row without a rendition or crop before the stream gives up
 
 typedef struct
 {
@@ -54,6 +84,19 @@ typedef struct
   size_t len;
 } jpg_chunking_t;
 
+typedef struct
+{
+  WiFiClient client;
+  int slot;     // admission slot
+  uint32_t fps; // 0: as fast as frames come
+  uint16_t skip;  // leave out frames whose signature moved less, 0: off
+  uint16_t key_s; // most seconds between frames sent while skipping
+  uint16_t hb_s;  // empty part after this many seconds without one, 0: none
+  frame_sig_t *sig; // [0] newest frame, [1] last frame sent
+  uint8_t scale;    // rendition: 1, 2, 4 or 8
+  roi_crop_t *roi;  // crop to a region, NULL: whole frame
+} stream_ctx_t;
+
 #if CONFIG_LED_ILLUMINATOR_ENABLED
 void enable_led(bool en)
 { // Turn LED On or Off
@@ -74,37 +117,54 @@ static void bmp_handler()
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
   uint64_t fr_start = esp_timer_get_time();
 #endif
-  fb = esp_camera_fb_get();
+  uint32_t seq = 0;
+  fb = frameSourceGet(&seq);
   if (!fb)
   {
     Serial.println("Camera capture failed");
     serverCamera.send(500, "text/plain", "Camera capture failed");
     return;
   }
-  serverCamera.sendHeader("Content-Type", "image/x-windows-bmp"); // 设置响应类型为bmp
   serverCamera.sendHeader("Content-Disposition", "inline; filename=capture.bmp");
   serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
   char ts[32];
-  snprintf(ts, 32, "%ld.%06ld", fb->timestamp.tv_sec, fb->timestamp.tv_usec);
+  struct timeval tv;
+  clockFrameTime(&fb->timestamp, &tv);
+  snprintf(ts, 32, "%ld.%06ld", tv.tv_sec, tv.tv_usec);
   serverCamera.sendHeader("X-Timestamp", (const char *)ts);
   uint8_t *buf = NULL;
   size_t buf_len = 0;
   bool converted = frame2bmp(fb, &buf, &buf_len);
-  esp_camera_fb_return(fb);
+  frameSourceRelease(fb);
   if (!converted)
   {
     Serial.println("BMP Conversion failed");
     serverCamera.send(500, "text/plain", "BMP Conversion failed");
     return;
   }
-  serverCamera.sendHeader("Content-Length", String(buf_len));
-  serverCamera.send(200, "image/x-windows-bmp", (const char *)buf);
+  // send() writes the status line and headers; the binary body follows as is
+  serverCamera.setContentLength(buf_len);
+  serverCamera.send(200, "image/x-windows-bmp", "");
+  serverCamera.sendContent((const char *)buf, buf_len);
   free(buf);
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
   uint64_t fr_end = esp_timer_get_time();
 #endif
   Serial.printf("BMP: %uB", buf_len);
 }
+// The sensor, or NULL after answering 503 while an update has the camera
+// stopped (or it did not come back)
+static sensor_t *camera_sensor()
+{
+  sensor_t *s = quiesceActive() ? NULL : esp_camera_sensor_get();
+  if (!s)
+  {
+    serverCamera.sendHeader("Retry-After", "30");
+    serverCamera.send(503, "text/plain", "Camera unavailable");
+  }
+  return s;
+}
+
 static void xclk_handler()
 {
   if (!serverCamera.hasArg("xclk"))
@@ -114,7 +174,12 @@ static void xclk_handler()
   }
   int xclk = serverCamera.arg("xclk").toInt();
   Serial.printf("Set XCLK: %d MHz\n", xclk);
-  sensor_t *s = esp_camera_sensor_get();
+  sensor_t *s = camera_sensor();
+  if (!s)
+  {
+    return;
+  }
+  SensorLock lock;
   int res = s->set_xclk(s, LEDC_TIMER_0, xclk);
   if (res)
   {
@@ -138,18 +203,68 @@ static void reg_handler()
   int val = serverCamera.arg("val").toInt();
   Serial.printf("Set Register: reg: 0x%02x, mask: 0x%02x, value: 0x%02x\n", reg, mask, val);
 
-  sensor_t *s = esp_camera_sensor_get();
-  int res = s->set_reg(s, reg, mask, val);
+  sensor_t *s = camera_sensor();
+  if (!s)
+  {
+    return;
+  }
+  SensorLock lock;
+  int res;
+  {
+    TraceSpan span("sccb.set_reg");
+    span.arg = reg;
+    res = s->set_reg(s, reg, mask, val);
+  }
   if (res)
   {
     serverCamera.send(500, "text/plain", "Internal Server Error");
     return;
   }
+  ctrlNotify(CTRL_N_REG, reg, mask, val & mask);
 
   serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
   serverCamera.send(200, "text/plain", "");
 }
 
+static void regs_handler()
+{
+  // GET /regs?list=3500:ff:00,3501:ff:2a or POST the same list as the body
+  String list = serverCamera.hasArg("list") ? serverCamera.arg("list") : serverCamera.arg("plain");
+  static reg_write_t writes[REG_BATCH_MAX];
+  int count = parseRegList(list.c_str(), writes, REG_BATCH_MAX);
+  if (count <= 0)
+  {
+    serverCamera.send(400, "text/plain", "Bad Request");
+    return;
+  }
+
+  sensor_t *s = camera_sensor();
+  if (!s)
+  {
+    return;
+  }
+  SensorLock lock;
+  bool latched = false;
+  int64_t start = esp_timer_get_time();
+  int res = applyRegBatch(s, writes, count, &latched);
+  uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+  Serial.printf("Set Registers: %d writes, latched: %u, %uus\n", count, latched, elapsed);
+  if (res)
+  {
+    serverCamera.send(500, "text/plain", "Internal Server Error");
+    return;
+  }
+  for (int i = 0; i < count; i++)
+  {
+    ctrlNotify(CTRL_N_REG, writes[i].reg, writes[i].mask, writes[i].val & writes[i].mask);
+  }
+
+  char json_response[64];
+  snprintf(json_response, sizeof(json_response), "{\"count\":%d,\"latched\":%s,\"us\":%u}", count, latched ? "true" : "false", elapsed);
+  serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+  serverCamera.send(200, "application/json", json_response);
+}
+
 static void greg_handler()
 {
   if (!serverCamera.hasArg("reg") || !serverCamera.hasArg("mask"))
@@ -161,8 +276,18 @@ static void greg_handler()
   int reg = serverCamera.arg("reg").toInt();
   int mask = serverCamera.arg("mask").toInt();
 
-  sensor_t *s = esp_camera_sensor_get();
-  int res = s->get_reg(s, reg, mask);
+  sensor_t *s = camera_sensor();
+  if (!s)
+  {
+    return;
+  }
+  SensorLock lock;
+  int res;
+  {
+    TraceSpan span("sccb.get_reg");
+    span.arg = reg;
+    res = s->get_reg(s, reg, mask);
+  }
   if (res < 0)
   {
     serverCamera.send(500, "text/plain", "Internal Server Error");
@@ -193,7 +318,12 @@ static void pll_handler()
   int pclken = parse_get_var("pclken", 0);
   int pclk = parse_get_var("pclk", 0);
   Serial.printf("Set Pll: bypass: %d, mul: %d, sys: %d, root: %d, pre: %d, seld5: %d, pclken: %d, pclk: %d\n", bypass, mul, sys, root, pre, seld5, pclken, pclk);
-  sensor_t *s = esp_camera_sensor_get();
+  sensor_t *s = camera_sensor();
+  if (!s)
+  {
+    return;
+  }
+  SensorLock lock;
   int res = s->set_pll(s, bypass, mul, sys, root, pre, seld5, pclken, pclk);
   if (res)
   {
@@ -203,6 +333,72 @@ static void pll_handler()
   serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
   serverCamera.send(200, "text/plain", "");
 }
+static void profile_handler()
+{
+  // /profile                     list stored profiles
+  // /profile?name=day            switch to a stored profile
+  // /profile?name=day&save=1     store the current settings (optional regs=reg:mask:val,...)
+  // /profile?name=day&delete=1   remove a stored profile
+  static char json_response[256];
+  if (!serverCamera.hasArg("name"))
+  {
+    profileListJson(json_response, sizeof(json_response));
+    serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+    serverCamera.send(200, "application/json", json_response);
+    return;
+  }
+
+  String name = serverCamera.arg("name");
+  if (parse_get_var("delete", 0) != 1 && !camera_sensor())
+  {
+    return;
+  }
+  esp_err_t err;
+  uint32_t elapsed = 0;
+  if (parse_get_var("save", 0) == 1)
+  {
+    static reg_write_t regs[PROFILE_MAX_REGS];
+    int reg_count = 0;
+    if (serverCamera.hasArg("regs"))
+    {
+      reg_count = parseRegList(serverCamera.arg("regs").c_str(), regs, PROFILE_MAX_REGS);
+      if (reg_count < 0)
+      {
+        serverCamera.send(400, "text/plain", "Bad Request");
+        return;
+      }
+    }
+    err = profileSave(name.c_str(), regs, reg_count);
+  }
+  else if (parse_get_var("delete", 0) == 1)
+  {
+    err = profileRemove(name.c_str());
+  }
+  else
+  {
+    err = profileApply(name.c_str(), &elapsed);
+  }
+
+  if (err == ESP_ERR_NOT_FOUND)
+  {
+    serverCamera.send(404, "text/plain", "Not Found");
+    return;
+  }
+  if (err == ESP_ERR_INVALID_ARG)
+  {
+    serverCamera.send(400, "text/plain", "Bad Request");
+    return;
+  }
+  if (err != ESP_OK)
+  {
+    serverCamera.send(500, "text/plain", "Internal Server Error");
+    return;
+  }
+  snprintf(json_response, sizeof(json_response), "{\"profile\":\"%s\",\"us\":%u}", name.c_str(), elapsed);
+  serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+  serverCamera.send(200, "application/json", json_response);
+}
+
 void win_handler()
 {
   int startX = parse_get_var("sx", 0);
@@ -218,7 +414,12 @@ void win_handler()
   bool scale = parse_get_var("scale", 0) == 1;
   bool binning = parse_get_var("binning", 0) == 1;
   Serial.printf("Set Window: Start: %d %d, End: %d %d, Offset: %d %d, Total: %d %d, Output: %d %d, Scale: %u, Binning: %u\n", startX, startY, endX, endY, offsetX, offsetY, totalX, totalY, outputX, outputY, scale, binning);
-  sensor_t *s = esp_camera_sensor_get();
+  sensor_t *s = camera_sensor();
+  if (!s)
+  {
+    return;
+  }
+  SensorLock lock;
   int res = s->set_res_raw(s, startX, startY, endX, endY, offsetX, offsetY, totalX, totalY, outputX, outputY, scale, binning);
   if (res)
   {
@@ -228,49 +429,16 @@ void win_handler()
   serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
   serverCamera.send(200, "text/plain", "");
 }
-static int print_reg(char *p, sensor_t *s, uint16_t reg, uint32_t mask)
-{
-  return sprintf(p, "\"0x%x\":%u,", reg, s->get_reg(s, reg, mask));
-}
 
 
-void loadFromCamera( char *json_response)
+void loadFromCamera( char *json_response, size_t len)
 {
   //static char json_response[1024];
   sensor_t *s = esp_camera_sensor_get();
   char *p = json_response;
   *p++ = '{';
-  if (s->id.PID == OV5640_PID || s->id.PID == OV3660_PID)
-  {
-    for (int reg = 0x3400; reg < 0x3406; reg += 2)
-    {
-      p += print_reg(p, s, reg, 0xFFF); // 12 bit
-    }
-    p += print_reg(p, s, 0x3406, 0xFF);
-    p += print_reg(p, s, 0x3500, 0xFFFF0); // 16 bit
-    p += print_reg(p, s, 0x3503, 0xFF);
-    p += print_reg(p, s, 0x350a, 0x3FF);  // 10 bit
-    p += print_reg(p, s, 0x350c, 0xFFFF); // 16 bit
-    for (int reg = 0x5480; reg <= 0x5490; reg++)
-    {
-      p += print_reg(p, s, reg, 0xFF);
-    }
-    for (int reg = 0x5380; reg <= 0x538b; reg++)
-    {
-      p += print_reg(p, s, reg, 0xFF);
-    }
-    for (int reg = 0x5580; reg < 0x558a; reg++)
-    {
-      p += print_reg(p, s, reg, 0xFF);
-    }
-    p += print_reg(p, s, 0x558a, 0x1FF); // 9 bit
-  }
-  else if (s->id.PID == OV2640_PID)
-  {
-    p += print_reg(p, s, 0xd3, 0xFF);
-    p += print_reg(p, s, 0x111, 0xFF);
-    p += print_reg(p, s, 0x132, 0xFF);
-  }
+  // the fixed fields below take under 640 bytes
+  p += sensorStatusRegsJson(s, p, len - 640);
   p += sprintf(p, "\"xclk\":%u,", s->xclk_freq_hz / 1000000);
   p += sprintf(p, "\"pixformat\":%u,", s->pixformat);
   p += sprintf(p, "\"framesize\":%u,", s->status.framesize);
@@ -302,6 +470,7 @@ void loadFromCamera( char *json_response)
 #else
   p += sprintf(p, ",\"led_intensity\":%d", -1);
 #endif
+  p += sprintf(p, ",\"preview\":%u", previewEnabled());
   *p++ = '}';
   *p++ = 0;
 
@@ -313,62 +482,15 @@ int setupCam(String param,sensor_t *s)
   param.replace(variable + ": ", "");
   int val = param.toInt();
   int res = 0;
-  if (variable.equals("framesize"))
-  {
-    if (s->pixformat == PIXFORMAT_JPEG)
-    {
-      res = s->set_framesize(s, (framesize_t)val);
-    }
-  }
-  else if (variable.equals("quality"))
-    res = s->set_quality(s, val);
-  else if (variable.equals("contrast"))
-    res = s->set_contrast(s, val);
-  else if (variable.equals("brightness"))
-    res = s->set_brightness(s, val);
-  else if (variable.equals("saturation"))
-    res = s->set_saturation(s, val);
-  else if (variable.equals("gainceiling"))
-    res = s->set_gainceiling(s, (gainceiling_t)val);
-  else if (variable.equals("colorbar"))
-    res = s->set_colorbar(s, val);
-  else if (variable.equals("awb"))
-    res = s->set_whitebal(s, val);
-  else if (variable.equals("agc"))
-    res = s->set_gain_ctrl(s, val);
-  else if (variable.equals("aec"))
-    res = s->set_exposure_ctrl(s, val);
-  else if (variable.equals("hmirror"))
-    res = s->set_hmirror(s, val);
-  else if (variable.equals("vflip"))
-    res = s->set_vflip(s, val);
-  else if (variable.equals("awb_gain"))
-    res = s->set_awb_gain(s, val);
-  else if (variable.equals("agc_gain"))
-    res = s->set_agc_gain(s, val);
-  else if (variable.equals("aec_value"))
-    res = s->set_aec_value(s, val);
-  else if (variable.equals("aec2"))
-    res = s->set_aec2(s, val);
-  else if (variable.equals("dcw"))
-    res = s->set_dcw(s, val);
-  else if (variable.equals("bpc"))
-    res = s->set_bpc(s, val);
-  else if (variable.equals("wpc"))
-    res = s->set_wpc(s, val);
-  else if (variable.equals("raw_gma"))
-    res = s->set_raw_gma(s, val);
-  else if (variable.equals("lenc"))
-    res = s->set_lenc(s, val);
-  else if (variable.equals("special_effect"))
-    res = s->set_special_effect(s, val);
-  else if (variable.equals("wb_mode"))
-    res = s->set_wb_mode(s, val);
-  else if (variable.equals("ae_level"))
-    res = s->set_ae_level(s, val);
+  // both callers pass the JSON form, "name": value
+  variable.replace("\"", "");
+  variable.trim();
+  int id = camSettingId(variable.c_str());
+  if (id >= 0)
+    res = camSettingSet(s, id, val);
   else
   {
-    Serial.printf("Unknown command: %s", variable);
+    Serial.printf("Unknown command: %s\n", variable.c_str());
     res = -1;
   }
   
@@ -401,12 +523,17 @@ return res;
 }
 void status_handler()
 {//read SPIFFS
+  if (!camera_sensor())
+  {
+    return;
+  }
+  SensorLock lock;
   File file = SPIFFS.open("/params.json", "r");
   if (!file)
   {
     Serial.println("There was an error opening the file for reading load params from camera");
-    static char json_response[1024];
-    loadFromCamera(json_response);
+    static char json_response[1536];
+    loadFromCamera(json_response, sizeof(json_response));
     serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
     serverCamera.send(200, "application/json", json_response);
     return;
@@ -428,7 +555,99 @@ void cmd_handler(){
   String value = serverCamera.arg("val");
   int val = value.toInt();
   Serial.printf("%s = %d\n", variable.c_str(), val);
-  sensor_t *s = esp_camera_sensor_get();
+  if (variable.startsWith("tl_"))
+  {
+    if (timelapseSet(variable, value) < 0)
+    {
+      serverCamera.send(500, "text/plain", "Internal Server Error");
+      return;
+    }
+    serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+    serverCamera.send(200, "text/plain", "");
+    return;
+  }
+  if (variable.startsWith("mcast"))
+  {
+    if (mcastSet(variable, value) < 0)
+    {
+      serverCamera.send(500, "text/plain", "Internal Server Error");
+      return;
+    }
+    serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+    serverCamera.send(200, "text/plain", "");
+    return;
+  }
+  if (variable.startsWith("motion"))
+  {
+    if (motionSet(variable, value) < 0)
+    {
+      serverCamera.send(500, "text/plain", "Internal Server Error");
+      return;
+    }
+    serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+    serverCamera.send(200, "text/plain", "");
+    return;
+  }
+  if (variable.equals("admit_token"))
+  {
+    if (admitSet(variable, value) < 0)
+    {
+      serverCamera.send(500, "text/plain", "Internal Server Error");
+      return;
+    }
+    serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+    serverCamera.send(200, "text/plain", "");
+    return;
+  }
+  if (variable.equals("ntp"))
+  {
+    if (clockSet(variable, value) < 0)
+    {
+      serverCamera.send(500, "text/plain", "Internal Server Error");
+      return;
+    }
+    serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+    serverCamera.send(200, "text/plain", "");
+    return;
+  }
+  if (variable.equals("sync"))
+  {
+    if (syncSet(variable, value) < 0)
+    {
+      serverCamera.send(500, "text/plain", "Internal Server Error");
+      return;
+    }
+    serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+    serverCamera.send(200, "text/plain", "");
+    return;
+  }
+  if (variable.startsWith("abr"))
+  {
+    if (abrSet(variable, value) < 0)
+    {
+      serverCamera.send(500, "text/plain", "Internal Server Error");
+      return;
+    }
+    serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+    serverCamera.send(200, "text/plain", "");
+    return;
+  }
+  if (variable.equals("preview") || variable.equals("hud"))
+  {
+    if (variable.equals("hud"))
+      tftHud(val != 0);
+    else
+      previewEnable(val != 0);
+    serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+    serverCamera.send(200, "text/plain", "");
+    return;
+  }
+  sensor_t *s = camera_sensor();
+  if (!s)
+  {
+    return;
+  }
+  SensorLock lock;
   if (setupCam(  variable + "\": " + value,s) < 0)
   {
     serverCamera.send(500, "text/plain", "Internal Server Error");
@@ -437,6 +656,175 @@ void cmd_handler(){
   serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
   serverCamera.send(200, "text/plain", "");
 }
+static void store_handler()
+{
+  // /store           list the stored images
+  // /store?seq=N     download one, after checking its CRC
+  // /store?snap=1    capture a frame into the store
+  if (!imgStoreMounted())
+  {
+    serverCamera.send(404, "text/plain", "Not Found");
+    return;
+  }
+  img_record_t rec;
+  if (parse_get_var("snap", 0) == 1)
+  {
+    uint32_t fs_seq = 0;
+    camera_fb_t *fb = frameSourceGet(&fs_seq);
+    if (!fb || fb->format != PIXFORMAT_JPEG)
+    {
+      if (fb)
+      {
+        frameSourceRelease(fb);
+      }
+      serverCamera.send(500, "text/plain", "Camera capture failed");
+      return;
+    }
+    uint32_t seq = 0;
+    struct timeval tv;
+    clockFrameTime(&fb->timestamp, &tv);
+    esp_err_t err = imgStoreAppend(fb->buf, fb->len, &tv, &seq);
+    frameSourceRelease(fb);
+    if (err != ESP_OK)
+    {
+      serverCamera.send(500, "text/plain", "Internal Server Error");
+      return;
+    }
+    serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+    serverCamera.send(200, "application/json", "{\"seq\":" + String(seq) + "}");
+    return;
+  }
+  if (serverCamera.hasArg("seq"))
+  {
+    if (imgStoreFind(serverCamera.arg("seq").toInt(), &rec) != ESP_OK)
+    {
+      serverCamera.send(404, "text/plain", "Not Found");
+      return;
+    }
+    if (!imgStoreVerify(&rec))
+    {
+      serverCamera.send(500, "text/plain", "Stored image failed its CRC check");
+      return;
+    }
+    char ts[32];
+    snprintf(ts, 32, "%ld.%06ld", rec.timestamp.tv_sec, rec.timestamp.tv_usec);
+    serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+    serverCamera.sendHeader("X-Timestamp", (const char *)ts);
+    serverCamera.setContentLength(rec.len);
+    serverCamera.send(200, "image/jpeg", "");
+    static uint8_t chunk[2048];
+    for (uint32_t off = 0; off < rec.len; off += sizeof(chunk))
+    {
+      size_t n = min((size_t)(rec.len - off), sizeof(chunk));
+      if (imgStoreRead(&rec, off, chunk, n) != ESP_OK)
+      {
+        break; // reclaimed while sending; the client sees a short body
+      }
+      serverCamera.sendContent((const char *)chunk, n);
+    }
+    return;
+  }
+  String json = "[";
+  for (int i = 0; i < imgStoreCount(); i++)
+  {
+    if (imgStoreRecord(i, &rec) == ESP_OK)
+    {
+      char item[96];
+      snprintf(item, sizeof(item), "%s{\"seq\":%u,\"len\":%u,\"ts\":%ld.%06ld}", i ? "," : "", rec.seq, rec.len, rec.timestamp.tv_sec, rec.timestamp.tv_usec);
+      json += item;
+    }
+  }
+  json += "]";
+  serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+  serverCamera.send(200, "application/json", json);
+}
+
+static void trace_handler()
+{
+  // /trace?start=1[&ms=N]  open a capture window, optionally closing after N ms
+  // /trace?stop=1          close it
+  // /trace                 close it and download Chrome trace JSON
+  serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+  if (parse_get_var("start", 0))
+  {
+    if (!traceStart(parse_get_var("ms", 0)))
+    {
+      serverCamera.send(500, "text/plain", "Internal Server Error");
+      return;
+    }
+    serverCamera.send(200, "application/json", "{\"tracing\":true}");
+    return;
+  }
+  traceStop();
+  if (parse_get_var("stop", 0))
+  {
+    serverCamera.send(200, "application/json", "{\"tracing\":false,\"events\":" + String(traceCount()) + "}");
+    return;
+  }
+  serverCamera.sendHeader("Content-Disposition", "attachment; filename=trace.json");
+  serverCamera.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  serverCamera.send(200, "application/json", "");
+  static char chunk[1024];
+  int len = snprintf(chunk, sizeof(chunk), "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%u},\"traceEvents\":[", traceDropped());
+  bool first = true;
+  for (int i = 0; i < traceCount(); i++)
+  {
+    const trace_event_t *e = traceEvent(i);
+    if (!e)
+    {
+      continue;
+    }
+    if (len > (int)sizeof(chunk) - 160)
+    {
+      serverCamera.sendContent(chunk, len);
+      len = 0;
+    }
+    len += snprintf(chunk + len, sizeof(chunk) - len,
+                    "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%u,\"args\":{\"v\":%u}}",
+                    first ? "" : ",", e->name, e->tid, (long long)e->ts, e->dur, e->arg);
+    first = false;
+  }
+  len += snprintf(chunk + len, sizeof(chunk) - len, "]}");
+  serverCamera.sendContent(chunk, len);
+  serverCamera.sendContent("");
+}
+// Append one /metrics section and the character after it. Sections return
+// what snprintf wanted, which can exceed the room left: clamp it so a full
+// buffer cuts the document short instead of running past its end.
+static char *metrics_section(char *p, char *end, int (*section)(char *, size_t), char next)
+{
+  int room = end - p - 2; // next and the terminator
+  if (room > 1)
+  {
+    p += constrain(section(p, room), 0, room - 1);
+    *p++ = next;
+  }
+  *p = 0;
+  return p;
+}
+static int heap_metrics_json(char *p, size_t len)
+{
+  return snprintf(p, len, "\"heap\":%u,\"psram\":%u", ESP.getFreeHeap(), ESP.getFreePsram());
+}
+static void metrics_handler()
+{
+  static int (*const sections[])(char *, size_t) = {
+      bootTimingJson, wifiMetricsJson, timelapseMetricsJson, imgStoreMetricsJson, quiesceMetricsJson,
+      abrMetricsJson, syncMetricsJson, clockMetricsJson, admitMetricsJson, mcastMetricsJson,
+      ctrlMetricsJson, motionMetricsJson, frameSigMetricsJson, simulcastMetricsJson, roiMetricsJson,
+      heap_metrics_json};
+  static char json_response[3072];
+  char *p = json_response;
+  char *end = json_response + sizeof(json_response);
+  const size_t count = sizeof(sections) / sizeof(sections[0]);
+  *p++ = '{';
+  for (size_t i = 0; i < count; i++)
+  {
+    p = metrics_section(p, end, sections[i], i + 1 < count ? ',' : '}');
+  }
+  serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
+  serverCamera.send(200, "application/json", json_response);
+}
 size_t jpg_encode_stream(void *arg, size_t index, const void *data, size_t len)
 {
   jpg_chunking_t *j = (jpg_chunking_t *)arg;
@@ -450,57 +838,91 @@ size_t jpg_encode_stream(void *arg, size_t index, const void *data, size_t len)
 }
 static void capture_handler()
 {
+  TRACE_SPAN("capture");
   camera_fb_t *fb = NULL;
   esp_err_t res = ESP_OK;
   WiFiClient client = serverCamera.client();
 #if CONFIG_LED_ILLUMINATOR_ENABLED
   enable_led(true);
-  vTaskDelay(150 / portTICK_PERIOD_MS); // The LED needs to be turned on ~150ms before the call to esp_camera_fb_get()
-  fb = esp_camera_fb_get();             // or it won't be visible in the frame. A better way to do this is needed.
+  {
+    TRACE_SPAN("led.delay");
+    vTaskDelay(150 / portTICK_PERIOD_MS); // The LED needs to be turned on ~150ms before the call to esp_camera_fb_get()
+  }
+  fb = frameSourceGet(NULL); // or it won't be visible in the frame. A better way to do this is needed.
   enable_led(false);
+  uint32_t seq = frameSourceSeq();
 #else
-  fb = esp_camera_fb_get();
+  // a frame a stream is still sending is recent enough
+  uint32_t seq = 0;
+  fb = frameSourceGet(&seq);
 #endif
   if (!fb)
   {
+    if (quiesceActive())
+    {
+      serverCamera.sendHeader("Retry-After", "30");
+      serverCamera.send(503, "text/plain", "Firmware update in progress");
+      return;
+    }
     Serial.println("Camera capture failed");
     serverCamera.send(500, "text/plain", "Camera capture failed");
     return;
   }
-  serverCamera.sendHeader("Content-Type", "image/jpeg");
+  uint32_t queue_us = clockFrameAge(&fb->timestamp);
+  bootFirstFrame();
   serverCamera.sendHeader("Content-Disposition", "inline; filename=capture.jpg");
   serverCamera.sendHeader("Access-Control-Allow-Origin", "*");
   char ts[32];
-  snprintf(ts, 32, "%ld.%06ld", fb->timestamp.tv_sec, fb->timestamp.tv_usec);
+  struct timeval tv;
+  clockFrameTime(&fb->timestamp, &tv);
+  snprintf(ts, 32, "%ld.%06ld", tv.tv_sec, tv.tv_usec);
   serverCamera.sendHeader("X-Timestamp", (const char *)ts);
+  serverCamera.sendHeader("X-Frame-Seq", String(seq));
+  serverCamera.sendHeader("X-Queue-Us", String(queue_us));
   if (fb->format == PIXFORMAT_JPEG)
   {
-    serverCamera.sendHeader("Content-Length", String(fb->len));
-    serverCamera.sendHeader("Content-Type", "image/jpeg");
+    TraceSpan span("capture.send");
+    serverCamera.sendHeader("X-Latency-Us", String(clockFrameAge(&fb->timestamp)));
+    span.arg = fb->len;
+    serverCamera.setContentLength(fb->len);
+    serverCamera.send(200, "image/jpeg", "");
     serverCamera.sendContent((const char *)fb->buf, fb->len);
   }
   else
   {
+    TRACE_SPAN("frame2jpg");
     serverCamera.sendHeader("Content-Type", "multipart/x-mixed-replace; boundary=123456789000000000000987654321");
     jpg_chunking_t jchunk = {client, 0};
     frame2jpg_cb(fb, 80, jpg_encode_stream, &jchunk);
   }
-  esp_camera_fb_return(fb);
+  frameSourceRelease(fb);
   // Serial.printf("JPG: %uB ", (uint32_t)(fb_len) );
 }
 
-static void stream_handler()
+// Each stream client is served from its own task so loop() keeps running
+static void stream_task(void *arg)
 {
   Serial.println("stream");
   camera_fb_t *fb = NULL;
+  camera_fb_t *rendition = NULL;
+  camera_fb_t *cropped = NULL; // ctx->roi's, not released
   struct timeval _timestamp;
+  struct timeval frame_time; // boot-relative, for the latency headers
+  uint32_t queue_us = 0;
   esp_err_t res = ESP_OK;
   size_t _jpg_buf_len = 0;
   uint8_t *_jpg_buf = NULL;
-  char *part_buf[128];
+  char part_buf[192];
 
   static int64_t last_frame = 0;
-  WiFiClient client = serverStream.client();
+  stream_ctx_t *ctx = (stream_ctx_t *)arg;
+  WiFiClient &client = ctx->client;
+  int64_t next_due = 0;
+  uint32_t seq = 0;
+  bool abr = abrAttach();
+  int64_t last_sent = 0, last_part = 0;
+  uint32_t unchanged = 0;
+  int failed = 0; // consecutive frames that produced nothing to send
 
   if (!last_frame)
   {
@@ -526,13 +948,43 @@ static void stream_handler()
     res = ESP_FAIL;
   }
 #if CONFIG_LED_ILLUMINATOR_ENABLED
+  portENTER_CRITICAL(&stream_mux);
+  stream_count++;
+  portEXIT_CRITICAL(&stream_mux);
   isStreaming = true;
   enable_led(true);
 #endif
 
   while (true)
   {
-    fb = esp_camera_fb_get();
+    if (admitPreempted(ctx->slot))
+    {
+      client.write(_STREAM_END, strlen(_STREAM_END));
+      Serial.println("Stream closed for a recorder");
+      break;
+    }
+    if (ctx->fps)
+    {
+      // paced to the rate the client asked for
+      int64_t now = esp_timer_get_time();
+      if (next_due > now)
+      {
+        delay((next_due - now) / 1000);
+      }
+      next_due = max(next_due, now) + 1000000 / ctx->fps;
+    }
+    TraceSpan frame_span("stream.frame");
+    {
+      TRACE_SPAN("stream.get");
+      fb = frameSourceGet(&seq);
+    }
+    if (!fb && quiesceActive())
+    {
+      // end the multipart response properly so clients do not see an error
+      client.write(_STREAM_END, strlen(_STREAM_END));
+      Serial.println("Stream closed for update");
+      break;
+    }
     if (!fb)
     {
       Serial.println("Camera capture failed");
@@ -540,13 +992,17 @@ static void stream_handler()
     }
     else
     {
-      _timestamp.tv_sec = fb->timestamp.tv_sec;
-      _timestamp.tv_usec = fb->timestamp.tv_usec;
+      bootFirstFrame();
+      frame_time = fb->timestamp;
+      queue_us = clockFrameAge(&frame_time);
+      clockFrameTime(&frame_time, &_timestamp);
 
       if (fb->format != PIXFORMAT_JPEG)
       {
+        TraceSpan span("frame2jpg");
         bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-        esp_camera_fb_return(fb);
+        span.arg = _jpg_buf_len;
+        frameSourceRelease(fb);
         fb = NULL;
         if (!jpeg_converted)
         {
@@ -559,6 +1015,75 @@ static void stream_handler()
         _jpg_buf_len = fb->len;
         _jpg_buf = fb->buf;
       }
+      if (fb && ctx->skip && frameSignature(fb, seq, &ctx->sig[0]))
+      {
+        int64_t now = esp_timer_get_time();
+        if (last_sent && now - last_sent < ctx->key_s * 1000000LL &&
+            frameSigDiff(&ctx->sig[0], &ctx->sig[1]) <= ctx->skip)
+        {
+          frameSigSkipped(fb->len);
+          frameSourceRelease(fb);
+          fb = NULL;
+          unchanged++;
+          if (ctx->hb_s && now - last_part >= ctx->hb_s * 1000000LL)
+          {
+            // lets the client tell a still scene from a dead stream
+            size_t hlen = snprintf(part_buf, sizeof(part_buf), _STREAM_HEARTBEAT, seq, unchanged);
+            client.write(_STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
+            client.write((const uint8_t *)part_buf, hlen);
+            frameSigHeartbeat();
+            last_part = now;
+          }
+          if (!client.connected())
+          {
+            Serial.println("Client disconnected");
+            break;
+          }
+          continue;
+        }
+        ctx->sig[1] = ctx->sig[0];
+        last_sent = last_part = now;
+        unchanged = 0;
+        frameSigSent(fb->len);
+      }
+      if (fb && ctx->scale > 1)
+      {
+        // the full frame goes back as soon as the rendition is there
+        rendition = simulcastGet(fb, seq, ctx->scale);
+        frameSourceRelease(fb);
+        fb = NULL;
+        if (!rendition)
+        {
+          // a failed frame: the client may be gone, or scaling keeps failing
+          if (!client.connected() || ++failed >= STREAM_MAX_FAILED)
+          {
+            Serial.println("Rendition failed");
+            break;
+          }
+          continue;
+        }
+        failed = 0;
+        _jpg_buf_len = rendition->len;
+        _jpg_buf = rendition->buf;
+      }
+      else if (fb && ctx->roi)
+      {
+        cropped = roiCropFrame(ctx->roi, fb);
+        frameSourceRelease(fb);
+        fb = NULL;
+        if (!cropped)
+        {
+          if (!client.connected() || ++failed >= STREAM_MAX_FAILED)
+          {
+            Serial.println("Crop failed");
+            break;
+          }
+          continue;
+        }
+        failed = 0;
+        _jpg_buf_len = cropped->len;
+        _jpg_buf = cropped->buf;
+      }
     }
     if (res == ESP_OK)
     {
@@ -572,7 +1097,8 @@ static void stream_handler()
     }
     if (res == ESP_OK)
     {
-      size_t hlen = snprintf((char *)part_buf, 128, _STREAM_PART, _jpg_buf_len, _timestamp.tv_sec, _timestamp.tv_usec);
+      size_t hlen = snprintf(part_buf, sizeof(part_buf), _STREAM_PART, _jpg_buf_len, _timestamp.tv_sec, _timestamp.tv_usec,
+                             seq, queue_us, clockFrameAge(&frame_time));
       // serverCamera.sendContent((const char *)part_buf, hlen);
       client.write((const uint8_t *)part_buf, hlen);
     }
@@ -585,7 +1111,17 @@ static void stream_handler()
       }
       Serial.printf("sent buf %d\n", _jpg_buf_len);
       // serverStream.sendContent((const char *)_jpg_buf, _jpg_buf_len);
+      TraceSpan span("stream.send"); // blocks while lwIP has no room
+      span.arg = _jpg_buf_len;
+      int64_t send_start = esp_timer_get_time();
       client.write((const uint8_t *)_jpg_buf, _jpg_buf_len);
+      uint32_t send_us = esp_timer_get_time() - send_start;
+      admitFrame(ctx->slot, _jpg_buf_len, send_us);
+      if (abr)
+      {
+        abrFrame(_jpg_buf_len, send_us);
+      }
+      frame_span.arg = _jpg_buf_len;
       // check if the client has disconnected
       if (!client.connected())
       {
@@ -599,9 +1135,20 @@ static void stream_handler()
       //        res = ESP_FAIL;
       //      }
     }
-    if (fb)
+    if (rendition)
+    {
+      simulcastRelease(rendition);
+      rendition = NULL;
+      _jpg_buf = NULL;
+    }
+    else if (cropped)
     {
-      esp_camera_fb_return(fb);
+      cropped = NULL;
+      _jpg_buf = NULL;
+    }
+    else if (fb)
+    {
+      frameSourceRelease(fb);
       fb = NULL;
       _jpg_buf = NULL;
     }
@@ -624,9 +1171,99 @@ static void stream_handler()
                   (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time);
   }
 #if CONFIG_LED_ILLUMINATOR_ENABLED
-  isStreaming = false;
-  enable_led(false);
+  portENTER_CRITICAL(&stream_mux);
+  int remaining = --stream_count;
+  portEXIT_CRITICAL(&stream_mux);
+  if (remaining == 0)
+  {
+    isStreaming = false;
+    enable_led(false);
+  }
 #endif
+  if (abr)
+  {
+    abrDetach();
+  }
+  client.stop();
+  admitRelease(ctx->slot);
+  delete[] ctx->sig;
+  roiCropFree(ctx->roi);
+  delete ctx;
+  quiesceTaskEnd();
+  vTaskDelete(NULL);
+}
+
+static void stream_handler()
+{
+  TRACE_SPAN("stream.handler");
+  if (!quiesceTaskBegin())
+  {
+    serverStream.sendHeader("Retry-After", "30");
+    serverStream.send(503, "text/plain", "Firmware update in progress");
+    return;
+  }
+  // /stream[?fps=N][&token=T][&scale=N|&roi=x,y,w,h][&skip[=N][&key=S][&hb=S]]:
+  // the token puts a recorder ahead of viewers; scale picks a 1/2, 1/4 or
+  // 1/8 size rendition (see simulcast.h), roi a region in percent of the
+  // frame instead (see roi_crop.h); skip leaves out frames that did not
+  // change (see frame_sig.h), sending one at least every key seconds and an
+  // empty heartbeat part every hb seconds in between
+  uint32_t fps = serverStream.arg("fps").toInt();
+  int scale = serverStream.hasArg("scale") ? serverStream.arg("scale").toInt() : 1;
+  if (scale != 1 && scale != 2 && scale != 4 && scale != 8)
+  {
+    quiesceTaskEnd();
+    serverStream.send(400, "text/plain", "scale must be 1, 2, 4 or 8");
+    return;
+  }
+  if (serverStream.hasArg("roi") && scale != 1)
+  {
+    quiesceTaskEnd();
+    serverStream.send(400, "text/plain", "roi and scale cannot be combined");
+    return;
+  }
+  roi_crop_t *roi = NULL;
+  if (serverStream.hasArg("roi") && !(roi = roiCropNew(serverStream.arg("roi").c_str())))
+  {
+    quiesceTaskEnd();
+    serverStream.send(400, "text/plain", "roi must be x,y,w,h in percent");
+    return;
+  }
+  uint16_t skip = 0, key_s = FRAME_SIG_DEFAULT_KEY_S, hb_s = 0;
+  if (serverStream.hasArg("skip"))
+  {
+    int val = serverStream.arg("skip").toInt();
+    skip = val > 0 ? min(val, 4096) : FRAME_SIG_DEFAULT_THRESH;
+    if (serverStream.hasArg("key"))
+    {
+      key_s = constrain(serverStream.arg("key").toInt(), 1, 3600);
+    }
+    hb_s = constrain(serverStream.arg("hb").toInt(), 0, 3600);
+  }
+  const char *reason;
+  int slot = admitStream(admitClass(serverStream.arg("token")), fps, &reason);
+  if (slot < 0)
+  {
+    roiCropFree(roi);
+    quiesceTaskEnd();
+    serverStream.sendHeader("Retry-After", String(ADMIT_RETRY_S));
+    serverStream.send(503, "text/plain", String("Stream refused: ") + reason);
+    return;
+  }
+  stream_ctx_t *ctx = new stream_ctx_t{serverStream.client(), slot, fps, skip, key_s, hb_s, NULL, (uint8_t)scale, roi};
+  if (skip)
+  {
+    ctx->sig = new frame_sig_t[2];
+  }
+  if (xTaskCreatePinnedToCore(stream_task, "stream", 4096, ctx, 1, NULL, 1) != pdPASS)
+  {
+    delete[] ctx->sig;
+    roiCropFree(roi);
+    delete ctx;
+    admitRelease(slot);
+    quiesceTaskEnd();
+    serverStream.send(503, "text/plain", "Service Unavailable");
+  }
 }
 
 static void index_handler()
@@ -652,39 +1289,62 @@ void loopServer()
 void update_handler()
 {
   serverCamera.sendHeader("Connection", "close");
-  serverCamera.send(200, "text/plain", (Update.hasError()) ? "FAIL" : "OK");
+  if (Update.hasError() || fwUpdateError()[0])
+  {
+    // the running image stays; nothing to restart for
+    serverCamera.send(500, "text/plain", String("FAIL: ") + fwUpdateError());
+    return;
+  }
+  serverCamera.send(200, "text/plain", "OK");
   ESP.restart();
 }
+// set once fwUpdateBegin accepted the upload and the camera was quiesced
+static bool upload_active;
+
 void upload_handler()
 {
   HTTPUpload &upload = serverCamera.upload();
   if (upload.status == UPLOAD_FILE_START)
   {
     Serial.printf("Update: %s\n", upload.filename.c_str());
-    if (!Update.begin(UPDATE_SIZE_UNKNOWN))
-    { // start with max available size
-      Update.printError(Serial);
+    // a rejected request (no digest, bad hs) must not stop the camera
+    upload_active = fwUpdateBegin(upload.filename, serverCamera.arg("sha256").c_str(), serverCamera.arg("hs").c_str());
+    if (upload_active)
+    {
+      quiesceEnter("http");
     }
   }
+  else if (!upload_active)
+  {
+    // the rest of a rejected upload; update_handler reports the error
+  }
   else if (upload.status == UPLOAD_FILE_WRITE)
   {
     /* flashing firmware to ESP*/
-    if (Update.write(upload.buf, upload.currentSize) != upload.currentSize)
-    {
-      Update.printError(Serial);
-    }
+    fwUpdateWrite(upload.buf, upload.currentSize);
+    otaProgress(upload.totalSize + upload.currentSize, 0); // totalSize lags by this chunk
   }
   else if (upload.status == UPLOAD_FILE_END)
   {
-    if (Update.end(true))
-    { // true to set the size to the current progress
-      Serial.printf("Update Success: %u\nRebooting...\n", upload.totalSize);
+    bool ok = fwUpdateEnd();
+    upload_active = false;
+    otaFinished(ok);
+    if (ok)
+    {
+      Serial.printf("Update: %zu bytes uploaded\nRebooting...\n", upload.totalSize);
     }
     else
     {
-      Update.printError(Serial);
+      quiesceResume();
     }
   }
+  else if (upload.status == UPLOAD_FILE_ABORTED)
+  {
+    fwUpdateAbort();
+    upload_active = false;
+    otaFinished(false);
+    quiesceResume();
+  }
 }
 
 void premeter_save_handler()
@@ -722,6 +1382,11 @@ void startCameraServer()
   serverCamera.on("/capture", HTTP_GET, capture_handler);
   serverCamera.on("/xclk", HTTP_GET, xclk_handler);
   serverCamera.on("/reg", HTTP_GET, reg_handler);
+  serverCamera.on("/regs", HTTP_ANY, regs_handler);
+  serverCamera.on("/profile", HTTP_GET, profile_handler);
+  serverCamera.on("/metrics", HTTP_GET, metrics_handler);
+  serverCamera.on("/trace", HTTP_GET, trace_handler);
+  serverCamera.on("/store", HTTP_GET, store_handler);
   serverCamera.on("/greg", HTTP_GET, greg_handler);
   serverCamera.on("/pll", HTTP_GET, pll_handler);
   serverCamera.on("/resolution", HTTP_GET, win_handler);
@@ -737,6 +1402,17 @@ void startCameraServer()
     Serial.println("An Error has occurred while mounting SPIFFS");
     return;
   }
+  imgStoreBegin();
+}
+// Called after a WiFi outage: the listening sockets do not survive the
+// netif going down, so reopen them.
+void restartCameraServer()
+{
+  serverCamera.close();
+  serverStream.close();
+  serverCamera.begin();
+  serverStream.begin();
+  Serial.println("Web Server restarted");
 }
 void setupLedFlash(int pin)
 {
@@ -0,0 +1,68 @@
+#pragma once
+#include "esp_camera.h"
+
+// The selected board as one constant: its pin set and how the sensor is
+// mounted. Built from the macros camera_pins.h defines for the chosen
+// CAMERA_MODEL_*; include that first.
+
+#ifndef BOARD_VFLIP
+#define BOARD_VFLIP 0
+#endif
+#ifndef BOARD_HMIRROR
+#define BOARD_HMIRROR 0
+#endif
+
+typedef struct
+{
+  int8_t d[8]; // D0..D7 (Y2..Y9)
+  int8_t xclk, pclk, vsync, href;
+  int8_t sda, scl, pwdn, reset;
+  bool vflip, hmirror; // sensor mounted upside down / mirrored
+} camera_board_t;
+
+static constexpr camera_board_t camera_board = {
+    {Y2_GPIO_NUM, Y3_GPIO_NUM, Y4_GPIO_NUM, Y5_GPIO_NUM, Y6_GPIO_NUM, Y7_GPIO_NUM, Y8_GPIO_NUM, Y9_GPIO_NUM},
+    XCLK_GPIO_NUM,
+    PCLK_GPIO_NUM,
+    VSYNC_GPIO_NUM,
+    HREF_GPIO_NUM,
+    SIOD_GPIO_NUM,
+    SIOC_GPIO_NUM,
+    PWDN_GPIO_NUM,
+    RESET_GPIO_NUM,
+    BOARD_VFLIP != 0,
+    BOARD_HMIRROR != 0,
+};
+
+static inline void boardConfig(camera_config_t *config, const camera_board_t &b)
+{
+  config->pin_d0 = b.d[0];
+  config->pin_d1 = b.d[1];
+  config->pin_d2 = b.d[2];
+  config->pin_d3 = b.d[3];
+  config->pin_d4 = b.d[4];
+  config->pin_d5 = b.d[5];
+  config->pin_d6 = b.d[6];
+  config->pin_d7 = b.d[7];
+  config->pin_xclk = b.xclk;
+  config->pin_pclk = b.pclk;
+  config->pin_vsync = b.vsync;
+  config->pin_href = b.href;
+  config->pin_sccb_sda = b.sda;
+  config->pin_sccb_scl = b.scl;
+  config->pin_pwdn = b.pwdn;
+  config->pin_reset = b.reset;
+}
+
+// Undo the board's mounting; after the sensor's own tuning
+static inline void boardApplyDefaults(sensor_t *s, const camera_board_t &b)
+{
+  if (b.vflip)
+  {
+    s->set_vflip(s, 1);
+  }
+  if (b.hmirror)
+  {
+    s->set_hmirror(s, 1);
+  }
+}
@@ -0,0 +1,61 @@
+#include "boot_timing.h"
+
+typedef struct
+{
+  const char *name;
+  int64_t us;
+} boot_phase_t;
+
+static boot_phase_t boot_phases[BOOT_PHASES_MAX];
+static int boot_phase_count = 0;
+static portMUX_TYPE boot_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool first_frame_seen = false;
+
+void bootMark(const char *phase)
+{
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&boot_mux);
+  if (boot_phase_count < BOOT_PHASES_MAX)
+  {
+    boot_phases[boot_phase_count].name = phase;
+    boot_phases[boot_phase_count].us = now;
+    boot_phase_count++;
+  }
+  portEXIT_CRITICAL(&boot_mux);
+}
+
+void bootFirstFrame()
+{
+  if (first_frame_seen)
+  {
+    return;
+  }
+  first_frame_seen = true;
+  bootMark("first_frame");
+  Serial.printf("Time to first frame: %ums\n", (uint32_t)(esp_timer_get_time() / 1000));
+}
+
+void bootTimingPrint()
+{
+  int64_t prev = 0;
+  for (int i = 0; i < boot_phase_count; i++)
+  {
+    Serial.printf("Boot %-12s %7ums (+%ums)\n", boot_phases[i].name,
+                  (uint32_t)(boot_phases[i].us / 1000), (uint32_t)((boot_phases[i].us - prev) / 1000));
+    prev = boot_phases[i].us;
+  }
+}
+
+int bootTimingJson(char *p, size_t len)
+{
+  int n = snprintf(p, len, "\"boot\":{");
+  for (int i = 0; i < boot_phase_count && n < (int)len; i++)
+  {
+    n += snprintf(p + n, len - n, "%s\"%s\":%lld", i ? "," : "", boot_phases[i].name, (long long)boot_phases[i].us);
+  }
+  if (n < (int)len)
+  {
+    n += snprintf(p + n, len - n, "}");
+  }
+  return n;
+}
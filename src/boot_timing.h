@@ -0,0 +1,16 @@
+#pragma once
+#include <Arduino.h>
+
+// Boot phase timestamps (esp_timer, i.e. microseconds since the app started;
+// ROM and second stage bootloader time is not included).
+
+#define BOOT_PHASES_MAX 12
+
+// Record the end of a phase; name must be a string literal
+void bootMark(const char *phase);
+// Marks "first_frame" the first time a frame is handed to a client
+void bootFirstFrame();
+// Print the recorded phases with their deltas
+void bootTimingPrint();
+// "boot":{"phase":us,...}
+int bootTimingJson(char *p, size_t len);
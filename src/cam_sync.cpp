@@ -0,0 +1,377 @@
+#include "cam_sync.h"
+#include <Preferences.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "frame_source.h"
+#include "img_store.h"
+
+typedef struct
+{
+  int64_t local; // node clock when the pong came back
+  int64_t offset;
+  uint32_t rtt;
+} sync_sample_t;
+
+static WiFiUDP udp;
+static bool enabled = false;
+static bool loaded = false;
+static TaskHandle_t sync_task_handle = NULL;
+
+static IPAddress leader_ip;
+static uint16_t leader_port = 0;
+static uint32_t leader_seen = 0;
+static uint32_t ping_id = 0;
+static int64_t ping_sent = 0;
+static uint32_t last_ping = 0;
+
+static sync_sample_t samples[SYNC_SAMPLES];
+static uint32_t sample_count = 0;
+// current estimate: shared = local + base_offset + drift * (local - base_local)
+static portMUX_TYPE est_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool locked = false;
+static int64_t base_local = 0, base_offset = 0;
+static float drift = 0; // us per us
+static uint32_t best_rtt = 0;
+
+static bool trigger_pending = false;
+static uint32_t trigger_id = 0;
+static int64_t trigger_fire = 0; // shared epoch
+static uint32_t triggers = 0;
+static int32_t last_error_us = 0;
+static uint32_t last_trigger_id = 0, last_store_seq = 0;
+
+static void load_config()
+{
+  Preferences prefs;
+  enabled = false;
+  if (prefs.begin("sync", true))
+  {
+    enabled = prefs.getBool("enable", false);
+    prefs.end();
+  }
+  loaded = true;
+}
+
+static int64_t tv_us(const struct timeval *tv)
+{
+  return (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+static int64_t offset_at(int64_t local)
+{
+  portENTER_CRITICAL(&est_mux);
+  int64_t off = base_offset + (int64_t)(drift * (local - base_local));
+  portEXIT_CRITICAL(&est_mux);
+  return off;
+}
+
+// Offset of the fastest exchange, plus the drift fitted through the samples
+// that were nearly as fast
+static void update_estimate()
+{
+  int n = min(sample_count, (uint32_t)SYNC_SAMPLES);
+  const sync_sample_t *best = &samples[0];
+  for (int i = 1; i < n; i++)
+  {
+    if (samples[i].rtt < best->rtt)
+    {
+      best = &samples[i];
+    }
+  }
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  int m = 0;
+  for (int i = 0; i < n; i++)
+  {
+    if (samples[i].rtt <= best->rtt * 2 + 1000)
+    {
+      double x = (samples[i].local - best->local) / 1e6;
+      double y = (double)(samples[i].offset - best->offset);
+      sx += x;
+      sy += y;
+      sxx += x * x;
+      sxy += x * y;
+      m++;
+    }
+  }
+  float ppm = 0;
+  double den = m * sxx - sx * sx;
+  if (m >= 3 && den > 1.0)
+  {
+    ppm = constrain((m * sxy - sx * sy) / den, -SYNC_MAX_DRIFT_PPM, SYNC_MAX_DRIFT_PPM);
+  }
+  portENTER_CRITICAL(&est_mux);
+  base_local = best->local;
+  base_offset = best->offset;
+  drift = ppm / 1e6f;
+  best_rtt = best->rtt;
+  locked = n >= SYNC_MIN_SAMPLES && best->rtt <= SYNC_MAX_RTT_US;
+  portEXIT_CRITICAL(&est_mux);
+}
+
+static void send_msg(sync_msg_t *msg)
+{
+  msg->magic = SYNC_MAGIC;
+  udp.beginPacket(leader_ip, leader_port);
+  udp.write((const uint8_t *)msg, sizeof(*msg));
+  udp.endPacket();
+}
+
+static bool receive(sync_msg_t *msg, int64_t *at)
+{
+  if (udp.parsePacket() != sizeof(*msg))
+  {
+    return false;
+  }
+  *at = esp_timer_get_time();
+  udp.read((uint8_t *)msg, sizeof(*msg));
+  return msg->magic == SYNC_MAGIC;
+}
+
+static void on_pong(const sync_msg_t *msg, int64_t t4)
+{
+  if (msg->id != ping_id || msg->t[0] != ping_sent)
+  {
+    return; // an answer to a ping we gave up on
+  }
+  int64_t t1 = msg->t[0], t2 = msg->t[1], t3 = msg->t[2];
+  sync_sample_t *s = &samples[sample_count++ % SYNC_SAMPLES];
+  s->local = t4;
+  s->offset = ((t2 - t1) + (t3 - t4)) / 2;
+  s->rtt = (uint32_t)max((int64_t)0, (t4 - t1) - (t3 - t2));
+  ping_sent = 0;
+  update_estimate();
+}
+
+static void handle(const sync_msg_t *msg, int64_t at)
+{
+  switch (msg->type)
+  {
+  case SYNC_BEACON:
+    if (udp.remoteIP() != leader_ip || udp.remotePort() != leader_port)
+    {
+      Serial.printf("Sync: leader %s:%u\n", udp.remoteIP().toString().c_str(), udp.remotePort());
+      leader_ip = udp.remoteIP();
+      leader_port = udp.remotePort();
+      sample_count = 0;
+      portENTER_CRITICAL(&est_mux);
+      locked = false;
+      portEXIT_CRITICAL(&est_mux);
+    }
+    leader_seen = millis();
+    break;
+  case SYNC_PONG:
+    on_pong(msg, at);
+    break;
+  case SYNC_TRIGGER:
+    trigger_pending = true;
+    trigger_id = msg->id;
+    trigger_fire = msg->t[0];
+    break;
+  }
+}
+
+static void ping()
+{
+  sync_msg_t msg = {};
+  msg.type = SYNC_PING;
+  msg.id = ++ping_id;
+  msg.t[0] = ping_sent = esp_timer_get_time();
+  send_msg(&msg);
+  last_ping = millis();
+  // the receive time is half of the sample, so poll for it instead of sleeping
+  while (millis() - last_ping < SYNC_PONG_TIMEOUT_MS && ping_sent)
+  {
+    sync_msg_t in;
+    int64_t at;
+    if (receive(&in, &at))
+    {
+      handle(&in, at);
+    }
+    else
+    {
+      taskYIELD();
+    }
+  }
+}
+
+static void capture_trigger()
+{
+  sync_msg_t msg = {};
+  msg.type = SYNC_REPORT;
+  msg.id = trigger_id;
+  msg.t[0] = trigger_fire;
+  trigger_pending = false;
+  if (!syncLocked())
+  {
+    msg.flags = SYNC_F_UNSYNCED;
+    send_msg(&msg);
+    return;
+  }
+  int64_t fire = trigger_fire - offset_at(esp_timer_get_time());
+  int64_t wait = fire - SYNC_ARM_US - esp_timer_get_time();
+  if (wait > 0)
+  {
+    delay(wait / 1000);
+  }
+  // fresh frames until the first one past the fire time minus half a
+  // period: the frame closest to it
+  camera_fb_t *fb = NULL;
+  int64_t prev = 0, period = 0;
+  uint32_t start = millis();
+  while ((fb = frameSourceGet(NULL)) != NULL)
+  {
+    int64_t ts = tv_us(&fb->timestamp);
+    period = prev ? ts - prev : period;
+    prev = ts;
+    if (ts >= fire - period / 2 || millis() - start > 1000)
+    {
+      break;
+    }
+    frameSourceRelease(fb);
+  }
+  if (!fb)
+  {
+    msg.flags = SYNC_F_FAILED;
+    send_msg(&msg);
+    return;
+  }
+  struct timeval shared;
+  syncTimestamp(&fb->timestamp, &shared);
+  msg.t[1] = tv_us(&shared);
+  msg.t[2] = offset_at(tv_us(&fb->timestamp));
+  msg.a = fb->len;
+  uint32_t seq;
+  if (fb->format == PIXFORMAT_JPEG && imgStoreMounted() &&
+      imgStoreAppend(fb->buf, fb->len, &shared, &seq) == ESP_OK)
+  {
+    msg.flags |= SYNC_F_STORED;
+    msg.b = last_store_seq = seq;
+  }
+  frameSourceRelease(fb);
+  send_msg(&msg);
+  triggers++;
+  last_trigger_id = msg.id;
+  last_error_us = (int32_t)(msg.t[1] - msg.t[0]);
+  Serial.printf("Sync: trigger %u frame %+dus from fire time\n", msg.id, last_error_us);
+}
+
+static void sync_task(void *arg)
+{
+  bool open = false;
+  while (true)
+  {
+    if (!enabled || !WiFi.isConnected())
+    {
+      if (open)
+      {
+        udp.stop();
+        open = false;
+        leader_port = 0;
+        portENTER_CRITICAL(&est_mux);
+        locked = false;
+        portEXIT_CRITICAL(&est_mux);
+      }
+      delay(500);
+      continue;
+    }
+    if (!open)
+    {
+      open = udp.begin(SYNC_PORT);
+      if (!open)
+      {
+        delay(1000);
+        continue;
+      }
+    }
+    sync_msg_t msg;
+    int64_t at;
+    if (receive(&msg, &at))
+    {
+      handle(&msg, at);
+      continue;
+    }
+    if (leader_port && millis() - leader_seen > SYNC_STALE_MS)
+    {
+      Serial.println("Sync: leader lost");
+      leader_port = 0;
+      portENTER_CRITICAL(&est_mux);
+      locked = false;
+      portEXIT_CRITICAL(&est_mux);
+    }
+    if (trigger_pending && leader_port)
+    {
+      capture_trigger();
+      continue;
+    }
+    uint32_t interval = syncLocked() ? SYNC_PING_MS : SYNC_ACQUIRE_PING_MS;
+    if (leader_port && millis() - last_ping >= interval)
+    {
+      ping();
+    }
+    delay(1);
+  }
+}
+
+void syncBegin()
+{
+  if (!loaded)
+  {
+    load_config();
+  }
+  if (!sync_task_handle)
+  {
+    xTaskCreatePinnedToCore(sync_task, "sync", 4096, NULL, 2, &sync_task_handle, 0);
+  }
+}
+
+bool syncLocked()
+{
+  portENTER_CRITICAL(&est_mux);
+  bool l = locked;
+  portEXIT_CRITICAL(&est_mux);
+  return l;
+}
+
+bool syncTimestamp(const struct timeval *local, struct timeval *shared)
+{
+  if (!syncLocked())
+  {
+    *shared = *local;
+    return false;
+  }
+  int64_t us = tv_us(local);
+  us += offset_at(us);
+  shared->tv_sec = us / 1000000;
+  shared->tv_usec = us % 1000000;
+  return true;
+}
+
+int syncSet(const String &var, const String &value)
+{
+  Preferences prefs;
+  if (!var.equals("sync") || !prefs.begin("sync", false))
+  {
+    return -1;
+  }
+  prefs.putBool("enable", value.toInt() != 0);
+  prefs.end();
+  load_config();
+  return 0;
+}
+
+int syncMetricsJson(char *p, size_t len)
+{
+  portENTER_CRITICAL(&est_mux);
+  bool l = locked;
+  int64_t off = base_offset;
+  float ppm = drift * 1e6f;
+  uint32_t rtt = best_rtt;
+  portEXIT_CRITICAL(&est_mux);
+  return snprintf(p, len,
+                  "\"sync\":{\"enabled\":%u,\"locked\":%u,\"leader\":\"%s\",\"offset_us\":%lld,\"rtt_us\":%u,"
+                  "\"drift_ppm\":%.2f,\"samples\":%u,\"triggers\":%u,\"last_id\":%u,\"last_error_us\":%d,\"last_seq\":%u}",
+                  enabled, l, leader_port ? leader_ip.toString().c_str() : "", (long long)off, rtt,
+                  ppm, sample_count, triggers, last_trigger_id, last_error_us, last_store_seq);
+}
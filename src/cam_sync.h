@@ -0,0 +1,39 @@
+#pragma once
+#include <Arduino.h>
+#include <sys/time.h>
+#include "sync_proto.h"
+
+// Synchronized capture across several boards. A leader (tools/syncleader
+// on a Linux host) beacons on UDP; each node pings it and estimates the
+// offset from its boot-relative clock to the leader's with the NTP
+// four-timestamp exchange, keeping the lowest-delay samples and the drift
+// between them. A broadcast trigger names a fire time on the leader's
+// clock: the node arms ahead of it, takes the frame nearest that instant,
+// appends it to the image store with its shared-epoch timestamp and
+// reports back, so the leader can tell how far apart the frames are.
+//
+// The sensors free-run, so a frame is at best half a frame period from the
+// fire time; the report shows that residual per node. While the offset is
+// locked every X-Timestamp (/capture, /bmp, /stream, /store) is on the
+// shared epoch too. Enabled through /control with sync=0/1.
+
+#define SYNC_SAMPLES 8          // offset samples kept
+#define SYNC_MIN_SAMPLES 4      // before the estimate counts as locked
+#define SYNC_PING_MS 1000       // once locked; faster while acquiring
+#define SYNC_ACQUIRE_PING_MS 200
+#define SYNC_PONG_TIMEOUT_MS 50 // polled without sleeping meanwhile
+#define SYNC_MAX_RTT_US 20000   // slower exchanges say little about the offset
+#define SYNC_STALE_MS 5000      // leader silent this long: unlocked
+#define SYNC_ARM_US 100000      // start pulling frames this early
+#define SYNC_MAX_DRIFT_PPM 200
+
+// Start the sync task; call once the station is up
+void syncBegin();
+bool syncLocked();
+// Boot-relative frame timestamp to the shared epoch; copied unchanged
+// (and false) while not locked
+bool syncTimestamp(const struct timeval *local, struct timeval *shared);
+// Handle the sync /control variable; -1 if invalid
+int syncSet(const String &var, const String &value);
+// "sync":{...}
+int syncMetricsJson(char *p, size_t len);
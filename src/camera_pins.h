@@ -98,6 +98,9 @@
 
 #define LED_GPIO_NUM       2
 
+#define BOARD_VFLIP        1
+#define BOARD_HMIRROR      1
+
 #elif defined(CAMERA_MODEL_M5STACK_ESP32CAM)
 #define PWDN_GPIO_NUM     -1
 #define RESET_GPIO_NUM    15
@@ -117,6 +120,9 @@
 #define HREF_GPIO_NUM     26
 #define PCLK_GPIO_NUM     21
 
+#define BOARD_VFLIP        1
+#define BOARD_HMIRROR      1
+
 #elif defined(CAMERA_MODEL_M5STACK_UNITCAM)
 #define PWDN_GPIO_NUM     -1
 #define RESET_GPIO_NUM    15
@@ -293,6 +299,8 @@
 #define HREF_GPIO_NUM 7
 #define PCLK_GPIO_NUM 13
 
+#define BOARD_VFLIP 1
+
 #elif defined(CAMERA_MODEL_DFRobot_FireBeetle2_ESP32S3) || defined(CAMERA_MODEL_DFRobot_Romeo_ESP32S3)
 #define PWDN_GPIO_NUM     -1
 #define RESET_GPIO_NUM    -1
@@ -0,0 +1,421 @@
+#include "ctrl_channel.h"
+#include <WiFi.h>
+#include "esp_camera.h"
+#include "esp32-hal-ledc.h"
+#include "profiles.h"
+#include "quiesce.h"
+#include "reg_batch.h"
+
+#define CTRL_TX_MAX 1024
+
+typedef struct
+{
+  WiFiClient client;
+  bool subscribed;
+  uint16_t rx_len;
+  uint8_t rx[2 + CTRL_MAX_MSG];
+} ctrl_client_t;
+
+static WiFiServer server(CTRL_PORT, CTRL_MAX_CLIENTS);
+static ctrl_client_t clients[CTRL_MAX_CLIENTS];
+static QueueHandle_t notify_queue = NULL;
+static volatile uint32_t subscribers = 0;
+static TaskHandle_t ctrl_task_handle = NULL;
+static volatile bool restart = false;
+
+// replies to one client, written once per pass
+static uint8_t tx[CTRL_TX_MAX];
+static size_t tx_len = 0;
+
+static uint32_t connections = 0, refused = 0, requests = 0, errors = 0;
+static uint32_t notifies = 0, notify_dropped = 0;
+
+static void flush(ctrl_client_t *c)
+{
+  if (tx_len && c->client.write(tx, tx_len) != tx_len)
+  {
+    c->client.stop();
+  }
+  tx_len = 0;
+}
+
+static void put(ctrl_client_t *c, const void *data, size_t len)
+{
+  if (tx_len + len > sizeof(tx))
+  {
+    flush(c);
+  }
+  memcpy(tx + tx_len, data, len);
+  tx_len += len;
+}
+
+static void put_i16(uint8_t **p, int16_t v)
+{
+  memcpy(*p, &v, 2);
+  *p += 2;
+}
+
+static void reply(ctrl_client_t *c, uint8_t op, uint16_t id, const uint8_t *body, size_t len)
+{
+  ctrl_hdr_t hdr = {(uint16_t)(sizeof(hdr) - 2 + len), (uint8_t)(op | CTRL_REPLY), 0, id};
+  put(c, &hdr, sizeof(hdr));
+  put(c, body, len);
+}
+
+// Body bytes of a single op, -1 if it has no fixed size
+static int body_len(uint8_t op)
+{
+  switch (op)
+  {
+  case CTRL_GET:
+  case CTRL_XCLK:
+  case CTRL_SUBSCRIBE:
+    return 1;
+  case CTRL_SET:
+  case CTRL_REG_READ:
+    return 3;
+  case CTRL_REG_WRITE:
+    return 4;
+  case CTRL_NAMES:
+    return 0;
+  }
+  return -1;
+}
+
+// GET, SET, REG_READ, REG_WRITE or XCLK; *value is set by the reads
+static int16_t run_op(sensor_t *s, uint8_t op, const uint8_t *b, int16_t *value)
+{
+  uint16_t reg = b[0] | b[1] << 8;
+  int res;
+  switch (op)
+  {
+  case CTRL_GET:
+    if (!camSettingName(b[0]))
+    {
+      return CTRL_E_ARG;
+    }
+    *value = camSettingGet(s, b[0]);
+    return CTRL_OK;
+  case CTRL_SET:
+    if (!camSettingName(b[0]))
+    {
+      return CTRL_E_ARG;
+    }
+    return camSettingSet(s, b[0], (int16_t)(b[1] | b[2] << 8)) ? CTRL_E_FAILED : CTRL_OK;
+  case CTRL_REG_READ:
+    res = s->get_reg(s, reg, b[2]);
+    if (res < 0)
+    {
+      return CTRL_E_FAILED;
+    }
+    *value = res;
+    return CTRL_OK;
+  case CTRL_REG_WRITE:
+    if (s->set_reg(s, reg, b[2], b[3]))
+    {
+      return CTRL_E_FAILED;
+    }
+    ctrlNotify(CTRL_N_REG, reg, b[2], b[3] & b[2]);
+    return CTRL_OK;
+  case CTRL_XCLK:
+    return s->set_xclk(s, LEDC_TIMER_0, b[0]) ? CTRL_E_FAILED : CTRL_OK;
+  }
+  return CTRL_E_OP;
+}
+
+static void run_batch(ctrl_client_t *c, uint16_t id, const uint8_t *b, size_t len)
+{
+  uint8_t out[3 + CTRL_BATCH_MAX * 2], *p = out + 2;
+  uint8_t n = len ? b[0] : 0;
+  // check the whole batch before touching the sensor, counting the
+  // register writes it makes
+  bool framesize = false;
+  int writes = 0;
+  size_t off = 1;
+  for (int i = 0; i < n && off <= len; i++)
+  {
+    uint8_t op = off < len ? b[off] : 0;
+    if (op != CTRL_GET && op != CTRL_SET && op != CTRL_REG_READ && op != CTRL_REG_WRITE)
+    {
+      off = len + 1;
+      break;
+    }
+    if (op == CTRL_SET && off + 1 < len && camSettingName(b[off + 1]))
+    {
+      framesize |= b[off + 1] == CAM_FRAMESIZE;
+      writes += camSettingWrites(b[off + 1]);
+    }
+    writes += op == CTRL_REG_WRITE;
+    off += 1 + body_len(op);
+  }
+  if (!len || n > CTRL_BATCH_MAX || off != len)
+  {
+    put_i16(&p, CTRL_E_ARG);
+    reply(c, CTRL_BATCH, id, out + 2, 2);
+    return;
+  }
+  SensorLock lock;
+  sensor_t *s = quiesceActive() ? NULL : esp_camera_sensor_get();
+  if (!s)
+  {
+    errors++;
+    put_i16(&p, CTRL_E_FAILED);
+    reply(c, CTRL_BATCH, id, out + 2, 2);
+    return;
+  }
+  // a frame size change reprograms the whole sensor and cannot be latched;
+  // like /regs, a batch larger than the hold buffer goes in unlatched
+  bool hold = !framesize && writes > 1 && writes <= REG_GROUP_HOLD_MAX && groupHoldBegin(s);
+  int16_t status = CTRL_OK;
+  *p++ = n;
+  off = 1;
+  for (int i = 0; i < n; i++)
+  {
+    int16_t value = 0;
+    int16_t res = run_op(s, b[off], b + off + 1, &value);
+    if (res && !status)
+    {
+      status = res;
+    }
+    put_i16(&p, res ? res : value);
+    off += 1 + body_len(b[off]);
+  }
+  if (hold)
+  {
+    groupHoldEnd(s, true);
+  }
+  errors += status != CTRL_OK;
+  memcpy(out, &status, 2);
+  reply(c, CTRL_BATCH, id, out, p - out);
+}
+
+static void send_names(ctrl_client_t *c, uint16_t id)
+{
+  uint8_t out[3 + CAM_SETTING_COUNT * 18], *p = out;
+  put_i16(&p, CTRL_OK);
+  *p++ = CAM_SETTING_COUNT;
+  for (int i = 0; i < CAM_SETTING_COUNT; i++)
+  {
+    const char *name = camSettingName(i);
+    uint8_t n = min(strlen(name), (size_t)16);
+    *p++ = i;
+    *p++ = n;
+    memcpy(p, name, n);
+    p += n;
+  }
+  reply(c, CTRL_NAMES, id, out, p - out);
+}
+
+static void handle(ctrl_client_t *c, const uint8_t *msg)
+{
+  ctrl_hdr_t hdr;
+  memcpy(&hdr, msg, sizeof(hdr));
+  const uint8_t *body = msg + sizeof(hdr);
+  size_t len = hdr.len + 2 - sizeof(hdr);
+  requests++;
+  if (hdr.op == CTRL_BATCH)
+  {
+    run_batch(c, hdr.id, body, len);
+    return;
+  }
+  uint8_t out[4], *p = out;
+  int16_t value = 0, status;
+  if (body_len(hdr.op) != (int)len)
+  {
+    status = body_len(hdr.op) < 0 ? CTRL_E_OP : CTRL_E_ARG;
+  }
+  else if (hdr.op == CTRL_NAMES)
+  {
+    send_names(c, hdr.id);
+    return;
+  }
+  else if (hdr.op == CTRL_SUBSCRIBE)
+  {
+    if (c->subscribed != (body[0] != 0))
+    {
+      c->subscribed = body[0] != 0;
+      subscribers += c->subscribed ? 1 : -1;
+    }
+    status = CTRL_OK;
+  }
+  else
+  {
+    SensorLock lock;
+    sensor_t *s = quiesceActive() ? NULL : esp_camera_sensor_get();
+    status = s ? run_op(s, hdr.op, body, &value) : CTRL_E_FAILED;
+  }
+  errors += status != CTRL_OK;
+  put_i16(&p, status);
+  if (hdr.op == CTRL_GET || hdr.op == CTRL_REG_READ)
+  {
+    put_i16(&p, value);
+  }
+  reply(c, hdr.op, hdr.id, out, p - out);
+}
+
+static void drop(ctrl_client_t *c)
+{
+  c->client.stop();
+  if (c->subscribed)
+  {
+    c->subscribed = false;
+    subscribers--;
+  }
+  c->rx_len = 0;
+}
+
+// Read what arrived and answer every complete request; true if any did
+static bool serve(ctrl_client_t *c)
+{
+  int avail = c->client.available();
+  if (avail <= 0)
+  {
+    return false;
+  }
+  int n = c->client.read(c->rx + c->rx_len, min((size_t)avail, sizeof(c->rx) - c->rx_len));
+  if (n <= 0)
+  {
+    return false;
+  }
+  c->rx_len += n;
+  size_t off = 0;
+  while (c->rx_len - off >= 2)
+  {
+    uint16_t len = c->rx[off] | c->rx[off + 1] << 8;
+    if (len < sizeof(ctrl_hdr_t) - 2 || len > CTRL_MAX_MSG)
+    {
+      Serial.printf("Control channel: bad message length %u\n", len);
+      tx_len = 0;
+      drop(c);
+      return true;
+    }
+    if (c->rx_len - off < 2u + len)
+    {
+      break;
+    }
+    handle(c, c->rx + off);
+    off += 2 + len;
+  }
+  memmove(c->rx, c->rx + off, c->rx_len - off);
+  c->rx_len -= off;
+  flush(c);
+  return true;
+}
+
+static void accept_client()
+{
+  WiFiClient client = server.available();
+  if (!client)
+  {
+    return;
+  }
+  for (ctrl_client_t &c : clients)
+  {
+    if (!c.client.connected())
+    {
+      drop(&c);
+      c.client = client;
+      c.client.setNoDelay(true);
+      connections++;
+      return;
+    }
+  }
+  refused++;
+  client.stop();
+}
+
+static void send_notifies()
+{
+  ctrl_notify_t n;
+  while (xQueueReceive(notify_queue, &n, 0) == pdTRUE)
+  {
+    uint8_t msg[sizeof(ctrl_hdr_t) + sizeof(n)];
+    ctrl_hdr_t hdr = {(uint16_t)(sizeof(msg) - 2), CTRL_NOTIFY, 0, 0};
+    memcpy(msg, &hdr, sizeof(hdr));
+    memcpy(msg + sizeof(hdr), &n, sizeof(n));
+    for (ctrl_client_t &c : clients)
+    {
+      if (c.subscribed && c.client.connected())
+      {
+        c.client.write(msg, sizeof(msg));
+      }
+    }
+    notifies++;
+  }
+}
+
+static void ctrl_task(void *arg)
+{
+  while (true)
+  {
+    if (restart)
+    {
+      restart = false;
+      server.close();
+      server.begin();
+      server.setNoDelay(true);
+      Serial.println("Control channel restarted");
+    }
+    accept_client();
+    bool busy = false;
+    for (ctrl_client_t &c : clients)
+    {
+      if (c.client.connected())
+      {
+        busy |= serve(&c);
+      }
+      else if (c.subscribed || c.rx_len)
+      {
+        drop(&c);
+      }
+    }
+    send_notifies();
+    if (!busy)
+    {
+      delay(1);
+    }
+  }
+}
+
+void ctrlBegin()
+{
+  if (ctrl_task_handle)
+  {
+    return;
+  }
+  notify_queue = xQueueCreate(CTRL_NOTIFY_QUEUE, sizeof(ctrl_notify_t));
+  server.begin();
+  server.setNoDelay(true);
+  xTaskCreatePinnedToCore(ctrl_task, "ctrl", 4096, NULL, 2, &ctrl_task_handle, 1);
+}
+
+void ctrlRestart()
+{
+  restart = ctrl_task_handle != NULL;
+}
+
+void ctrlNotify(uint8_t kind, uint16_t key, uint8_t mask, int16_t value)
+{
+  if (!notify_queue || !subscribers)
+  {
+    return;
+  }
+  ctrl_notify_t n = {kind, key, mask, value};
+  if (xQueueSend(notify_queue, &n, 0) != pdTRUE)
+  {
+    notify_dropped++;
+  }
+}
+
+int ctrlMetricsJson(char *p, size_t len)
+{
+  int open = 0;
+  for (ctrl_client_t &c : clients)
+  {
+    open += c.client.connected() ? 1 : 0;
+  }
+  return snprintf(p, len,
+                  "\"ctrl\":{\"clients\":%d,\"subscribers\":%u,\"connections\":%u,\"refused\":%u,\"requests\":%u,"
+                  "\"errors\":%u,\"notifies\":%u,\"notify_dropped\":%u}",
+                  open, subscribers, connections, refused, requests, errors, notifies, notify_dropped);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+#include "ctrl_proto.h"
+
+// Persistent binary control channel on CTRL_PORT, for clients that adjust
+// the sensor continuously (focus/exposure loops, rigs driving several
+// boards) and cannot afford an HTTP request per change. One task serves up
+// to CTRL_MAX_CLIENTS connections; requests are length-prefixed, carry an
+// id, may be pipelined, and each read from a socket is answered with one
+// write. A BATCH carries at most CTRL_BATCH_MAX ops and is latched in one
+// group hold when its register writes fit in REG_GROUP_HOLD_MAX. The same
+// settings table as /control and profiles is used, and subscribed clients
+// are told about every change made through any path.
+
+#define CTRL_MAX_CLIENTS 4
+#define CTRL_BATCH_MAX 32
+#define CTRL_NOTIFY_QUEUE 32
+
+// Start the listener and its task
+void ctrlBegin();
+// Reopen the listener after a WiFi outage (done by the task on its next
+// pass); clients whose sockets died are dropped as usual
+void ctrlRestart();
+// Tell subscribers a setting or register changed; safe from any task,
+// dropped when the queue is full
+void ctrlNotify(uint8_t kind, uint16_t key, uint8_t mask, int16_t value);
+// "ctrl":{...}
+int ctrlMetricsJson(char *p, size_t len);
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+
+// Wire format of the binary control channel (see ctrl_channel.h), shared
+// with tools/camctl.cpp. Little-endian throughout. Every message is a
+// ctrl_hdr_t followed by len - 4 body bytes (len counts everything after
+// the len field itself).
+//
+//   request                      body                      reply body
+//   GET        setting            u8 id                     i16 status, i16 value
+//   SET        setting            u8 id, i16 value          i16 status
+//   REG_READ   sensor register    u16 reg, u8 mask          i16 status, i16 value
+//   REG_WRITE  sensor register    u16 reg, u8 mask, u8 val  i16 status
+//   XCLK       clock, MHz         u8 mhz                    i16 status
+//   BATCH      ops in one hold    u8 n, n x (u8 op, body)   i16 status, u8 n, n x i16
+//   SUBSCRIBE  notifications      u8 on                     i16 status
+//   NAMES      setting table      -                         i16 status, u8 n,
+//                                                           n x (u8 id, u8 len, name)
+//
+// A reply carries op | CTRL_REPLY and the request's id; requests may be
+// pipelined and are answered in order. status is 0 or negative. BATCH
+// entries are GET, SET, REG_READ or REG_WRITE; each result is the value
+// read or the write status. A subscribed client also receives NOTIFY (id 0)
+// whenever a setting or register changes, from any control path.
+
+#define CTRL_PORT 82
+#define CTRL_MAX_MSG 512 // len limit; a longer message closes the connection
+
+enum
+{
+  CTRL_GET = 1,
+  CTRL_SET,
+  CTRL_REG_READ,
+  CTRL_REG_WRITE,
+  CTRL_XCLK,
+  CTRL_BATCH,
+  CTRL_SUBSCRIBE,
+  CTRL_NAMES,
+  CTRL_NOTIFY = 0x40,
+  CTRL_REPLY = 0x80,
+};
+
+// status
+#define CTRL_OK 0
+#define CTRL_E_FAILED -1 // the sensor call failed
+#define CTRL_E_ARG -2    // unknown setting, or a malformed body
+#define CTRL_E_OP -3     // unknown op
+
+// NOTIFY kinds
+#define CTRL_N_SETTING 0 // key is the setting id
+#define CTRL_N_REG 1     // key is the register, mask the bits written
+
+typedef struct __attribute__((packed))
+{
+  uint16_t len;
+  uint8_t op;
+  uint8_t flags; // 0
+  uint16_t id;   // chosen by the client, echoed in the reply
+} ctrl_hdr_t;
+
+typedef struct __attribute__((packed))
+{
+  uint8_t kind;
+  uint16_t key;
+  uint8_t mask;
+  int16_t value;
+} ctrl_notify_t;
@@ -0,0 +1,150 @@
+#include "frame_sig.h"
+#include <limits.h>
+#include "esp_timer.h"
+#include "jpeg_scan.h"
+
+static SemaphoreHandle_t sig_lock = NULL;
+static portMUX_TYPE count_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// newest signature and the scratch space to make one, under sig_lock
+static frame_sig_t last = {};
+static jpeg_info_t info;
+static int16_t *dc = NULL;
+static size_t dc_size = 0;
+static int32_t sums[FRAME_SIG_COLS * FRAME_SIG_ROWS];
+static uint16_t counts[FRAME_SIG_COLS * FRAME_SIG_ROWS];
+
+static uint32_t computed = 0, errors = 0;
+static uint64_t us_total = 0;
+static uint32_t sent = 0, skipped = 0, heartbeats = 0;
+static uint64_t bytes_sent = 0, bytes_saved = 0;
+
+static bool compute(camera_fb_t *fb, uint32_t seq)
+{
+  int64_t start = esp_timer_get_time();
+  if (jpegParse(fb->buf, fb->len, &info) != JPEG_OK)
+  {
+    return false;
+  }
+  size_t blocks = (size_t)info.luma_cols * info.luma_rows;
+  if (blocks > dc_size)
+  {
+    free(dc);
+    dc = (int16_t *)(psramFound() ? ps_malloc(blocks * sizeof(int16_t)) : malloc(blocks * sizeof(int16_t)));
+    dc_size = dc ? blocks : 0;
+    if (!dc)
+    {
+      Serial.printf("Skip: no memory for %ux%u blocks\n", info.luma_cols, info.luma_rows);
+      return false;
+    }
+  }
+  if (jpegLumaDc(fb->buf, fb->len, &info, dc, dc_size) != JPEG_OK)
+  {
+    return false;
+  }
+  uint8_t cols = min((int)info.luma_cols, FRAME_SIG_COLS);
+  uint8_t rows = min((int)info.luma_rows, FRAME_SIG_ROWS);
+  memset(sums, 0, sizeof(sums));
+  memset(counts, 0, sizeof(counts));
+  for (uint16_t by = 0; by < info.luma_rows; by++)
+  {
+    const int16_t *row = dc + (size_t)by * info.luma_cols;
+    int base = by * rows / info.luma_rows * cols;
+    for (uint16_t bx = 0; bx < info.luma_cols; bx++)
+    {
+      int c = base + bx * cols / info.luma_cols;
+      sums[c] += row[bx];
+      counts[c]++;
+    }
+  }
+  last.seq = seq;
+  last.width = info.width;
+  last.height = info.height;
+  last.cols = cols;
+  last.rows = rows;
+  for (int i = 0; i < cols * rows; i++)
+  {
+    last.cell[i] = sums[i] / counts[i];
+  }
+  computed++;
+  us_total += esp_timer_get_time() - start;
+  return true;
+}
+
+bool frameSignature(camera_fb_t *fb, uint32_t seq, frame_sig_t *sig)
+{
+  if (fb->format != PIXFORMAT_JPEG)
+  {
+    return false;
+  }
+  if (!sig_lock)
+  {
+    portENTER_CRITICAL(&count_mux);
+    if (!sig_lock)
+    {
+      sig_lock = xSemaphoreCreateMutex();
+    }
+    portEXIT_CRITICAL(&count_mux);
+  }
+  // a client that comes second waits for the first one's result
+  xSemaphoreTake(sig_lock, portMAX_DELAY);
+  bool ok = (last.seq == seq && seq) || compute(fb, seq);
+  if (ok)
+  {
+    *sig = last;
+  }
+  else
+  {
+    errors++;
+  }
+  xSemaphoreGive(sig_lock);
+  return ok;
+}
+
+int frameSigDiff(const frame_sig_t *a, const frame_sig_t *b)
+{
+  if (a->width != b->width || a->height != b->height || a->cols != b->cols || a->rows != b->rows)
+  {
+    return INT_MAX;
+  }
+  int diff = 0;
+  for (int i = 0; i < a->cols * a->rows; i++)
+  {
+    diff = max(diff, abs(a->cell[i] - b->cell[i]));
+  }
+  return diff;
+}
+
+void frameSigSent(size_t len)
+{
+  portENTER_CRITICAL(&count_mux);
+  sent++;
+  bytes_sent += len;
+  portEXIT_CRITICAL(&count_mux);
+}
+
+void frameSigSkipped(size_t len)
+{
+  portENTER_CRITICAL(&count_mux);
+  skipped++;
+  bytes_saved += len;
+  portEXIT_CRITICAL(&count_mux);
+}
+
+void frameSigHeartbeat()
+{
+  portENTER_CRITICAL(&count_mux);
+  heartbeats++;
+  portEXIT_CRITICAL(&count_mux);
+}
+
+int frameSigMetricsJson(char *p, size_t len)
+{
+  uint64_t total = bytes_sent + bytes_saved;
+  return snprintf(p, len,
+                  "\"skip\":{\"signatures\":%u,\"errors\":%u,\"sig_us_avg\":%u,\"sent\":%u,\"skipped\":%u,"
+                  "\"heartbeats\":%u,\"kb_sent\":%u,\"kb_saved\":%u,\"saved_pct\":%.1f}",
+                  computed, errors, computed ? (uint32_t)(us_total / computed) : 0, sent, skipped, heartbeats,
+                  (uint32_t)(bytes_sent >> 10), (uint32_t)(bytes_saved >> 10),
+                  total ? bytes_saved * 100.0 / total : 0.0);
+}
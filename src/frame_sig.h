@@ -0,0 +1,35 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_camera.h"
+
+// Change signature for streams that leave out unchanged frames
+// (/stream?skip=N). The luminance DC terms of a frame (jpeg_scan.h, no
+// decode) are averaged into a grid of at most 32x24 cells; a frame is
+// unchanged when no cell moved by more than the client's threshold since
+// the last frame that client was sent. The signature of the newest frame
+// is kept, so it is computed once per frame however many clients skip.
+
+#define FRAME_SIG_COLS 32
+#define FRAME_SIG_ROWS 24
+#define FRAME_SIG_DEFAULT_THRESH 16 // DC units: 8 per luminance level
+#define FRAME_SIG_DEFAULT_KEY_S 10  // longest a skip stream goes without a frame
+
+typedef struct
+{
+  uint32_t seq;
+  uint16_t width, height;
+  uint8_t cols, rows;
+  int16_t cell[FRAME_SIG_COLS * FRAME_SIG_ROWS];
+} frame_sig_t;
+
+// Signature of fb, seq as returned by frameSourceGet(); false if the frame
+// cannot be scanned
+bool frameSignature(camera_fb_t *fb, uint32_t seq, frame_sig_t *sig);
+// Largest cell difference; INT_MAX when the frame size differs
+int frameSigDiff(const frame_sig_t *a, const frame_sig_t *b);
+// Accounting from the skip streams
+void frameSigSent(size_t len);
+void frameSigSkipped(size_t len);
+void frameSigHeartbeat();
+// "skip":{...}
+int frameSigMetricsJson(char *p, size_t len);
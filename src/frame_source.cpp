@@ -0,0 +1,228 @@
+#include "frame_source.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "trace.h"
+
+typedef struct
+{
+  camera_fb_t *fb;
+  uint32_t refs;
+} fs_slot_t;
+
+static fs_slot_t slots[FRAME_SOURCE_SLOTS];
+// The newest frame keeps one reference of its own until a newer one is in
+// (or the driver needs its buffer back), so a consumer a little out of
+// phase with the others still shares it instead of waiting for the driver.
+static fs_slot_t *latest = NULL;
+static size_t driver_buffers = 1;
+static uint32_t latest_seq = 0;
+static int64_t latest_us = 0;
+static int64_t fetch_interval_us = 0; // smoothed time between fetches
+// fetch_lock serializes driver fetches; state_mux only guards the table, so
+// a release never waits behind a consumer that is blocked in the driver
+static SemaphoreHandle_t fetch_lock = NULL;
+static portMUX_TYPE state_mux = portMUX_INITIALIZER_UNLOCKED;
+static volatile bool paused = false;
+
+static fs_slot_t *share_latest(uint32_t *seq)
+{
+  fs_slot_t *slot = NULL;
+  // no older than the rate frames are being pulled at: after an idle spell
+  // the next consumer gets a fresh capture, not the last one from before
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&state_mux);
+  if (latest && latest_seq != *seq && now - latest_us <= fetch_interval_us)
+  {
+    slot = latest;
+    slot->refs++;
+    *seq = latest_seq;
+  }
+  portEXIT_CRITICAL(&state_mux);
+  return slot;
+}
+
+// Drop the source's own reference; the buffer goes back to the driver if
+// no consumer holds it. Only when every driver buffer is out, unless
+// always: the driver cannot capture into a buffer the source sits on.
+static void drop_latest(bool always)
+{
+  camera_fb_t *fb = NULL;
+  portENTER_CRITICAL(&state_mux);
+  size_t out = 0;
+  for (int i = 0; i < FRAME_SOURCE_SLOTS; i++)
+  {
+    out += slots[i].fb != NULL;
+  }
+  if (latest && (always || out >= driver_buffers))
+  {
+    if (--latest->refs == 0)
+    {
+      fb = latest->fb;
+      latest->fb = NULL;
+    }
+    latest = NULL;
+  }
+  portEXIT_CRITICAL(&state_mux);
+  if (fb)
+  {
+    esp_camera_fb_return(fb);
+  }
+}
+
+void frameSourceBegin(size_t fb_count)
+{
+  driver_buffers = fb_count ? fb_count : 1;
+  if (!fetch_lock)
+  {
+    fetch_lock = xSemaphoreCreateMutex();
+  }
+}
+
+camera_fb_t *frameSourceGet(uint32_t *seq)
+{
+  if (!fetch_lock || paused)
+  {
+    return NULL; // the camera is not up yet, or quiesced
+  }
+  uint32_t fresh_seq;
+  if (!seq)
+  {
+    // anything fetched after this call began; it must not have to win the
+    // lock against the streams to get one
+    portENTER_CRITICAL(&state_mux);
+    fresh_seq = latest_seq;
+    portEXIT_CRITICAL(&state_mux);
+    seq = &fresh_seq;
+  }
+  fs_slot_t *slot = share_latest(seq);
+  if (slot)
+  {
+    return slot->fb;
+  }
+  // Somebody else is in the driver: share what they bring back as soon as
+  // it is published rather than when the lock comes free, which the
+  // fetcher may well take again first
+  while (xSemaphoreTake(fetch_lock, pdMS_TO_TICKS(1)) != pdTRUE)
+  {
+    slot = paused ? NULL : share_latest(seq);
+    if (slot)
+    {
+      return slot->fb;
+    }
+  }
+  slot = paused ? NULL : share_latest(seq);
+  if (slot || paused)
+  {
+    xSemaphoreGive(fetch_lock);
+    return slot ? slot->fb : NULL;
+  }
+  drop_latest(false);
+  camera_fb_t *fb;
+  {
+    TraceSpan span("sensor.wait");
+    fb = esp_camera_fb_get();
+    span.arg = fb ? fb->len : 0;
+  }
+  camera_fb_t *old = NULL;
+  if (fb)
+  {
+    portENTER_CRITICAL(&state_mux);
+    for (int i = 0; i < FRAME_SOURCE_SLOTS; i++)
+    {
+      if (!slots[i].fb)
+      {
+        slot = &slots[i];
+        break;
+      }
+    }
+    if (slot)
+    {
+      // the previous frame's source reference moves to this one
+      if (latest && --latest->refs == 0)
+      {
+        old = latest->fb;
+        latest->fb = NULL;
+      }
+      int64_t now = esp_timer_get_time();
+      int64_t gap = min(now - latest_us, (int64_t)FRAME_SOURCE_SHARE_MAX_US);
+      fetch_interval_us = fetch_interval_us ? (3 * fetch_interval_us + gap) / 4 : gap;
+      latest_us = now;
+      slot->fb = fb;
+      slot->refs = 2; // the caller's and the source's
+      latest = slot;
+      *seq = ++latest_seq;
+    }
+    portEXIT_CRITICAL(&state_mux);
+    if (!slot)
+    {
+      // more frames out than the driver has buffers; cannot happen with
+      // fb_count <= FRAME_SOURCE_SLOTS
+      esp_camera_fb_return(fb);
+      fb = NULL;
+    }
+  }
+  xSemaphoreGive(fetch_lock);
+  if (old)
+  {
+    esp_camera_fb_return(old);
+  }
+  return fb;
+}
+
+void frameSourcePause(bool pause)
+{
+  paused = pause;
+  if (pause && fetch_lock)
+  {
+    // wait out a fetch that is already in the driver
+    xSemaphoreTake(fetch_lock, portMAX_DELAY);
+    drop_latest(true);
+    xSemaphoreGive(fetch_lock);
+  }
+}
+
+int frameSourceOutstanding()
+{
+  int n = 0;
+  portENTER_CRITICAL(&state_mux);
+  for (int i = 0; i < FRAME_SOURCE_SLOTS; i++)
+  {
+    // the source's own reference is not a consumer's
+    n += slots[i].fb && slots[i].refs > (latest == &slots[i] ? 1u : 0u);
+  }
+  portEXIT_CRITICAL(&state_mux);
+  return n;
+}
+
+uint32_t frameSourceSeq()
+{
+  return latest_seq;
+}
+
+void frameSourceRelease(camera_fb_t *fb)
+{
+  if (!fb)
+  {
+    return;
+  }
+  bool last = false;
+  portENTER_CRITICAL(&state_mux);
+  for (int i = 0; i < FRAME_SOURCE_SLOTS; i++)
+  {
+    if (slots[i].fb == fb)
+    {
+      if (--slots[i].refs == 0)
+      {
+        slots[i].fb = NULL; // never latest: that one holds a reference
+        last = true;
+      }
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&state_mux);
+  if (last)
+  {
+    esp_camera_fb_return(fb);
+  }
+}
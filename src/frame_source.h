@@ -0,0 +1,30 @@
+#pragma once
+#include "esp_camera.h"
+
+// Shared access to camera frames. Consumers that overlap in time get the
+// same driver buffer, reference counted, instead of each pulling their own:
+// a preview or a second stream rides along with the frame that is already
+// out rather than costing another capture. The newest frame stays shareable
+// until a newer one is fetched, for about as long as frames are being
+// pulled apart, so consumers out of phase do not take turns on the driver.
+
+#define FRAME_SOURCE_SLOTS 3
+// Upper bound on that sharing window
+#define FRAME_SOURCE_SHARE_MAX_US 250000
+
+// Call once after esp_camera_init() with its fb_count; until then
+// frameSourceGet() is NULL
+void frameSourceBegin(size_t fb_count);
+// A frame newer than *seq, shared if another consumer still holds one,
+// else fetched from the driver. *seq is updated; start it at 0. Pass NULL
+// for a frame fetched after the call (e.g. after switching the flash LED on).
+camera_fb_t *frameSourceGet(uint32_t *seq);
+// While paused frameSourceGet() returns NULL. Pausing returns once no
+// fetch is in the driver; frames already out stay valid until released.
+void frameSourcePause(bool pause);
+// Driver buffers currently held by consumers
+int frameSourceOutstanding();
+// Frames fetched from the driver so far; the HUD derives fps from it
+uint32_t frameSourceSeq();
+// Drop a reference; the last one hands the buffer back to the driver
+void frameSourceRelease(camera_fb_t *fb);
@@ -0,0 +1,177 @@
+#include "fw_delta.h"
+#include <string.h>
+
+static uint32_t get_u32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool fwDeltaIsPatch(const uint8_t *data, size_t len)
+{
+  return len >= 4 && !memcmp(data, FW_DELTA_MAGIC, 4);
+}
+
+void fwDeltaInit(fw_delta_t *d, const fw_delta_io_t *io)
+{
+  memset(d, 0, sizeof(*d));
+  d->io = *io;
+  d->state = FW_DELTA_HEADER;
+}
+
+static int set_err(fw_delta_t *d, int err)
+{
+  d->err = err;
+  return err;
+}
+
+// Collect a fixed-size block that may arrive split; true once complete
+static bool collect(fw_delta_t *d, const uint8_t *&data, size_t &len, size_t want)
+{
+  size_t n = want - d->buf_len < len ? want - d->buf_len : len;
+  memcpy(d->buf + d->buf_len, data, n);
+  d->buf_len += n;
+  data += n;
+  len -= n;
+  if (d->buf_len < want)
+  {
+    return false;
+  }
+  d->buf_len = 0;
+  return true;
+}
+
+// Leave runs that are used up, including empty ones, without waiting for
+// more input; at the end of a record move on to the next one or finish
+static void settle(fw_delta_t *d)
+{
+  if (d->state == FW_DELTA_DIFF && !d->remaining)
+  {
+    d->remaining = d->extra_len;
+    d->state = FW_DELTA_EXTRA;
+  }
+  if (d->state == FW_DELTA_EXTRA && !d->remaining)
+  {
+    // a seek outside the base is caught by the next record's check
+    d->pos += d->seek;
+    d->state = FW_DELTA_CTRL;
+  }
+  if (d->state == FW_DELTA_CTRL && d->out == d->header.new_size)
+  {
+    d->state = FW_DELTA_DONE;
+  }
+}
+
+int fwDeltaWrite(fw_delta_t *d, const uint8_t *data, size_t len)
+{
+  uint8_t base[FW_DELTA_BASE_CHUNK];
+  while (len && !d->err)
+  {
+    switch (d->state)
+    {
+    case FW_DELTA_HEADER:
+      if (!collect(d, data, len, FW_DELTA_HEADER_LEN))
+      {
+        break;
+      }
+      if (!fwDeltaIsPatch(d->buf, FW_DELTA_HEADER_LEN))
+      {
+        return set_err(d, FW_DELTA_ERR_MAGIC);
+      }
+      d->header.old_size = get_u32(d->buf + 4);
+      d->header.new_size = get_u32(d->buf + 8);
+      d->header.flags = get_u32(d->buf + 12);
+      memcpy(d->header.old_sha256, d->buf + 16, 32);
+      if (d->io.check_base && d->io.check_base(d->io.ctx, &d->header))
+      {
+        return set_err(d, FW_DELTA_ERR_BASE);
+      }
+      d->state = FW_DELTA_CTRL;
+      break;
+    case FW_DELTA_CTRL:
+      if (!collect(d, data, len, FW_DELTA_CTRL_LEN))
+      {
+        break;
+      }
+      d->remaining = get_u32(d->buf);
+      d->extra_len = get_u32(d->buf + 4);
+      d->seek = (int32_t)get_u32(d->buf + 8);
+      if ((uint64_t)d->pos + d->remaining > d->header.old_size ||
+          (uint64_t)d->out + d->remaining + d->extra_len > d->header.new_size)
+      {
+        return set_err(d, FW_DELTA_ERR_RANGE);
+      }
+      d->state = FW_DELTA_DIFF;
+      break;
+    case FW_DELTA_DIFF:
+    {
+      size_t n = d->remaining < len ? d->remaining : len;
+      if (n > sizeof(base))
+      {
+        n = sizeof(base);
+      }
+      if (n)
+      {
+        if (d->io.read_base(d->io.ctx, d->pos, base, n))
+        {
+          return set_err(d, FW_DELTA_ERR_BASE);
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+          base[i] += data[i];
+        }
+        if (d->io.write(d->io.ctx, base, n))
+        {
+          return set_err(d, FW_DELTA_ERR_WRITE);
+        }
+        d->pos += n;
+        d->out += n;
+        d->remaining -= n;
+        data += n;
+        len -= n;
+      }
+      break;
+    }
+    case FW_DELTA_EXTRA:
+    {
+      size_t n = d->remaining < len ? d->remaining : len;
+      if (n && d->io.write(d->io.ctx, data, n))
+      {
+        return set_err(d, FW_DELTA_ERR_WRITE);
+      }
+      d->out += n;
+      d->remaining -= n;
+      data += n;
+      len -= n;
+      break;
+    }
+    case FW_DELTA_DONE:
+      return set_err(d, FW_DELTA_ERR_TRAILING);
+    }
+    settle(d);
+  }
+  return d->err;
+}
+
+bool fwDeltaDone(const fw_delta_t *d)
+{
+  return !d->err && d->state == FW_DELTA_DONE;
+}
+
+const char *fwDeltaError(int err)
+{
+  switch (err)
+  {
+  case FW_DELTA_OK:
+    return "";
+  case FW_DELTA_ERR_MAGIC:
+    return "not a delta patch";
+  case FW_DELTA_ERR_BASE:
+    return "delta base does not match the running firmware";
+  case FW_DELTA_ERR_RANGE:
+    return "delta record out of range";
+  case FW_DELTA_ERR_WRITE:
+    return "write failed";
+  default:
+    return "data after the end of the delta";
+  }
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming decoder for firmware delta patches (bsdiff-style). A patch
+// rebuilds the new image from the one in the running slot:
+//
+//   header   "FWD1", old_size, new_size, flags (uint32 LE each),
+//            sha256 of the first old_size bytes of the base
+//   records  diff_len, extra_len (uint32 LE), seek (int32 LE)
+//            diff_len bytes:  new = old[pos++] + diff  (mod 256)
+//            extra_len bytes: copied as they are
+//            then pos += seek
+//
+// until new_size bytes came out. Each record is consumed as it arrives, so
+// RAM use is the header plus one small base read buffer, however large the
+// images are. tools/fwdelta.cpp makes the patches; gzip them for the
+// transfer, most diff bytes are zero.
+//
+// No Arduino dependencies: the host tool links this file as well.
+
+#define FW_DELTA_MAGIC "FWD1"
+#define FW_DELTA_HEADER_LEN 48
+#define FW_DELTA_CTRL_LEN 12
+#define FW_DELTA_BASE_CHUNK 256
+
+typedef enum
+{
+  FW_DELTA_OK = 0,
+  FW_DELTA_ERR_MAGIC = -1,
+  FW_DELTA_ERR_BASE = -2,    // base mismatch or unreadable
+  FW_DELTA_ERR_RANGE = -3,   // record reads outside the base or writes past new_size
+  FW_DELTA_ERR_WRITE = -4,   // the output sink failed
+  FW_DELTA_ERR_TRAILING = -5 // data after the last record
+} fw_delta_err_t;
+
+typedef struct
+{
+  uint32_t old_size;
+  uint32_t new_size;
+  uint32_t flags;
+  uint8_t old_sha256[32];
+} fw_delta_header_t;
+
+typedef struct
+{
+  // all return 0 on success
+  int (*check_base)(void *ctx, const fw_delta_header_t *header);
+  int (*read_base)(void *ctx, uint32_t offset, uint8_t *dst, size_t len);
+  int (*write)(void *ctx, const uint8_t *data, size_t len);
+  void *ctx;
+} fw_delta_io_t;
+
+typedef enum
+{
+  FW_DELTA_HEADER,
+  FW_DELTA_CTRL,
+  FW_DELTA_DIFF,
+  FW_DELTA_EXTRA,
+  FW_DELTA_DONE,
+} fw_delta_state_t;
+
+typedef struct
+{
+  fw_delta_io_t io;
+  fw_delta_state_t state;
+  fw_delta_header_t header;
+  uint8_t buf[FW_DELTA_HEADER_LEN]; // header or control record being collected
+  size_t buf_len;
+  uint32_t remaining; // of the current diff or extra run
+  uint32_t extra_len;
+  int32_t seek;
+  uint32_t pos; // in the base
+  uint32_t out;
+  int err;
+} fw_delta_t;
+
+// True if data starts a patch (needs 4 bytes)
+bool fwDeltaIsPatch(const uint8_t *data, size_t len);
+void fwDeltaInit(fw_delta_t *d, const fw_delta_io_t *io);
+// Feed patch bytes in any split; FW_DELTA_OK or the first error
+int fwDeltaWrite(fw_delta_t *d, const uint8_t *data, size_t len);
+// All of new_size produced
+bool fwDeltaDone(const fw_delta_t *d);
+const char *fwDeltaError(int err);
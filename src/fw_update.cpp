@@ -0,0 +1,558 @@
+#include "fw_update.h"
+#include <Update.h>
+#include "esp32/rom/miniz.h"
+#include "mbedtls/sha256.h"
+#include "esp_rom_crc.h"
+#include "esp_ota_ops.h"
+#include "fw_delta.h"
+#include "trace.h"
+
+typedef enum
+{
+  FW_RAW,
+  FW_GZIP,
+  FW_HEATSHRINK,
+} fw_format_t;
+
+typedef enum
+{
+  HS_TAG,
+  HS_LITERAL,
+  HS_INDEX,
+  HS_COUNT,
+} hs_state_t;
+
+#define GZIP_HEADER_MAX 256
+#define GZIP_FEXTRA 0x04
+#define GZIP_FNAME 0x08
+#define GZIP_FCOMMENT 0x10
+#define GZIP_FHCRC 0x02
+
+static struct
+{
+  bool running;
+  bool detected; // format known, i.e. the first bytes were seen
+  uint8_t magic[2];
+  size_t magic_len;
+  fw_format_t format;
+  const char *error;
+  mbedtls_sha256_context sha;
+  uint8_t expected[32];
+  uint8_t *out; // one flash sector
+  size_t out_len;
+  uint32_t total;     // decompressed bytes
+  uint32_t image_len; // firmware bytes written
+
+  // a decompressed stream that starts with FW_DELTA_MAGIC is a patch
+  // against the running slot
+  bool kind_known;
+  uint8_t kind[4];
+  size_t kind_len;
+  bool delta;
+  fw_delta_t patch;
+  const esp_partition_t *base;
+
+  // gzip
+  uint8_t header[GZIP_HEADER_MAX];
+  size_t header_len;
+  bool header_done;
+  tinfl_decompressor *inflator;
+  uint8_t *dict; // TINFL_LZ_DICT_SIZE, circular
+  size_t dict_ofs;
+  bool inflate_done;
+  uint32_t crc; // of the inflated data, for the trailer
+  uint8_t trailer[8]; // crc32, isize
+  size_t trailer_len;
+
+  // heatshrink
+  uint8_t hs_window_sz2, hs_lookahead_sz2;
+  uint8_t *hs_window;
+  uint16_t hs_head;
+  hs_state_t hs_state;
+  uint32_t hs_acc;
+  uint8_t hs_nbits;
+  uint16_t hs_index;
+} fw;
+
+static bool fail(const char *why)
+{
+  if (!fw.error || !fw.error[0])
+  {
+    fw.error = why;
+    Serial.printf("Update: %s\n", why);
+  }
+  return false;
+}
+
+static bool flush_out()
+{
+  TraceSpan span("ota.write");
+  span.arg = fw.out_len;
+  if (fw.out_len && Update.write(fw.out, fw.out_len) != fw.out_len)
+  {
+    Update.printError(Serial);
+    return fail(Update.errorString());
+  }
+  fw.out_len = 0;
+  return true;
+}
+
+// Firmware bytes: hash them and write whole sectors
+static bool image_write(const uint8_t *data, size_t len)
+{
+  mbedtls_sha256_update_ret(&fw.sha, data, len);
+  fw.image_len += len;
+  while (len)
+  {
+    size_t n = min(len, (size_t)FW_UPDATE_SECTOR - fw.out_len);
+    memcpy(fw.out + fw.out_len, data, n);
+    fw.out_len += n;
+    data += n;
+    len -= n;
+    if (fw.out_len == FW_UPDATE_SECTOR && !flush_out())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int delta_check_base(void *ctx, const fw_delta_header_t *header)
+{
+  fw.base = esp_ota_get_running_partition();
+  if (!fw.base || header->old_size > fw.base->size)
+  {
+    return -1;
+  }
+  // nothing is buffered for flash yet, so the sector buffer is free
+  mbedtls_sha256_context sha;
+  uint8_t digest[32];
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts_ret(&sha, 0);
+  for (uint32_t off = 0; off < header->old_size; off += FW_UPDATE_SECTOR)
+  {
+    size_t n = min((size_t)FW_UPDATE_SECTOR, (size_t)(header->old_size - off));
+    if (esp_partition_read(fw.base, off, fw.out, n) != ESP_OK)
+    {
+      mbedtls_sha256_free(&sha);
+      return -1;
+    }
+    mbedtls_sha256_update_ret(&sha, fw.out, n);
+  }
+  mbedtls_sha256_finish_ret(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  Serial.printf("Update: delta %u -> %u bytes against %s\n", header->old_size, header->new_size, fw.base->label);
+  return memcmp(digest, header->old_sha256, sizeof(digest)) ? -1 : 0;
+}
+
+static int delta_read_base(void *ctx, uint32_t offset, uint8_t *dst, size_t len)
+{
+  return esp_partition_read(fw.base, offset, dst, len) == ESP_OK ? 0 : -1;
+}
+
+static int delta_write(void *ctx, const uint8_t *data, size_t len)
+{
+  return image_write(data, len) ? 0 : -1;
+}
+
+// Decompressed upload bytes: a full image or a delta patch
+static bool emit(const uint8_t *data, size_t len)
+{
+  fw.total += len;
+  if (!fw.kind_known)
+  {
+    while (len && fw.kind_len < sizeof(fw.kind))
+    {
+      fw.kind[fw.kind_len++] = *data++;
+      len--;
+    }
+    if (fw.kind_len < sizeof(fw.kind))
+    {
+      return true;
+    }
+    fw.kind_known = true;
+    if (fwDeltaIsPatch(fw.kind, sizeof(fw.kind)))
+    {
+      fw_delta_io_t io = {delta_check_base, delta_read_base, delta_write, NULL};
+      fw.delta = true;
+      fwDeltaInit(&fw.patch, &io);
+    }
+    fw.total -= sizeof(fw.kind);
+    if (!emit(fw.kind, sizeof(fw.kind)))
+    {
+      return false;
+    }
+  }
+  if (fw.delta)
+  {
+    int err = fwDeltaWrite(&fw.patch, data, len);
+    return err == FW_DELTA_OK || fail(fwDeltaError(err)); // a write error was reported first
+  }
+  return image_write(data, len);
+}
+
+static int hex_nibble(char c)
+{
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// Length of a complete gzip header at the start of buf, 0 if more bytes
+// are needed, -1 if it is not one
+static int gzip_header_len(const uint8_t *buf, size_t len)
+{
+  if (len < 10)
+  {
+    return 0;
+  }
+  if (buf[0] != 0x1f || buf[1] != 0x8b || buf[2] != 8)
+  {
+    return -1;
+  }
+  uint8_t flags = buf[3];
+  size_t pos = 10;
+  if (flags & GZIP_FEXTRA)
+  {
+    if (len < pos + 2)
+      return 0;
+    pos += 2 + (buf[pos] | (buf[pos + 1] << 8));
+  }
+  for (uint8_t f : {GZIP_FNAME, GZIP_FCOMMENT})
+  {
+    if (flags & f)
+    {
+      while (pos < len && buf[pos])
+        pos++;
+      if (pos++ >= len)
+        return 0;
+    }
+  }
+  if (flags & GZIP_FHCRC)
+  {
+    pos += 2;
+  }
+  return pos <= len ? (int)pos : 0;
+}
+
+static bool write_gzip(const uint8_t *data, size_t len)
+{
+  if (!fw.header_done)
+  {
+    size_t n = min(len, sizeof(fw.header) - fw.header_len);
+    memcpy(fw.header + fw.header_len, data, n);
+    int hlen = gzip_header_len(fw.header, fw.header_len + n);
+    if (hlen < 0 || (hlen == 0 && fw.header_len + n == sizeof(fw.header)))
+    {
+      return fail("bad gzip header");
+    }
+    if (hlen == 0)
+    {
+      fw.header_len += n;
+      return true;
+    }
+    // the rest of this chunk is deflate data
+    size_t used = hlen - fw.header_len;
+    data += used;
+    len -= used;
+    fw.header_done = true;
+  }
+  while (len && !fw.inflate_done)
+  {
+    size_t in_bytes = len;
+    size_t out_bytes = TINFL_LZ_DICT_SIZE - fw.dict_ofs;
+    tinfl_status status = tinfl_decompress(fw.inflator, data, &in_bytes, fw.dict, fw.dict + fw.dict_ofs, &out_bytes,
+                                           TINFL_FLAG_HAS_MORE_INPUT);
+    data += in_bytes;
+    len -= in_bytes;
+    fw.crc = esp_rom_crc32_le(fw.crc, fw.dict + fw.dict_ofs, out_bytes);
+    if (out_bytes && !emit(fw.dict + fw.dict_ofs, out_bytes))
+    {
+      return false;
+    }
+    fw.dict_ofs = (fw.dict_ofs + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+    if (status == TINFL_STATUS_DONE)
+    {
+      fw.inflate_done = true;
+    }
+    else if (status < 0)
+    {
+      return fail("corrupt gzip data");
+    }
+    else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && !len)
+    {
+      break;
+    }
+  }
+  // whatever follows the deflate stream is the trailer
+  size_t n = min(len, sizeof(fw.trailer) - fw.trailer_len);
+  memcpy(fw.trailer + fw.trailer_len, data, n);
+  fw.trailer_len += n;
+  return true;
+}
+
+// Next n bits MSB first, -1 until the input has them
+static int hs_bits(const uint8_t *&data, size_t &len, uint8_t n)
+{
+  while (fw.hs_nbits < n)
+  {
+    if (!len)
+    {
+      return -1;
+    }
+    fw.hs_acc = (fw.hs_acc << 8) | *data++;
+    len--;
+    fw.hs_nbits += 8;
+  }
+  fw.hs_nbits -= n;
+  return (fw.hs_acc >> fw.hs_nbits) & ((1u << n) - 1);
+}
+
+static bool hs_put(uint8_t c)
+{
+  fw.hs_window[fw.hs_head] = c;
+  fw.hs_head = (fw.hs_head + 1) & ((1u << fw.hs_window_sz2) - 1);
+  return emit(&c, 1);
+}
+
+static bool write_heatshrink(const uint8_t *data, size_t len)
+{
+  uint16_t mask = (1u << fw.hs_window_sz2) - 1;
+  while (true)
+  {
+    int v;
+    switch (fw.hs_state)
+    {
+    case HS_TAG:
+      if ((v = hs_bits(data, len, 1)) < 0)
+        return true;
+      fw.hs_state = v ? HS_LITERAL : HS_INDEX;
+      break;
+    case HS_LITERAL:
+      if ((v = hs_bits(data, len, 8)) < 0)
+        return true;
+      if (!hs_put(v))
+        return false;
+      fw.hs_state = HS_TAG;
+      break;
+    case HS_INDEX:
+      if ((v = hs_bits(data, len, fw.hs_window_sz2)) < 0)
+        return true;
+      fw.hs_index = v + 1;
+      fw.hs_state = HS_COUNT;
+      break;
+    case HS_COUNT:
+      if ((v = hs_bits(data, len, fw.hs_lookahead_sz2)) < 0)
+        return true;
+      // byte by byte: the copy may overlap what it produces
+      for (int i = 0; i <= v; i++)
+      {
+        if (!hs_put(fw.hs_window[(fw.hs_head - fw.hs_index) & mask]))
+          return false;
+      }
+      fw.hs_state = HS_TAG;
+      break;
+    }
+  }
+}
+
+static void release()
+{
+  free(fw.out);
+  free(fw.inflator);
+  free(fw.dict);
+  free(fw.hs_window);
+  fw.out = NULL;
+  fw.inflator = NULL;
+  fw.dict = NULL;
+  fw.hs_window = NULL;
+  mbedtls_sha256_free(&fw.sha);
+  fw.running = false;
+}
+
+bool fwUpdateBegin(const String &filename, const char *sha256, const char *hs)
+{
+  if (fw.running)
+  {
+    fwUpdateAbort();
+  }
+  memset(&fw, 0, sizeof(fw));
+  fw.error = "";
+  // raw and heatshrink uploads carry no checksum of their own: nothing is
+  // flashed without the digest to check it against
+  if (!sha256 || !*sha256)
+  {
+    return fail("sha256 required");
+  }
+  if (strlen(sha256) != 64)
+  {
+    return fail("sha256 must be 64 hex digits");
+  }
+  for (int i = 0; i < 32; i++)
+  {
+    int hi = hex_nibble(sha256[2 * i]), lo = hex_nibble(sha256[2 * i + 1]);
+    if (hi < 0 || lo < 0)
+    {
+      return fail("sha256 must be 64 hex digits");
+    }
+    fw.expected[i] = (hi << 4) | lo;
+  }
+  fw.hs_window_sz2 = FW_HS_WINDOW_DEFAULT;
+  fw.hs_lookahead_sz2 = FW_HS_LOOKAHEAD_DEFAULT;
+  if (hs && *hs)
+  {
+    int w = 0, l = 0;
+    if (sscanf(hs, "%d,%d", &w, &l) != 2 || w < 4 || w > 15 || l < 3 || l >= w)
+    {
+      return fail("hs must be <window>,<lookahead>");
+    }
+    fw.hs_window_sz2 = w;
+    fw.hs_lookahead_sz2 = l;
+  }
+  // the format is settled by the first bytes; heatshrink has no magic
+  fw.format = (hs && *hs) || filename.endsWith(".hs") ? FW_HEATSHRINK : FW_RAW;
+  fw.out = (uint8_t *)malloc(FW_UPDATE_SECTOR);
+  if (!fw.out)
+  {
+    return fail("out of memory");
+  }
+  mbedtls_sha256_init(&fw.sha);
+  mbedtls_sha256_starts_ret(&fw.sha, 0);
+  if (!Update.begin(UPDATE_SIZE_UNKNOWN))
+  { // start with max available size
+    Update.printError(Serial);
+    release();
+    return fail(Update.errorString());
+  }
+  fw.running = true;
+  return true;
+}
+
+bool fwUpdateWrite(const uint8_t *data, size_t len)
+{
+  if (!fw.running || fw.error[0])
+  {
+    return false;
+  }
+  if (!fw.detected)
+  {
+    // the gzip magic may straddle two chunks
+    while (len && fw.magic_len < sizeof(fw.magic))
+    {
+      fw.magic[fw.magic_len++] = *data++;
+      len--;
+    }
+    if (fw.magic_len < sizeof(fw.magic))
+    {
+      return true;
+    }
+    fw.detected = true;
+    if (fw.magic[0] == 0x1f && fw.magic[1] == 0x8b)
+    {
+      fw.format = FW_GZIP;
+      fw.inflator = (tinfl_decompressor *)malloc(sizeof(tinfl_decompressor));
+      fw.dict = (uint8_t *)malloc(TINFL_LZ_DICT_SIZE);
+      if (!fw.inflator || !fw.dict)
+      {
+        return fail("out of memory");
+      }
+      tinfl_init(fw.inflator);
+    }
+    else if (fw.format == FW_HEATSHRINK)
+    {
+      fw.hs_window = (uint8_t *)calloc(1, 1u << fw.hs_window_sz2);
+      if (!fw.hs_window)
+      {
+        return fail("out of memory");
+      }
+    }
+    Serial.printf("Update: %s image\n", fw.format == FW_GZIP ? "gzip" : fw.format == FW_HEATSHRINK ? "heatshrink" : "uncompressed");
+    if (!fwUpdateWrite(fw.magic, sizeof(fw.magic)))
+    {
+      return false;
+    }
+  }
+  switch (fw.format)
+  {
+  case FW_GZIP:
+    return write_gzip(data, len);
+  case FW_HEATSHRINK:
+    return write_heatshrink(data, len);
+  default:
+    return emit(data, len);
+  }
+}
+
+bool fwUpdateEnd()
+{
+  if (!fw.running)
+  {
+    return false;
+  }
+  if (!fw.error[0] && fw.format == FW_GZIP)
+  {
+    uint32_t crc, isize;
+    memcpy(&crc, fw.trailer, 4); // both little endian, like the ESP32
+    memcpy(&isize, fw.trailer + 4, 4);
+    if (!fw.inflate_done || fw.trailer_len < sizeof(fw.trailer))
+    {
+      fail("truncated gzip stream");
+    }
+    else if (isize != fw.total || crc != fw.crc)
+    {
+      fail("gzip checksum mismatch");
+    }
+  }
+  if (!fw.error[0] && fw.delta && !fwDeltaDone(&fw.patch))
+  {
+    fail("truncated delta patch");
+  }
+  if (!fw.error[0] && !fw.kind_known)
+  {
+    image_write(fw.kind, fw.kind_len); // shorter than a magic; Update.end() rejects it
+  }
+  if (!fw.error[0])
+  {
+    flush_out();
+  }
+  uint8_t digest[32];
+  mbedtls_sha256_finish_ret(&fw.sha, digest);
+  if (!fw.error[0] && memcmp(digest, fw.expected, sizeof(digest)))
+  {
+    fail("sha256 mismatch");
+  }
+  if (fw.error[0])
+  {
+    Update.abort();
+    release();
+    return false;
+  }
+  release();
+  TRACE_SPAN("ota.end");
+  if (!Update.end(true))
+  { // true to set the size to the current progress
+    Update.printError(Serial);
+    return fail(Update.errorString());
+  }
+  Serial.printf("Update Success: %u bytes%s, sha256 verified\n", fw.image_len, fw.delta ? " from a delta" : "");
+  return true;
+}
+
+void fwUpdateAbort()
+{
+  if (fw.running)
+  {
+    Update.abort();
+    release();
+  }
+  fail("aborted");
+}
+
+const char *fwUpdateError()
+{
+  return fw.error ? fw.error : "";
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <Arduino.h>
+
+// Streaming firmware update for /update. The upload may be the raw .bin, a
+// gzip of it (detected by its magic) or a heatshrink stream (a ".hs" file
+// name or hs=<window>,<lookahead>). Data is inflated chunk by chunk, hashed
+// with SHA-256 and handed to Update in whole flash sectors. Every upload
+// must carry sha256 (hex, of the uncompressed .bin), and it must match
+// before Update.end() commits.
+//
+// Once decompressed, the upload may also be a delta patch (src/fw_delta.h,
+// made by tools/fwdelta) that rebuilds the new image from the running slot;
+// sha256 is then still the digest of the new .bin.
+//
+// gzip needs its full 32 KB window; heatshrink's is 2^window bytes
+// (default 2 KB), which is what makes it the small-footprint option.
+
+#define FW_UPDATE_SECTOR 4096
+#define FW_HS_WINDOW_DEFAULT 11 // the heatshrink tool's defaults
+#define FW_HS_LOOKAHEAD_DEFAULT 4
+
+// Fails without a valid sha256; hs is "w,l" or NULL
+bool fwUpdateBegin(const String &filename, const char *sha256, const char *hs);
+bool fwUpdateWrite(const uint8_t *data, size_t len);
+// Verify and commit; false leaves the running image in place
+bool fwUpdateEnd();
+void fwUpdateAbort();
+// Why the last update failed, "" if it did not
+const char *fwUpdateError();
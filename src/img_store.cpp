@@ -0,0 +1,541 @@
+#include "img_store.h"
+#include "esp_rom_crc.h"
+#include "esp_partition.h"
+
+#define IMG_MAGIC 0x4A504731 // "JPG1"
+#define ALIGN4(x) (((x) + 3) & ~3u)
+#define SECTOR_START(x) ((x) & ~(IMG_STORE_SECTOR - 1))
+#define SECTOR_END(x) (SECTOR_START(x) + IMG_STORE_SECTOR)
+
+typedef struct
+{
+  uint32_t magic;
+  uint32_t seq;
+  uint32_t len;
+  uint32_t crc;
+  uint32_t ts_sec;
+  uint32_t ts_usec;
+  uint32_t reserved;
+  uint32_t hdr_crc;
+} img_header_t;
+
+static img_store_flash_t store_flash;
+static bool mounted = false;
+static SemaphoreHandle_t store_lock = NULL;
+
+// Index ring, oldest first
+static img_record_t records[IMG_STORE_MAX_RECORDS];
+static int rec_first = 0;
+static int rec_count = 0;
+
+static uint32_t head = 0;         // next header offset
+static uint32_t erased_until = 0; // [head, erased_until) is known to be erased
+static uint32_t next_seq = 1;
+
+static uint32_t appends = 0;
+static uint32_t erases = 0;
+static uint32_t last_append_us = 0;
+static uint32_t max_append_us = 0;
+static uint32_t mount_us = 0;
+
+static inline uint32_t record_size(uint32_t len)
+{
+  return sizeof(img_header_t) + ALIGN4(len);
+}
+
+static uint32_t header_crc(const img_header_t *h)
+{
+  return esp_rom_crc32_le(0, (const uint8_t *)h, offsetof(img_header_t, hdr_crc));
+}
+
+static bool read_header(uint32_t offset, img_header_t *h)
+{
+  if (offset + sizeof(*h) > store_flash.size ||
+      store_flash.read(store_flash.ctx, offset, h, sizeof(*h)) != ESP_OK)
+  {
+    return false;
+  }
+  return h->magic == IMG_MAGIC && h->hdr_crc == header_crc(h) &&
+         offset + record_size(h->len) <= store_flash.size;
+}
+
+static img_record_t *record_at(int i)
+{
+  return &records[(rec_first + i) % IMG_STORE_MAX_RECORDS];
+}
+
+static void push_record(uint32_t offset, const img_header_t *h)
+{
+  if (rec_count == IMG_STORE_MAX_RECORDS)
+  {
+    // Still on flash, just no longer indexed
+    rec_first = (rec_first + 1) % IMG_STORE_MAX_RECORDS;
+    rec_count--;
+  }
+  img_record_t *r = record_at(rec_count++);
+  r->seq = h->seq;
+  r->offset = offset;
+  r->len = h->len;
+  r->crc = h->crc;
+  r->timestamp.tv_sec = h->ts_sec;
+  r->timestamp.tv_usec = h->ts_usec;
+}
+
+static void pop_oldest()
+{
+  rec_first = (rec_first + 1) % IMG_STORE_MAX_RECORDS;
+  rec_count--;
+}
+
+// Oldest records sit right after the head; drop those the erase will hit
+static void drop_overlapping(uint32_t start, uint32_t end)
+{
+  while (rec_count)
+  {
+    img_record_t *r = record_at(0);
+    if (r->offset >= end || r->offset + record_size(r->len) <= start)
+    {
+      break;
+    }
+    pop_oldest();
+  }
+}
+
+static bool is_erased(uint32_t start, uint32_t end)
+{
+  uint32_t buf[64];
+  while (start < end)
+  {
+    size_t n = min((size_t)(end - start), sizeof(buf));
+    if (store_flash.read(store_flash.ctx, start, buf, n) != ESP_OK)
+    {
+      return false;
+    }
+    for (size_t i = 0; i < n / 4; i++)
+    {
+      if (buf[i] != 0xFFFFFFFF)
+      {
+        return false;
+      }
+    }
+    start += n;
+  }
+  return true;
+}
+
+// Follow a chain of back-to-back records while sequence numbers increase;
+// *seq is the one before the chain's first record and ends at the last one
+static uint32_t walk_chain(uint32_t offset, uint32_t seq_limit, bool index, uint32_t *seq)
+{
+  img_header_t h;
+  while (read_header(offset, &h) && h.seq > *seq && h.seq < seq_limit)
+  {
+    if (index)
+    {
+      push_record(offset, &h);
+    }
+    *seq = h.seq;
+    offset += record_size(h.len);
+  }
+  return offset;
+}
+
+// Where the next append goes after the record chain ended at offset: a cut
+// during an append leaves programmed bytes there, and those are never
+// programmed over, so appends resume at the next sector
+static uint32_t resume_at(uint32_t offset)
+{
+  if (offset >= store_flash.size || is_erased(offset, min(SECTOR_END(offset), store_flash.size)))
+  {
+    return offset;
+  }
+  return min(offset == SECTOR_START(offset) ? offset : SECTOR_END(offset), store_flash.size);
+}
+
+// The newest lap starts at offset 0 and runs up to the head, continuing
+// past the sectors skipped after earlier cuts
+static uint32_t walk_newest(bool index)
+{
+  uint32_t seq = 0;
+  uint32_t end = walk_chain(0, UINT32_MAX, index, &seq);
+  for (;;)
+  {
+    uint32_t next = resume_at(end);
+    img_header_t h;
+    if (next == end || !read_header(next, &h) || h.seq <= seq)
+    {
+      return end;
+    }
+    end = walk_chain(next, UINT32_MAX, index, &seq);
+  }
+}
+
+// First intact header at or after offset; older records past an erased
+// sector start mid-sector, behind the tail of a partly erased record
+static bool find_header(uint32_t offset, uint32_t seq_limit, uint32_t *found)
+{
+  static uint32_t buf[IMG_STORE_SECTOR / 4];
+  for (uint32_t sector = SECTOR_START(offset); sector < store_flash.size; sector += IMG_STORE_SECTOR)
+  {
+    if (store_flash.read(store_flash.ctx, sector, buf, IMG_STORE_SECTOR) != ESP_OK)
+    {
+      return false;
+    }
+    for (uint32_t i = 0; i < IMG_STORE_SECTOR / 4; i++)
+    {
+      uint32_t at = sector + i * 4;
+      img_header_t h;
+      if (at >= offset && buf[i] == IMG_MAGIC && read_header(at, &h) && h.seq < seq_limit)
+      {
+        *found = at;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+esp_err_t imgStoreMount(const img_store_flash_t *flash)
+{
+  if (flash->size < 2 * IMG_STORE_SECTOR || flash->size % IMG_STORE_SECTOR)
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  if (!store_lock)
+  {
+    store_lock = xSemaphoreCreateMutex();
+  }
+  xSemaphoreTake(store_lock, portMAX_DELAY);
+  int64_t start = esp_timer_get_time();
+  store_flash = *flash;
+  rec_first = 0;
+  rec_count = 0;
+
+  img_header_t first;
+  uint32_t first_seq = read_header(0, &first) ? first.seq : UINT32_MAX;
+  head = resume_at(walk_newest(false));
+  erased_until = head < store_flash.size && is_erased(head, min(SECTOR_END(head), store_flash.size))
+                     ? min(SECTOR_END(head), store_flash.size)
+                     : head;
+
+  // Records of the previous lap survive after the head
+  uint32_t old = 0;
+  if (erased_until < store_flash.size && find_header(erased_until, first_seq, &old))
+  {
+    uint32_t seq = 0;
+    walk_chain(old, first_seq, true, &seq);
+  }
+  if (first_seq != UINT32_MAX)
+  {
+    walk_newest(true);
+  }
+  next_seq = rec_count ? record_at(rec_count - 1)->seq + 1 : 1;
+  mount_us = (uint32_t)(esp_timer_get_time() - start);
+  mounted = true;
+  xSemaphoreGive(store_lock);
+  Serial.printf("Image store: %d records, head 0x%x, mounted in %uus\n", rec_count, head, mount_us);
+  return ESP_OK;
+}
+
+esp_err_t imgStoreAppend(const uint8_t *data, size_t len, const struct timeval *timestamp, uint32_t *seq)
+{
+  if (!mounted)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  uint32_t size = record_size(len);
+  if (size > store_flash.size - IMG_STORE_SECTOR)
+  {
+    return ESP_ERR_INVALID_SIZE;
+  }
+  xSemaphoreTake(store_lock, portMAX_DELAY);
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = ESP_OK;
+
+  if (head + size > store_flash.size)
+  {
+    // Wrap. Whatever is left behind the head is the oldest data; dropping
+    // it now keeps reclaim strictly oldest first.
+    while (rec_count && record_at(0)->offset >= head)
+    {
+      pop_oldest();
+    }
+    head = 0;
+    erased_until = 0;
+  }
+  while (erased_until < head + size && err == ESP_OK)
+  {
+    drop_overlapping(erased_until, erased_until + IMG_STORE_SECTOR);
+    err = store_flash.erase(store_flash.ctx, erased_until, IMG_STORE_SECTOR);
+    erased_until += IMG_STORE_SECTOR;
+    erases++;
+  }
+
+  img_header_t h;
+  memset(&h, 0, sizeof(h));
+  h.magic = IMG_MAGIC;
+  h.seq = next_seq;
+  h.len = len;
+  h.crc = esp_rom_crc32_le(0, data, len);
+  h.ts_sec = timestamp ? timestamp->tv_sec : 0;
+  h.ts_usec = timestamp ? timestamp->tv_usec : 0;
+  h.hdr_crc = header_crc(&h);
+  if (err == ESP_OK)
+  {
+    // Payload first, header last: the header is the commit
+    err = store_flash.write(store_flash.ctx, head + sizeof(h), data, len & ~3u);
+  }
+  if (err == ESP_OK && (len & 3))
+  {
+    uint32_t tail = 0xFFFFFFFF;
+    memcpy(&tail, data + (len & ~3u), len & 3);
+    err = store_flash.write(store_flash.ctx, head + sizeof(h) + (len & ~3u), &tail, 4);
+  }
+  if (err == ESP_OK)
+  {
+    err = store_flash.write(store_flash.ctx, head, &h, sizeof(h));
+  }
+  if (err == ESP_OK)
+  {
+    push_record(head, &h);
+    if (seq)
+    {
+      *seq = next_seq;
+    }
+    next_seq++;
+    appends++;
+  }
+  // Even a failed append consumed the space: never program it twice
+  head += size;
+  if (erased_until < head)
+  {
+    erased_until = head;
+  }
+  last_append_us = (uint32_t)(esp_timer_get_time() - start);
+  max_append_us = max(max_append_us, last_append_us);
+  xSemaphoreGive(store_lock);
+  return err;
+}
+
+bool imgStoreMounted()
+{
+  return mounted;
+}
+
+int imgStoreCount()
+{
+  return rec_count;
+}
+
+esp_err_t imgStoreRecord(int index, img_record_t *rec)
+{
+  if (!mounted)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  xSemaphoreTake(store_lock, portMAX_DELAY);
+  esp_err_t err = ESP_ERR_NOT_FOUND;
+  if (index >= 0 && index < rec_count)
+  {
+    *rec = *record_at(index);
+    err = ESP_OK;
+  }
+  xSemaphoreGive(store_lock);
+  return err;
+}
+
+esp_err_t imgStoreFind(uint32_t seq, img_record_t *rec)
+{
+  if (!mounted)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  xSemaphoreTake(store_lock, portMAX_DELAY);
+  esp_err_t err = ESP_ERR_NOT_FOUND;
+  if (rec_count && seq >= record_at(0)->seq)
+  {
+    // Sequence numbers are dense within a mount, so try the direct slot first
+    int i = seq - record_at(0)->seq;
+    if (i < rec_count && record_at(i)->seq == seq)
+    {
+      *rec = *record_at(i);
+      err = ESP_OK;
+    }
+    for (i = 0; err != ESP_OK && i < rec_count; i++)
+    {
+      if (record_at(i)->seq == seq)
+      {
+        *rec = *record_at(i);
+        err = ESP_OK;
+      }
+    }
+  }
+  xSemaphoreGive(store_lock);
+  return err;
+}
+
+esp_err_t imgStoreRead(const img_record_t *rec, uint32_t offset, void *dst, size_t len)
+{
+  if (!mounted || offset + len > rec->len)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  xSemaphoreTake(store_lock, portMAX_DELAY);
+  // The record may have been reclaimed since the caller looked it up
+  esp_err_t err = ESP_ERR_NOT_FOUND;
+  if (rec_count && rec->seq >= record_at(0)->seq && rec->seq < next_seq)
+  {
+    err = store_flash.read(store_flash.ctx, rec->offset + sizeof(img_header_t) + offset, dst, len);
+  }
+  xSemaphoreGive(store_lock);
+  return err;
+}
+
+bool imgStoreVerify(const img_record_t *rec)
+{
+  static uint8_t buf[1024];
+  uint32_t crc = 0;
+  for (uint32_t off = 0; off < rec->len; off += sizeof(buf))
+  {
+    size_t n = min((size_t)(rec->len - off), sizeof(buf));
+    if (imgStoreRead(rec, off, buf, n) != ESP_OK)
+    {
+      return false;
+    }
+    crc = esp_rom_crc32_le(crc, buf, n);
+  }
+  return crc == rec->crc;
+}
+
+int imgStoreMetricsJson(char *p, size_t len)
+{
+  uint32_t used = 0;
+  for (int i = 0; i < rec_count; i++)
+  {
+    used += record_size(record_at(i)->len);
+  }
+  return snprintf(p, len,
+                  "\"imgstore\":{\"mounted\":%u,\"size\":%u,\"records\":%d,\"used\":%u,\"head\":%u,"
+                  "\"appends\":%u,\"erases\":%u,\"last_append_us\":%u,\"max_append_us\":%u,\"mount_us\":%u}",
+                  mounted, mounted ? store_flash.size : 0, rec_count, used, head,
+                  appends, erases, last_append_us, max_append_us, mount_us);
+}
+
+static esp_err_t part_read(void *ctx, uint32_t offset, void *dst, size_t len)
+{
+  return esp_partition_read((const esp_partition_t *)ctx, offset, dst, len);
+}
+
+static esp_err_t part_write(void *ctx, uint32_t offset, const void *src, size_t len)
+{
+  return esp_partition_write((const esp_partition_t *)ctx, offset, src, len);
+}
+
+static esp_err_t part_erase(void *ctx, uint32_t offset, size_t len)
+{
+  return esp_partition_erase_range((const esp_partition_t *)ctx, offset, len);
+}
+
+esp_err_t imgStoreBegin()
+{
+  const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, IMG_STORE_LABEL);
+  if (!part)
+  {
+    Serial.println("Image store: no " IMG_STORE_LABEL " partition");
+    return ESP_ERR_NOT_FOUND;
+  }
+  img_store_flash_t flash = {part_read, part_write, part_erase, part->size & ~(IMG_STORE_SECTOR - 1), (void *)part};
+  return imgStoreMount(&flash);
+}
+
+#ifndef ARDUINO
+typedef struct
+{
+  FILE *fp;
+  int ops_left; // < 0: no power cut
+} file_flash_t;
+
+static esp_err_t file_read(void *ctx, uint32_t offset, void *dst, size_t len)
+{
+  file_flash_t *f = (file_flash_t *)ctx;
+  fseek(f->fp, offset, SEEK_SET);
+  return fread(dst, 1, len, f->fp) == len ? ESP_OK : ESP_FAIL;
+}
+
+// Returns how many bytes the operation may touch before the power goes
+static size_t file_budget(file_flash_t *f, size_t len)
+{
+  if (f->ops_left < 0)
+  {
+    return len;
+  }
+  if (f->ops_left == 0)
+  {
+    return 0;
+  }
+  return --f->ops_left ? len : len / 2;
+}
+
+static esp_err_t file_write(void *ctx, uint32_t offset, const void *src, size_t len)
+{
+  file_flash_t *f = (file_flash_t *)ctx;
+  size_t n = file_budget(f, len);
+  uint8_t buf[256];
+  for (size_t done = 0; done < n;)
+  {
+    size_t chunk = min(n - done, sizeof(buf));
+    fseek(f->fp, offset + done, SEEK_SET);
+    if (fread(buf, 1, chunk, f->fp) != chunk)
+    {
+      return ESP_FAIL;
+    }
+    for (size_t i = 0; i < chunk; i++)
+    {
+      buf[i] &= ((const uint8_t *)src)[done + i]; // NOR: program only clears bits
+    }
+    fseek(f->fp, offset + done, SEEK_SET);
+    fwrite(buf, 1, chunk, f->fp);
+    done += chunk;
+  }
+  fflush(f->fp);
+  return n == len ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t file_erase(void *ctx, uint32_t offset, size_t len)
+{
+  file_flash_t *f = (file_flash_t *)ctx;
+  size_t n = file_budget(f, len);
+  uint8_t erased[IMG_STORE_SECTOR];
+  memset(erased, 0xFF, sizeof(erased));
+  fseek(f->fp, offset, SEEK_SET);
+  for (size_t done = 0; done < n; done += min(n - done, sizeof(erased)))
+  {
+    fwrite(erased, 1, min(n - done, sizeof(erased)), f->fp);
+  }
+  fflush(f->fp);
+  return n == len ? ESP_OK : ESP_FAIL;
+}
+
+bool imgStoreFileFlash(img_store_flash_t *flash, const char *path, uint32_t size, int power_cut_after)
+{
+  FILE *fp = fopen(path, "r+b");
+  if (!fp)
+  {
+    fp = fopen(path, "w+b");
+    if (!fp)
+    {
+      return false;
+    }
+    uint8_t erased[IMG_STORE_SECTOR];
+    memset(erased, 0xFF, sizeof(erased));
+    for (uint32_t i = 0; i < size; i += sizeof(erased))
+    {
+      fwrite(erased, 1, sizeof(erased), fp);
+    }
+    fflush(fp);
+  }
+  file_flash_t *f = new file_flash_t{fp, power_cut_after};
+  *flash = {file_read, file_write, file_erase, size, f};
+  return true;
+}
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+#include <Arduino.h>
+#include <sys/time.h>
+
+// Circular, log-structured JPEG store on a raw data partition ("imgstore").
+// Records are appended back to back as [header][jpeg][pad to 4]; the header
+// is programmed last, so a record is either complete or invisible after a
+// power cut. Sectors ahead of the write head are erased just in time, which
+// drops the oldest records: there is no garbage collection, and an append
+// costs at most one erase per 4 KB sector it touches.
+
+#define IMG_STORE_LABEL "imgstore"
+#define IMG_STORE_SECTOR 4096
+#define IMG_STORE_MAX_RECORDS 256
+
+// Raw flash access; writes may only clear bits (NOR semantics)
+typedef struct
+{
+  esp_err_t (*read)(void *ctx, uint32_t offset, void *dst, size_t len);
+  esp_err_t (*write)(void *ctx, uint32_t offset, const void *src, size_t len);
+  esp_err_t (*erase)(void *ctx, uint32_t offset, size_t len);
+  uint32_t size; // multiple of IMG_STORE_SECTOR
+  void *ctx;
+} img_store_flash_t;
+
+typedef struct
+{
+  uint32_t seq;
+  uint32_t offset; // of the header
+  uint32_t len;    // jpeg bytes
+  uint32_t crc;    // of the jpeg bytes
+  struct timeval timestamp;
+} img_record_t;
+
+// Mount the "imgstore" partition; ESP_ERR_NOT_FOUND if the table has none
+esp_err_t imgStoreBegin();
+// Mount any flash region and rebuild the RAM index
+esp_err_t imgStoreMount(const img_store_flash_t *flash);
+bool imgStoreMounted();
+esp_err_t imgStoreAppend(const uint8_t *data, size_t len, const struct timeval *timestamp, uint32_t *seq);
+// Oldest first; index 0 .. imgStoreCount() - 1
+int imgStoreCount();
+esp_err_t imgStoreRecord(int index, img_record_t *rec);
+esp_err_t imgStoreFind(uint32_t seq, img_record_t *rec);
+// Read part of a record's jpeg; callers stream large images in chunks
+esp_err_t imgStoreRead(const img_record_t *rec, uint32_t offset, void *dst, size_t len);
+// Check a record's jpeg against its CRC
+bool imgStoreVerify(const img_record_t *rec);
+// "imgstore":{...}
+int imgStoreMetricsJson(char *p, size_t len);
+
+#ifndef ARDUINO
+// Host builds: a flash image in a regular file with NOR program/erase
+// semantics. After power_cut_after program/erase operations every further
+// one fails, and the one that hits the limit is only half applied, which
+// lets a test remount and check what survived.
+bool imgStoreFileFlash(img_store_flash_t *flash, const char *path, uint32_t size, int power_cut_after);
+#endif
@@ -0,0 +1,121 @@
+#include "jpeg_crop.h"
+#include <string.h>
+
+typedef struct
+{
+  jpeg_cropper_t *c;
+  jpeg_writer_t w;
+  int pred[JPEG_MAX_COMPS];
+} crop_ctx_t;
+
+static int clamp_pct(int v)
+{
+  return v < 0 ? 0 : v > 100 ? 100 : v;
+}
+
+// [*lo, *hi) of count MCUs of unit pixels covering from..to of size pixels
+static void span(int from, int to, int size, int unit, uint16_t count, uint16_t *lo, uint16_t *hi)
+{
+  int a = from * size / 100 / unit;
+  int b = (to * size / 100 + unit - 1) / unit;
+  a = a < count ? a : count - 1;
+  b = b > count ? count : b;
+  *lo = a;
+  *hi = b > a ? b : a + 1;
+}
+
+void jpegCropRegion(jpeg_cropper_t *c, int x, int y, int w, int h)
+{
+  const jpeg_info_t *info = &c->info;
+  int mw = 8 * info->hmax, mh = 8 * info->vmax;
+  x = clamp_pct(x), y = clamp_pct(y);
+  span(x, clamp_pct(x + w), info->width, mw, info->mcus_x, &c->mx0, &c->mx1);
+  span(y, clamp_pct(y + h), info->height, mh, info->mcus_y, &c->my0, &c->my1);
+  c->x = c->mx0 * mw;
+  c->y = c->my0 * mh;
+  c->width = (c->mx1 * mw < info->width ? c->mx1 * mw : info->width) - c->x;
+  c->height = (c->my1 * mh < info->height ? c->my1 * mh : info->height) - c->y;
+}
+
+static jpeg_err_t put_block(void *arg, int comp, uint16_t bx, uint16_t by, const int16_t *coef)
+{
+  crop_ctx_t *x = (crop_ctx_t *)arg;
+  const jpeg_comp_t *cp = &x->c->info.comp[comp];
+  if (!jpegWriteBlock(&x->w, coef, &x->pred[comp], &x->c->codes[cp->td], &x->c->codes[2 + cp->ta]))
+  {
+    return JPEG_ERR_UNSUPPORTED;
+  }
+  return x->w.full ? JPEG_ERR_SPACE : JPEG_OK;
+}
+
+// With the source's Huffman tables, or the standard ones in their place
+// when the source's are optimized and lack a code the new DC differences
+// need
+static jpeg_err_t crop(jpeg_cropper_t *c, const uint8_t *buf, size_t len, bool std_tables, uint8_t *out, size_t cap,
+                       size_t *out_len)
+{
+  const jpeg_info_t *info = &c->info;
+  crop_ctx_t x;
+  memset(&x, 0, sizeof(x));
+  x.c = c;
+  if (std_tables)
+  {
+    const jpeg_codes_t *std = jpegStdCodes();
+    c->codes[0] = std[0];
+    c->codes[1] = std[2];
+    c->codes[2] = std[1];
+    c->codes[3] = std[3];
+  }
+  else
+  {
+    for (int t = 0; t < 2; t++)
+    {
+      jpegCodesFromHuff(&c->codes[t], &info->dc[t]);
+      jpegCodesFromHuff(&c->codes[2 + t], &info->ac[t]);
+    }
+  }
+  // the headers as they are, but for the frame size and the restart interval
+  jpegWriteBegin(&x.w, out, cap);
+  jpegWriteMarker(&x.w, 0xD8, 0);
+  for (size_t off = 2; off + 4 <= info->scan_off;)
+  {
+    uint8_t marker = buf[off + 1];
+    size_t seg = 2 + (buf[off + 2] << 8 | buf[off + 3]);
+    if (marker == 0xC0 || marker == 0xC1)
+    {
+      uint8_t sof[9];
+      memcpy(sof, buf + off, sizeof(sof));
+      sof[5] = c->height >> 8;
+      sof[6] = c->height;
+      sof[7] = c->width >> 8;
+      sof[8] = c->width;
+      jpegWriteBytes(&x.w, sof, sizeof(sof));
+      jpegWriteBytes(&x.w, buf + off + sizeof(sof), seg - sizeof(sof));
+    }
+    else if (marker == 0xDA && std_tables)
+    {
+      jpegWriteStdTables(&x.w, info->comps > 1);
+      jpegWriteBytes(&x.w, buf + off, seg);
+    }
+    else if (marker != 0xDD && !(marker == 0xC4 && std_tables))
+    {
+      jpegWriteBytes(&x.w, buf + off, seg);
+    }
+    off += seg;
+  }
+  jpeg_err_t res = jpegCodedBlocks(buf, len, info, c->mx0, c->my0, c->mx1, c->my1, put_block, &x);
+  if (res != JPEG_OK)
+  {
+    return res;
+  }
+  jpegWriteAlign(&x.w);
+  jpegWriteMarker(&x.w, 0xD9, 0);
+  *out_len = jpegWriteDone(&x.w);
+  return *out_len ? JPEG_OK : JPEG_ERR_SPACE;
+}
+
+jpeg_err_t jpegCrop(jpeg_cropper_t *c, const uint8_t *buf, size_t len, uint8_t *out, size_t cap, size_t *out_len)
+{
+  jpeg_err_t res = crop(c, buf, len, false, out, cap, out_len);
+  return res == JPEG_ERR_UNSUPPORTED ? crop(c, buf, len, true, out, cap, out_len) : res;
+}
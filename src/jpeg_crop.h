@@ -0,0 +1,31 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "jpeg_write.h"
+
+// Region-of-interest crop of a baseline JPEG in the compressed domain. The
+// region is widened to whole MCUs; the headers are copied with new frame
+// dimensions in the SOF (and without DRI), and the blocks of the MCUs
+// inside are copied as coded, with the source's Huffman tables (the
+// standard ones if the source's are optimized and miss a code). Only the
+// DC terms need new differences, because their predictor now starts at
+// the region's edge. MCUs outside the region are skipped over without
+// decoding their AC terms and the scan is not read past the region's
+// last row; nothing is dequantized or transformed.
+//
+// No Arduino dependencies: host tools link this file as well.
+
+typedef struct
+{
+  jpeg_info_t info;           // jpegParse() of the source
+  jpeg_codes_t codes[4];      // its DC 0, 1 and AC 0, 1 tables
+  uint16_t mx0, my0, mx1, my1; // MCUs, end exclusive
+  uint16_t x, y, width, height; // the same in pixels of the source
+} jpeg_cropper_t;
+
+// Region covering x, y, w, h given in percent of c->info's frame, at least
+// one MCU
+void jpegCropRegion(jpeg_cropper_t *c, int x, int y, int w, int h);
+// Crop buf (c->info parsed from it, region set) into out. *out_len is set
+// on success; JPEG_ERR_SPACE if cap is too small.
+jpeg_err_t jpegCrop(jpeg_cropper_t *c, const uint8_t *buf, size_t len, uint8_t *out, size_t cap, size_t *out_len);
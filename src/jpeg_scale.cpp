@@ -0,0 +1,313 @@
+#include "jpeg_scale.h"
+#include <math.h>
+#include <string.h>
+#include "jpeg_write.h"
+
+// cos_table(n)[x * 8 + u] = C(u)/2 cos((2x+1)u pi/2n) in Q12, for the
+// n-point inverse DCT
+typedef struct
+{
+  int32_t k[3][64]; // n = 1, 2, 4
+} dct_tables_t;
+
+static dct_tables_t make_tables()
+{
+  dct_tables_t t;
+  for (int i = 0; i < 3; i++)
+  {
+    int n = 1 << i;
+    for (int x = 0; x < n; x++)
+    {
+      for (int u = 0; u < n; u++)
+      {
+        double c = (u ? 1.0 : sqrt(0.5)) / 2 * cos((2 * x + 1) * u * M_PI / (2 * n));
+        t.k[i][x * 8 + u] = (int32_t)lround(c * 4096);
+      }
+    }
+  }
+  return t;
+}
+
+static const int32_t *cos_table(int n)
+{
+  static const dct_tables_t t = make_tables();
+  return t.k[n == 4 ? 2 : n == 2 ? 1 : 0];
+}
+
+static inline uint8_t clamp_px(int32_t v)
+{
+  return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+typedef struct
+{
+  jpeg_scaler_t *s;
+  int scale, n; // n x n pixels out of each block
+  const int32_t *idct;
+  uint32_t recip[4][64]; // half the divisor << 16 | 2^18 / divisor, zigzag
+  jpeg_writer_t w;
+  const jpeg_codes_t *codes;
+  int pred[JPEG_MAX_COMPS];
+  uint16_t mcus_x;
+  uint8_t *plane[JPEG_MAX_COMPS];
+  uint16_t stride[JPEG_MAX_COMPS]; // pixels per strip row
+  uint16_t covered[JPEG_MAX_COMPS]; // of those, columns the source reaches
+  uint16_t out_row;
+} scale_ctx_t;
+
+// Low n x n corner of a block through the n-point inverse DCT
+static void reduce(const scale_ctx_t *x, const int16_t *coef, uint8_t *dst, int stride)
+{
+  int n = x->n;
+  if (n == 1)
+  {
+    dst[0] = clamp_px(128 + ((coef[0] + 4) >> 3));
+    return;
+  }
+  bool flat = true; // common in smooth areas and at low quality
+  for (int v = 0; v < n && flat; v++)
+  {
+    for (int u = v ? 0 : 1; u < n; u++)
+    {
+      flat &= !coef[v * 8 + u];
+    }
+  }
+  if (flat)
+  {
+    uint8_t px = clamp_px(128 + ((coef[0] + 4) >> 3));
+    for (int py = 0; py < n; py++)
+    {
+      memset(dst + py * stride, px, n);
+    }
+    return;
+  }
+  const int32_t *k = x->idct;
+  int32_t t[4][4];
+  for (int v = 0; v < n; v++)
+  {
+    for (int px = 0; px < n; px++)
+    {
+      int32_t sum = 0;
+      for (int u = 0; u < n; u++)
+      {
+        sum += coef[v * 8 + u] * k[px * 8 + u];
+      }
+      t[v][px] = (sum + 2048) >> 12;
+    }
+  }
+  for (int py = 0; py < n; py++)
+  {
+    for (int px = 0; px < n; px++)
+    {
+      int32_t sum = 0;
+      for (int v = 0; v < n; v++)
+      {
+        sum += t[v][px] * k[py * 8 + v];
+      }
+      dst[py * stride + px] = clamp_px(128 + ((sum + 2048) >> 12));
+    }
+  }
+}
+
+// Forward DCT of an 8x8 pixel block (the integer LLM one libjpeg calls
+// islow; its output is 8x the true DCT) and quantization by reciprocal
+// multiply; q in natural order
+#define FDCT_BITS 13
+#define PASS1_BITS 2
+#define DESCALE(x, n) (((x) + (1 << ((n)-1))) >> (n))
+
+// One row (shift > 0: scale up by 2^shift) or column (shift < 0: scale
+// back down) of 8 values, output every step apart
+static inline void fdct_1d(const int32_t *v, int32_t *out, int step, int shift)
+{
+  int odd = FDCT_BITS - shift;
+  int32_t tmp0 = v[0] + v[7], tmp7 = v[0] - v[7];
+  int32_t tmp1 = v[1] + v[6], tmp6 = v[1] - v[6];
+  int32_t tmp2 = v[2] + v[5], tmp5 = v[2] - v[5];
+  int32_t tmp3 = v[3] + v[4], tmp4 = v[3] - v[4];
+  int32_t tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+  int32_t tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+  out[0] = shift > 0 ? (tmp10 + tmp11) << shift : DESCALE(tmp10 + tmp11, -shift);
+  out[4 * step] = shift > 0 ? (tmp10 - tmp11) << shift : DESCALE(tmp10 - tmp11, -shift);
+  int32_t z1 = (tmp12 + tmp13) * 4433;
+  out[2 * step] = DESCALE(z1 + tmp13 * 6270, odd);
+  out[6 * step] = DESCALE(z1 - tmp12 * 15137, odd);
+  z1 = tmp4 + tmp7;
+  int32_t z2 = tmp5 + tmp6, z3 = tmp4 + tmp6, z4 = tmp5 + tmp7;
+  int32_t z5 = (z3 + z4) * 9633;
+  tmp4 *= 2446;
+  tmp5 *= 16819;
+  tmp6 *= 25172;
+  tmp7 *= 12299;
+  z1 *= -7373;
+  z2 *= -20995;
+  z3 = z3 * -16069 + z5;
+  z4 = z4 * -3196 + z5;
+  out[7 * step] = DESCALE(tmp4 + z1 + z3, odd);
+  out[5 * step] = DESCALE(tmp5 + z2 + z4, odd);
+  out[3 * step] = DESCALE(tmp6 + z2 + z3, odd);
+  out[1 * step] = DESCALE(tmp7 + z1 + z4, odd);
+}
+
+static void fdct_quant(const uint8_t *src, int stride, const uint32_t *recip, int16_t *q)
+{
+  int32_t d[64], v[8];
+  for (int y = 0; y < 8; y++)
+  {
+    for (int x = 0; x < 8; x++)
+    {
+      v[x] = src[y * stride + x] - 128;
+    }
+    fdct_1d(v, d + y * 8, 1, PASS1_BITS);
+  }
+  for (int x = 0; x < 8; x++)
+  {
+    for (int y = 0; y < 8; y++)
+    {
+      v[y] = d[y * 8 + x];
+    }
+    fdct_1d(v, d + x, 8, -PASS1_BITS);
+  }
+  for (int z = 0; z < 64; z++)
+  {
+    int k = jpeg_natural[z];
+    int32_t v = d[k];
+    int32_t m = (int32_t)(((uint32_t)(v < 0 ? -v : v) + (recip[z] >> 16)) * (recip[z] & 0xFFFF) >> 18);
+    q[k] = v < 0 ? -m : m;
+  }
+}
+
+// Fill the edge padding the source does not reach, then encode the strip
+// as one output MCU row. in_rows is the source MCU rows it holds.
+static void flush(scale_ctx_t *x, int in_rows)
+{
+  const jpeg_info_t *info = &x->s->info;
+  for (int c = 0; c < info->comps; c++)
+  {
+    const jpeg_comp_t *comp = &info->comp[c];
+    int rows = comp->v * 8, filled = in_rows * comp->v * x->n;
+    filled = filled < rows ? filled : rows;
+    int stride = x->stride[c], cov = x->covered[c];
+    for (int y = 0; y < filled; y++)
+    {
+      uint8_t *row = x->plane[c] + y * stride;
+      memset(row + cov, row[cov - 1], stride - cov);
+    }
+    for (int y = filled; y < rows; y++)
+    {
+      memcpy(x->plane[c] + y * stride, x->plane[c] + (filled - 1) * stride, stride);
+    }
+  }
+  int16_t q[64];
+  for (int mx = 0; mx < x->mcus_x; mx++)
+  {
+    for (int c = 0; c < info->comps; c++)
+    {
+      const jpeg_comp_t *comp = &info->comp[c];
+      const jpeg_codes_t *dc = &x->codes[c ? 2 : 0], *ac = &x->codes[c ? 3 : 1];
+      for (int by = 0; by < comp->v; by++)
+      {
+        for (int bx = 0; bx < comp->h; bx++)
+        {
+          const uint8_t *src = x->plane[c] + by * 8 * x->stride[c] + (mx * comp->h + bx) * 8;
+          fdct_quant(src, x->stride[c], x->recip[comp->tq], q);
+          jpegWriteBlock(&x->w, q, &x->pred[c], dc, ac);
+        }
+      }
+    }
+  }
+  x->out_row++;
+}
+
+static jpeg_err_t put_block(void *arg, int c, uint16_t bx, uint16_t by, const int16_t *coef)
+{
+  scale_ctx_t *x = (scale_ctx_t *)arg;
+  const jpeg_comp_t *comp = &x->s->info.comp[c];
+  int row = by / comp->v;
+  if (c == 0 && bx == 0 && by % comp->v == 0 && row && row % x->scale == 0)
+  {
+    // first block of the source MCU row that starts the next strip
+    flush(x, x->scale);
+    if (x->w.full)
+    {
+      return JPEG_ERR_SPACE;
+    }
+  }
+  int px = bx * x->n;
+  if (px >= x->stride[c])
+  {
+    return JPEG_OK;
+  }
+  int py = ((row % x->scale) * comp->v + by % comp->v) * x->n;
+  reduce(x, coef, x->plane[c] + py * x->stride[c] + px, x->stride[c]);
+  return JPEG_OK;
+}
+
+static uint16_t out_mcus(uint16_t size, int scale, int sampling)
+{
+  uint16_t out = (size + scale - 1) / scale;
+  return (out + 8 * sampling - 1) / (8 * sampling);
+}
+
+size_t jpegScaleStripSize(const jpeg_info_t *info, int scale)
+{
+  size_t size = 0;
+  uint16_t mcus_x = out_mcus(info->width, scale, info->hmax);
+  for (int c = 0; c < info->comps; c++)
+  {
+    size += (size_t)mcus_x * info->comp[c].h * 8 * info->comp[c].v * 8;
+  }
+  return size;
+}
+
+jpeg_err_t jpegScale(jpeg_scaler_t *s, const uint8_t *buf, size_t len, int scale, uint8_t *out, size_t cap,
+                     size_t *out_len)
+{
+  const jpeg_info_t *info = &s->info;
+  if ((scale != 2 && scale != 4 && scale != 8) || s->strip_size < jpegScaleStripSize(info, scale))
+  {
+    return JPEG_ERR_SPACE;
+  }
+  scale_ctx_t x;
+  memset(&x, 0, sizeof(x));
+  x.s = s;
+  x.scale = scale;
+  x.n = 8 / scale;
+  x.idct = cos_table(x.n);
+  for (int c = 0; c < info->comps; c++)
+  {
+    for (int z = 0; z < 64; z++)
+    {
+      uint32_t div = 8 * info->qt[info->comp[c].tq][z]; // the DCT above is 8x
+      div = div ? div : 8;
+      x.recip[info->comp[c].tq][z] = (div / 2) << 16 | (((1u << 18) + div / 2) / div);
+    }
+  }
+  x.codes = jpegStdCodes();
+  x.mcus_x = out_mcus(info->width, scale, info->hmax);
+  uint8_t *p = s->strip;
+  for (int c = 0; c < info->comps; c++)
+  {
+    x.plane[c] = p;
+    x.stride[c] = x.mcus_x * info->comp[c].h * 8;
+    x.covered[c] = info->mcus_x * info->comp[c].h * x.n;
+    x.covered[c] = x.covered[c] < x.stride[c] ? x.covered[c] : x.stride[c];
+    p += (size_t)x.stride[c] * info->comp[c].v * 8;
+  }
+  jpegWriteBegin(&x.w, out, cap);
+  jpegWriteHeaders(&x.w, info, (info->width + scale - 1) / scale, (info->height + scale - 1) / scale);
+  jpeg_err_t res = jpegDecodeBlocks(buf, len, info, put_block, &x);
+  if (res != JPEG_OK)
+  {
+    return res;
+  }
+  int left = info->mcus_y - x.out_row * scale;
+  if (left > 0)
+  {
+    flush(&x, left);
+  }
+  jpegWriteAlign(&x.w);
+  jpegWriteMarker(&x.w, 0xD9, 0);
+  *out_len = jpegWriteDone(&x.w);
+  return *out_len ? JPEG_OK : JPEG_ERR_SPACE;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "jpeg_scan.h"
+
+// 1/2, 1/4 and 1/8 scale copies of a baseline JPEG without a full decode.
+// Every 8x8 block is entropy-decoded (jpegDecodeBlocks()) and only its
+// low-frequency corner is kept: the 4x4, 2x2 or DC coefficients go
+// through a reduced inverse DCT of that size straight to the smaller
+// image, the way libjpeg decodes at a reduced scale. The result is
+// re-encoded one MCU row at a time (forward DCT, the source's
+// quantization tables, standard Huffman tables), so the working memory is
+// one output MCU row, not a frame. Components and sampling factors are
+// kept.
+//
+// No Arduino dependencies: host tools link this file as well.
+
+typedef struct
+{
+  jpeg_info_t info;
+  uint8_t *strip; // one output MCU row of pixels, all components
+  size_t strip_size;
+} jpeg_scaler_t;
+
+// Working memory jpegScale() needs for info at scale (2, 4 or 8)
+size_t jpegScaleStripSize(const jpeg_info_t *info, int scale);
+// Scale the frame in buf into out. s->info is what jpegParse() returned
+// for buf and s->strip holds jpegScaleStripSize() bytes for it. *out_len
+// is set on success; JPEG_ERR_SPACE if cap is too small.
+jpeg_err_t jpegScale(jpeg_scaler_t *s, const uint8_t *buf, size_t len, int scale, uint8_t *out, size_t cap,
+                     size_t *out_len);
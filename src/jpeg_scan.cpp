@@ -0,0 +1,556 @@
+#include "jpeg_scan.h"
+#include <string.h>
+
+typedef struct
+{
+  const uint8_t *p, *end;
+  uint32_t acc; // next bits, left-aligned
+  int n;        // valid bits in acc
+  int over;     // bytes made up past a marker or the end
+} bitreader_t;
+
+const uint8_t jpeg_natural[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33, 40, 48,
+    41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+    30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+static uint16_t get_u16(const uint8_t *p)
+{
+  return p[0] << 8 | p[1];
+}
+
+// Top up to at least 25 bits. A marker stops the reader; zeros are fed
+// after it so a truncated scan shows up as over > 0 instead of a fault.
+static inline void fill(bitreader_t *b)
+{
+  while (b->n <= 24)
+  {
+    uint32_t byte = 0;
+    if (b->p < b->end)
+    {
+      byte = *b->p;
+      if (byte != 0xFF)
+      {
+        b->p++;
+      }
+      else if (b->p + 1 < b->end && b->p[1] == 0x00)
+      {
+        b->p += 2; // stuffed 0xFF
+      }
+      else
+      {
+        byte = 0;
+        b->over++;
+      }
+    }
+    else
+    {
+      b->over++;
+    }
+    b->acc |= byte << (24 - b->n);
+    b->n += 8;
+  }
+}
+
+static inline uint32_t get_bits(bitreader_t *b, int k)
+{
+  if (!k)
+  {
+    return 0;
+  }
+  fill(b);
+  uint32_t v = b->acc >> (32 - k);
+  b->acc <<= k;
+  b->n -= k;
+  return v;
+}
+
+static inline int extend(uint32_t v, int s)
+{
+  return v < (1u << (s - 1)) ? (int)v - (1 << s) + 1 : (int)v;
+}
+
+static inline int decode(bitreader_t *b, const jpeg_huff_t *h)
+{
+  fill(b);
+  uint16_t e = h->lookup[b->acc >> (32 - JPEG_LOOKUP_BITS)];
+  if (e)
+  {
+    b->acc <<= e >> 8;
+    b->n -= e >> 8;
+    return e & 0xff;
+  }
+  for (int l = JPEG_LOOKUP_BITS + 1; l <= 16; l++)
+  {
+    int32_t code = b->acc >> (32 - l);
+    if (code <= h->maxcode[l])
+    {
+      b->acc <<= l;
+      b->n -= l;
+      return h->vals[h->valptr[l] + code - h->mincode[l]];
+    }
+  }
+  return -1;
+}
+
+// Skip the 63 AC terms of a block
+static inline int skip_ac(bitreader_t *b, const jpeg_huff_t *h)
+{
+  for (int k = 1; k < 64;)
+  {
+    int rs = decode(b, h);
+    if (rs < 0)
+    {
+      return -1;
+    }
+    int s = rs & 15;
+    if (s)
+    {
+      get_bits(b, s);
+      k += (rs >> 4) + 1;
+    }
+    else if (rs == 0xF0)
+    {
+      k += 16;
+    }
+    else
+    {
+      break; // end of block
+    }
+  }
+  return 0;
+}
+
+// All 63 AC terms of a block, dequantized, into natural order
+static inline int decode_ac(bitreader_t *b, const jpeg_huff_t *h, const uint16_t *qt, int16_t *coef)
+{
+  for (int k = 1; k < 64;)
+  {
+    int rs = decode(b, h);
+    if (rs < 0)
+    {
+      return -1;
+    }
+    int s = rs & 15;
+    if (s)
+    {
+      k += rs >> 4;
+      if (k > 63)
+      {
+        return -1;
+      }
+      coef[jpeg_natural[k]] = extend(get_bits(b, s), s) * qt[k];
+      k++;
+    }
+    else if (rs == 0xF0)
+    {
+      k += 16;
+    }
+    else
+    {
+      break; // end of block
+    }
+  }
+  return 0;
+}
+
+// Past the RSTn marker that ends a restart interval
+static bool restart(bitreader_t *b)
+{
+  b->acc = 0;
+  b->n = 0;
+  b->over = 0;
+  if (b->p + 1 < b->end && b->p[0] == 0xFF && (b->p[1] & 0xF8) == 0xD0)
+  {
+    b->p += 2;
+    return true;
+  }
+  return false;
+}
+
+static jpeg_err_t build_huff(jpeg_huff_t *h, const uint8_t *counts, const uint8_t *vals)
+{
+  int total = 0;
+  for (int l = 0; l < 16; l++)
+  {
+    total += counts[l];
+  }
+  if (total > 256)
+  {
+    return JPEG_ERR_FORMAT;
+  }
+  memcpy(h->vals, vals, total);
+  memset(h->lookup, 0, sizeof(h->lookup));
+  uint32_t code = 0;
+  int k = 0;
+  for (int l = 1; l <= 16; l++)
+  {
+    h->valptr[l] = k;
+    h->mincode[l] = code;
+    for (int i = 0; i < counts[l - 1]; i++, k++, code++)
+    {
+      // more codes than fit in l bits (libjpeg's "bad Huffman table")
+      if (code >= (1u << l))
+      {
+        return JPEG_ERR_FORMAT;
+      }
+      if (l <= JPEG_LOOKUP_BITS)
+      {
+        int shift = JPEG_LOOKUP_BITS - l;
+        for (uint32_t j = 0; j < (1u << shift); j++)
+        {
+          h->lookup[(code << shift) + j] = l << 8 | vals[k];
+        }
+      }
+    }
+    h->maxcode[l] = counts[l - 1] ? (int32_t)code - 1 : -1;
+    code <<= 1;
+  }
+  return JPEG_OK;
+}
+
+static jpeg_err_t parse_sof(const uint8_t *p, size_t len, jpeg_info_t *info)
+{
+  if (len < 6 || p[0] != 8)
+  {
+    return JPEG_ERR_UNSUPPORTED;
+  }
+  info->height = get_u16(p + 1);
+  info->width = get_u16(p + 3);
+  info->comps = p[5];
+  if ((info->comps != 1 && info->comps != 3) || len < 6u + info->comps * 3 || !info->width || !info->height)
+  {
+    return JPEG_ERR_UNSUPPORTED;
+  }
+  info->hmax = info->vmax = 1;
+  for (int i = 0; i < info->comps; i++)
+  {
+    jpeg_comp_t *c = &info->comp[i];
+    c->id = p[6 + i * 3];
+    c->h = p[7 + i * 3] >> 4;
+    c->v = p[7 + i * 3] & 15;
+    c->tq = p[8 + i * 3] & 3;
+    if (info->comps == 1)
+    {
+      c->h = c->v = 1; // a single-component scan is never interleaved
+    }
+    if (c->h < 1 || c->h > 4 || c->v < 1 || c->v > 4)
+    {
+      return JPEG_ERR_FORMAT;
+    }
+    info->hmax = c->h > info->hmax ? c->h : info->hmax;
+    info->vmax = c->v > info->vmax ? c->v : info->vmax;
+  }
+  info->mcus_x = (info->width + 8 * info->hmax - 1) / (8 * info->hmax);
+  info->mcus_y = (info->height + 8 * info->vmax - 1) / (8 * info->vmax);
+  info->luma_cols = info->mcus_x * info->comp[0].h;
+  info->luma_rows = info->mcus_y * info->comp[0].v;
+  return JPEG_OK;
+}
+
+static jpeg_err_t parse_dht(const uint8_t *p, size_t len, jpeg_info_t *info)
+{
+  while (len >= 17)
+  {
+    int tc = p[0] >> 4, th = p[0] & 15;
+    int total = 0;
+    for (int l = 0; l < 16; l++)
+    {
+      total += p[1 + l];
+    }
+    if (tc > 1 || th > 1)
+    {
+      return JPEG_ERR_UNSUPPORTED;
+    }
+    if (len < 17u + total)
+    {
+      return JPEG_ERR_FORMAT;
+    }
+    jpeg_err_t res = build_huff(tc ? &info->ac[th] : &info->dc[th], p + 1, p + 17);
+    if (res)
+    {
+      return res;
+    }
+    p += 17 + total;
+    len -= 17 + total;
+  }
+  return JPEG_OK;
+}
+
+static jpeg_err_t parse_dqt(const uint8_t *p, size_t len, jpeg_info_t *info)
+{
+  while (len >= 65)
+  {
+    int pq = p[0] >> 4, tq = p[0] & 3;
+    size_t n = pq ? 129 : 65;
+    if (len < n)
+    {
+      return JPEG_ERR_FORMAT;
+    }
+    for (int i = 0; i < 64; i++)
+    {
+      info->qt[tq][i] = pq ? get_u16(p + 1 + i * 2) : p[1 + i];
+    }
+    p += n;
+    len -= n;
+  }
+  return JPEG_OK;
+}
+
+static jpeg_err_t parse_sos(const uint8_t *p, size_t len, jpeg_info_t *info)
+{
+  if (len < 1 || p[0] != info->comps || len < 4u + p[0] * 2)
+  {
+    return JPEG_ERR_UNSUPPORTED; // non-interleaved colour scans
+  }
+  // put the components in scan order
+  jpeg_comp_t frame[JPEG_MAX_COMPS];
+  memcpy(frame, info->comp, sizeof(frame));
+  for (int i = 0; i < info->comps; i++)
+  {
+    int found = -1;
+    for (int j = 0; j < info->comps; j++)
+    {
+      if (frame[j].id == p[1 + i * 2])
+      {
+        found = j;
+      }
+    }
+    if (found < 0 || (p[2 + i * 2] >> 4) > 1 || (p[2 + i * 2] & 15) > 1)
+    {
+      return JPEG_ERR_FORMAT;
+    }
+    info->comp[i] = frame[found];
+    info->comp[i].td = p[2 + i * 2] >> 4;
+    info->comp[i].ta = p[2 + i * 2] & 15;
+  }
+  return JPEG_OK;
+}
+
+jpeg_err_t jpegParse(const uint8_t *buf, size_t len, jpeg_info_t *info)
+{
+  memset(info, 0, sizeof(*info));
+  if (len < 4 || buf[0] != 0xFF || buf[1] != 0xD8)
+  {
+    return JPEG_ERR_FORMAT;
+  }
+  size_t off = 2;
+  bool have_sof = false;
+  while (off + 4 <= len)
+  {
+    if (buf[off] != 0xFF)
+    {
+      return JPEG_ERR_FORMAT;
+    }
+    uint8_t marker = buf[off + 1];
+    if (marker == 0xFF)
+    {
+      off++; // fill byte
+      continue;
+    }
+    size_t seg = get_u16(buf + off + 2);
+    if (seg < 2 || off + 2 + seg > len)
+    {
+      return JPEG_ERR_FORMAT;
+    }
+    const uint8_t *p = buf + off + 4;
+    size_t plen = seg - 2;
+    jpeg_err_t res = JPEG_OK;
+    if (marker == 0xC0 || marker == 0xC1)
+    {
+      info->sof_off = off;
+      res = parse_sof(p, plen, info);
+      have_sof = true;
+    }
+    else if ((marker >= 0xC2 && marker <= 0xCF) && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+    {
+      return JPEG_ERR_UNSUPPORTED; // progressive, lossless, arithmetic
+    }
+    else if (marker == 0xC4)
+    {
+      res = parse_dht(p, plen, info);
+    }
+    else if (marker == 0xDB)
+    {
+      res = parse_dqt(p, plen, info);
+    }
+    else if (marker == 0xDD && plen >= 2)
+    {
+      info->restart_interval = get_u16(p);
+    }
+    else if (marker == 0xDA)
+    {
+      if (!have_sof)
+      {
+        return JPEG_ERR_FORMAT;
+      }
+      res = parse_sos(p, plen, info);
+      info->scan_off = off + 2 + seg;
+      return res;
+    }
+    else if (marker == 0xD9)
+    {
+      return JPEG_ERR_FORMAT;
+    }
+    if (res)
+    {
+      return res;
+    }
+    off += 2 + seg;
+  }
+  return JPEG_ERR_FORMAT;
+}
+
+jpeg_err_t jpegLumaDc(const uint8_t *buf, size_t len, const jpeg_info_t *info, int16_t *dc, size_t max)
+{
+  size_t cols = info->luma_cols;
+  if ((size_t)info->luma_cols * info->luma_rows > max)
+  {
+    return JPEG_ERR_SPACE;
+  }
+  bitreader_t b = {buf + info->scan_off, buf + len, 0, 0, 0};
+  int pred[JPEG_MAX_COMPS] = {0};
+  uint16_t q0 = info->qt[info->comp[0].tq][0];
+  int luma_h = info->comp[0].h, luma_v = info->comp[0].v;
+  uint32_t todo = info->restart_interval;
+  for (int my = 0; my < info->mcus_y; my++)
+  {
+    for (int mx = 0; mx < info->mcus_x; mx++)
+    {
+      if (info->restart_interval)
+      {
+        if (!todo)
+        {
+          if (!restart(&b))
+          {
+            return JPEG_ERR_DATA;
+          }
+          memset(pred, 0, sizeof(pred));
+          todo = info->restart_interval;
+        }
+        todo--;
+      }
+      for (int c = 0; c < info->comps; c++)
+      {
+        const jpeg_comp_t *comp = &info->comp[c];
+        for (int by = 0; by < comp->v; by++)
+        {
+          for (int bx = 0; bx < comp->h; bx++)
+          {
+            int s = decode(&b, &info->dc[comp->td]);
+            if (s < 0 || s > 11)
+            {
+              return JPEG_ERR_DATA;
+            }
+            pred[c] += s ? extend(get_bits(&b, s), s) : 0;
+            if (c == 0)
+            {
+              dc[(my * luma_v + by) * cols + mx * luma_h + bx] = pred[0] * q0;
+            }
+            if (skip_ac(&b, &info->ac[comp->ta]))
+            {
+              return JPEG_ERR_DATA;
+            }
+          }
+        }
+      }
+      // up to four made-up bytes are only read ahead, not consumed
+      if (b.over > 4)
+      {
+        return JPEG_ERR_DATA;
+      }
+    }
+  }
+  return JPEG_OK;
+}
+
+// Blocks of the MCUs in [mx0, mx1) x [my0, my1) go to fn, dequantized or
+// as coded; the others are only skipped over, and the walk stops after the
+// last row it needs
+static jpeg_err_t walk_blocks(const uint8_t *buf, size_t len, const jpeg_info_t *info, uint16_t mx0, uint16_t my0,
+                              uint16_t mx1, uint16_t my1, bool dequant, jpeg_block_fn fn, void *ctx)
+{
+  static const uint16_t unit_qt[64] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+                                       1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+                                       1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+  bitreader_t b = {buf + info->scan_off, buf + len, 0, 0, 0};
+  int pred[JPEG_MAX_COMPS] = {0};
+  int16_t coef[64];
+  uint32_t todo = info->restart_interval;
+  for (int my = 0; my < my1; my++)
+  {
+    for (int mx = 0; mx < info->mcus_x; mx++)
+    {
+      if (info->restart_interval)
+      {
+        if (!todo)
+        {
+          if (!restart(&b))
+          {
+            return JPEG_ERR_DATA;
+          }
+          memset(pred, 0, sizeof(pred));
+          todo = info->restart_interval;
+        }
+        todo--;
+      }
+      bool wanted = my >= my0 && mx >= mx0 && mx < mx1;
+      for (int c = 0; c < info->comps; c++)
+      {
+        const jpeg_comp_t *comp = &info->comp[c];
+        const uint16_t *qt = dequant ? info->qt[comp->tq] : unit_qt;
+        for (int by = 0; by < comp->v; by++)
+        {
+          for (int bx = 0; bx < comp->h; bx++)
+          {
+            int s = decode(&b, &info->dc[comp->td]);
+            if (s < 0 || s > 11)
+            {
+              return JPEG_ERR_DATA;
+            }
+            pred[c] += s ? extend(get_bits(&b, s), s) : 0;
+            if (!wanted)
+            {
+              if (skip_ac(&b, &info->ac[comp->ta]))
+              {
+                return JPEG_ERR_DATA;
+              }
+              continue;
+            }
+            memset(coef, 0, sizeof(coef));
+            coef[0] = pred[c] * qt[0];
+            if (decode_ac(&b, &info->ac[comp->ta], qt, coef))
+            {
+              return JPEG_ERR_DATA;
+            }
+            jpeg_err_t res = fn(ctx, c, mx * comp->h + bx, my * comp->v + by, coef);
+            if (res != JPEG_OK)
+            {
+              return res;
+            }
+          }
+        }
+      }
+      if (b.over > 4)
+      {
+        return JPEG_ERR_DATA;
+      }
+    }
+  }
+  return JPEG_OK;
+}
+
+jpeg_err_t jpegDecodeBlocks(const uint8_t *buf, size_t len, const jpeg_info_t *info, jpeg_block_fn fn, void *ctx)
+{
+  return walk_blocks(buf, len, info, 0, 0, info->mcus_x, info->mcus_y, true, fn, ctx);
+}
+
+jpeg_err_t jpegCodedBlocks(const uint8_t *buf, size_t len, const jpeg_info_t *info, uint16_t mx0, uint16_t my0,
+                           uint16_t mx1, uint16_t my1, jpeg_block_fn fn, void *ctx)
+{
+  if (mx0 >= mx1 || my0 >= my1 || mx1 > info->mcus_x || my1 > info->mcus_y)
+  {
+    return JPEG_ERR_FORMAT;
+  }
+  return walk_blocks(buf, len, info, mx0, my0, mx1, my1, false, fn, ctx);
+}
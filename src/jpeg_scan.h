@@ -0,0 +1,88 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Baseline JPEG header parser and entropy-scan walker, for work that can
+// be done on the compressed frames without decoding them. The Huffman
+// data is walked block by block; AC coefficients are decoded only far
+// enough to skip them, so extracting the DC terms (one value per 8x8
+// block: a 1/8-scale image) costs a fraction of a full decode and no IDCT.
+//
+// Handles what the camera sensors and libjpeg produce: 8-bit baseline,
+// one or three components, any sampling factors, restart intervals.
+// Progressive and arithmetic-coded files are refused.
+//
+// No Arduino dependencies: host tools link this file as well.
+
+#define JPEG_MAX_COMPS 3
+#define JPEG_LOOKUP_BITS 9 // codes up to this long decode with one table read
+
+typedef enum
+{
+  JPEG_OK = 0,
+  JPEG_ERR_FORMAT = -1,      // not a JPEG, or a truncated header
+  JPEG_ERR_UNSUPPORTED = -2, // progressive, arithmetic, 12-bit, ...
+  JPEG_ERR_DATA = -3,        // corrupt or truncated entropy-coded data
+  JPEG_ERR_SPACE = -4,       // output buffer too small
+} jpeg_err_t;
+
+typedef struct
+{
+  uint16_t lookup[1 << JPEG_LOOKUP_BITS]; // len << 8 | symbol, 0 for longer codes
+  int32_t maxcode[17];                    // by code length, -1 if none
+  uint16_t mincode[17];
+  uint16_t valptr[17];
+  uint8_t vals[256];
+} jpeg_huff_t;
+
+typedef struct
+{
+  uint8_t id;
+  uint8_t h, v; // sampling factors
+  uint8_t tq;   // quantization table
+  uint8_t td, ta; // Huffman tables, from the scan header
+} jpeg_comp_t;
+
+// About 6 KB, nearly all of it the Huffman tables: too big for a task stack,
+// so it and the scaler and cropper that embed it live in static or heap
+// storage
+typedef struct
+{
+  uint16_t width, height;
+  uint8_t comps;
+  jpeg_comp_t comp[JPEG_MAX_COMPS]; // in scan order
+  uint8_t hmax, vmax;
+  uint16_t mcus_x, mcus_y;
+  uint16_t luma_cols, luma_rows; // 8x8 luminance blocks, edge padding included
+  uint16_t restart_interval;     // MCUs, 0 if none
+  uint16_t qt[4][64];            // zigzag order
+  jpeg_huff_t dc[2], ac[2];
+  size_t sof_off;  // offset of the SOF marker
+  size_t scan_off; // first byte of entropy-coded data
+} jpeg_info_t;
+
+// Parse the headers up to the first scan
+jpeg_err_t jpegParse(const uint8_t *buf, size_t len, jpeg_info_t *info);
+
+// Dequantized DC coefficient of every luminance block, row by row
+// (luma_cols x luma_rows): 8 x (mean level - 128). info is what jpegParse
+// returned for the same buffer.
+jpeg_err_t jpegLumaDc(const uint8_t *buf, size_t len, const jpeg_info_t *info, int16_t *dc, size_t max);
+
+// Natural (row-major) position of each zigzag index
+extern const uint8_t jpeg_natural[64];
+
+// Called for every block in scan order with its component (index into
+// info->comp), its position in that component's block grid and its
+// dequantized coefficients in natural order. Anything but JPEG_OK stops
+// the walk and is returned by jpegDecodeBlocks().
+typedef jpeg_err_t (*jpeg_block_fn)(void *ctx, int comp, uint16_t bx, uint16_t by, const int16_t *coef);
+
+// Entropy-decode every block, still without an IDCT
+jpeg_err_t jpegDecodeBlocks(const uint8_t *buf, size_t len, const jpeg_info_t *info, jpeg_block_fn fn, void *ctx);
+// Only the MCUs in [mx0, mx1) x [my0, my1), with the coefficients as coded
+// (quantized; the DC term absolute, not a difference). The rest of the
+// scan is skipped over without decoding the AC terms, and nothing past
+// row my1 - 1 is read.
+jpeg_err_t jpegCodedBlocks(const uint8_t *buf, size_t len, const jpeg_info_t *info, uint16_t mx0, uint16_t my0,
+                           uint16_t mx1, uint16_t my1, jpeg_block_fn fn, void *ctx);
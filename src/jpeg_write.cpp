@@ -0,0 +1,265 @@
+#include "jpeg_write.h"
+#include <string.h>
+
+// Annex K.3 tables
+static const uint8_t dc_luma_counts[16] = {0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+static const uint8_t dc_chroma_counts[16] = {0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0};
+static const uint8_t dc_vals[12] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11};
+static const uint8_t ac_luma_counts[16] = {0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d};
+static const uint8_t ac_luma_vals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14,
+    0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09,
+    0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a,
+    0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65,
+    0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88,
+    0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9,
+    0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca,
+    0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+    0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+static const uint8_t ac_chroma_counts[16] = {0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77};
+static const uint8_t ac_chroma_vals[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32,
+    0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16,
+    0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64,
+    0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86,
+    0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8,
+    0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+    0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa};
+
+static jpeg_codes_t std_codes[4];
+static bool std_ready = false;
+
+void jpegWriteBegin(jpeg_writer_t *w, uint8_t *out, size_t cap)
+{
+  w->p = w->start = out;
+  w->end = out + cap;
+  w->acc = 0;
+  w->n = 0;
+  w->full = false;
+}
+
+void jpegWriteBytes(jpeg_writer_t *w, const void *data, size_t len)
+{
+  if (w->full || (size_t)(w->end - w->p) < len)
+  {
+    w->full = true;
+    return;
+  }
+  memcpy(w->p, data, len);
+  w->p += len;
+}
+
+void jpegWriteMarker(jpeg_writer_t *w, uint8_t marker, uint16_t seg_len)
+{
+  uint8_t m[4] = {0xFF, marker, (uint8_t)(seg_len >> 8), (uint8_t)seg_len};
+  jpegWriteBytes(w, m, seg_len ? 4 : 2);
+}
+
+void jpegWriteBits(jpeg_writer_t *w, uint32_t bits, int n)
+{
+  // at most 16 bits at a time, so acc never holds more than 23
+  while (n > 16)
+  {
+    n -= 16;
+    jpegWriteBits(w, bits >> n, 16);
+  }
+  w->acc = (w->acc << n) | (bits & ((1u << n) - 1));
+  w->n += n;
+  while (w->n >= 8)
+  {
+    w->n -= 8;
+    uint8_t byte = w->acc >> w->n;
+    if (w->end - w->p < 2)
+    {
+      w->full = true;
+      w->n = 0;
+      return;
+    }
+    *w->p++ = byte;
+    if (byte == 0xFF)
+    {
+      *w->p++ = 0;
+    }
+  }
+}
+
+void jpegWriteAlign(jpeg_writer_t *w)
+{
+  if (w->n)
+  {
+    jpegWriteBits(w, 0x7F, 8 - w->n);
+  }
+}
+
+size_t jpegWriteDone(jpeg_writer_t *w)
+{
+  return w->full ? 0 : w->p - w->start;
+}
+
+void jpegCodes(jpeg_codes_t *t, const uint8_t *counts, const uint8_t *vals)
+{
+  memset(t->size, 0, sizeof(t->size));
+  uint32_t code = 0;
+  int k = 0;
+  for (int l = 1; l <= 16; l++)
+  {
+    for (int i = 0; i < counts[l - 1]; i++, k++, code++)
+    {
+      t->code[vals[k]] = code;
+      t->size[vals[k]] = l;
+    }
+    code <<= 1;
+  }
+}
+
+void jpegCodesFromHuff(jpeg_codes_t *t, const jpeg_huff_t *h)
+{
+  memset(t->size, 0, sizeof(t->size));
+  for (int l = 1; l <= 16; l++)
+  {
+    for (int32_t code = h->mincode[l]; code <= h->maxcode[l]; code++)
+    {
+      uint8_t sym = h->vals[h->valptr[l] + code - h->mincode[l]];
+      t->code[sym] = code;
+      t->size[sym] = l;
+    }
+  }
+}
+
+static int magnitude(int v)
+{
+  int s = 0;
+  for (v = v < 0 ? -v : v; v; v >>= 1)
+  {
+    s++;
+  }
+  return s;
+}
+
+static void write_value(jpeg_writer_t *w, int v, int s)
+{
+  jpegWriteBits(w, v < 0 ? v - 1 : v, s);
+}
+
+bool jpegWriteBlock(jpeg_writer_t *w, const int16_t *q, int *pred, const jpeg_codes_t *dc, const jpeg_codes_t *ac)
+{
+  int diff = q[0] - *pred;
+  *pred = q[0];
+  int s = magnitude(diff);
+  bool ok = dc->size[s];
+  jpegWriteBits(w, dc->code[s], dc->size[s]);
+  write_value(w, diff, s);
+  int run = 0;
+  for (int k = 1; k < 64; k++)
+  {
+    int v = q[jpeg_natural[k]];
+    if (!v)
+    {
+      run++;
+      continue;
+    }
+    for (; run > 15; run -= 16)
+    {
+      ok &= ac->size[0xF0] != 0;
+      jpegWriteBits(w, ac->code[0xF0], ac->size[0xF0]);
+    }
+    s = magnitude(v);
+    int rs = run << 4 | s;
+    ok &= ac->size[rs] != 0;
+    jpegWriteBits(w, ac->code[rs], ac->size[rs]);
+    write_value(w, v, s);
+    run = 0;
+  }
+  if (run)
+  {
+    ok &= ac->size[0] != 0;
+    jpegWriteBits(w, ac->code[0], ac->size[0]); // end of block
+  }
+  return ok;
+}
+
+const jpeg_codes_t *jpegStdCodes()
+{
+  if (!std_ready)
+  {
+    jpegCodes(&std_codes[0], dc_luma_counts, dc_vals);
+    jpegCodes(&std_codes[1], ac_luma_counts, ac_luma_vals);
+    jpegCodes(&std_codes[2], dc_chroma_counts, dc_vals);
+    jpegCodes(&std_codes[3], ac_chroma_counts, ac_chroma_vals);
+    std_ready = true;
+  }
+  return std_codes;
+}
+
+static void write_dht(jpeg_writer_t *w, uint8_t tc_th, const uint8_t *counts, const uint8_t *vals, int total)
+{
+  jpegWriteBytes(w, &tc_th, 1);
+  jpegWriteBytes(w, counts, 16);
+  jpegWriteBytes(w, vals, total);
+}
+
+void jpegWriteStdTables(jpeg_writer_t *w, bool colour)
+{
+  // the chrominance tables only for colour
+  jpegWriteMarker(w, 0xC4, 2 + (17 + 12) + (17 + 162) + (colour ? (17 + 12) + (17 + 162) : 0));
+  write_dht(w, 0x00, dc_luma_counts, dc_vals, 12);
+  write_dht(w, 0x10, ac_luma_counts, ac_luma_vals, 162);
+  if (colour)
+  {
+    write_dht(w, 0x01, dc_chroma_counts, dc_vals, 12);
+    write_dht(w, 0x11, ac_chroma_counts, ac_chroma_vals, 162);
+  }
+}
+
+void jpegWriteHeaders(jpeg_writer_t *w, const jpeg_info_t *info, uint16_t width, uint16_t height)
+{
+  jpegWriteMarker(w, 0xD8, 0);
+  // DQT: each table the components use, 8-bit when the values allow
+  uint8_t used = 0;
+  for (int c = 0; c < info->comps; c++)
+  {
+    used |= 1 << info->comp[c].tq;
+  }
+  for (int t = 0; t < 4; t++)
+  {
+    if (!(used & 1 << t))
+    {
+      continue;
+    }
+    bool wide = false;
+    for (int i = 0; i < 64; i++)
+    {
+      wide |= info->qt[t][i] > 255;
+    }
+    jpegWriteMarker(w, 0xDB, wide ? 131 : 67);
+    uint8_t pq_tq = (wide ? 0x10 : 0) | t;
+    jpegWriteBytes(w, &pq_tq, 1);
+    for (int i = 0; i < 64; i++)
+    {
+      uint8_t v[2] = {(uint8_t)(info->qt[t][i] >> 8), (uint8_t)info->qt[t][i]};
+      jpegWriteBytes(w, wide ? v : v + 1, wide ? 2 : 1);
+    }
+  }
+  // SOF0
+  jpegWriteMarker(w, 0xC0, 8 + 3 * info->comps);
+  uint8_t sof[6] = {8, (uint8_t)(height >> 8), (uint8_t)height, (uint8_t)(width >> 8), (uint8_t)width, info->comps};
+  jpegWriteBytes(w, sof, sizeof(sof));
+  for (int c = 0; c < info->comps; c++)
+  {
+    uint8_t spec[3] = {info->comp[c].id, (uint8_t)(info->comp[c].h << 4 | info->comp[c].v), info->comp[c].tq};
+    jpegWriteBytes(w, spec, 3);
+  }
+  jpegWriteStdTables(w, info->comps > 1);
+  // SOS
+  jpegWriteMarker(w, 0xDA, 6 + 2 * info->comps);
+  jpegWriteBytes(w, &info->comps, 1);
+  for (int c = 0; c < info->comps; c++)
+  {
+    uint8_t spec[2] = {info->comp[c].id, (uint8_t)(c ? 0x11 : 0x00)};
+    jpegWriteBytes(w, spec, 2);
+  }
+  uint8_t tail[3] = {0, 63, 0};
+  jpegWriteBytes(w, tail, 3);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "jpeg_scan.h"
+
+// Baseline JPEG output for the compressed-domain transforms: a bit writer
+// with 0xFF stuffing, Huffman code tables, block entropy coding and the
+// headers of a file that uses the standard (Annex K) Huffman tables. A
+// full buffer is reported once at the end (jpegWriteDone()), so callers
+// write without checking each step.
+//
+// No Arduino dependencies: host tools link this file as well.
+
+typedef struct
+{
+  uint8_t *p, *start, *end;
+  uint32_t acc; // pending bits, right-aligned
+  int n;        // pending bit count
+  bool full;
+} jpeg_writer_t;
+
+typedef struct
+{
+  uint16_t code[256];
+  uint8_t size[256]; // 0 if the symbol has no code
+} jpeg_codes_t;
+
+void jpegWriteBegin(jpeg_writer_t *w, uint8_t *out, size_t cap);
+void jpegWriteBytes(jpeg_writer_t *w, const void *data, size_t len);
+void jpegWriteMarker(jpeg_writer_t *w, uint8_t marker, uint16_t seg_len);
+void jpegWriteBits(jpeg_writer_t *w, uint32_t bits, int n);
+// Pad the entropy-coded data to a byte with 1 bits
+void jpegWriteAlign(jpeg_writer_t *w);
+// Bytes written, or 0 if the buffer ran out
+size_t jpegWriteDone(jpeg_writer_t *w);
+
+// Codes for a DHT table (16 counts, then the symbols)
+void jpegCodes(jpeg_codes_t *t, const uint8_t *counts, const uint8_t *vals);
+// The codes of a table jpegParse() read, to write with the source's tables
+void jpegCodesFromHuff(jpeg_codes_t *t, const jpeg_huff_t *h);
+// One block: quantized coefficients in natural order, *pred is the
+// component's previous DC value. False if the tables have no code for a
+// symbol it needs (only possible with optimized source tables).
+bool jpegWriteBlock(jpeg_writer_t *w, const int16_t *q, int *pred, const jpeg_codes_t *dc, const jpeg_codes_t *ac);
+
+// SOI to SOS for a width x height baseline file with info's components,
+// sampling factors and quantization tables and the standard Huffman
+// tables (DC/AC 0 for the first component, 1 for the others)
+void jpegWriteHeaders(jpeg_writer_t *w, const jpeg_info_t *info, uint16_t width, uint16_t height);
+// DHT segment with the standard tables, as ids 0 (luminance) and 1
+// (chrominance, colour only)
+void jpegWriteStdTables(jpeg_writer_t *w, bool colour);
+// Codes of the standard tables: luminance DC, AC, chrominance DC, AC
+const jpeg_codes_t *jpegStdCodes();
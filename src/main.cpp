@@ -2,6 +2,18 @@
 #include <WiFi.h>
 #include "OTA.h"
 #include "tft.h"
+#include "profiles.h"
+#include "sensor_traits.h"
+#include "wifi_conn.h"
+#include "boot_timing.h"
+#include "timelapse.h"
+#include "frame_source.h"
+#include "quiesce.h"
+#include "cam_sync.h"
+#include "wall_clock.h"
+#include "mcast.h"
+#include "ctrl_channel.h"
+#include "motion.h"
 //
 // WARNING!!! PSRAM IC required for UXGA resolution and high JPEG quality
 //            Ensure ESP32 Wrover Module or other board with PSRAM is selected
@@ -32,6 +44,7 @@
 //#define CAMERA_MODEL_DFRobot_FireBeetle2_ESP32S3 // Has PSRAM
 //#define CAMERA_MODEL_DFRobot_Romeo_ESP32S3 // Has PSRAM
 #include "camera_pins.h"
+#include "board_traits.h"
 
 // ===========================
 // Enter your WiFi credentials
@@ -42,31 +55,69 @@ const char* password = "0425271998";
 void startCameraServer();
 void setupLedFlash(int pin);
 void loopServer();
+void restartCameraServer();
+
+static SemaphoreHandle_t lcd_ready;
+static bool network_started = false;
+
+// Everything that needs an address; runs once the first IP is assigned,
+// at boot or from the reconnect hook when the AP was down at boot
+static void start_network()
+{
+  clockBegin();
+  mcastBegin();
+  ctrlBegin();
+  setupOTA();
+  syncBegin();
+  network_started = true;
+}
+
+static void on_wifi_reconnect()
+{
+  if (!network_started)
+  {
+    start_network();
+    Serial.print("WiFi up, use 'http://");
+    Serial.print(WiFi.localIP());
+    Serial.println("' to connect");
+    tftPrint(WiFi.localIP().toString(), 1);
+    return;
+  }
+  restartCameraServer();
+  ctrlRestart();
+  ArduinoOTA.end();
+  ArduinoOTA.begin();
+}
+
+// The panel's reset and init delays run here, in parallel with the camera
+static void lcd_task(void *arg)
+{
+  setupLCD();
+  bootMark("lcd");
+  xSemaphoreGive(lcd_ready);
+  vTaskDelete(NULL);
+}
 
 void setup() {
   Serial.begin(115200);
   Serial.setDebugOutput(true);
   Serial.println();
 
+  // a timelapse wake-up only needs the camera and the uplink
+  bool timelapse = timelapseWakeup();
+
+  // association runs in the WiFi task while the camera and LCD come up
+  wifiBegin(ssid, password);
+  bootMark("wifi_begin");
+  lcd_ready = xSemaphoreCreateBinary();
+  if (!timelapse) {
+    xTaskCreatePinnedToCore(lcd_task, "lcd", 4096, NULL, 1, NULL, 0);
+  }
+
   camera_config_t config;
   config.ledc_channel = LEDC_CHANNEL_0;
   config.ledc_timer = LEDC_TIMER_0;
-  config.pin_d0 = Y2_GPIO_NUM;
-  config.pin_d1 = Y3_GPIO_NUM;
-  config.pin_d2 = Y4_GPIO_NUM;
-  config.pin_d3 = Y5_GPIO_NUM;
-  config.pin_d4 = Y6_GPIO_NUM;
-  config.pin_d5 = Y7_GPIO_NUM;
-  config.pin_d6 = Y8_GPIO_NUM;
-  config.pin_d7 = Y9_GPIO_NUM;
-  config.pin_xclk = XCLK_GPIO_NUM;
-  config.pin_pclk = PCLK_GPIO_NUM;
-  config.pin_vsync = VSYNC_GPIO_NUM;
-  config.pin_href = HREF_GPIO_NUM;
-  config.pin_sccb_sda = SIOD_GPIO_NUM;
-  config.pin_sccb_scl = SIOC_GPIO_NUM;
-  config.pin_pwdn = PWDN_GPIO_NUM;
-  config.pin_reset = RESET_GPIO_NUM;
+  boardConfig(&config, camera_board);
   config.xclk_freq_hz = 20000000;
   config.frame_size = FRAMESIZE_UXGA;
   config.pixel_format = PIXFORMAT_JPEG; // for streaming
@@ -107,54 +158,62 @@ void setup() {
     Serial.printf("Camera init failed with error 0x%x", err);
     return;
   }
+  bootMark("camera");
+  frameSourceBegin(config.fb_count);
+  quiesceInit(&config);
 
   sensor_t * s = esp_camera_sensor_get();
-  // initial sensors are flipped vertically and colors are a bit saturated
-  if (s->id.PID == OV3660_PID) {
-    s->set_vflip(s, 1); // flip it back
-    s->set_brightness(s, 1); // up the brightness just a bit
-    s->set_saturation(s, -2); // lower the saturation
-  }
+  sensorTraitsInit(s);
+  sensorApplyDefaults(s);
   // drop down frame size for higher initial frame rate
   if(config.pixel_format == PIXFORMAT_JPEG){
     s->set_framesize(s, FRAMESIZE_QVGA);
   }
 
-#if defined(CAMERA_MODEL_M5STACK_WIDE) || defined(CAMERA_MODEL_M5STACK_ESP32CAM)
-  s->set_vflip(s, 1);
-  s->set_hmirror(s, 1);
-#endif
+  boardApplyDefaults(s, camera_board);
 
-#if defined(CAMERA_MODEL_ESP32S3_EYE)
-  s->set_vflip(s, 1);
-#endif
+  // last profile selected through /profile overrides the defaults above
+  profileApplyActive();
+  bootMark("profile");
+  if (timelapse) {
+    timelapseRun();
+  }
 
 // Setup LED FLash if LED pin is defined in camera_pins.h
 #if defined(LED_GPIO_NUM)
   setupLedFlash(LED_GPIO_NUM);
 #endif
 
-  WiFi.begin(ssid, password);
-  WiFi.setSleep(false);
+  // lwIP is up once WiFi.begin() ran, so the listeners can open before the IP
+  startCameraServer();
+  bootMark("server");
 
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
-    Serial.print(".");
-  }
+  // an AP that is down at boot must not keep loop() from running: past the
+  // timeout loopWifi() keeps trying and the hook starts the network side
+  bool online = wifiWaitConnected(WIFI_BOOT_TIMEOUT_MS);
+  bootMark("wifi_ip");
   Serial.println("");
-  Serial.println("WiFi connected");
-    setupOTA();
-    setupLCD();
-  startCameraServer();
+  Serial.println(online ? "WiFi connected" : "WiFi not connected yet, continuing");
+  if (online)
+  {
+    start_network();
+    bootMark("ota");
+  }
+  motionBegin();
+  wifiOnReconnect(on_wifi_reconnect);
 
+  xSemaphoreTake(lcd_ready, portMAX_DELAY);
   Serial.print("Camera Ready! Use 'http://");
   Serial.print(WiFi.localIP());
   Serial.println("' to connect");
   String ip=WiFi.localIP().toString();
   tftPrint(ip,1);
+  bootTimingPrint();
 }
 
 void loop() {
+loopWifi();
+loopTimelapse();
 loopOTA();
 loopServer();
 }
\ No newline at end of file
@@ -0,0 +1,163 @@
+#include "mcast.h"
+#include <Preferences.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "frame_source.h"
+#include "wall_clock.h"
+
+static WiFiUDP udp;
+static bool enabled = false;
+static uint32_t fps = MCAST_DEFAULT_FPS;
+static IPAddress dest;
+static bool loaded = false;
+static TaskHandle_t mcast_task_handle = NULL;
+
+static uint32_t feed_seq = 0;
+static uint32_t frames = 0, datagrams = 0, send_errors = 0;
+static uint64_t bytes = 0;
+static uint32_t rate_start = 0, rate_bytes = 0, kbps = 0;
+
+static void load_config()
+{
+  Preferences prefs;
+  enabled = false;
+  fps = MCAST_DEFAULT_FPS;
+  String addr = MCAST_GROUP;
+  if (prefs.begin("mcast", true))
+  {
+    enabled = prefs.getBool("enable", false);
+    fps = prefs.getUInt("fps", MCAST_DEFAULT_FPS);
+    addr = prefs.getString("addr", MCAST_GROUP);
+    prefs.end();
+  }
+  if (!dest.fromString(addr))
+  {
+    dest.fromString(MCAST_GROUP);
+  }
+  loaded = true;
+}
+
+static void send_frame(camera_fb_t *fb)
+{
+  static uint8_t dgram[sizeof(mcast_hdr_t) + MCAST_PAYLOAD];
+  mcast_hdr_t *hdr = (mcast_hdr_t *)dgram;
+  struct timeval tv;
+  clockFrameTime(&fb->timestamp, &tv);
+  hdr->magic = MCAST_MAGIC;
+  hdr->frame = ++feed_seq;
+  hdr->frags = (fb->len + MCAST_PAYLOAD - 1) / MCAST_PAYLOAD;
+  hdr->len = fb->len;
+  hdr->ts_us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+  for (uint16_t i = 0; i < hdr->frags; i++)
+  {
+    size_t off = (size_t)i * MCAST_PAYLOAD;
+    size_t n = min((size_t)MCAST_PAYLOAD, fb->len - off);
+    hdr->frag = i;
+    memcpy(dgram + sizeof(*hdr), fb->buf + off, n);
+    // out of pbufs: give the WiFi task a moment to drain, once
+    bool sent = false;
+    for (int attempt = 0; attempt < 2 && !sent; attempt++)
+    {
+      udp.beginPacket(dest, MCAST_PORT);
+      udp.write(dgram, sizeof(*hdr) + n);
+      sent = udp.endPacket();
+      if (!sent)
+      {
+        delay(2);
+      }
+    }
+    if (!sent)
+    {
+      send_errors++;
+      return; // the receivers drop this frame anyway
+    }
+    datagrams++;
+  }
+  frames++;
+  bytes += fb->len;
+  rate_bytes += fb->len;
+  uint32_t now = millis();
+  if (now - rate_start >= 1000)
+  {
+    kbps = rate_bytes * 8 / (now - rate_start);
+    rate_start = now;
+    rate_bytes = 0;
+  }
+}
+
+static void mcast_task(void *arg)
+{
+  uint32_t seq = 0;
+  int64_t next_due = 0;
+  while (true)
+  {
+    if (!enabled || !fps || !WiFi.isConnected())
+    {
+      delay(500);
+      continue;
+    }
+    int64_t now = esp_timer_get_time();
+    if (next_due > now)
+    {
+      delay((next_due - now) / 1000);
+    }
+    next_due = max(next_due, now) + 1000000 / fps;
+    camera_fb_t *fb = frameSourceGet(&seq);
+    if (!fb)
+    {
+      delay(100); // quiesced for an update
+      continue;
+    }
+    if (fb->format == PIXFORMAT_JPEG)
+    {
+      send_frame(fb);
+    }
+    frameSourceRelease(fb);
+  }
+}
+
+void mcastBegin()
+{
+  if (!loaded)
+  {
+    load_config();
+  }
+  if (!mcast_task_handle)
+  {
+    xTaskCreatePinnedToCore(mcast_task, "mcast", 4096, NULL, 1, &mcast_task_handle, 1);
+  }
+}
+
+int mcastSet(const String &var, const String &value)
+{
+  Preferences prefs;
+  if (!prefs.begin("mcast", false))
+  {
+    return -1;
+  }
+  int val = value.toInt();
+  IPAddress ip;
+  int res = 0;
+  if (var.equals("mcast"))
+    prefs.putBool("enable", val != 0);
+  else if (var.equals("mcast_fps") && val > 0 && val <= 60)
+    prefs.putUInt("fps", val);
+  else if (var.equals("mcast_addr") && ip.fromString(value))
+    prefs.putString("addr", value);
+  else
+    res = -1;
+  prefs.end();
+  load_config();
+  return res;
+}
+
+int mcastMetricsJson(char *p, size_t len)
+{
+  return snprintf(p, len,
+                  "\"mcast\":{\"enabled\":%u,\"fps\":%u,\"addr\":\"%s\",\"frames\":%u,\"datagrams\":%u,"
+                  "\"send_errors\":%u,\"bytes\":%llu,\"kbps\":%u}",
+                  enabled, fps, dest.toString().c_str(), frames, datagrams, send_errors,
+                  (unsigned long long)bytes, kbps);
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <Arduino.h>
+#include "mcast_proto.h"
+
+// Opt-in multicast MJPEG for LAN viewers. One task takes frames from the
+// frame source, paced to mcast_fps, and sends each as sequence-numbered
+// datagrams to the group; the cost is the same for one listener or fifty.
+// There is no retransmission: a receiver drops a frame that lost a
+// fragment and waits for the next one. Configured through /control:
+//   mcast        0/1
+//   mcast_fps    frames per second sent
+//   mcast_addr   destination, MCAST_GROUP by default (a unicast or
+//                broadcast address works too)
+
+#define MCAST_DEFAULT_FPS 10
+
+// Start the sender task; it idles while disabled
+void mcastBegin();
+// Handle an mcast* /control variable; -1 if unknown or invalid
+int mcastSet(const String &var, const String &value);
+// "mcast":{...}
+int mcastMetricsJson(char *p, size_t len);
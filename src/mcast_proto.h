@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+
+// Wire format of the multicast MJPEG feed (see mcast.h), shared with
+// tools/mcastrecv.cpp. Each JPEG goes out as frags datagrams of at most
+// MCAST_PAYLOAD bytes, each led by this little-endian header; a frame that
+// misses any fragment is dropped by the receiver.
+
+#define MCAST_GROUP "239.255.0.81"
+#define MCAST_PORT 5081
+#define MCAST_MAGIC 0x314d4a4d // "MJM1"
+#define MCAST_PAYLOAD 1400     // header + payload stay under one Ethernet MTU
+
+typedef struct __attribute__((packed))
+{
+  uint32_t magic;
+  uint32_t frame; // counts up by one per frame sent; a gap is a lost frame
+  uint16_t frag;
+  uint16_t frags;
+  uint32_t len;  // jpeg bytes
+  int64_t ts_us; // frame time, as X-Timestamp on /stream
+} mcast_hdr_t;
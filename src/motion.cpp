@@ -0,0 +1,324 @@
+#include "motion.h"
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "frame_source.h"
+#include "jpeg_scan.h"
+#include "wall_clock.h"
+
+typedef struct
+{
+  bool start; // else end
+  uint32_t id;
+  int64_t ts_us;
+  uint32_t duration_ms;
+  uint32_t blocks; // most changed blocks in one frame
+  uint16_t x, y, w, h; // pixels
+} motion_event_t;
+
+static bool enabled = false;
+static motion_params_t params = {MOTION_DEFAULT_THRESH, MOTION_DEFAULT_BLOCKS, MOTION_LEARN_SHIFT, MOTION_WARMUP,
+                                 MOTION_ABSORB};
+static char mask_spec[96];
+static char callback_url[128];
+static volatile bool reset_model = false;
+static bool loaded = false;
+static TaskHandle_t motion_task_handle = NULL;
+static QueueHandle_t event_queue = NULL;
+
+static jpeg_info_t info;
+static motion_model_t model;
+static int16_t *dc = NULL;
+
+// current event
+static bool active = false;
+static uint32_t event_id = 0, event_start_ms = 0, last_motion_ms = 0, event_blocks = 0;
+static int64_t event_ts_us = 0;
+static uint16_t bx0, by0, bx1, by1;
+
+static uint32_t frames = 0, skipped = 0, errors = 0, changed = 0;
+static uint32_t us_total = 0, us_avg = 0, us_max = 0;
+static uint32_t rate_start = 0, rate_frames = 0;
+static float fps = 0;
+static uint32_t callbacks = 0, callback_errors = 0;
+static motion_event_t last_event;
+
+static void load_config()
+{
+  Preferences prefs;
+  enabled = false;
+  params.threshold = MOTION_DEFAULT_THRESH;
+  params.min_blocks = MOTION_DEFAULT_BLOCKS;
+  mask_spec[0] = callback_url[0] = 0;
+  if (prefs.begin("motion", true))
+  {
+    enabled = prefs.getBool("enable", false);
+    params.threshold = prefs.getUInt("thresh", MOTION_DEFAULT_THRESH);
+    params.min_blocks = prefs.getUInt("blocks", MOTION_DEFAULT_BLOCKS);
+    strncpy(mask_spec, prefs.getString("mask").c_str(), sizeof(mask_spec) - 1);
+    strncpy(callback_url, prefs.getString("url").c_str(), sizeof(callback_url) - 1);
+    prefs.end();
+  }
+  reset_model = true;
+  loaded = true;
+}
+
+// "x,y,w,h;..." in percent; false if malformed
+static bool apply_mask(const char *spec, motion_model_t *m)
+{
+  int count = 0;
+  while (*spec)
+  {
+    int x, y, w, h, n = 0;
+    if (sscanf(spec, "%d,%d,%d,%d%n", &x, &y, &w, &h, &n) != 4 || ++count > MOTION_MAX_MASKS)
+    {
+      return false;
+    }
+    if (m)
+    {
+      motionModelMask(m, x, y, w, h);
+    }
+    spec += n;
+    if (*spec == ';')
+    {
+      spec++;
+    }
+  }
+  return true;
+}
+
+static bool setup_model(uint16_t cols, uint16_t rows)
+{
+  size_t blocks = (size_t)cols * rows;
+  if (!dc || model.cols != cols || model.rows != rows)
+  {
+    free(dc);
+    size_t size = blocks * sizeof(int16_t) + motionModelSize(cols, rows);
+    dc = (int16_t *)(psramFound() ? ps_malloc(size) : malloc(size));
+    if (!dc)
+    {
+      Serial.printf("Motion: no memory for %ux%u blocks\n", cols, rows);
+      return false;
+    }
+  }
+  motionModelInit(&model, cols, rows, dc + blocks);
+  apply_mask(mask_spec, &model);
+  active = false;
+  return true;
+}
+
+static void post_event(bool start, uint32_t now)
+{
+  motion_event_t ev;
+  ev.start = start;
+  ev.id = event_id;
+  ev.ts_us = event_ts_us;
+  ev.duration_ms = now - event_start_ms;
+  ev.blocks = event_blocks;
+  ev.x = bx0 * 8;
+  ev.y = by0 * 8;
+  ev.w = (bx1 - bx0 + 1) * 8;
+  ev.h = (by1 - by0 + 1) * 8;
+  last_event = ev;
+  Serial.printf("Motion %s: event %u, %u blocks at %u,%u %ux%u\n", start ? "start" : "end", ev.id, ev.blocks, ev.x,
+                ev.y, ev.w, ev.h);
+  if (callback_url[0] && xQueueSend(event_queue, &ev, 0) != pdTRUE)
+  {
+    callback_errors++;
+  }
+}
+
+static void track(bool motion, const motion_result_t *r, camera_fb_t *fb)
+{
+  uint32_t now = millis();
+  if (motion && !active)
+  {
+    struct timeval tv;
+    clockFrameTime(&fb->timestamp, &tv);
+    active = true;
+    event_id++;
+    event_start_ms = last_motion_ms = now;
+    event_ts_us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+    event_blocks = r->changed;
+    bx0 = r->x0, by0 = r->y0, bx1 = r->x1, by1 = r->y1;
+    post_event(true, now);
+  }
+  else if (motion)
+  {
+    bx0 = min(bx0, r->x0), by0 = min(by0, r->y0);
+    bx1 = max(bx1, r->x1), by1 = max(by1, r->y1);
+    event_blocks = max(event_blocks, r->changed);
+    last_motion_ms = now;
+  }
+  else if (active && now - last_motion_ms >= MOTION_HOLD_MS)
+  {
+    active = false;
+    post_event(false, now);
+  }
+}
+
+static void process(camera_fb_t *fb)
+{
+  int64_t start = esp_timer_get_time();
+  if (jpegParse(fb->buf, fb->len, &info) != JPEG_OK)
+  {
+    errors++;
+    return;
+  }
+  if (reset_model || !dc || model.cols != info.luma_cols || model.rows != info.luma_rows)
+  {
+    reset_model = false;
+    if (!setup_model(info.luma_cols, info.luma_rows))
+    {
+      return;
+    }
+  }
+  if (jpegLumaDc(fb->buf, fb->len, &info, dc, (size_t)model.cols * model.rows) != JPEG_OK)
+  {
+    errors++;
+    return;
+  }
+  motion_result_t r;
+  bool motion = motionModelUpdate(&model, dc, &params, &r);
+  changed = r.changed;
+  track(motion, &r, fb);
+
+  uint32_t us = esp_timer_get_time() - start;
+  us_max = max(us_max, us);
+  us_total += us;
+  frames++;
+  rate_frames++;
+  uint32_t now = millis();
+  if (now - rate_start >= 1000)
+  {
+    fps = rate_frames * 1000.0f / (now - rate_start);
+    us_avg = us_total / rate_frames;
+    rate_start = now;
+    rate_frames = 0;
+    us_total = 0;
+  }
+}
+
+static void motion_task(void *arg)
+{
+  uint32_t seq = 0;
+  while (true)
+  {
+    if (!enabled)
+    {
+      active = false;
+      delay(500);
+      continue;
+    }
+    uint32_t prev = seq;
+    camera_fb_t *fb = frameSourceGet(&seq);
+    if (!fb)
+    {
+      delay(100); // quiesced for an update
+      continue;
+    }
+    if (prev && seq > prev + 1)
+    {
+      skipped += seq - prev - 1;
+    }
+    if (fb->format == PIXFORMAT_JPEG)
+    {
+      process(fb);
+    }
+    frameSourceRelease(fb);
+  }
+}
+
+// Callbacks go out from their own task so a slow receiver never holds up
+// detection
+static void callback_task(void *arg)
+{
+  motion_event_t ev;
+  while (true)
+  {
+    if (xQueueReceive(event_queue, &ev, portMAX_DELAY) != pdTRUE || !callback_url[0] || !WiFi.isConnected())
+    {
+      continue;
+    }
+    char body[224];
+    snprintf(body, sizeof(body),
+             "{\"event\":\"%s\",\"id\":%u,\"ts\":%lld.%06lld,\"duration_ms\":%u,\"blocks\":%u,"
+             "\"bbox\":{\"x\":%u,\"y\":%u,\"w\":%u,\"h\":%u}}",
+             ev.start ? "start" : "end", ev.id, (long long)(ev.ts_us / 1000000), (long long)(ev.ts_us % 1000000),
+             ev.duration_ms, ev.blocks, ev.x, ev.y, ev.w, ev.h);
+    HTTPClient http;
+    int code = HTTPC_ERROR_CONNECTION_REFUSED;
+    if (http.begin(callback_url))
+    {
+      http.setConnectTimeout(MOTION_HTTP_TIMEOUT_MS);
+      http.setTimeout(MOTION_HTTP_TIMEOUT_MS);
+      http.addHeader("Content-Type", "application/json");
+      code = http.POST(String(body));
+      http.end();
+    }
+    if (code >= 200 && code < 300)
+    {
+      callbacks++;
+    }
+    else
+    {
+      callback_errors++;
+      Serial.printf("Motion callback failed: %d\n", code);
+    }
+  }
+}
+
+void motionBegin()
+{
+  if (!loaded)
+  {
+    load_config();
+  }
+  if (!motion_task_handle)
+  {
+    event_queue = xQueueCreate(8, sizeof(motion_event_t));
+    xTaskCreatePinnedToCore(callback_task, "motion_cb", 4096, NULL, 1, NULL, 0);
+    // the streams run on core 1
+    xTaskCreatePinnedToCore(motion_task, "motion", 4096, NULL, 1, &motion_task_handle, 0);
+  }
+}
+
+int motionSet(const String &var, const String &value)
+{
+  Preferences prefs;
+  if (!prefs.begin("motion", false))
+  {
+    return -1;
+  }
+  int val = value.toInt();
+  int res = 0;
+  if (var.equals("motion"))
+    prefs.putBool("enable", val != 0);
+  else if (var.equals("motion_thresh") && val > 0 && val <= 1024)
+    prefs.putUInt("thresh", val);
+  else if (var.equals("motion_blocks") && val > 0 && val <= 10000)
+    prefs.putUInt("blocks", val);
+  else if (var.equals("motion_mask") && value.length() < sizeof(mask_spec) && apply_mask(value.c_str(), NULL))
+    prefs.putString("mask", value);
+  else if (var.equals("motion_url") && value.length() < sizeof(callback_url) &&
+           (value.length() == 0 || value.startsWith("http://") || value.startsWith("https://")))
+    prefs.putString("url", value);
+  else
+    res = -1;
+  prefs.end();
+  load_config();
+  return res;
+}
+
+int motionMetricsJson(char *p, size_t len)
+{
+  const motion_event_t &ev = last_event;
+  return snprintf(p, len,
+                  "\"motion\":{\"enabled\":%u,\"grid\":[%u,%u],\"fps\":%.1f,\"frames\":%u,\"skipped\":%u,"
+                  "\"errors\":%u,\"us_avg\":%u,\"us_max\":%u,\"changed\":%u,\"active\":%u,\"events\":%u,"
+                  "\"bbox\":[%u,%u,%u,%u],\"callbacks\":%u,\"callback_errors\":%u}",
+                  enabled, model.cols, model.rows, fps, frames, skipped, errors, us_avg, us_max, changed, active,
+                  event_id, ev.x, ev.y, ev.w, ev.h, callbacks, callback_errors);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <Arduino.h>
+#include "motion_model.h"
+
+// Motion detection on the JPEG frames the camera already produces. A task
+// on core 0 takes every frame from the frame source, pulls the luminance
+// DC terms out of the entropy-coded data (jpeg_scan.h, no full decode)
+// and feeds them to the background model. Motion frames close together
+// form one event; its start and end are POSTed as JSON to motion_url and
+// the latest one is in /metrics. Configured through /control:
+//   motion          0/1
+//   motion_thresh   change in DC units (8 per luminance level) a block
+//                   needs on top of its own noise
+//   motion_blocks   changed blocks that make a motion frame
+//   motion_mask     ignored areas, "x,y,w,h;..." in percent of the frame
+//   motion_url      http:// callback, empty for none
+
+#define MOTION_DEFAULT_THRESH 48
+#define MOTION_DEFAULT_BLOCKS 4
+#define MOTION_LEARN_SHIFT 5 // background follows 1/32 per frame
+#define MOTION_WARMUP 10     // frames after start or a frame size change
+#define MOTION_ABSORB 200    // frames something must stay put to become background
+#define MOTION_HOLD_MS 2000  // quiet time that ends an event
+#define MOTION_MAX_MASKS 8
+#define MOTION_HTTP_TIMEOUT_MS 3000
+
+// Start the detector task; it idles while disabled
+void motionBegin();
+// Handle a motion* /control variable; -1 if unknown or invalid
+int motionSet(const String &var, const String &value);
+// "motion":{...}
+int motionMetricsJson(char *p, size_t len);
@@ -0,0 +1,102 @@
+#include "motion_model.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DEV_CAP (64 << 4) // one outlier must not swamp a block's deviation
+
+size_t motionModelSize(uint16_t cols, uint16_t rows)
+{
+  size_t n = (size_t)cols * rows;
+  return n * (sizeof(int16_t) + sizeof(uint16_t) + sizeof(uint8_t));
+}
+
+void motionModelInit(motion_model_t *m, uint16_t cols, uint16_t rows, void *mem)
+{
+  size_t n = (size_t)cols * rows;
+  m->cols = cols;
+  m->rows = rows;
+  m->frames = 0;
+  m->mean = (int16_t *)mem;
+  m->dev = (uint16_t *)(m->mean + n);
+  m->state = (uint8_t *)(m->dev + n);
+  memset(mem, 0, motionModelSize(cols, rows));
+}
+
+void motionModelMask(motion_model_t *m, int x, int y, int w, int h)
+{
+  int x0 = x * m->cols / 100, x1 = (x + w) * m->cols / 100;
+  int y0 = y * m->rows / 100, y1 = (y + h) * m->rows / 100;
+  for (int by = y0 < 0 ? 0 : y0; by < y1 && by < m->rows; by++)
+  {
+    for (int bx = x0 < 0 ? 0 : x0; bx < x1 && bx < m->cols; bx++)
+    {
+      m->state[by * m->cols + bx] = MOTION_MASKED;
+    }
+  }
+}
+
+bool motionModelUpdate(motion_model_t *m, const int16_t *dc, const motion_params_t *p, motion_result_t *r)
+{
+  size_t n = (size_t)m->cols * m->rows;
+  memset(r, 0, sizeof(*r));
+  r->x0 = m->cols;
+  r->y0 = m->rows;
+  if (!m->frames++)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      m->mean[i] = dc[i] * 16;
+    }
+    return false;
+  }
+  // whole-frame shift, from the unmasked blocks
+  int64_t sum = 0;
+  size_t counted = 0;
+  for (size_t i = 0; i < n; i++)
+  {
+    if (m->state[i] != MOTION_MASKED)
+    {
+      sum += dc[i] * 16 - m->mean[i];
+      counted++;
+    }
+  }
+  int32_t shift = counted ? (int32_t)(sum / (int64_t)counted) : 0;
+  r->shift = shift >> 4;
+  bool learning = m->frames <= p->warmup;
+  int32_t base = p->threshold << 4;
+  for (size_t i = 0; i < n; i++)
+  {
+    int32_t d = dc[i] * 16 - m->mean[i];
+    int32_t ad = abs(d - shift);
+    if (m->state[i] == MOTION_MASKED)
+    {
+      continue;
+    }
+    if (!learning && ad > base + 3 * m->dev[i])
+    {
+      uint16_t x = i % m->cols, y = i / m->cols;
+      r->changed++;
+      r->x0 = x < r->x0 ? x : r->x0;
+      r->x1 = x > r->x1 ? x : r->x1;
+      r->y0 = y < r->y0 ? y : r->y0;
+      r->y1 = y > r->y1 ? y : r->y1;
+      if (m->state[i] < MOTION_MASKED - 1)
+      {
+        m->state[i]++;
+      }
+      if (p->absorb && m->state[i] >= p->absorb)
+      {
+        m->mean[i] = dc[i] * 16;
+        m->state[i] = 0;
+      }
+      continue;
+    }
+    // learn fast while warming up
+    m->mean[i] += d >> (learning ? 1 : p->learn_shift);
+    int32_t dev = m->dev[i];
+    dev += ((ad < DEV_CAP ? ad : DEV_CAP) - dev) >> 4;
+    m->dev[i] = dev;
+    m->state[i] = 0;
+  }
+  return r->changed >= p->min_blocks && r->changed > 0;
+}
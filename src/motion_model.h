@@ -0,0 +1,51 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Background model over a grid of 8x8-block luminance values (the DC
+// terms from jpegLumaDc()). Every block keeps a running mean and a mean
+// absolute deviation; a block has changed when it differs from its mean by
+// more than threshold plus 3 deviations, so blocks that are always noisy
+// (foliage, screens) need a larger change. A shift of the whole frame
+// (exposure, lights) is taken out before comparing. Masked blocks are
+// never reported. The mean follows slowly and stands still while a block
+// is changed; a block that stays changed for absorb frames takes the new
+// value as its background, so something that stops moving is dropped.
+//
+// No Arduino dependencies: host tools link this file as well.
+
+#define MOTION_MASKED 0xFF
+
+typedef struct
+{
+  uint16_t threshold;  // DC units: 8 per luminance level
+  uint16_t min_blocks; // changed blocks that make a motion frame
+  uint8_t learn_shift; // mean follows 1/2^n of the difference per frame
+  uint8_t warmup;      // frames to learn before reporting
+  uint8_t absorb;      // frames a block stays changed before that is the background
+} motion_params_t;
+
+typedef struct
+{
+  uint16_t cols, rows;
+  uint32_t frames;
+  int16_t *mean; // Q4
+  uint16_t *dev; // Q4
+  uint8_t *state; // frames changed in a row, or MOTION_MASKED
+} motion_model_t;
+
+typedef struct
+{
+  uint32_t changed;    // blocks over their threshold
+  int16_t shift;       // whole-frame shift taken out, DC units
+  uint16_t x0, y0;     // bounding box of the changed blocks,
+  uint16_t x1, y1;     // in blocks, inclusive
+} motion_result_t;
+
+// Bytes motionModelInit() needs for a cols x rows grid
+size_t motionModelSize(uint16_t cols, uint16_t rows);
+void motionModelInit(motion_model_t *m, uint16_t cols, uint16_t rows, void *mem);
+// Mask a rectangle given in percent of the frame (0-100)
+void motionModelMask(motion_model_t *m, int x, int y, int w, int h);
+// Feed one frame; true if it counts as motion
+bool motionModelUpdate(motion_model_t *m, const int16_t *dc, const motion_params_t *p, motion_result_t *r);
@@ -0,0 +1,149 @@
+#include "preview.h"
+#include <TJpg_Decoder.h>
+#include "esp_heap_caps.h"
+#include "frame_source.h"
+#include "tft.h"
+
+static volatile bool preview_on = true;
+
+// Two strips: one is on the wire while the decoder fills the other
+static uint16_t *strips[2];
+static int strip_cur = 0;
+static int strip_y = -1; // panel row of the strip being filled
+static int strip_h = 0;
+
+static void flush_strip()
+{
+  if (strip_y < 0 || strip_h <= 0)
+  {
+    return;
+  }
+  tftComposeStrip(strips[strip_cur], strip_y, strip_h);
+  // pushImageDMA waits for the previous transfer, which is the other strip
+  tft.pushImageDMA(0, strip_y, TFT_PREVIEW_W, strip_h, strips[strip_cur]);
+  strip_cur ^= 1;
+  strip_y = -1;
+}
+
+// Called by the decoder for each MCU block, left to right, top to bottom
+static bool on_block(int16_t x, int16_t y, uint16_t w, uint16_t h, uint16_t *bitmap)
+{
+  if (!preview_on)
+  {
+    return false; // abort the decode
+  }
+  if (y + h <= 0)
+  {
+    return true; // cropped off the top
+  }
+  if (y >= TFT_PREVIEW_H)
+  {
+    return false; // the rest is below the panel
+  }
+  int top = max((int)y, 0);
+  if (top != strip_y)
+  {
+    flush_strip();
+    strip_y = top;
+    strip_h = min(y + h, TFT_PREVIEW_H) - top;
+    memset(strips[strip_cur], 0, TFT_PREVIEW_W * PREVIEW_STRIP_LINES * sizeof(uint16_t));
+  }
+  if (x >= TFT_PREVIEW_W || x + w <= 0)
+  {
+    return true;
+  }
+  int x0 = max((int)x, 0);
+  int x1 = min(x + w, TFT_PREVIEW_W);
+  for (int row = 0; row < strip_h; row++)
+  {
+    memcpy(&strips[strip_cur][row * TFT_PREVIEW_W + x0], &bitmap[(row + top - y) * w + (x0 - x)],
+           (x1 - x0) * sizeof(uint16_t));
+  }
+  return true;
+}
+
+// Smallest DCT scale that fits the image in the preview area
+static uint8_t pick_scale(uint16_t w, uint16_t h)
+{
+  uint8_t scale = 1;
+  while (scale < 8 && (w / scale > TFT_PREVIEW_W || h / scale > TFT_PREVIEW_H))
+  {
+    scale *= 2;
+  }
+  return scale;
+}
+
+static void draw_frame(camera_fb_t *fb)
+{
+  uint16_t w = 0, h = 0;
+  if (TJpgDec.getJpgSize(&w, &h, fb->buf, fb->len) != JDR_OK)
+  {
+    return;
+  }
+  uint8_t scale = pick_scale(w, h);
+  TJpgDec.setJpgScale(scale);
+  // centred; larger images (above SVGA at 1/8) are cropped to the middle
+  int ox = (TFT_PREVIEW_W - w / scale) / 2;
+  int oy = (TFT_PREVIEW_H - h / scale) / 2;
+  static int last_ox = 0, last_oy = 0;
+  if (ox != last_ox || oy != last_oy)
+  {
+    // new geometry: the strips only cover the rows the image spans
+    tft.fillRect(0, 0, TFT_PREVIEW_W, TFT_PREVIEW_H, TFT_BLACK);
+    last_ox = ox;
+    last_oy = oy;
+  }
+  tft.startWrite();
+  strip_y = -1;
+  TJpgDec.drawJpg(ox, oy, fb->buf, fb->len);
+  flush_strip();
+  tft.dmaWait();
+  tft.endWrite();
+}
+
+bool previewInit()
+{
+  for (int i = 0; i < 2; i++)
+  {
+    strips[i] = (uint16_t *)heap_caps_malloc(TFT_PREVIEW_W * PREVIEW_STRIP_LINES * sizeof(uint16_t), MALLOC_CAP_DMA);
+    if (!strips[i])
+    {
+      Serial.println("Preview: no DMA memory for the strips");
+      return false;
+    }
+  }
+  tft.initDMA();
+  TJpgDec.setSwapBytes(true); // the panel takes big-endian RGB565
+  TJpgDec.setCallback(on_block);
+  return true;
+}
+
+uint32_t previewDraw()
+{
+  static uint32_t seq = 0;
+  uint32_t wait = PREVIEW_INTERVAL_MS;
+  camera_fb_t *fb = frameSourceGet(&seq);
+  if (fb)
+  {
+    if (fb->format == PIXFORMAT_JPEG)
+    {
+      int64_t start = esp_timer_get_time();
+      draw_frame(fb);
+      uint32_t took = (uint32_t)((esp_timer_get_time() - start) / 1000);
+      wait = max(wait, took * PREVIEW_CPU_SHARE);
+    }
+    frameSourceRelease(fb);
+  }
+  return wait;
+}
+
+void previewEnable(bool enable)
+{
+  preview_on = enable;
+  tftRefresh();
+}
+
+bool previewEnabled()
+{
+  return preview_on;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <Arduino.h>
+
+// Live camera preview on the TFT, drawn by the display task. Frames come
+// from the frame source and are decoded at a reduced DCT scale (1/2 .. 1/8)
+// straight into line strips; the overlay boxes are composited into each
+// strip, which then goes out over DMA while the next one decodes. The frame
+// rate adapts so decoding stays under PREVIEW_CPU_SHARE of the core, and a
+// frame is only pulled from the driver when no other consumer has one out.
+
+#define PREVIEW_INTERVAL_MS 200 // at most 5 fps
+#define PREVIEW_CPU_SHARE 4     // sleep >= 4x the decode time (~20% of a core)
+#define PREVIEW_STRIP_LINES 16  // tallest MCU row at 1:1 scale
+
+// Display task only
+bool previewInit();
+// Decode and push the latest frame; ms until the next one is due
+uint32_t previewDraw();
+
+void previewEnable(bool enable);
+bool previewEnabled();
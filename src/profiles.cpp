@@ -0,0 +1,367 @@
+#include "profiles.h"
+#include <Preferences.h>
+#include "esp_rom_crc.h"
+#include "ctrl_channel.h"
+#include "sensor_traits.h"
+
+#define PROFILE_MAGIC 0x46525043 // "CPRF"
+#define PROFILE_NS "profiles"
+#define KEY_INDEX "_index"
+#define KEY_ACTIVE "_active"
+
+typedef struct
+{
+  const char *name;
+  uint8_t writes; // most register writes set() makes (OV5640/OV3660 drivers)
+  int (*get)(const camera_status_t &st);
+  int (*set)(sensor_t *s, int v);
+} cam_setting_t;
+
+// Indexed by cam_setting_id_t
+static const cam_setting_t cam_settings[CAM_SETTING_COUNT] = {
+    {"framesize", 0, [](const camera_status_t &st) { return (int)st.framesize; }, [](sensor_t *s, int v) { return s->pixformat == PIXFORMAT_JPEG ? s->set_framesize(s, (framesize_t)v) : 0; }},
+    {"quality", 1, [](const camera_status_t &st) { return (int)st.quality; }, [](sensor_t *s, int v) { return s->set_quality(s, v); }},
+    {"contrast", 4, [](const camera_status_t &st) { return (int)st.contrast; }, [](sensor_t *s, int v) { return s->set_contrast(s, v); }},
+    {"brightness", 3, [](const camera_status_t &st) { return (int)st.brightness; }, [](sensor_t *s, int v) { return s->set_brightness(s, v); }},
+    {"saturation", 12, [](const camera_status_t &st) { return (int)st.saturation; }, [](sensor_t *s, int v) { return s->set_saturation(s, v); }},
+    {"gainceiling", 2, [](const camera_status_t &st) { return (int)st.gainceiling; }, [](sensor_t *s, int v) { return s->set_gainceiling(s, (gainceiling_t)v); }},
+    {"colorbar", 1, [](const camera_status_t &st) { return (int)st.colorbar; }, [](sensor_t *s, int v) { return s->set_colorbar(s, v); }},
+    {"awb", 1, [](const camera_status_t &st) { return (int)st.awb; }, [](sensor_t *s, int v) { return s->set_whitebal(s, v); }},
+    {"agc", 1, [](const camera_status_t &st) { return (int)st.agc; }, [](sensor_t *s, int v) { return s->set_gain_ctrl(s, v); }},
+    {"aec", 1, [](const camera_status_t &st) { return (int)st.aec; }, [](sensor_t *s, int v) { return s->set_exposure_ctrl(s, v); }},
+    {"hmirror", 2, [](const camera_status_t &st) { return (int)st.hmirror; }, [](sensor_t *s, int v) { return s->set_hmirror(s, v); }},
+    {"vflip", 2, [](const camera_status_t &st) { return (int)st.vflip; }, [](sensor_t *s, int v) { return s->set_vflip(s, v); }},
+    {"awb_gain", 1, [](const camera_status_t &st) { return (int)st.awb_gain; }, [](sensor_t *s, int v) { return s->set_awb_gain(s, v); }},
+    {"agc_gain", 2, [](const camera_status_t &st) { return (int)st.agc_gain; }, [](sensor_t *s, int v) { return s->set_agc_gain(s, v); }},
+    {"aec_value", 3, [](const camera_status_t &st) { return (int)st.aec_value; }, [](sensor_t *s, int v) { return s->set_aec_value(s, v); }},
+    {"aec2", 1, [](const camera_status_t &st) { return (int)st.aec2; }, [](sensor_t *s, int v) { return s->set_aec2(s, v); }},
+    {"dcw", 1, [](const camera_status_t &st) { return (int)st.dcw; }, [](sensor_t *s, int v) { return s->set_dcw(s, v); }},
+    {"bpc", 1, [](const camera_status_t &st) { return (int)st.bpc; }, [](sensor_t *s, int v) { return s->set_bpc(s, v); }},
+    {"wpc", 1, [](const camera_status_t &st) { return (int)st.wpc; }, [](sensor_t *s, int v) { return s->set_wpc(s, v); }},
+    {"raw_gma", 1, [](const camera_status_t &st) { return (int)st.raw_gma; }, [](sensor_t *s, int v) { return s->set_raw_gma(s, v); }},
+    {"lenc", 1, [](const camera_status_t &st) { return (int)st.lenc; }, [](sensor_t *s, int v) { return s->set_lenc(s, v); }},
+    {"special_effect", 4, [](const camera_status_t &st) { return (int)st.special_effect; }, [](sensor_t *s, int v) { return s->set_special_effect(s, v); }},
+    {"wb_mode", 7, [](const camera_status_t &st) { return (int)st.wb_mode; }, [](sensor_t *s, int v) { return s->set_wb_mode(s, v); }},
+    {"ae_level", 6, [](const camera_status_t &st) { return (int)st.ae_level; }, [](sensor_t *s, int v) { return s->set_ae_level(s, v); }},
+};
+
+static Preferences prefs;
+static char profile_index[PROFILE_SLOTS][PROFILE_NAME_LEN];
+
+int camSettingId(const char *name)
+{
+  for (int i = 0; i < CAM_SETTING_COUNT; i++)
+  {
+    if (!strcmp(cam_settings[i].name, name))
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+const char *camSettingName(int id)
+{
+  return (id >= 0 && id < CAM_SETTING_COUNT) ? cam_settings[id].name : NULL;
+}
+
+int camSettingWrites(int id)
+{
+  return cam_settings[id].writes;
+}
+
+int camSettingGet(sensor_t *s, int id)
+{
+  return cam_settings[id].get(s->status);
+}
+
+int camSettingSet(sensor_t *s, int id, int value)
+{
+  if (id < 0 || id >= CAM_SETTING_COUNT || !sensorSettingValid(id, value))
+  {
+    return -1;
+  }
+  int old = cam_settings[id].get(s->status);
+  int res = cam_settings[id].set(s, value);
+  int now = cam_settings[id].get(s->status);
+  if (!res && now != old)
+  {
+    ctrlNotify(CTRL_N_SETTING, id, 0, now);
+  }
+  return res;
+}
+
+static uint32_t profile_crc(const sensor_profile_t *rec)
+{
+  return esp_rom_crc32_le(0, (const uint8_t *)rec, offsetof(sensor_profile_t, crc));
+}
+
+static bool valid_name(const char *name)
+{
+  size_t len = strlen(name);
+  return len > 0 && len < PROFILE_NAME_LEN && name[0] != '_';
+}
+
+static bool open_store()
+{
+  if (!prefs.begin(PROFILE_NS, false))
+  {
+    Serial.println("Profile store: NVS open failed");
+    return false;
+  }
+  if (prefs.getBytes(KEY_INDEX, profile_index, sizeof(profile_index)) != sizeof(profile_index))
+  {
+    memset(profile_index, 0, sizeof(profile_index));
+  }
+  return true;
+}
+
+static int index_slot(const char *name)
+{
+  for (int i = 0; i < PROFILE_SLOTS; i++)
+  {
+    if (!strncmp(profile_index[i], name, PROFILE_NAME_LEN))
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static esp_err_t load_profile(const char *name, sensor_profile_t *rec)
+{
+  if (prefs.getBytes(name, rec, sizeof(*rec)) != sizeof(*rec))
+  {
+    return ESP_ERR_NOT_FOUND;
+  }
+  if (rec->magic != PROFILE_MAGIC || rec->version != PROFILE_VERSION ||
+      rec->setting_count > CAM_SETTING_COUNT || rec->reg_count > PROFILE_MAX_REGS)
+  {
+    return ESP_ERR_INVALID_STATE;
+  }
+  if (rec->crc != profile_crc(rec))
+  {
+    return ESP_ERR_INVALID_CRC;
+  }
+  return ESP_OK;
+}
+
+esp_err_t profileSave(const char *name, const reg_write_t *regs, int reg_count)
+{
+  if (!valid_name(name) || reg_count < 0 || reg_count > PROFILE_MAX_REGS)
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!open_store())
+  {
+    return ESP_FAIL;
+  }
+  int slot = index_slot(name);
+  if (slot < 0)
+  {
+    slot = index_slot("");
+  }
+  if (slot < 0)
+  {
+    prefs.end();
+    return ESP_ERR_NO_MEM;
+  }
+
+  SensorLock lock;
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s)
+  {
+    prefs.end();
+    return ESP_ERR_INVALID_STATE;
+  }
+  static sensor_profile_t rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.magic = PROFILE_MAGIC;
+  rec.version = PROFILE_VERSION;
+  rec.pid = s->id.PID;
+  rec.setting_count = CAM_SETTING_COUNT;
+  for (int i = 0; i < CAM_SETTING_COUNT; i++)
+  {
+    rec.settings[i].id = i;
+    rec.settings[i].value = camSettingGet(s, i);
+  }
+  rec.reg_count = reg_count;
+  memcpy(rec.regs, regs, reg_count * sizeof(reg_write_t));
+  rec.crc = profile_crc(&rec);
+
+  esp_err_t res = ESP_OK;
+  if (prefs.putBytes(name, &rec, sizeof(rec)) != sizeof(rec))
+  {
+    res = ESP_FAIL;
+  }
+  else if (strncmp(profile_index[slot], name, PROFILE_NAME_LEN))
+  {
+    strncpy(profile_index[slot], name, PROFILE_NAME_LEN - 1);
+    prefs.putBytes(KEY_INDEX, profile_index, sizeof(profile_index));
+  }
+  prefs.end();
+  Serial.printf("Profile %s saved: %d settings, %d registers\n", name, CAM_SETTING_COUNT, reg_count);
+  return res;
+}
+
+// Launch the open group hold and start another if writes more would not fit
+static int hold_room(sensor_t *s, bool *hold, int *held, int writes)
+{
+  if (!*hold || *held + writes <= REG_GROUP_HOLD_MAX)
+  {
+    *held += writes;
+    return 0;
+  }
+  int res = groupHoldEnd(s, true);
+  *hold = !res && groupHoldBegin(s);
+  *held = writes;
+  return res;
+}
+
+esp_err_t profileApply(const char *name, uint32_t *elapsed_us)
+{
+  if (!valid_name(name))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!open_store())
+  {
+    return ESP_FAIL;
+  }
+  SensorLock lock;
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s)
+  {
+    prefs.end();
+    return ESP_ERR_INVALID_STATE; // stopped for an update
+  }
+  static sensor_profile_t rec;
+  esp_err_t err = load_profile(name, &rec);
+  if (err != ESP_OK)
+  {
+    prefs.end();
+    Serial.printf("Profile %s not loaded: 0x%x\n", name, err);
+    return err;
+  }
+
+  int64_t start = esp_timer_get_time();
+  int res = 0;
+  int i = 0;
+  // A frame size change reconfigures the sensor and cannot sit in a group
+  if (rec.setting_count && rec.settings[0].id == CAM_FRAMESIZE)
+  {
+    if (camSettingGet(s, CAM_FRAMESIZE) != rec.settings[0].value)
+    {
+      res = camSettingSet(s, CAM_FRAMESIZE, rec.settings[0].value);
+    }
+    i = 1;
+  }
+  // Split into holds the group buffer can take; each lands on one frame
+  bool hold = groupHoldBegin(s);
+  int held = 0;
+  for (; i < rec.setting_count && !res; i++)
+  {
+    const profile_setting_t &st = rec.settings[i];
+    if (st.id < CAM_SETTING_COUNT && camSettingGet(s, st.id) != st.value)
+    {
+      res = hold_room(s, &hold, &held, camSettingWrites(st.id));
+      res = res ? res : camSettingSet(s, st.id, st.value);
+    }
+  }
+  // Raw registers are sensor specific
+  if (rec.pid == s->id.PID)
+  {
+    for (int r = 0; r < rec.reg_count && !res; r++)
+    {
+      res = hold_room(s, &hold, &held, 1);
+      res = res ? res : s->set_reg(s, rec.regs[r].reg, rec.regs[r].mask, rec.regs[r].val);
+    }
+  }
+  if (hold)
+  {
+    int end = groupHoldEnd(s, !res);
+    res = res ? res : end;
+  }
+  if (elapsed_us)
+  {
+    *elapsed_us = (uint32_t)(esp_timer_get_time() - start);
+  }
+
+  if (!res && prefs.getString(KEY_ACTIVE) != name)
+  {
+    prefs.putString(KEY_ACTIVE, name);
+  }
+  prefs.end();
+  return res ? ESP_FAIL : ESP_OK;
+}
+
+esp_err_t profileRemove(const char *name)
+{
+  if (!valid_name(name))
+  {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!open_store())
+  {
+    return ESP_FAIL;
+  }
+  int slot = index_slot(name);
+  if (slot < 0)
+  {
+    prefs.end();
+    return ESP_ERR_NOT_FOUND;
+  }
+  prefs.remove(name);
+  memset(profile_index[slot], 0, PROFILE_NAME_LEN);
+  prefs.putBytes(KEY_INDEX, profile_index, sizeof(profile_index));
+  if (prefs.getString(KEY_ACTIVE) == name)
+  {
+    prefs.remove(KEY_ACTIVE);
+  }
+  prefs.end();
+  return ESP_OK;
+}
+
+int profileListJson(char *p, size_t len)
+{
+  if (!open_store())
+  {
+    return snprintf(p, len, "{\"active\":\"\",\"profiles\":[]}");
+  }
+  String active = prefs.getString(KEY_ACTIVE);
+  prefs.end();
+  int n = snprintf(p, len, "{\"active\":\"%s\",\"profiles\":[", active.c_str());
+  bool first = true;
+  for (int i = 0; i < PROFILE_SLOTS && n < (int)len; i++)
+  {
+    if (profile_index[i][0])
+    {
+      n += snprintf(p + n, len - n, "%s\"%s\"", first ? "" : ",", profile_index[i]);
+      first = false;
+    }
+  }
+  if (n < (int)len)
+  {
+    n += snprintf(p + n, len - n, "]}");
+  }
+  return n;
+}
+
+void profileApplyActive()
+{
+  if (!prefs.begin(PROFILE_NS, true))
+  {
+    return;
+  }
+  String active = prefs.getString(KEY_ACTIVE);
+  prefs.end();
+  if (active.length() == 0)
+  {
+    return;
+  }
+  uint32_t us = 0;
+  if (profileApply(active.c_str(), &us) == ESP_OK)
+  {
+    Serial.printf("Profile %s applied in %uus\n", active.c_str(), us);
+  }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "reg_batch.h"
+
+// Named sensor profiles kept as fixed-layout binary records in the "nvs"
+// partition. A record holds the settings as a precomputed (id, value) list
+// plus optional raw register writes, so applying one needs no parsing.
+
+#define PROFILE_VERSION 1
+#define PROFILE_NAME_LEN 16 // NVS keys are limited to 15 characters
+#define PROFILE_SLOTS 8
+#define PROFILE_MAX_REGS 16
+
+// Setting ids are stored in NVS: append only, never renumber.
+typedef enum
+{
+  CAM_FRAMESIZE = 0,
+  CAM_QUALITY,
+  CAM_CONTRAST,
+  CAM_BRIGHTNESS,
+  CAM_SATURATION,
+  CAM_GAINCEILING,
+  CAM_COLORBAR,
+  CAM_AWB,
+  CAM_AGC,
+  CAM_AEC,
+  CAM_HMIRROR,
+  CAM_VFLIP,
+  CAM_AWB_GAIN,
+  CAM_AGC_GAIN,
+  CAM_AEC_VALUE,
+  CAM_AEC2,
+  CAM_DCW,
+  CAM_BPC,
+  CAM_WPC,
+  CAM_RAW_GMA,
+  CAM_LENC,
+  CAM_SPECIAL_EFFECT,
+  CAM_WB_MODE,
+  CAM_AE_LEVEL,
+  CAM_SETTING_COUNT
+} cam_setting_id_t;
+
+typedef struct __attribute__((packed))
+{
+  uint8_t id;
+  int16_t value;
+} profile_setting_t;
+
+typedef struct __attribute__((packed))
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t pid; // sensor the register list was captured for
+  uint8_t setting_count;
+  uint8_t reg_count;
+  profile_setting_t settings[CAM_SETTING_COUNT];
+  reg_write_t regs[PROFILE_MAX_REGS];
+  uint32_t crc;
+} sensor_profile_t;
+
+// Setting table shared with the other control paths
+int camSettingId(const char *name); // -1 if unknown
+const char *camSettingName(int id);
+// Most sensor registers one set of setting id writes, to size group holds
+int camSettingWrites(int id);
+int camSettingGet(sensor_t *s, int id);
+int camSettingSet(sensor_t *s, int id, int value); // changes go to ctrlNotify()
+
+// Snapshot the current sensor state (plus optional raw registers) as name
+esp_err_t profileSave(const char *name, const reg_write_t *regs, int reg_count);
+// Apply a stored profile; settings already at their target are skipped and
+// everything except a frame size change goes into group holds of at most
+// REG_GROUP_HOLD_MAX register writes
+esp_err_t profileApply(const char *name, uint32_t *elapsed_us);
+esp_err_t profileRemove(const char *name);
+// {"active":"...","profiles":["...",...]}
+int profileListJson(char *p, size_t len);
+// Re-apply the last applied profile at boot
+void profileApplyActive();
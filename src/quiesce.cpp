@@ -0,0 +1,231 @@
+#include "quiesce.h"
+#include "frame_source.h"
+#include "profiles.h"
+#include "tft.h"
+
+#define OTA_RTC_MAGIC 0x4F544131 // "OTA1"
+
+typedef enum
+{
+  QUIESCE_RUNNING,
+  QUIESCE_PAUSED,  // frames stopped, camera still initialized
+  QUIESCE_STOPPED, // camera deinitialized
+} quiesce_state_t;
+
+static const char *quiesce_state_names[] = {"running", "paused", "stopped"};
+
+// Survives the restart after an update
+typedef struct
+{
+  uint32_t magic;
+  char source[8];
+  uint32_t bytes;
+  uint32_t ms;
+  uint32_t quiesce_ms;
+  bool ok;
+} ota_result_t;
+
+RTC_DATA_ATTR static ota_result_t ota_last;
+
+static camera_config_t cam_config;
+static bool have_config = false;
+static volatile quiesce_state_t state = QUIESCE_RUNNING;
+static int tasks = 0;
+static portMUX_TYPE tasks_mux = portMUX_INITIALIZER_UNLOCKED;
+static int16_t settings[CAM_SETTING_COUNT];
+
+// current update
+static const char *ota_source = NULL;
+static uint32_t ota_start = 0;
+static uint32_t ota_quiesce_ms = 0;
+static uint32_t ota_bytes = 0;
+static uint32_t ota_total = 0;
+static int ota_shown = -1; // last percentage (or 100 KB step) on the TFT
+
+void quiesceInit(const camera_config_t *config)
+{
+  cam_config = *config;
+  have_config = true;
+}
+
+bool quiesceActive()
+{
+  return state != QUIESCE_RUNNING;
+}
+
+bool quiesceTaskBegin()
+{
+  bool ok;
+  portENTER_CRITICAL(&tasks_mux);
+  ok = state == QUIESCE_RUNNING;
+  if (ok)
+  {
+    tasks++;
+  }
+  portEXIT_CRITICAL(&tasks_mux);
+  return ok;
+}
+
+void quiesceTaskEnd()
+{
+  portENTER_CRITICAL(&tasks_mux);
+  tasks--;
+  portEXIT_CRITICAL(&tasks_mux);
+}
+
+static bool drained()
+{
+  portENTER_CRITICAL(&tasks_mux);
+  bool idle = tasks == 0;
+  portEXIT_CRITICAL(&tasks_mux);
+  return idle && frameSourceOutstanding() == 0;
+}
+
+void quiesceEnter(const char *source)
+{
+  ota_source = source;
+  ota_start = millis();
+  ota_bytes = 0;
+  ota_total = 0;
+  ota_shown = -1;
+  if (state != QUIESCE_RUNNING)
+  {
+    return;
+  }
+  portENTER_CRITICAL(&tasks_mux);
+  state = QUIESCE_PAUSED;
+  portEXIT_CRITICAL(&tasks_mux);
+  frameSourcePause(true);
+  while (!drained() && millis() - ota_start < QUIESCE_DRAIN_MS)
+  {
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  // a control channel batch in flight finishes before the driver goes
+  sensorLock();
+  sensor_t *s = esp_camera_sensor_get();
+  if (drained() && s && have_config)
+  {
+    for (int id = 0; id < CAM_SETTING_COUNT; id++)
+    {
+      settings[id] = camSettingGet(s, id);
+    }
+    esp_camera_deinit();
+    state = QUIESCE_STOPPED;
+  }
+  else
+  {
+    // a stuck client still holds a frame: freeing it under them is worse
+    // than leaving the camera idle
+    Serial.println("Quiesce: frames still held, camera left initialized");
+  }
+  sensorUnlock();
+  ota_quiesce_ms = millis() - ota_start;
+  Serial.printf("Quiesce: %s for %s in %ums\n", quiesce_state_names[state], source, ota_quiesce_ms);
+  tftLabel(2, "OTA", 3);
+}
+
+void quiesceResume()
+{
+  if (state == QUIESCE_STOPPED)
+  {
+    SensorLock lock;
+    esp_err_t err = ESP_FAIL;
+    for (int attempt = 0; attempt < QUIESCE_INIT_TRIES && err != ESP_OK; attempt++)
+    {
+      if (attempt)
+      {
+        vTaskDelay(pdMS_TO_TICKS(500));
+      }
+      err = esp_camera_init(&cam_config);
+      if (err != ESP_OK)
+      {
+        Serial.printf("Quiesce: camera init failed with error 0x%x\n", err);
+      }
+    }
+    if (err != ESP_OK)
+    {
+      // the running image is untouched: a restart brings the camera back,
+      // staying up without one leaves every sensor handler on a NULL driver
+      Serial.println("Quiesce: camera did not come back, restarting");
+      ESP.restart();
+      return;
+    }
+    sensor_t *s = esp_camera_sensor_get();
+    // raw registers only live in the profile; the rest is the snapshot
+    profileApplyActive();
+    for (int id = 0; id < CAM_SETTING_COUNT; id++)
+    {
+      if (camSettingGet(s, id) != settings[id])
+      {
+        camSettingSet(s, id, settings[id]);
+      }
+    }
+  }
+  if (state != QUIESCE_RUNNING)
+  {
+    frameSourcePause(false);
+    state = QUIESCE_RUNNING;
+    tftLabel(2, "", 3);
+    Serial.println("Quiesce: resumed");
+  }
+}
+
+void otaProgress(uint32_t bytes, uint32_t total)
+{
+  ota_bytes = bytes;
+  ota_total = total;
+  // a label update per 10% (or 100 KB when the size is unknown)
+  int step = total ? (int)((uint64_t)bytes * 10 / total) : (int)(bytes / 102400);
+  if (step != ota_shown)
+  {
+    char text[16];
+    if (total)
+      snprintf(text, sizeof(text), "OTA %d%%", step * 10);
+    else
+      snprintf(text, sizeof(text), "OTA %uK", bytes / 1024);
+    tftLabel(2, text, 3);
+    ota_shown = step;
+  }
+}
+
+void otaFinished(bool ok)
+{
+  if (!ota_source)
+  {
+    return;
+  }
+  ota_last.magic = OTA_RTC_MAGIC;
+  strncpy(ota_last.source, ota_source, sizeof(ota_last.source) - 1);
+  ota_last.source[sizeof(ota_last.source) - 1] = 0;
+  ota_last.bytes = ota_bytes;
+  ota_last.ms = millis() - ota_start;
+  ota_last.quiesce_ms = ota_quiesce_ms;
+  ota_last.ok = ok;
+  Serial.printf("OTA %s: %u bytes in %ums (%u KB/s)\n", ok ? "done" : "failed", ota_last.bytes, ota_last.ms,
+                ota_last.ms ? ota_last.bytes / ota_last.ms : 0);
+  tftLabel(2, ok ? "OTA ok" : "OTA fail", ok ? 2 : 0);
+  ota_source = NULL;
+}
+
+int quiesceMetricsJson(char *p, size_t len)
+{
+  uint32_t elapsed = ota_source ? millis() - ota_start : 0;
+  int n = snprintf(p, len, "\"ota\":{\"state\":\"%s\"", quiesce_state_names[state]);
+  if (ota_source && n < (int)len)
+  {
+    // bytes/ms is KB/s
+    n += snprintf(p + n, len - n, ",\"source\":\"%s\",\"bytes\":%u,\"total\":%u,\"elapsed_ms\":%u,\"kBps\":%u,\"quiesce_ms\":%u",
+                  ota_source, ota_bytes, ota_total, elapsed, elapsed ? ota_bytes / elapsed : 0, ota_quiesce_ms);
+  }
+  if (ota_last.magic == OTA_RTC_MAGIC && n < (int)len)
+  {
+    n += snprintf(p + n, len - n, ",\"last\":{\"source\":\"%s\",\"ok\":%s,\"bytes\":%u,\"ms\":%u,\"kBps\":%u,\"quiesce_ms\":%u}",
+                  ota_last.source, ota_last.ok ? "true" : "false", ota_last.bytes, ota_last.ms,
+                  ota_last.ms ? ota_last.bytes / ota_last.ms : 0, ota_last.quiesce_ms);
+  }
+  if (n < (int)len)
+  {
+    n += snprintf(p + n, len - n, "}");
+  }
+  return n;
+}
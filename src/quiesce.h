@@ -0,0 +1,36 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_camera.h"
+
+// Quiesce the camera while a firmware update runs (ArduinoOTA or /update).
+// Entering pauses the frame source, which makes streams finish their
+// multipart response and refuses new ones, waits for every frame to come
+// back, then deinitializes the camera: XCLK stops and the frame buffers go
+// back to the heap. If the update fails the camera is brought back with the
+// sensor settings it had, or the device restarts if it will not come back.
+// Handlers that touch the sensor answer 503 while quiesced.
+//
+// Update progress and throughput are exported in /metrics; the result of
+// the last update is kept in RTC memory so it is still there after the
+// restart that follows a successful one.
+
+#define QUIESCE_DRAIN_MS 3000 // how long streams get to let go of their frames
+#define QUIESCE_INIT_TRIES 3  // camera restarts on resume before rebooting
+
+// Keep the config esp_camera_init() was called with, for the resume
+void quiesceInit(const camera_config_t *config);
+// Safe to call again while already quiesced; source names the update path
+void quiesceEnter(const char *source);
+void quiesceResume();
+bool quiesceActive();
+
+// Long-running frame consumers (stream tasks) register here; false while
+// quiesced, and the caller should answer 503
+bool quiesceTaskBegin();
+void quiesceTaskEnd();
+
+// total is 0 when unknown (HTTP uploads)
+void otaProgress(uint32_t bytes, uint32_t total);
+void otaFinished(bool ok);
+// "ota":{...}
+int quiesceMetricsJson(char *p, size_t len);
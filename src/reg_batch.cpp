@@ -0,0 +1,149 @@
+#include "reg_batch.h"
+#include "sensor_traits.h"
+#include "trace.h"
+
+// OV5640/OV3660 SRM group access register
+#define GROUP_ACCESS_REG 0x3212
+#define GROUP_ID 0x03
+#define GROUP_HOLD_START (0x00 | GROUP_ID)
+#define GROUP_HOLD_END (0x10 | GROUP_ID)
+#define GROUP_LAUNCH (0xA0 | GROUP_ID)
+
+static SemaphoreHandle_t sensor_lock = NULL;
+static portMUX_TYPE lock_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static int find_write(const reg_write_t *w, int count, uint16_t reg)
+{
+  for (int i = 0; i < count; i++)
+  {
+    if (w[i].reg == reg)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int parseRegList(const char *list, reg_write_t *out, int max)
+{
+  int count = 0;
+  const char *p = list;
+  while (*p)
+  {
+    while (*p == ',' || *p == ';' || *p == '\n' || *p == '\r' || *p == ' ')
+    {
+      p++;
+    }
+    if (!*p)
+    {
+      break;
+    }
+    char *end;
+    unsigned long reg = strtoul(p, &end, 16);
+    if (end == p || *end != ':')
+    {
+      return -1;
+    }
+    p = end + 1;
+    unsigned long mask = strtoul(p, &end, 16);
+    if (end == p || *end != ':')
+    {
+      return -1;
+    }
+    p = end + 1;
+    unsigned long val = strtoul(p, &end, 16);
+    if (end == p || reg > 0xFFFF || mask > 0xFF || val > 0xFF)
+    {
+      return -1;
+    }
+    p = end;
+    if (reg == GROUP_ACCESS_REG)
+    {
+      return -1; // the batch owns the group hold
+    }
+    int i = find_write(out, count, reg);
+    if (i >= 0)
+    {
+      // Reads inside a group hold return the live value, not the pending
+      // one, so two masked writes to one register are folded here.
+      out[i].val = (out[i].val & ~mask) | (val & mask);
+      out[i].mask |= mask;
+      continue;
+    }
+    if (count == max)
+    {
+      return -1;
+    }
+    out[count].reg = reg;
+    out[count].mask = mask;
+    out[count].val = val & mask;
+    count++;
+  }
+  return count;
+}
+
+void sensorLock()
+{
+  if (!sensor_lock)
+  {
+    // the first use may race between loop() and the control task
+    SemaphoreHandle_t m = xSemaphoreCreateRecursiveMutex();
+    portENTER_CRITICAL(&lock_mux);
+    if (!sensor_lock)
+    {
+      sensor_lock = m;
+      m = NULL;
+    }
+    portEXIT_CRITICAL(&lock_mux);
+    if (m)
+    {
+      vSemaphoreDelete(m);
+    }
+  }
+  xSemaphoreTakeRecursive(sensor_lock, portMAX_DELAY);
+}
+
+void sensorUnlock()
+{
+  xSemaphoreGiveRecursive(sensor_lock);
+}
+
+bool groupHoldBegin(sensor_t *s)
+{
+  return sensorTraits()->group_hold && s->set_reg(s, GROUP_ACCESS_REG, 0xFF, GROUP_HOLD_START) == 0;
+}
+
+int groupHoldEnd(sensor_t *s, bool launch)
+{
+  int res = s->set_reg(s, GROUP_ACCESS_REG, 0xFF, GROUP_HOLD_END);
+  if (!res && launch)
+  {
+    res = s->set_reg(s, GROUP_ACCESS_REG, 0xFF, GROUP_LAUNCH);
+  }
+  return res;
+}
+
+int applyRegBatch(sensor_t *s, const reg_write_t *w, int count, bool *latched)
+{
+  TraceSpan span("sccb.batch");
+  span.arg = count;
+  bool hold = count > 1 && count <= REG_GROUP_HOLD_MAX && groupHoldBegin(s);
+  int res = 0;
+  *latched = false;
+  for (int i = 0; i < count && !res; i++)
+  {
+    res = s->set_reg(s, w[i].reg, w[i].mask, w[i].val);
+  }
+  if (hold)
+  {
+    // Close the group even after a failed write so the sensor does not stay
+    // in hold; only launch it if every write made it in.
+    int end = groupHoldEnd(s, !res);
+    if (!res)
+    {
+      res = end;
+      *latched = !res;
+    }
+  }
+  return res;
+}
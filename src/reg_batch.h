@@ -0,0 +1,43 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_camera.h"
+
+// Upper bound on one /regs request
+#define REG_BATCH_MAX 64
+// OV5640/OV3660 group hold buffers are small (sized in 16-byte units by
+// 0x3200-0x3203); larger batches are applied without the latch.
+#define REG_GROUP_HOLD_MAX 32
+
+typedef struct
+{
+  uint16_t reg;
+  uint8_t mask;
+  uint8_t val;
+} reg_write_t;
+
+// Parse "reg:mask:val,reg:mask:val,..." (hex, ',' ';' or newline separated).
+// Writes to the same register are merged. Returns the entry count or -1.
+int parseRegList(const char *list, reg_write_t *out, int max);
+
+// Open/close an SRM group hold around arbitrary sensor writes. Begin
+// returns false on sensors without group hold; end launches the group.
+bool groupHoldBegin(sensor_t *s);
+int groupHoldEnd(sensor_t *s, bool launch);
+
+// Serializes sensor access between loop() (web handlers, ABR, profiles)
+// and the control channel task. Recursive, so a holder may call helpers
+// that lock again.
+void sensorLock();
+void sensorUnlock();
+
+class SensorLock
+{
+public:
+  SensorLock() { sensorLock(); }
+  ~SensorLock() { sensorUnlock(); }
+};
+
+// Apply a parsed batch. On sensors with group hold (OV5640/OV3660) the
+// writes are latched together on the next frame boundary and *latched is
+// set. Returns 0 or the first failing set_reg() result.
+int applyRegBatch(sensor_t *s, const reg_write_t *w, int count, bool *latched);
@@ -0,0 +1,135 @@
+#include "roi_crop.h"
+#include "esp_timer.h"
+#include "jpeg_crop.h"
+#include "trace.h"
+
+struct roi_crop
+{
+  int x, y, w, h;          // percent
+  jpeg_cropper_t *cropper; // on first use
+  camera_fb_t fb;
+  size_t cap;
+};
+
+static portMUX_TYPE count_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t crops = 0, errors = 0;
+static uint64_t us_total = 0, bytes_in = 0, bytes_out = 0;
+
+static void *alloc(size_t size)
+{
+  return psramFound() ? ps_malloc(size) : malloc(size);
+}
+
+roi_crop_t *roiCropNew(const char *spec)
+{
+  int x, y, w, h, n = 0;
+  if (sscanf(spec, "%d,%d,%d,%d%n", &x, &y, &w, &h, &n) != 4 || spec[n] || x < 0 || y < 0 || w < 1 || h < 1 ||
+      x + w > 100 || y + h > 100)
+  {
+    return NULL;
+  }
+  roi_crop_t *roi = (roi_crop_t *)calloc(1, sizeof(roi_crop_t));
+  if (roi)
+  {
+    roi->x = x;
+    roi->y = y;
+    roi->w = w;
+    roi->h = h;
+  }
+  return roi;
+}
+
+void roiCropFree(roi_crop_t *roi)
+{
+  if (roi)
+  {
+    free(roi->cropper);
+    free(roi->fb.buf);
+    free(roi);
+  }
+}
+
+static bool crop(roi_crop_t *roi, camera_fb_t *src)
+{
+  jpeg_cropper_t *c = roi->cropper;
+  if (!c)
+  {
+    c = roi->cropper = (jpeg_cropper_t *)alloc(sizeof(jpeg_cropper_t));
+    if (!c)
+    {
+      return false;
+    }
+    memset(c, 0, sizeof(*c));
+  }
+  if (jpegParse(src->buf, src->len, &c->info) != JPEG_OK)
+  {
+    return false;
+  }
+  jpegCropRegion(c, roi->x, roi->y, roi->w, roi->h);
+  // the region's share of the source plus the headers; grown if short
+  size_t want = (uint64_t)src->len * c->width * c->height / ((uint32_t)c->info.width * c->info.height) + 4096;
+  for (int attempt = 0; attempt < 3; attempt++)
+  {
+    if (roi->cap < want)
+    {
+      free(roi->fb.buf);
+      roi->fb.buf = (uint8_t *)alloc(want);
+      roi->cap = roi->fb.buf ? want : 0;
+      if (!roi->fb.buf)
+      {
+        return false;
+      }
+    }
+    size_t len;
+    jpeg_err_t res = jpegCrop(c, src->buf, src->len, roi->fb.buf, roi->cap, &len);
+    if (res == JPEG_OK)
+    {
+      roi->fb.len = len;
+      roi->fb.width = c->width;
+      roi->fb.height = c->height;
+      roi->fb.format = PIXFORMAT_JPEG;
+      roi->fb.timestamp = src->timestamp;
+      return true;
+    }
+    if (res != JPEG_ERR_SPACE)
+    {
+      return false;
+    }
+    want = roi->cap * 2;
+  }
+  return false;
+}
+
+camera_fb_t *roiCropFrame(roi_crop_t *roi, camera_fb_t *fb)
+{
+  if (fb->format != PIXFORMAT_JPEG)
+  {
+    return NULL;
+  }
+  TraceSpan span("roi");
+  int64_t start = esp_timer_get_time();
+  bool ok = crop(roi, fb);
+  uint32_t us = esp_timer_get_time() - start;
+  portENTER_CRITICAL(&count_mux);
+  if (ok)
+  {
+    crops++;
+    us_total += us;
+    bytes_in += fb->len;
+    bytes_out += roi->fb.len;
+  }
+  else
+  {
+    errors++;
+  }
+  portEXIT_CRITICAL(&count_mux);
+  span.arg = ok ? roi->fb.len : 0;
+  return ok ? &roi->fb : NULL;
+}
+
+int roiMetricsJson(char *p, size_t len)
+{
+  return snprintf(p, len, "\"roi\":{\"crops\":%u,\"errors\":%u,\"us_avg\":%u,\"kb_in\":%u,\"kb_out\":%u}", crops,
+                  errors, crops ? (uint32_t)(us_total / crops) : 0, (uint32_t)(bytes_in >> 10),
+                  (uint32_t)(bytes_out >> 10));
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_camera.h"
+
+// Region of interest for /stream?roi=x,y,w,h (percent of the frame): each
+// frame is cut down to the MCUs covering the region in the compressed
+// domain (jpeg_crop.h), so a client watching a doorway gets that doorway
+// at full resolution for a fraction of the bytes. Unlike a rendition the
+// crop belongs to one client, which holds its own output buffer.
+
+typedef struct roi_crop roi_crop_t;
+
+// Client state for spec "x,y,w,h"; NULL if malformed
+roi_crop_t *roiCropNew(const char *spec);
+void roiCropFree(roi_crop_t *roi);
+// Crop of fb with its timestamp, valid until the next call; NULL if it
+// cannot be made (not a JPEG, no memory)
+camera_fb_t *roiCropFrame(roi_crop_t *roi, camera_fb_t *fb);
+// "roi":{...}
+int roiMetricsJson(char *p, size_t len);
@@ -0,0 +1,113 @@
+#include "sensor_traits.h"
+
+static constexpr sensor_reg_span_t ov3660_5640_regs[] = {
+    {0x3400, 0xFFF, 3, 2}, // AWB R/G/B gains, 12 bit
+    {0x3406, 0xFF, 1, 1},
+    {0x3500, 0xFFFF0, 1, 1}, // exposure, 16 bit
+    {0x3503, 0xFF, 1, 1},
+    {0x350a, 0x3FF, 1, 1},  // gain, 10 bit
+    {0x350c, 0xFFFF, 1, 1}, // VTS, 16 bit
+    {0x5480, 0xFF, 17, 1},  // gamma
+    {0x5380, 0xFF, 12, 1},  // color matrix
+    {0x5580, 0xFF, 10, 1},  // SDE
+    {0x558a, 0x1FF, 1, 1},  // 9 bit
+};
+
+static constexpr sensor_reg_span_t ov2640_regs[] = {
+    {0xd3, 0xFF, 1, 1},
+    {0x111, 0xFF, 1, 1},
+    {0x132, 0xFF, 1, 1},
+};
+
+// The OV2640 driver indexes 5-entry tables with these levels
+static constexpr sensor_range_t ov2640_ranges[] = {
+    {CAM_FRAMESIZE, 0, FRAMESIZE_UXGA},
+    {CAM_QUALITY, 0, 63},
+    {CAM_BRIGHTNESS, -2, 2},
+    {CAM_CONTRAST, -2, 2},
+    {CAM_SATURATION, -2, 2},
+    {CAM_AE_LEVEL, -2, 2},
+};
+
+static constexpr sensor_range_t ov3660_ranges[] = {
+    {CAM_FRAMESIZE, 0, FRAMESIZE_QXGA},
+    {CAM_QUALITY, 0, 63},
+};
+
+static constexpr sensor_range_t ov5640_ranges[] = {
+    {CAM_FRAMESIZE, 0, FRAMESIZE_QSXGA},
+    {CAM_QUALITY, 0, 63},
+};
+
+// initial image is flipped vertically and colors are a bit saturated
+static constexpr profile_setting_t ov3660_defaults[] = {
+    {CAM_VFLIP, 1},
+    {CAM_BRIGHTNESS, 1},
+    {CAM_SATURATION, -2},
+};
+
+#define SPAN(a) a, sizeof(a) / sizeof(a[0])
+
+static constexpr sensor_traits_t sensor_table[] = {
+    {OV2640_PID, "OV2640", false, SPAN(ov2640_regs), SPAN(ov2640_ranges), NULL, 0},
+    {OV3660_PID, "OV3660", true, SPAN(ov3660_5640_regs), SPAN(ov3660_ranges), SPAN(ov3660_defaults)},
+    {OV5640_PID, "OV5640", true, SPAN(ov3660_5640_regs), SPAN(ov5640_ranges), NULL, 0},
+};
+
+static constexpr sensor_traits_t unknown_sensor = {0, "unknown", false, NULL, 0, NULL, 0, NULL, 0};
+
+static const sensor_traits_t *traits = &unknown_sensor;
+
+void sensorTraitsInit(sensor_t *s)
+{
+  traits = &unknown_sensor;
+  for (const sensor_traits_t &t : sensor_table)
+  {
+    if (t.pid == s->id.PID)
+    {
+      traits = &t;
+    }
+  }
+  Serial.printf("Sensor: %s (PID 0x%x)\n", traits->name, s->id.PID);
+}
+
+const sensor_traits_t *sensorTraits()
+{
+  return traits;
+}
+
+void sensorApplyDefaults(sensor_t *s)
+{
+  for (int i = 0; i < traits->default_count; i++)
+  {
+    camSettingSet(s, traits->defaults[i].id, traits->defaults[i].value);
+  }
+}
+
+bool sensorSettingValid(int id, int value)
+{
+  for (int i = 0; i < traits->range_count; i++)
+  {
+    const sensor_range_t &r = traits->ranges[i];
+    if (r.id == id)
+    {
+      return value >= r.min && value <= r.max;
+    }
+  }
+  return true;
+}
+
+int sensorStatusRegsJson(sensor_t *s, char *p, size_t len)
+{
+  int n = 0;
+  for (int i = 0; i < traits->status_reg_count; i++)
+  {
+    const sensor_reg_span_t &span = traits->status_regs[i];
+    for (int r = 0; r < span.count && n < (int)len; r++)
+    {
+      uint16_t reg = span.reg + r * span.step;
+      n += snprintf(p + n, len - n, "\"0x%x\":%u,", reg, s->get_reg(s, reg, span.mask));
+    }
+  }
+  return min(n, (int)len - 1);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "profiles.h"
+
+// What differs between sensors, as data: the registers /status reports,
+// the valid range of settings whose limits depend on the sensor, the
+// tuning applied at boot and whether writes can be latched with a group
+// hold. The entry for the detected sensor is looked up once, by PID, in
+// sensorTraitsInit(); everything else reads sensorTraits(). Supporting a
+// new sensor means adding an entry to the table in sensor_traits.cpp.
+
+typedef struct
+{
+  uint16_t reg;
+  uint32_t mask; // wider than 0xff reads consecutive registers as one value
+  uint8_t count; // registers reg, reg + step, ...
+  uint8_t step;
+} sensor_reg_span_t;
+
+typedef struct
+{
+  uint8_t id; // cam_setting_id_t
+  int16_t min, max;
+} sensor_range_t;
+
+typedef struct
+{
+  uint16_t pid;
+  const char *name;
+  bool group_hold; // SRM group access at 0x3212
+  const sensor_reg_span_t *status_regs;
+  uint8_t status_reg_count;
+  const sensor_range_t *ranges;
+  uint8_t range_count;
+  const profile_setting_t *defaults;
+  uint8_t default_count;
+} sensor_traits_t;
+
+// Pick the traits for the attached sensor; unknown sensors get an entry
+// without registers, ranges or tuning
+void sensorTraitsInit(sensor_t *s);
+const sensor_traits_t *sensorTraits();
+// Apply the sensor's boot tuning
+void sensorApplyDefaults(sensor_t *s);
+// False if value is outside the sensor's range for setting id
+bool sensorSettingValid(int id, int value);
+// "0xREG":value, for every status register; returns bytes written
+int sensorStatusRegsJson(sensor_t *s, char *p, size_t len);
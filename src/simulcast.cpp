@@ -0,0 +1,219 @@
+#include "simulcast.h"
+#include "esp_timer.h"
+#include "jpeg_scale.h"
+#include "trace.h"
+
+typedef struct
+{
+  camera_fb_t fb;
+  size_t cap;
+  uint32_t seq; // 0 while empty or being made
+  uint32_t refs;
+} sc_slot_t;
+
+typedef struct
+{
+  int scale;
+  SemaphoreHandle_t lock; // one maker at a time; the others wait and share
+  jpeg_scaler_t *scaler;
+  sc_slot_t slots[SIMULCAST_SLOTS];
+  uint32_t made, shared, errors;
+  uint64_t us_total;
+  size_t last_len;
+} rendition_t;
+
+static rendition_t renditions[3] = {{2}, {4}, {8}};
+static portMUX_TYPE state_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void *alloc(size_t size)
+{
+  return psramFound() ? ps_malloc(size) : malloc(size);
+}
+
+static camera_fb_t *share(rendition_t *r, uint32_t seq)
+{
+  camera_fb_t *fb = NULL;
+  portENTER_CRITICAL(&state_mux);
+  for (sc_slot_t &s : r->slots)
+  {
+    if (s.seq == seq)
+    {
+      s.refs++;
+      r->shared++;
+      fb = &s.fb;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&state_mux);
+  return fb;
+}
+
+// Free slot, oldest rendition first; taken for the caller with seq 0
+static sc_slot_t *claim(rendition_t *r)
+{
+  sc_slot_t *slot = NULL;
+  portENTER_CRITICAL(&state_mux);
+  for (sc_slot_t &s : r->slots)
+  {
+    if (!s.refs && (!slot || s.seq < slot->seq))
+    {
+      slot = &s;
+    }
+  }
+  if (slot)
+  {
+    slot->seq = 0;
+    slot->refs = 1;
+  }
+  portEXIT_CRITICAL(&state_mux);
+  return slot;
+}
+
+static bool make(rendition_t *r, sc_slot_t *slot, camera_fb_t *src)
+{
+  TraceSpan span("simulcast");
+  jpeg_scaler_t *sc = r->scaler;
+  if (!sc)
+  {
+    sc = r->scaler = (jpeg_scaler_t *)alloc(sizeof(jpeg_scaler_t));
+    if (!sc)
+    {
+      return false;
+    }
+    memset(sc, 0, sizeof(*sc));
+  }
+  if (jpegParse(src->buf, src->len, &sc->info) != JPEG_OK)
+  {
+    return false;
+  }
+  size_t need = jpegScaleStripSize(&sc->info, r->scale);
+  if (sc->strip_size < need)
+  {
+    free(sc->strip);
+    sc->strip = (uint8_t *)alloc(need);
+    sc->strip_size = sc->strip ? need : 0;
+    if (!sc->strip)
+    {
+      return false;
+    }
+  }
+  // about a quarter of the source at 1/2 on camera frames; grown if short
+  size_t want = src->len / r->scale + 4096;
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    if (slot->cap < want)
+    {
+      free(slot->fb.buf);
+      slot->fb.buf = (uint8_t *)alloc(want);
+      slot->cap = slot->fb.buf ? want : 0;
+      if (!slot->fb.buf)
+      {
+        return false;
+      }
+    }
+    size_t len;
+    jpeg_err_t res = jpegScale(sc, src->buf, src->len, r->scale, slot->fb.buf, slot->cap, &len);
+    if (res == JPEG_OK)
+    {
+      slot->fb.len = len;
+      slot->fb.width = (sc->info.width + r->scale - 1) / r->scale;
+      slot->fb.height = (sc->info.height + r->scale - 1) / r->scale;
+      slot->fb.format = PIXFORMAT_JPEG;
+      slot->fb.timestamp = src->timestamp;
+      span.arg = len;
+      return true;
+    }
+    if (res != JPEG_ERR_SPACE)
+    {
+      return false;
+    }
+    want = slot->cap * 2;
+  }
+  return false;
+}
+
+camera_fb_t *simulcastGet(camera_fb_t *fb, uint32_t seq, int scale)
+{
+  rendition_t *r = scale == 2 ? &renditions[0] : scale == 4 ? &renditions[1] : scale == 8 ? &renditions[2] : NULL;
+  if (!r || !seq || fb->format != PIXFORMAT_JPEG)
+  {
+    return NULL;
+  }
+  if (!r->lock)
+  {
+    portENTER_CRITICAL(&state_mux);
+    if (!r->lock)
+    {
+      r->lock = xSemaphoreCreateMutex();
+    }
+    portEXIT_CRITICAL(&state_mux);
+  }
+  camera_fb_t *out = share(r, seq);
+  if (out)
+  {
+    return out;
+  }
+  xSemaphoreTake(r->lock, portMAX_DELAY);
+  // somebody may have made it while we waited
+  out = share(r, seq);
+  if (!out)
+  {
+    sc_slot_t *slot = claim(r);
+    int64_t start = esp_timer_get_time();
+    if (slot && make(r, slot, fb))
+    {
+      r->made++;
+      r->us_total += esp_timer_get_time() - start;
+      r->last_len = slot->fb.len;
+      portENTER_CRITICAL(&state_mux);
+      slot->seq = seq;
+      portEXIT_CRITICAL(&state_mux);
+      out = &slot->fb;
+    }
+    else
+    {
+      r->errors++;
+      if (slot)
+      {
+        simulcastRelease(&slot->fb);
+      }
+    }
+  }
+  xSemaphoreGive(r->lock);
+  return out;
+}
+
+void simulcastRelease(camera_fb_t *fb)
+{
+  portENTER_CRITICAL(&state_mux);
+  for (rendition_t &r : renditions)
+  {
+    for (sc_slot_t &s : r.slots)
+    {
+      if (&s.fb == fb && s.refs)
+      {
+        s.refs--;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&state_mux);
+}
+
+int simulcastMetricsJson(char *p, size_t len)
+{
+  int n = snprintf(p, len, "\"simulcast\":[");
+  for (const rendition_t &r : renditions)
+  {
+    if (n < (int)len)
+    {
+      n += snprintf(p + n, len - n, "%s{\"scale\":%d,\"made\":%u,\"shared\":%u,\"errors\":%u,\"us_avg\":%u,\"bytes\":%u}",
+                    r.scale == 2 ? "" : ",", r.scale, r.made, r.shared, r.errors,
+                    r.made ? (uint32_t)(r.us_total / r.made) : 0, (uint32_t)r.last_len);
+    }
+  }
+  if (n < (int)len)
+  {
+    n += snprintf(p + n, len - n, "]");
+  }
+  return n;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_camera.h"
+
+// Reduced-resolution copies of the camera frames for /stream?scale=N
+// (N = 2, 4 or 8), so a phone and a recorder can watch one sensor at
+// different sizes. A rendition is made in the compressed domain
+// (jpeg_scale.h) by the first client that wants it for a frame and shared
+// with every other client on that scale: each is computed at most once
+// per frame, and scales nobody streams cost nothing.
+
+#define SIMULCAST_SLOTS 3 // renditions of one scale clients can hold at once
+
+// Rendition of fb (seq from frameSourceGet()) at scale 2, 4 or 8, with the
+// source's timestamp; NULL if it cannot be made (not a JPEG, no memory,
+// every slot held)
+camera_fb_t *simulcastGet(camera_fb_t *fb, uint32_t seq, int scale);
+void simulcastRelease(camera_fb_t *fb);
+// "simulcast":[...]
+int simulcastMetricsJson(char *p, size_t len);
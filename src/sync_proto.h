@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+
+// Wire format of the capture-sync protocol (see cam_sync.h), shared with
+// tools/syncleader.cpp. One fixed-size little-endian datagram per message.
+//
+//   leader -> all   BEACON    I am the leader; ping me
+//   node -> leader  PING      t[0] node send time (node clock)
+//   leader -> node  PONG      t[0] echoed, t[1] leader receive, t[2] leader send
+//   leader -> all   TRIGGER   id, t[0] fire time (shared epoch)
+//   node -> leader  REPORT    id, t[0] fire time, t[1] frame time (shared),
+//                             t[2] offset used, a jpeg bytes, b store seq
+//
+// The shared epoch is the leader's clock, in microseconds; the Linux leader
+// uses Unix time.
+
+#define SYNC_PORT 3333
+#define SYNC_MAGIC 0x31595343 // "CSY1"
+
+enum
+{
+  SYNC_BEACON = 1,
+  SYNC_PING,
+  SYNC_PONG,
+  SYNC_TRIGGER,
+  SYNC_REPORT,
+};
+
+// REPORT flags
+#define SYNC_F_STORED 0x01   // frame appended to the image store, b is its seq
+#define SYNC_F_UNSYNCED 0x02 // no offset estimate when the trigger came
+#define SYNC_F_FAILED 0x04   // no frame
+
+typedef struct __attribute__((packed))
+{
+  uint32_t magic;
+  uint8_t type;
+  uint8_t flags;
+  uint16_t reserved;
+  uint32_t id; // ping sequence, or trigger id
+  int64_t t[3];
+  uint32_t a, b;
+} sync_msg_t;
@@ -0,0 +1,408 @@
+#include "tft.h"
+#include <Wire.h>
+#include <SPI.h>
+#include <Adafruit_GFX.h>    // Core graphics library
+#include <WiFi.h>
+#include "freertos/queue.h"
+#include "frame_source.h"
+#include "preview.h"
+
+int recColor[] = {TFT_RED, TFT_BLUE, TFT_GREEN, TFT_YELLOW, TFT_CYAN, TFT_MAGENTA};
+TFT_eSPI tft = TFT_eSPI();
+
+#define COLORS (sizeof(recColor) / sizeof(recColor[0]))
+
+typedef enum
+{
+  TFT_CMD_LABEL,
+  TFT_CMD_BOX,
+  TFT_CMD_HUD,
+  TFT_CMD_CLEAR,
+  TFT_CMD_REFRESH,
+} tft_cmd_type_t;
+
+typedef struct
+{
+  uint8_t type;
+  uint8_t id;
+  uint8_t color;
+  int16_t x, y, w, h;
+  char text[TFT_LABEL_LEN];
+} tft_cmd_t;
+
+typedef struct
+{
+  int16_t x, y, w, h;
+} rect_t;
+
+typedef struct
+{
+  rect_t r;
+  uint8_t color;
+  bool on;
+} box_t;
+
+typedef struct
+{
+  char text[TFT_LABEL_LEN];
+  uint8_t color;
+} label_t;
+
+static QueueHandle_t tft_queue = NULL;
+
+// Owned by the display task
+static label_t labels[TFT_LABELS];
+static box_t boxes[TFT_BOXES];
+static bool hud_on = true;
+static char hud_text[2][12];
+static rect_t dirty[TFT_DIRTY_MAX];
+static int dirty_count = 0;
+static bool preview_shown = false;
+
+static bool intersects(const rect_t &a, const rect_t &b)
+{
+  return a.x < b.x + b.w && b.x < a.x + a.w && a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+static rect_t unite(const rect_t &a, const rect_t &b)
+{
+  int16_t x = min(a.x, b.x);
+  int16_t y = min(a.y, b.y);
+  return {x, y, (int16_t)(max(a.x + a.w, b.x + b.w) - x), (int16_t)(max(a.y + a.h, b.y + b.h) - y)};
+}
+
+// Rectangles never span the preview and label areas, so merging stays
+// within one of them
+static void add_dirty(rect_t r, const rect_t &area)
+{
+  int16_t x0 = max(r.x, area.x), y0 = max(r.y, area.y);
+  int16_t x1 = min(r.x + r.w, area.x + area.w), y1 = min(r.y + r.h, area.y + area.h);
+  if (x1 <= x0 || y1 <= y0)
+  {
+    return;
+  }
+  r = {x0, y0, (int16_t)(x1 - x0), (int16_t)(y1 - y0)};
+  for (int i = 0; i < dirty_count; i++)
+  {
+    if (intersects(dirty[i], r))
+    {
+      dirty[i] = unite(dirty[i], r);
+      return;
+    }
+  }
+  if (dirty_count < TFT_DIRTY_MAX)
+  {
+    dirty[dirty_count++] = r;
+  }
+  else
+  {
+    dirty[0] = unite(dirty[0], r); // too fragmented: fall back to one big one
+  }
+}
+
+static const rect_t preview_area = {0, 0, TFT_PREVIEW_W, TFT_PREVIEW_H};
+// TFT_HEIGHT is the long side, which is the width in landscape
+static const rect_t label_area = {TFT_PREVIEW_W, 0, TFT_HEIGHT - TFT_PREVIEW_W, TFT_PREVIEW_H};
+
+static rect_t label_rect(int slot)
+{
+  return {label_area.x, (int16_t)(slot * TFT_LABEL_H), label_area.w, TFT_LABEL_H};
+}
+
+static void box_dirty(const rect_t &r)
+{
+  // a live preview redraws the boxes with the next frame
+  if (!preview_shown)
+  {
+    add_dirty(r, preview_area);
+  }
+}
+
+static void apply(const tft_cmd_t &c)
+{
+  switch (c.type)
+  {
+  case TFT_CMD_LABEL:
+    if (strcmp(labels[c.id].text, c.text) || labels[c.id].color != c.color)
+    {
+      strcpy(labels[c.id].text, c.text);
+      labels[c.id].color = c.color;
+      add_dirty(label_rect(c.id), label_area);
+    }
+    break;
+  case TFT_CMD_BOX:
+  {
+    box_t &b = boxes[c.id];
+    if (b.on)
+    {
+      box_dirty(b.r);
+    }
+    b.r = {c.x, c.y, c.w, c.h};
+    b.color = c.color;
+    b.on = c.w > 0 && c.h > 0;
+    if (b.on)
+    {
+      box_dirty(b.r);
+    }
+    break;
+  }
+  case TFT_CMD_HUD:
+    if (hud_on != (bool)c.id)
+    {
+      hud_on = c.id;
+      add_dirty(label_rect(TFT_LABELS - 1), label_area);
+    }
+    break;
+  case TFT_CMD_CLEAR:
+    for (int i = 0; i < TFT_LABELS; i++)
+    {
+      if (labels[i].text[0])
+      {
+        labels[i].text[0] = 0;
+        add_dirty(label_rect(i), label_area);
+      }
+    }
+    for (int i = 0; i < TFT_BOXES; i++)
+    {
+      if (boxes[i].on)
+      {
+        boxes[i].on = false;
+        box_dirty(boxes[i].r);
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+static void update_hud()
+{
+  static uint32_t last_seq = 0;
+  static uint32_t last_ms = 0;
+  uint32_t seq = frameSourceSeq();
+  uint32_t now = millis();
+  uint32_t fps = last_ms && now > last_ms ? (seq - last_seq) * 1000 / (now - last_ms) : 0;
+  last_seq = seq;
+  last_ms = now;
+  char line[2][12];
+  snprintf(line[0], sizeof(line[0]), "%ufps %d", fps, WiFi.isConnected() ? WiFi.RSSI() : 0);
+  snprintf(line[1], sizeof(line[1]), "%uk", ESP.getFreeHeap() / 1024);
+  if (memcmp(line, hud_text, sizeof(line)))
+  {
+    memcpy(hud_text, line, sizeof(line));
+    if (hud_on)
+    {
+      add_dirty(label_rect(TFT_LABELS - 1), label_area);
+    }
+  }
+}
+
+static void redraw()
+{
+  if (!dirty_count)
+  {
+    return;
+  }
+  tft.startWrite();
+  for (int d = 0; d < dirty_count; d++)
+  {
+    const rect_t &r = dirty[d];
+    // the viewport clips everything drawn below to the dirty rectangle
+    tft.setViewport(r.x, r.y, r.w, r.h, false);
+    tft.fillRect(r.x, r.y, r.w, r.h, TFT_BLACK);
+    if (intersects(r, preview_area))
+    {
+      for (int i = 0; i < TFT_BOXES; i++)
+      {
+        if (boxes[i].on && intersects(r, boxes[i].r))
+        {
+          tft.drawRect(boxes[i].r.x, boxes[i].r.y, boxes[i].r.w, boxes[i].r.h, recColor[boxes[i].color]);
+        }
+      }
+    }
+    else
+    {
+      for (int i = 0; i < TFT_LABELS; i++)
+      {
+        if (!intersects(r, label_rect(i)))
+        {
+          continue;
+        }
+        int y = i * TFT_LABEL_H;
+        if (hud_on && i == TFT_LABELS - 1)
+        {
+          tft.setTextColor(TFT_WHITE);
+          tft.setCursor(label_area.x, y);
+          tft.print(hud_text[0]);
+          tft.setCursor(label_area.x, y + 8);
+          tft.print(hud_text[1]);
+        }
+        else if (labels[i].text[0])
+        {
+          tft.setTextColor(recColor[labels[i].color]);
+          tft.setCursor(label_area.x, y);
+          tft.print(labels[i].text);
+        }
+      }
+    }
+  }
+  tft.resetViewport();
+  tft.endWrite();
+  dirty_count = 0;
+}
+
+static void display_task(void *arg)
+{
+  uint32_t next_frame = 0;
+  uint32_t next_hud = 0;
+  bool preview_ready = previewInit();
+  while (true)
+  {
+    uint32_t now = millis();
+    bool want_preview = preview_ready && previewEnabled();
+    uint32_t due = next_hud;
+    if (want_preview && (int32_t)(next_frame - due) < 0)
+    {
+      due = next_frame;
+    }
+    int32_t wait = (int32_t)(due - now);
+    tft_cmd_t c;
+    if (xQueueReceive(tft_queue, &c, pdMS_TO_TICKS(wait > 0 ? wait : 0)) == pdTRUE)
+    {
+      do
+      {
+        apply(c);
+      } while (xQueueReceive(tft_queue, &c, 0) == pdTRUE);
+    }
+    now = millis();
+    if (want_preview != preview_shown)
+    {
+      // switched off: blank the preview area and bring the boxes back
+      preview_shown = want_preview;
+      if (!preview_shown)
+      {
+        add_dirty(preview_area, preview_area);
+      }
+    }
+    if ((int32_t)(now - next_hud) >= 0)
+    {
+      update_hud();
+      next_hud = now + TFT_HUD_MS;
+    }
+    redraw();
+    if (want_preview && (int32_t)(now - next_frame) >= 0)
+    {
+      next_frame = millis() + previewDraw();
+    }
+  }
+}
+
+void setupLCD() {
+  tft.begin();
+  tft.setRotation(1);
+  tft.fillScreen(TFT_BLACK);
+  tft.invertDisplay( true );
+  tft.setTextFont(1);
+  tft.setTextSize(1);
+  strcpy(labels[0].text, "Ready");
+  labels[0].color = 5;
+  add_dirty(label_area, label_area);
+  tft_queue = xQueueCreate(TFT_QUEUE_LEN, sizeof(tft_cmd_t));
+  // lowest priority above idle, on the core that does not run loop()
+  xTaskCreatePinnedToCore(display_task, "display", 4096, NULL, tskIDLE_PRIORITY + 1, NULL, 0);
+}
+
+static bool post(const tft_cmd_t &c)
+{
+  return tft_queue && xQueueSend(tft_queue, &c, 0) == pdTRUE;
+}
+
+bool tftLabel(int slot, const char *text, int color)
+{
+  if (slot < 0 || slot >= TFT_LABELS || color < 0 || color >= (int)COLORS)
+  {
+    return false;
+  }
+  tft_cmd_t c = {TFT_CMD_LABEL, (uint8_t)slot, (uint8_t)color};
+  strncpy(c.text, text, sizeof(c.text) - 1);
+  return post(c);
+}
+
+bool tftBox(int id, int x, int y, int w, int h, int color)
+{
+  if (id < 0 || id >= TFT_BOXES || color < 0 || color >= (int)COLORS)
+  {
+    return false;
+  }
+  tft_cmd_t c = {TFT_CMD_BOX, (uint8_t)id, (uint8_t)color, (int16_t)x, (int16_t)y, (int16_t)w, (int16_t)h};
+  return post(c);
+}
+
+bool tftHud(bool on)
+{
+  tft_cmd_t c = {TFT_CMD_HUD, (uint8_t)on};
+  return post(c);
+}
+
+bool tftRefresh()
+{
+  tft_cmd_t c = {TFT_CMD_REFRESH};
+  return post(c);
+}
+
+void tftPrint(String label, int i) {
+  tftLabel(1, label.c_str(), i);
+}
+bool tftPrints(String label, int x, int y, int bheight, int bwidth, int i) {
+  bool ok = tftBox(i, x * 2, y * 2 - 8, bwidth * 2, bheight * 2, i);
+  // the last row belongs to the HUD
+  if (i < 0 || i + 1 >= TFT_LABELS - 1)
+  {
+    return false;
+  }
+  return tftLabel(i + 1, label.c_str(), i) && ok;
+}
+void tftClear() {
+  tft_cmd_t c = {TFT_CMD_CLEAR};
+  post(c);
+}
+
+// The strip holds big-endian RGB565, TFT_PREVIEW_W pixels per row
+void tftComposeStrip(uint16_t *strip, int y, int h)
+{
+  for (int i = 0; i < TFT_BOXES; i++)
+  {
+    const box_t &b = boxes[i];
+    if (!b.on || b.r.y >= y + h || b.r.y + b.r.h <= y)
+    {
+      continue;
+    }
+    uint16_t c = recColor[b.color];
+    c = (c >> 8) | (c << 8);
+    int x0 = max((int)b.r.x, 0);
+    int x1 = min(b.r.x + b.r.w - 1, TFT_PREVIEW_W - 1);
+    for (int row = max((int)b.r.y, y); row < min(b.r.y + b.r.h, y + h); row++)
+    {
+      uint16_t *line = &strip[(row - y) * TFT_PREVIEW_W];
+      if (row == b.r.y || row == b.r.y + b.r.h - 1)
+      {
+        for (int x = x0; x <= x1; x++)
+        {
+          line[x] = c;
+        }
+      }
+      else
+      {
+        if (b.r.x >= 0 && b.r.x < TFT_PREVIEW_W)
+        {
+          line[b.r.x] = c;
+        }
+        if (x1 == b.r.x + b.r.w - 1 && x1 >= 0)
+        {
+          line[x1] = c;
+        }
+      }
+    }
+  }
+}
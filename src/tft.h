@@ -1,34 +1,47 @@
+#pragma once
 #include <Arduino.h>
-#include <Wire.h>
-#include <SPI.h>
-#include <Adafruit_GFX.h>    // Core graphics library
 #include <TFT_eSPI.h> // Hardware-specific library
-int recColor[] = {TFT_RED, TFT_BLUE, TFT_GREEN, TFT_YELLOW, TFT_CYAN, TFT_MAGENTA};
-TFT_eSPI tft = TFT_eSPI();
-void setupLCD() {
-  tft.begin();
-  tft.setRotation(1);
-  tft.fillScreen(TFT_BLACK);
-  tft.invertDisplay( true );
-  tft.setTextFont(1);
-  tft.setTextSize(1);
-  tft.setCursor(96, 0);
-  tft.setTextColor(recColor[5]);
-  tft.print("Ready");
 
-}
-void tftPrint(String label, int i) {
-  tft.setCursor(96,  16);
-  tft.setTextColor(recColor[i]);
-  tft.print(label);
-}
-void tftPrints(String label, int x, int y, int bheight, int bwidth, int i) {
-  tft.drawRect(x * 2, y * 2 - 8, bwidth * 2, bheight * 2, recColor[i]);
-  tft.setCursor(96, i * 16 + 16);
-  tft.setTextColor(recColor[i]);
-  tft.print(label);
+// The 160x80 ST7735 is owned by one display task. Everything else talks to
+// it through a command queue: the calls below only enqueue and return (they
+// drop the update when the queue is full), and the task redraws just the
+// rectangles that changed, batched into one SPI transaction per pass.
+//
+// Layout in landscape: the camera preview and the overlay boxes use
+// x < TFT_PREVIEW_W; the column to the right holds TFT_LABELS text rows of
+// TFT_LABEL_H pixels, the last of which is the fps/RSSI/heap HUD when on.
 
-}
-void tftClear() {
-  tft.fillRect( 96, 0, 64, 80, 0);
-}
\ No newline at end of file
+#define TFT_PREVIEW_W 96
+#define TFT_PREVIEW_H 80
+#define TFT_LABEL_H 16
+#define TFT_LABELS 5
+#define TFT_LABEL_LEN 24
+#define TFT_BOXES 8
+#define TFT_QUEUE_LEN 16
+#define TFT_DIRTY_MAX 8
+#define TFT_HUD_MS 1000
+
+extern TFT_eSPI tft;
+extern int recColor[];
+
+// Panel init, then start the display task
+void setupLCD();
+
+// Overlay primitives; color is an index into recColor
+bool tftLabel(int slot, const char *text, int color);
+// A box in preview coordinates; w or h of 0 removes it
+bool tftBox(int id, int x, int y, int w, int h, int color);
+bool tftHud(bool on);
+// Wake the display task, e.g. after the preview was switched on
+bool tftRefresh();
+
+// Earlier helpers, now on top of the overlay
+void tftPrint(String label, int i);
+// Box i and its label in row i + 1. Rows stop short of the HUD, so only
+// i < TFT_LABELS - 2 gets a label; false when it did not fit or was dropped
+bool tftPrints(String label, int x, int y, int bheight, int bwidth, int i);
+// Remove all labels and boxes
+void tftClear();
+
+// Display task only: draw the boxes over a preview strip before it is sent
+void tftComposeStrip(uint16_t *strip, int y, int h);
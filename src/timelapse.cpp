@@ -0,0 +1,223 @@
+#include "timelapse.h"
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include "esp_camera.h"
+#include "esp_sleep.h"
+#include "wifi_conn.h"
+#include "img_store.h"
+
+#define TL_RTC_MAGIC 0x544C5331 // "TLS1"
+
+typedef struct
+{
+  bool enabled;
+  uint32_t interval_s;
+  uint32_t settle;
+  uint32_t window_s;
+  char url[128];
+} tl_config_t;
+
+// Survives deep sleep, lost on power-on
+typedef struct
+{
+  uint32_t magic;
+  uint32_t seq;           // sequence number of the next image
+  uint32_t failures;      // consecutive failed uploads of seq
+  uint32_t last_awake_ms; // wake-to-sleep time of the previous cycle
+  int32_t last_status;    // HTTP status (or HTTPClient error) of the previous cycle
+} tl_rtc_t;
+
+RTC_DATA_ATTR static tl_rtc_t tl_rtc;
+static tl_config_t tl_config;
+static bool tl_loaded = false;
+
+static void load_config()
+{
+  Preferences prefs;
+  tl_config.enabled = false;
+  tl_config.interval_s = TL_DEFAULT_INTERVAL_S;
+  tl_config.settle = TL_DEFAULT_SETTLE;
+  tl_config.window_s = TL_DEFAULT_WINDOW_S;
+  tl_config.url[0] = 0;
+  if (prefs.begin("timelapse", true))
+  {
+    tl_config.enabled = prefs.getBool("enable", false);
+    tl_config.interval_s = prefs.getUInt("interval", TL_DEFAULT_INTERVAL_S);
+    tl_config.settle = prefs.getUInt("settle", TL_DEFAULT_SETTLE);
+    // stored before the minimum existed
+    tl_config.window_s = max(prefs.getUInt("window", TL_DEFAULT_WINDOW_S), (uint32_t)TL_MIN_WINDOW_S);
+    String url = prefs.getString("url");
+    strncpy(tl_config.url, url.c_str(), sizeof(tl_config.url) - 1);
+    prefs.end();
+  }
+  if (tl_rtc.magic != TL_RTC_MAGIC)
+  {
+    memset(&tl_rtc, 0, sizeof(tl_rtc));
+    tl_rtc.magic = TL_RTC_MAGIC;
+  }
+  tl_loaded = true;
+}
+
+static bool usable()
+{
+  return tl_config.enabled && tl_config.interval_s > 0 && !strncmp(tl_config.url, "http://", 7);
+}
+
+bool timelapseWakeup()
+{
+  load_config();
+  return usable() && esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;
+}
+
+[[noreturn]] static void sleep_for(uint32_t seconds)
+{
+  uint32_t awake_ms = (uint32_t)(esp_timer_get_time() / 1000);
+  uint64_t sleep_us = (uint64_t)seconds * 1000000ULL;
+  // Keep the capture cadence: the time spent awake comes off the sleep
+  if (sleep_us > (uint64_t)awake_ms * 1000ULL)
+  {
+    sleep_us -= (uint64_t)awake_ms * 1000ULL;
+  }
+  tl_rtc.last_awake_ms = awake_ms;
+  Serial.printf("Timelapse: awake %ums, sleeping %us\n", awake_ms, (uint32_t)(sleep_us / 1000000ULL));
+  Serial.flush();
+  WiFi.disconnect(true);
+  esp_camera_deinit();
+  esp_sleep_enable_timer_wakeup(sleep_us);
+  esp_deep_sleep_start();
+}
+
+static int upload(camera_fb_t *fb)
+{
+  HTTPClient http;
+  if (!http.begin(tl_config.url))
+  {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  http.setConnectTimeout(TL_HTTP_TIMEOUT_MS);
+  http.setTimeout(TL_HTTP_TIMEOUT_MS);
+  http.addHeader("Content-Type", "image/jpeg");
+  http.addHeader("X-Sequence", String(tl_rtc.seq));
+  http.addHeader("X-Retry", String(tl_rtc.failures));
+  http.addHeader("X-Prev-Awake-Ms", String(tl_rtc.last_awake_ms));
+  http.addHeader("X-Prev-Status", String(tl_rtc.last_status));
+  http.addHeader("X-Awake-Ms", String((uint32_t)(esp_timer_get_time() / 1000)));
+  int code = http.POST(fb->buf, fb->len);
+  http.end();
+  return code;
+}
+
+void timelapseRun()
+{
+  if (!tl_loaded)
+  {
+    load_config();
+  }
+  // Let auto exposure and white balance converge on the profile
+  for (uint32_t i = 0; i < tl_config.settle; i++)
+  {
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (fb)
+    {
+      esp_camera_fb_return(fb);
+    }
+  }
+  camera_fb_t *fb = esp_camera_fb_get();
+  int code = HTTPC_ERROR_NOT_CONNECTED;
+  if (!fb)
+  {
+    Serial.println("Timelapse: camera capture failed");
+  }
+  else
+  {
+    // the cached lease keeps its address: the upload can go out at once
+    if (wifiWaitConnected(TL_WIFI_TIMEOUT_MS) && (uint32_t)WiFi.localIP())
+    {
+      code = upload(fb);
+    }
+    Serial.printf("Timelapse: #%u %zuB -> %d\n", tl_rtc.seq, fb->len, code);
+    if ((code < 200 || code >= 300) && imgStoreBegin() == ESP_OK)
+    {
+      // Keep the image on flash so a failed upload does not lose it
+      imgStoreAppend(fb->buf, fb->len, &fb->timestamp, NULL);
+    }
+    esp_camera_fb_return(fb);
+  }
+  tl_rtc.last_status = code;
+
+  uint32_t next = tl_config.interval_s;
+  if (code >= 200 && code < 300)
+  {
+    tl_rtc.seq++;
+    tl_rtc.failures = 0;
+  }
+  else if (++tl_rtc.failures <= TL_MAX_RETRIES)
+  {
+    next = min(next, TL_RETRY_S * tl_rtc.failures);
+  }
+  else
+  {
+    // Give this image up and stay on the normal cadence
+    tl_rtc.seq++;
+    tl_rtc.failures = 0;
+  }
+  sleep_for(next);
+}
+
+void loopTimelapse()
+{
+  // The window starts when timelapse becomes usable, not at boot: enabling
+  // it on a device that has been up for hours must not sleep it at once
+  static uint32_t usable_since = 0;
+  static bool was_usable = false;
+  if (!tl_loaded || !usable())
+  {
+    was_usable = false;
+    return;
+  }
+  if (!was_usable)
+  {
+    was_usable = true;
+    usable_since = millis();
+  }
+  if ((millis() - usable_since) / 1000 >= tl_config.window_s)
+  {
+    Serial.println("Timelapse: maintenance window over");
+    sleep_for(tl_config.interval_s);
+  }
+}
+
+int timelapseSet(const String &var, const String &value)
+{
+  Preferences prefs;
+  if (!prefs.begin("timelapse", false))
+  {
+    return -1;
+  }
+  int val = value.toInt();
+  int res = 0;
+  if (var.equals("tl_enable"))
+    prefs.putBool("enable", val != 0);
+  else if (var.equals("tl_interval") && val > 0)
+    prefs.putUInt("interval", val);
+  else if (var.equals("tl_settle") && val >= 0 && val < 64)
+    prefs.putUInt("settle", val);
+  else if (var.equals("tl_window") && val >= TL_MIN_WINDOW_S)
+    prefs.putUInt("window", val);
+  else if (var.equals("tl_url") && value.length() < sizeof(tl_config.url))
+    prefs.putString("url", value);
+  else
+    res = -1;
+  prefs.end();
+  load_config();
+  return res;
+}
+
+int timelapseMetricsJson(char *p, size_t len)
+{
+  return snprintf(p, len,
+                  "\"timelapse\":{\"enabled\":%u,\"interval_s\":%u,\"seq\":%u,\"failures\":%u,"
+                  "\"last_awake_ms\":%u,\"last_status\":%d}",
+                  tl_config.enabled, tl_config.interval_s, tl_rtc.seq, tl_rtc.failures,
+                  tl_rtc.last_awake_ms, tl_rtc.last_status);
+}
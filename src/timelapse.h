@@ -0,0 +1,35 @@
+#pragma once
+#include <Arduino.h>
+
+// Deep-sleep timelapse: wake on a timer, capture one frame with the stored
+// sensor profile, POST it to an ingest URL and go back to sleep. Configured
+// through /control with the tl_* variables:
+//   tl_enable    0/1
+//   tl_interval  seconds between captures
+//   tl_url       http:// ingest URL (JPEG is POSTed as the body)
+//   tl_settle    frames dropped while auto exposure settles
+//   tl_window    seconds a cold boot (or enabling it) stays awake for
+//                maintenance, at least TL_MIN_WINDOW_S
+
+#define TL_DEFAULT_INTERVAL_S 300
+#define TL_DEFAULT_SETTLE 4
+#define TL_DEFAULT_WINDOW_S 120
+// Long enough to reach /control and turn timelapse off again
+#define TL_MIN_WINDOW_S 30
+#define TL_WIFI_TIMEOUT_MS 8000
+#define TL_HTTP_TIMEOUT_MS 10000
+// A failed upload is retried after TL_RETRY_S * failures, up to the interval
+#define TL_RETRY_S 30
+#define TL_MAX_RETRIES 5
+
+// True when this boot is a timelapse timer wake-up: skip LCD and servers
+bool timelapseWakeup();
+// Capture, upload and sleep; never returns
+void timelapseRun();
+// Enter the sleep cycle once the maintenance window is over: tl_window
+// seconds after boot or after timelapse became usable, whichever is later
+void loopTimelapse();
+// Handle a tl_* /control variable; -1 if unknown or invalid
+int timelapseSet(const String &var, const String &value);
+// "timelapse":{...}
+int timelapseMetricsJson(char *p, size_t len);
@@ -0,0 +1,86 @@
+#include "trace.h"
+#include "esp_heap_caps.h"
+
+volatile bool trace_on = false;
+
+static trace_event_t *events = NULL;
+static uint32_t next_slot = 0;
+static uint32_t dropped = 0;
+static int64_t window_end = 0;
+
+bool traceStart(uint32_t window_ms)
+{
+  trace_on = false;
+  if (!events)
+  {
+    // 96 KB: PSRAM when there is some
+    events = (trace_event_t *)heap_caps_malloc(TRACE_EVENTS * sizeof(trace_event_t), MALLOC_CAP_SPIRAM);
+    if (!events)
+    {
+      events = (trace_event_t *)malloc(TRACE_EVENTS * sizeof(trace_event_t));
+    }
+    if (!events)
+    {
+      return false;
+    }
+  }
+  for (int i = 0; i < TRACE_EVENTS; i++)
+  {
+    events[i].name = NULL;
+  }
+  __atomic_store_n(&next_slot, 0, __ATOMIC_RELAXED);
+  __atomic_store_n(&dropped, 0, __ATOMIC_RELAXED);
+  window_end = window_ms ? esp_timer_get_time() + (int64_t)window_ms * 1000 : 0;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  trace_on = true;
+  return true;
+}
+
+void traceStop()
+{
+  trace_on = false;
+}
+
+int traceCount()
+{
+  uint32_t n = __atomic_load_n(&next_slot, __ATOMIC_ACQUIRE);
+  return n < TRACE_EVENTS ? n : TRACE_EVENTS;
+}
+
+uint32_t traceDropped()
+{
+  return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+// NULL for a slot that was claimed but not written yet
+const trace_event_t *traceEvent(int index)
+{
+  if (!events || index < 0 || index >= traceCount())
+  {
+    return NULL;
+  }
+  trace_event_t *e = &events[index];
+  return __atomic_load_n(&e->name, __ATOMIC_ACQUIRE) ? e : NULL;
+}
+
+void traceRecord(const char *name, int64_t start, uint32_t arg)
+{
+  int64_t now = esp_timer_get_time();
+  if (window_end && now > window_end)
+  {
+    trace_on = false;
+    return;
+  }
+  uint32_t slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED);
+  if (slot >= TRACE_EVENTS)
+  {
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  trace_event_t *e = &events[slot];
+  e->tid = (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+  e->ts = start;
+  e->dur = (uint32_t)(now - start);
+  e->arg = arg;
+  __atomic_store_n(&e->name, name, __ATOMIC_RELEASE);
+}
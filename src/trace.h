@@ -0,0 +1,56 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_timer.h"
+
+// Span tracing for the capture pipeline, exported as Chrome trace JSON
+// (chrome://tracing, ui.perfetto.dev). A span is recorded once, when it
+// ends, into a fixed buffer claimed with one atomic add; there is no lock
+// and nothing is recorded once the buffer is full. While no capture window
+// is open a span costs one load of trace_on.
+
+#define TRACE_EVENTS 4096
+
+typedef struct
+{
+  const char *name; // static string; NULL until the slot is published
+  uint32_t tid;     // task handle
+  int64_t ts;       // esp_timer_get_time() at span start
+  uint32_t dur;     // us
+  uint32_t arg;     // span-specific value: bytes, register, ...
+} trace_event_t;
+
+extern volatile bool trace_on;
+
+// Open a capture window, closing by itself after window_ms (0: on
+// traceStop()); earlier events are discarded. False if the buffer cannot be
+// allocated.
+bool traceStart(uint32_t window_ms);
+void traceStop();
+// Events recorded in the current or last window, and those that missed it
+int traceCount();
+uint32_t traceDropped();
+const trace_event_t *traceEvent(int index);
+void traceRecord(const char *name, int64_t start, uint32_t arg);
+
+// Records the enclosing scope as a span
+class TraceSpan
+{
+public:
+  explicit TraceSpan(const char *name) : name_(trace_on ? name : NULL), start_(name_ ? esp_timer_get_time() : 0) {}
+  ~TraceSpan()
+  {
+    if (name_)
+    {
+      traceRecord(name_, start_, arg);
+    }
+  }
+  uint32_t arg = 0;
+
+private:
+  const char *name_;
+  int64_t start_;
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name)
@@ -0,0 +1,86 @@
+#include "wall_clock.h"
+#include <Preferences.h>
+#include "esp_sntp.h"
+#include "esp_timer.h"
+#include "cam_sync.h"
+
+static char ntp_server[64] = CLOCK_DEFAULT_NTP;
+static volatile bool sntp_valid = false;
+static volatile uint32_t sntp_synced_ms = 0;
+static uint32_t sntp_syncs = 0;
+
+static void on_sntp_sync(struct timeval *tv)
+{
+  sntp_valid = true;
+  sntp_synced_ms = millis();
+  sntp_syncs++;
+}
+
+static void load_config()
+{
+  Preferences prefs;
+  if (prefs.begin("clock", true))
+  {
+    String server = prefs.getString("ntp", CLOCK_DEFAULT_NTP);
+    strncpy(ntp_server, server.c_str(), sizeof(ntp_server) - 1);
+    prefs.end();
+  }
+}
+
+void clockBegin()
+{
+  load_config();
+  sntp_set_time_sync_notification_cb(on_sntp_sync);
+  configTime(0, 0, ntp_server);
+}
+
+clock_source_t clockFrameTime(const struct timeval *boot, struct timeval *out)
+{
+  if (syncTimestamp(boot, out))
+  {
+    return CLOCK_SYNC;
+  }
+  if (!sntp_valid)
+  {
+    return CLOCK_BOOT;
+  }
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  int64_t mono = esp_timer_get_time();
+  int64_t us = (int64_t)boot->tv_sec * 1000000 + boot->tv_usec;
+  us += (int64_t)now.tv_sec * 1000000 + now.tv_usec - mono;
+  out->tv_sec = us / 1000000;
+  out->tv_usec = us % 1000000;
+  return CLOCK_SNTP;
+}
+
+uint32_t clockFrameAge(const struct timeval *boot)
+{
+  int64_t age = esp_timer_get_time() - ((int64_t)boot->tv_sec * 1000000 + boot->tv_usec);
+  return age > 0 ? (uint32_t)age : 0;
+}
+
+int clockSet(const String &var, const String &value)
+{
+  Preferences prefs;
+  if (!var.equals("ntp") || value.length() == 0 || value.length() >= sizeof(ntp_server) ||
+      !prefs.begin("clock", false))
+  {
+    return -1;
+  }
+  prefs.putString("ntp", value);
+  prefs.end();
+  load_config();
+  configTime(0, 0, ntp_server);
+  return 0;
+}
+
+int clockMetricsJson(char *p, size_t len)
+{
+  static const char *names[] = {"boot", "sntp", "sync"};
+  struct timeval tv = {0, 0}, out;
+  clock_source_t source = clockFrameTime(&tv, &out);
+  return snprintf(p, len, "\"clock\":{\"source\":\"%s\",\"ntp\":\"%s\",\"sntp_syncs\":%u,\"sntp_age_s\":%d}",
+                  names[source], ntp_server, sntp_syncs,
+                  sntp_valid ? (int)((millis() - sntp_synced_ms) / 1000) : -1);
+}
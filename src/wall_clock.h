@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+#include <sys/time.h>
+
+// Wall-clock frame timestamps. The driver stamps frames in microseconds
+// since boot; once SNTP has set the system clock, a frame time is moved
+// onto it by the current difference between the two clocks, so SNTP slews
+// carry over to every frame. A locked capture-sync offset (cam_sync.h)
+// takes precedence, and without either the boot-relative time is kept.
+// The server is set through /control with ntp=<host>.
+
+#define CLOCK_DEFAULT_NTP "pool.ntp.org"
+
+typedef enum
+{
+  CLOCK_BOOT, // microseconds since boot
+  CLOCK_SNTP,
+  CLOCK_SYNC, // capture-sync shared epoch
+} clock_source_t;
+
+// Start SNTP; call once the station is up
+void clockBegin();
+// Frame timestamp to the best clock available; returns which one
+clock_source_t clockFrameTime(const struct timeval *boot, struct timeval *out);
+// Microseconds between a frame timestamp and now
+uint32_t clockFrameAge(const struct timeval *boot);
+// Handle the ntp /control variable; -1 if invalid
+int clockSet(const String &var, const String &value);
+// "clock":{...}
+int clockMetricsJson(char *p, size_t len);
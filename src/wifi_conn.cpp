@@ -0,0 +1,315 @@
+#include "wifi_conn.h"
+#include <Preferences.h>
+#include "freertos/event_groups.h"
+
+#define WIFI_CACHE_MAGIC 0x57434131 // "WCA1"
+#define WIFI_GOT_IP_BIT BIT0
+#define WIFI_DISCONNECTED_BIT BIT1
+
+typedef struct
+{
+  uint32_t magic;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t lease_uses; // boots that came up on the lease without DHCP
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+} wifi_cache_t;
+
+static EventGroupHandle_t wifi_events = NULL;
+static const char *wifi_ssid;
+static const char *wifi_password;
+static wifi_cache_t wifi_cache;
+static bool using_cache = false;
+static bool lease_static = false;     // this boot runs on the cached lease
+static uint8_t lease_uses = 0;        // stored with the next update_cache()
+static volatile bool got_ip = false;  // GOT_IP not yet seen by loopWifi()
+
+typedef enum
+{
+  WIFI_SUP_CONNECTING, // initial association, owned by wifiWaitConnected()
+  WIFI_SUP_UP,
+  WIFI_SUP_BACKOFF,
+  WIFI_SUP_RETRYING,
+} wifi_sup_state_t;
+
+static const char *wifi_state_names[] = {"connecting", "up", "backoff", "retrying"};
+
+static wifi_sup_state_t sup_state = WIFI_SUP_CONNECTING;
+static void (*reconnect_cb)() = NULL;
+static uint32_t sup_since = 0;   // millis() of the last state change
+static uint32_t sup_backoff = WIFI_BACKOFF_MIN_MS;
+static uint32_t sup_wait = 0;     // current backoff including jitter
+static uint32_t sup_attempts = 0; // attempts in the current outage
+static uint32_t lost_at = 0;
+static uint32_t outages = 0;
+static uint32_t last_outage_ms = 0;
+static uint32_t total_down_ms = 0;
+
+static void wifi_event(WiFiEvent_t event)
+{
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP)
+  {
+    got_ip = true;
+    xEventGroupClearBits(wifi_events, WIFI_DISCONNECTED_BIT);
+    xEventGroupSetBits(wifi_events, WIFI_GOT_IP_BIT);
+  }
+  else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED || event == ARDUINO_EVENT_WIFI_STA_LOST_IP)
+  {
+    xEventGroupClearBits(wifi_events, WIFI_GOT_IP_BIT);
+    xEventGroupSetBits(wifi_events, WIFI_DISCONNECTED_BIT);
+  }
+}
+
+static bool load_cache()
+{
+  Preferences prefs;
+  if (!prefs.begin("wifi", true))
+  {
+    return false;
+  }
+  bool ok = prefs.getBytes("assoc", &wifi_cache, sizeof(wifi_cache)) == sizeof(wifi_cache) &&
+            wifi_cache.magic == WIFI_CACHE_MAGIC && wifi_cache.channel > 0;
+  prefs.end();
+  return ok;
+}
+
+static void store_cache(const wifi_cache_t *c)
+{
+  Preferences prefs;
+  if (prefs.begin("wifi", false))
+  {
+    if (c)
+    {
+      prefs.putBytes("assoc", c, sizeof(*c));
+    }
+    else
+    {
+      prefs.remove("assoc");
+    }
+    prefs.end();
+  }
+}
+
+// Only touch flash when the association actually changed
+static void update_cache()
+{
+  wifi_cache_t c;
+  memset(&c, 0, sizeof(c));
+  c.ip = WiFi.localIP();
+  if (!c.ip)
+  {
+    return; // GOT_IP raced a disconnect: nothing worth keeping
+  }
+  c.magic = WIFI_CACHE_MAGIC;
+  memcpy(c.bssid, WiFi.BSSID(), sizeof(c.bssid));
+  c.channel = WiFi.channel();
+  c.lease_uses = lease_uses;
+  c.gateway = WiFi.gatewayIP();
+  c.subnet = WiFi.subnetMask();
+  c.dns = WiFi.dnsIP();
+  if (memcmp(&c, &wifi_cache, sizeof(c)))
+  {
+    wifi_cache = c;
+    store_cache(&c);
+  }
+}
+
+static void begin_scan()
+{
+  using_cache = false;
+#if WIFI_CACHE_LEASE
+  WiFi.config((uint32_t)0, (uint32_t)0, (uint32_t)0); // back to DHCP
+  lease_static = false;
+  lease_uses = 0;
+#endif
+  WiFi.begin(wifi_ssid, wifi_password);
+}
+
+void wifiBegin(const char *ssid, const char *password)
+{
+  wifi_ssid = ssid;
+  wifi_password = password;
+  if (!wifi_events)
+  {
+    wifi_events = xEventGroupCreate();
+    WiFi.onEvent(wifi_event);
+  }
+  WiFi.mode(WIFI_STA);
+  WiFi.setSleep(false);
+  WiFi.persistent(false);
+  // loopWifi() owns reconnection and its backoff
+  WiFi.setAutoReconnect(false);
+
+  if (load_cache())
+  {
+    using_cache = true;
+#if WIFI_CACHE_LEASE
+    // Rerunning DHCP on a live link would clear the address, so the lease
+    // stays static for this boot; every WIFI_LEASE_REUSE boots one runs
+    // DHCP to renew it, or to learn that the server moved us.
+    if (wifi_cache.ip && wifi_cache.lease_uses < WIFI_LEASE_REUSE)
+    {
+      WiFi.config(wifi_cache.ip, wifi_cache.gateway, wifi_cache.subnet, wifi_cache.dns);
+      lease_static = true;
+      lease_uses = wifi_cache.lease_uses + 1;
+    }
+#endif
+    Serial.printf("WiFi: cached BSSID %02x:%02x:%02x:%02x:%02x:%02x channel %u\n",
+                  wifi_cache.bssid[0], wifi_cache.bssid[1], wifi_cache.bssid[2],
+                  wifi_cache.bssid[3], wifi_cache.bssid[4], wifi_cache.bssid[5], wifi_cache.channel);
+    WiFi.begin(ssid, password, wifi_cache.channel, wifi_cache.bssid);
+  }
+  else
+  {
+    memset(&wifi_cache, 0, sizeof(wifi_cache));
+    begin_scan();
+  }
+}
+
+static void set_state(wifi_sup_state_t state)
+{
+  sup_state = state;
+  sup_since = millis();
+}
+
+bool wifiWaitConnected(uint32_t timeout_ms)
+{
+  int64_t start = esp_timer_get_time();
+  while (true)
+  {
+    uint32_t wait = using_cache ? WIFI_CACHED_TIMEOUT_MS : 500;
+    EventBits_t bits = xEventGroupWaitBits(wifi_events, WIFI_GOT_IP_BIT | (using_cache ? WIFI_DISCONNECTED_BIT : 0),
+                                           pdFALSE, pdFALSE, pdMS_TO_TICKS(wait));
+    if (bits & WIFI_GOT_IP_BIT)
+    {
+      got_ip = false;
+      update_cache();
+      sup_state = WIFI_SUP_UP;
+      sup_since = millis();
+      return true;
+    }
+    if (using_cache)
+    {
+      // AP moved, changed channel or the lease is gone: forget and scan
+      Serial.println("WiFi: cached association failed, scanning");
+      store_cache(NULL);
+      memset(&wifi_cache, 0, sizeof(wifi_cache));
+      WiFi.disconnect();
+      xEventGroupClearBits(wifi_events, WIFI_DISCONNECTED_BIT);
+      begin_scan();
+    }
+    else
+    {
+      Serial.print(".");
+    }
+    if (timeout_ms && esp_timer_get_time() - start > (int64_t)timeout_ms * 1000)
+    {
+      // the supervisor owns it from here, as an outage
+      lost_at = millis();
+      outages++;
+      sup_attempts = 1;
+      sup_backoff = WIFI_BACKOFF_MIN_MS;
+      set_state(WIFI_SUP_RETRYING);
+      return false;
+    }
+  }
+}
+
+void wifiOnReconnect(void (*cb)())
+{
+  reconnect_cb = cb;
+}
+
+static void retry()
+{
+  sup_attempts++;
+  xEventGroupClearBits(wifi_events, WIFI_DISCONNECTED_BIT);
+  // The AP most likely came back on the same BSSID and channel; scan only
+  // when that did not work.
+  if (sup_attempts == 1 && wifi_cache.magic == WIFI_CACHE_MAGIC)
+  {
+    using_cache = true;
+    WiFi.begin(wifi_ssid, wifi_password, wifi_cache.channel, wifi_cache.bssid);
+  }
+  else
+  {
+    begin_scan();
+  }
+  set_state(WIFI_SUP_RETRYING);
+}
+
+void loopWifi()
+{
+  if (!wifi_events || sup_state == WIFI_SUP_CONNECTING)
+  {
+    return;
+  }
+  bool up = xEventGroupGetBits(wifi_events) & WIFI_GOT_IP_BIT;
+  uint32_t now = millis();
+  switch (sup_state)
+  {
+  case WIFI_SUP_UP:
+    if (up && got_ip)
+    {
+      // DHCP renewed onto a different address
+      got_ip = false;
+      update_cache();
+    }
+    else if (!up)
+    {
+      lost_at = now;
+      outages++;
+      sup_attempts = 0;
+      sup_backoff = WIFI_BACKOFF_MIN_MS;
+      Serial.println("WiFi: connection lost");
+      retry();
+    }
+    break;
+  case WIFI_SUP_RETRYING:
+    if (up)
+    {
+      last_outage_ms = now - lost_at;
+      total_down_ms += last_outage_ms;
+      got_ip = false;
+      update_cache();
+      set_state(WIFI_SUP_UP);
+      Serial.printf("WiFi: reconnected after %ums (%u attempts)\n", last_outage_ms, sup_attempts);
+      if (reconnect_cb)
+      {
+        reconnect_cb();
+      }
+    }
+    else if (now - sup_since > WIFI_CONNECT_TIMEOUT_MS)
+    {
+      // jitter keeps a fleet from hammering a recovering AP in lockstep
+      uint32_t jitter = esp_random() % (sup_backoff / 4 + 1);
+      sup_wait = sup_backoff + jitter;
+      Serial.printf("WiFi: attempt %u failed, next in %ums\n", sup_attempts, sup_wait);
+      WiFi.disconnect();
+      set_state(WIFI_SUP_BACKOFF);
+    }
+    break;
+  case WIFI_SUP_BACKOFF:
+    if (now - sup_since > sup_wait)
+    {
+      sup_backoff = min(sup_backoff * 2, (uint32_t)WIFI_BACKOFF_MAX_MS);
+      retry();
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+int wifiMetricsJson(char *p, size_t len)
+{
+  uint32_t down_for = (sup_state == WIFI_SUP_UP || sup_state == WIFI_SUP_CONNECTING) ? 0 : millis() - lost_at;
+  return snprintf(p, len,
+                  "\"wifi\":{\"state\":\"%s\",\"rssi\":%d,\"outages\":%u,\"down_for_ms\":%u,"
+                  "\"last_outage_ms\":%u,\"total_down_ms\":%u}",
+                  wifi_state_names[sup_state], sup_state == WIFI_SUP_UP ? WiFi.RSSI() : 0,
+                  outages, down_for, last_outage_ms, total_down_ms + down_for);
+}
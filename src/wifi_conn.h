@@ -0,0 +1,39 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+
+// Station connection with a cached association. The BSSID, channel and the
+// last DHCP lease are kept in NVS so a reboot (including after OTA) can
+// skip the scan and DHCP; a failed cached attempt falls back to a full scan.
+// The cached lease is reused for at most WIFI_LEASE_REUSE boots in a row;
+// the boot after that runs DHCP and caches the fresh lease.
+
+// After setup(), loopWifi() supervises the link: on loss it retries with
+// exponential backoff without ever blocking loop(), then calls the
+// reconnect hook so listeners can be reopened.
+
+// Reuse the last DHCP lease as a static configuration
+#define WIFI_CACHE_LEASE 1
+#define WIFI_LEASE_REUSE 4
+// How long a cached association gets before falling back to a scan
+#define WIFI_CACHED_TIMEOUT_MS 3000
+// One reconnect attempt before backing off
+#define WIFI_CONNECT_TIMEOUT_MS 10000
+// How long setup() waits for the first IP before loopWifi() takes over
+#define WIFI_BOOT_TIMEOUT_MS 30000
+#define WIFI_BACKOFF_MIN_MS 1000
+#define WIFI_BACKOFF_MAX_MS 60000
+
+// Start associating in the background; returns immediately
+void wifiBegin(const char *ssid, const char *password);
+// Block until an IP is assigned; 0 waits forever. On a timeout the attempt
+// carries on under loopWifi() as if the link had just been lost.
+bool wifiWaitConnected(uint32_t timeout_ms);
+
+// Called from loop() once the IP is back after an outage, including the
+// first IP when wifiWaitConnected() timed out
+void wifiOnReconnect(void (*cb)());
+// Non-blocking supervisor step; call from loop()
+void loopWifi();
+// "wifi":{...} link state and outage statistics
+int wifiMetricsJson(char *p, size_t len);
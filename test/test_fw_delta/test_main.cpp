@@ -0,0 +1,168 @@
+// Delta update round trip: a patch made by tools/fwdelta is uploaded through
+// fw_update (as /update would feed it) against a file-backed running slot,
+// and the OTA slot it writes must hash to the new image. Run with
+// `pio test -e native`.
+#include <unity.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "fw_update.h"
+
+// The patch comes from the host tool itself
+#define main fwdelta_main
+#include "../../tools/fwdelta.cpp"
+#undef main
+
+#define FLASH_DIR "test_fw_delta_flash"
+#define OTA_SLOT FLASH_DIR "/ota_slot.bin"
+#define SLOT_SIZE 0x60000
+
+static bytes old_image, new_image;
+
+// Something shaped like an app image: a header, code-like runs and tables
+static bytes make_image(uint32_t seed, size_t len)
+{
+  bytes img(len);
+  for (size_t i = 0; i < len; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    img[i] = (i % 4096 < 3000) ? (uint8_t)(seed >> 16) : (uint8_t)(i / 4096);
+  }
+  img[0] = 0xE9;
+  return img;
+}
+
+// A new build: edited constants, code moved by an insertion, a longer tail
+static bytes next_build(const bytes &old)
+{
+  bytes img(old);
+  for (size_t i = 1000; i < img.size(); i += 7919)
+  {
+    img[i] ^= 0x5A;
+  }
+  bytes inserted = make_image(99, 3000);
+  img.insert(img.begin() + 150000, inserted.begin() + 1, inserted.end());
+  bytes tail = make_image(7, 20000);
+  img.insert(img.end(), tail.begin() + 1, tail.end());
+  return img;
+}
+
+static std::string hex(const uint8_t *d, size_t len)
+{
+  std::string s;
+  char b[3];
+  for (size_t i = 0; i < len; i++)
+  {
+    snprintf(b, sizeof(b), "%02x", d[i]);
+    s += b;
+  }
+  return s;
+}
+
+static std::string sha_hex(const bytes &data)
+{
+  uint8_t digest[32];
+  sha256(data.data(), data.size(), digest);
+  return hex(digest, sizeof(digest));
+}
+
+static bytes gzip(const bytes &data)
+{
+  z_stream z = {};
+  TEST_ASSERT_EQUAL(Z_OK, deflateInit2(&z, 9, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY));
+  bytes out(deflateBound(&z, data.size()) + 32);
+  z.next_in = (Bytef *)data.data();
+  z.avail_in = data.size();
+  z.next_out = out.data();
+  z.avail_out = out.size();
+  TEST_ASSERT_EQUAL(Z_STREAM_END, deflate(&z, Z_FINISH));
+  out.resize(z.total_out);
+  deflateEnd(&z);
+  return out;
+}
+
+// Feed an upload in network-sized pieces, as the HTTP upload handler does
+static bool upload(const char *filename, const bytes &data, const std::string &sha)
+{
+  if (!fwUpdateBegin(filename, sha.c_str(), NULL))
+  {
+    return false;
+  }
+  for (size_t off = 0; off < data.size(); off += 1436)
+  {
+    fwUpdateWrite(data.data() + off, std::min((size_t)1436, data.size() - off));
+  }
+  return fwUpdateEnd();
+}
+
+static bytes ota_slot()
+{
+  bytes slot;
+  TEST_ASSERT_TRUE(read_file(OTA_SLOT, slot));
+  return slot;
+}
+
+void setUp()
+{
+  remove(OTA_SLOT);
+}
+
+void tearDown()
+{
+}
+
+static void test_delta_round_trip()
+{
+  TEST_ASSERT_TRUE(upload("fw.delta", make_patch(old_image, new_image), sha_hex(new_image)));
+  bytes slot = ota_slot();
+  TEST_ASSERT_EQUAL(new_image.size(), slot.size());
+  TEST_ASSERT_EQUAL_STRING(sha_hex(new_image).c_str(), sha_hex(slot).c_str());
+}
+
+// gzip -9 of the patch, the way it is meant to be sent
+static void test_gzip_delta_round_trip()
+{
+  bytes gz = gzip(make_patch(old_image, new_image));
+  TEST_ASSERT_TRUE(gz.size() < new_image.size() / 4);
+  TEST_ASSERT_TRUE(upload("fw.delta.gz", gz, sha_hex(new_image)));
+  TEST_ASSERT_EQUAL_STRING(sha_hex(new_image).c_str(), sha_hex(ota_slot()).c_str());
+}
+
+// A patch for another base never commits
+static void test_wrong_base()
+{
+  bytes other = make_image(2, old_image.size());
+  TEST_ASSERT_FALSE(upload("fw.delta", make_patch(other, new_image), sha_hex(new_image)));
+  TEST_ASSERT_TRUE(strlen(fwUpdateError()) > 0);
+}
+
+// Nor does a patch whose result is not the announced image
+static void test_digest_mismatch()
+{
+  bytes other = next_build(make_image(3, old_image.size()));
+  TEST_ASSERT_FALSE(upload("fw.delta", make_patch(old_image, new_image), sha_hex(other)));
+  TEST_ASSERT_EQUAL_STRING("sha256 mismatch", fwUpdateError());
+}
+
+int main()
+{
+  setenv("NATIVE_FLASH_DIR", FLASH_DIR, 1);
+  setenv("NATIVE_OTA_SLOT", OTA_SLOT, 1);
+  mkdir(FLASH_DIR, 0755);
+  old_image = make_image(1, 240000);
+  new_image = next_build(old_image);
+  // the running slot: the old image in an erased partition
+  bytes running(SLOT_SIZE, 0xFF);
+  std::copy(old_image.begin(), old_image.end(), running.begin());
+  if (!write_file(FLASH_DIR "/app0", running))
+  {
+    return 1;
+  }
+
+  UNITY_BEGIN();
+  RUN_TEST(test_delta_round_trip);
+  RUN_TEST(test_gzip_delta_round_trip);
+  RUN_TEST(test_wrong_base);
+  RUN_TEST(test_digest_mismatch);
+  return UNITY_END();
+}
@@ -0,0 +1,134 @@
+// Power-cut and remount checks for the image store on a file-backed flash
+// image (imgStoreFileFlash()). Run with `pio test -e native`.
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+#include "img_store.h"
+
+#define FLASH_PATH "test_imgstore.bin"
+#define FLASH_SIZE (32 * IMG_STORE_SECTOR)
+
+// Contents are a function of the sequence number, so a remount can check
+// every record it finds without remembering what was written
+static std::vector<uint8_t> image(uint32_t seq)
+{
+  std::vector<uint8_t> data(500 + (seq * 2654435761u) % 9000);
+  for (size_t i = 0; i < data.size(); i++)
+  {
+    data[i] = (uint8_t)(seq * 31 + i * 7 + (i >> 8));
+  }
+  return data;
+}
+
+static void mount(int power_cut_after)
+{
+  static img_store_flash_t flash;
+  TEST_ASSERT_TRUE(imgStoreFileFlash(&flash, FLASH_PATH, FLASH_SIZE, power_cut_after));
+  TEST_ASSERT_EQUAL(ESP_OK, imgStoreMount(&flash));
+}
+
+static uint32_t append(uint32_t seq)
+{
+  std::vector<uint8_t> data = image(seq);
+  uint32_t got = 0;
+  esp_err_t err = imgStoreAppend(data.data(), data.size(), NULL, &got);
+  return err == ESP_OK ? got : 0;
+}
+
+// Every indexed record is complete, intact and in order
+static void check_records()
+{
+  uint32_t prev = 0;
+  for (int i = 0; i < imgStoreCount(); i++)
+  {
+    img_record_t rec;
+    TEST_ASSERT_EQUAL(ESP_OK, imgStoreRecord(i, &rec));
+    TEST_ASSERT_GREATER_THAN_UINT32(prev, rec.seq);
+    prev = rec.seq;
+    std::vector<uint8_t> want = image(rec.seq), got(rec.len);
+    TEST_ASSERT_EQUAL_UINT32(want.size(), rec.len);
+    TEST_ASSERT_EQUAL(ESP_OK, imgStoreRead(&rec, 0, got.data(), got.size()));
+    TEST_ASSERT_EQUAL_MEMORY(want.data(), got.data(), want.size());
+    TEST_ASSERT_TRUE(imgStoreVerify(&rec));
+  }
+}
+
+static uint32_t newest()
+{
+  img_record_t rec;
+  int n = imgStoreCount();
+  return n && imgStoreRecord(n - 1, &rec) == ESP_OK ? rec.seq : 0;
+}
+
+void setUp()
+{
+  remove(FLASH_PATH);
+}
+
+void tearDown()
+{
+}
+
+// Cut the power at every program/erase operation of a run of appends that
+// wraps the store, then remount: nothing committed is lost, nothing torn is
+// indexed, and the store takes new records again
+static void test_power_cut_remount()
+{
+  for (int cut = 1; cut <= 120; cut++)
+  {
+    remove(FLASH_PATH);
+    mount(-1);
+    uint32_t seq = 1;
+    for (int i = 0; i < 40; i++)
+    {
+      TEST_ASSERT_EQUAL_UINT32(seq, append(seq));
+      seq++;
+    }
+    mount(cut);
+    uint32_t committed = seq - 1;
+    while (append(seq))
+    {
+      committed = seq++;
+    }
+    mount(-1);
+    check_records();
+    TEST_ASSERT_EQUAL_UINT32(committed, newest());
+    uint32_t next = newest() + 1;
+    TEST_ASSERT_EQUAL_UINT32(next, append(next));
+    mount(-1);
+    check_records();
+    TEST_ASSERT_EQUAL_UINT32(next, newest());
+  }
+}
+
+// A bit that flips in a stored payload shows up in imgStoreVerify()
+static void test_corrupt_payload()
+{
+  mount(-1);
+  TEST_ASSERT_EQUAL_UINT32(1, append(1));
+  img_record_t rec;
+  TEST_ASSERT_EQUAL(ESP_OK, imgStoreFind(1, &rec));
+  TEST_ASSERT_TRUE(imgStoreVerify(&rec));
+
+  FILE *fp = fopen(FLASH_PATH, "r+b");
+  TEST_ASSERT_NOT_NULL(fp);
+  long at = rec.offset + rec.len; // inside the payload, the header is smaller
+  fseek(fp, at, SEEK_SET);
+  int c = fgetc(fp);
+  fseek(fp, at, SEEK_SET);
+  fputc(c ^ 0x10, fp);
+  fclose(fp);
+
+  mount(-1);
+  TEST_ASSERT_EQUAL(ESP_OK, imgStoreFind(1, &rec));
+  TEST_ASSERT_FALSE(imgStoreVerify(&rec));
+}
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_power_cut_remount);
+  RUN_TEST(test_corrupt_payload);
+  remove(FLASH_PATH);
+  return UNITY_END();
+}
@@ -0,0 +1,344 @@
+// Compressed-domain JPEG transforms (jpeg_scale, jpeg_crop) against a
+// plain decode of their input. The source frames are encoded here with
+// jpeg_write from a synthetic scene, so the test carries no image files;
+// every frame is decoded with a float IDCT over jpegDecodeBlocks(). A crop
+// must reproduce the source's luma exactly; a 1/N rendition must have the
+// expected size and stay close to the source averaged over NxN pixels
+// (what a full decode then downscale would give). Run with
+// `pio test -e native`.
+#include <unity.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "jpeg_crop.h"
+#include "jpeg_scale.h"
+#include "jpeg_write.h"
+
+typedef std::vector<uint8_t> bytes;
+
+// Decoded component planes, edge padding included
+typedef struct
+{
+  int width, height;
+  int comps;
+  int pw[JPEG_MAX_COMPS], ph[JPEG_MAX_COMPS];
+  int h[JPEG_MAX_COMPS], v[JPEG_MAX_COMPS], hmax, vmax;
+  std::vector<uint8_t> plane[JPEG_MAX_COMPS];
+} image_t;
+
+// Annex K tables (zigzag order), scaled like libjpeg's quality 85
+static const uint8_t std_luma_q[64] = {16, 11, 12, 14, 12, 10, 16, 14, 13, 14, 18, 17, 16, 19, 24, 40,
+                                       26, 24, 22, 22, 24, 49, 35, 37, 29, 40, 58, 51, 61, 60, 57, 51,
+                                       56, 55, 64, 72, 92, 78, 64, 68, 87, 69, 55, 56, 80, 109, 81, 87,
+                                       95, 98, 103, 104, 103, 62, 77, 113, 121, 112, 100, 120, 92, 101, 103, 99};
+static const uint8_t std_chroma_q[64] = {17, 18, 18, 24, 21, 24, 47, 26, 26, 47, 99, 66, 56, 66, 99, 99,
+                                         99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+                                         99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+                                         99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99};
+#define TEST_QUALITY_SCALE 30 // percent, libjpeg quality 85
+// A rendition measures 36-48 dB here; a misplaced block or a wrong
+// table costs far more than the margin
+#define TEST_MIN_PSNR 34
+
+static float basis[8][8]; // C(u)/2 cos((2x+1)u pi/16), [u][x]
+
+static void init_basis()
+{
+  for (int u = 0; u < 8; u++)
+  {
+    for (int x = 0; x < 8; x++)
+    {
+      basis[u][x] = (u ? 0.5f : 0.5f / sqrtf(2)) * cosf((2 * x + 1) * u * (float)M_PI / 16);
+    }
+  }
+}
+
+// Smooth shading, a soft-edged disc, a few stripes and some fine texture:
+// enough detail for the AC terms to matter, nothing a camera would not see
+static float scene(int comp, int x, int y)
+{
+  float dx = x - 140.0f, dy = y - 100.0f;
+  float disc = 1 / (1 + expf((sqrtf(dx * dx + dy * dy) - 60) / 3));
+  switch (comp)
+  {
+  case 0:
+    return 60 + 0.3f * x + 0.2f * y + 80 * disc + 20 * sinf(x * 0.15f) * (y > 160) +
+           6 * sinf(x * 1.3f + y * 0.9f);
+  case 1:
+    return 128 + 40 * sinf(x * 0.02f) - 50 * disc;
+  default:
+    return 128 + 30 * cosf(y * 0.03f) + 40 * disc;
+  }
+}
+
+// A baseline frame of the scene: comps 1 or 3, luma sampling h x v, one
+// sample per chroma block
+static bytes encode(int width, int height, int comps, int h, int v)
+{
+  static jpeg_info_t info;
+  memset(&info, 0, sizeof(info));
+  info.comps = comps;
+  for (int c = 0; c < comps; c++)
+  {
+    info.comp[c].id = c + 1;
+    info.comp[c].h = c ? 1 : h;
+    info.comp[c].v = c ? 1 : v;
+    info.comp[c].tq = c ? 1 : 0;
+  }
+  for (int i = 0; i < 64; i++)
+  {
+    info.qt[0][i] = (std_luma_q[i] * TEST_QUALITY_SCALE + 50) / 100;
+    info.qt[1][i] = (std_chroma_q[i] * TEST_QUALITY_SCALE + 50) / 100;
+  }
+  int mcus_x = (width + 8 * h - 1) / (8 * h), mcus_y = (height + 8 * v - 1) / (8 * v);
+  bytes out(width * height * 2 + 4096);
+  jpeg_writer_t w;
+  jpegWriteBegin(&w, out.data(), out.size());
+  jpegWriteHeaders(&w, &info, width, height);
+  const jpeg_codes_t *codes = jpegStdCodes();
+  int pred[JPEG_MAX_COMPS] = {0};
+  for (int my = 0; my < mcus_y; my++)
+  {
+    for (int mx = 0; mx < mcus_x; mx++)
+    {
+      for (int c = 0; c < comps; c++)
+      {
+        int ch = info.comp[c].h, cv = info.comp[c].v;
+        int sx = h / ch, sy = v / cv; // luma pixels per sample
+        for (int by = 0; by < cv; by++)
+        {
+          for (int bx = 0; bx < ch; bx++)
+          {
+            float px[8][8];
+            for (int y = 0; y < 8; y++)
+            {
+              for (int x = 0; x < 8; x++)
+              {
+                // the frame's last row and column repeat into the padding
+                int x0 = ((mx * ch + bx) * 8 + x) * sx, y0 = ((my * cv + by) * 8 + y) * sy;
+                float sum = 0;
+                for (int j = 0; j < sy; j++)
+                {
+                  for (int i = 0; i < sx; i++)
+                  {
+                    float s = scene(c, x0 + i < width ? x0 + i : width - 1, y0 + j < height ? y0 + j : height - 1);
+                    sum += s < 0 ? 0 : s > 255 ? 255 : s;
+                  }
+                }
+                px[y][x] = sum / (sx * sy) - 128;
+              }
+            }
+            int16_t q[64];
+            for (int k = 0; k < 64; k++)
+            {
+              int n = jpeg_natural[k], u = n % 8, vv = n / 8;
+              float f = 0;
+              for (int y = 0; y < 8; y++)
+              {
+                for (int x = 0; x < 8; x++)
+                {
+                  f += px[y][x] * basis[u][x] * basis[vv][y];
+                }
+              }
+              q[n] = (int16_t)lroundf(f / info.qt[info.comp[c].tq][k]);
+            }
+            TEST_ASSERT_TRUE(jpegWriteBlock(&w, q, &pred[c], &codes[c ? 2 : 0], &codes[c ? 3 : 1]));
+          }
+        }
+      }
+    }
+  }
+  jpegWriteAlign(&w);
+  jpegWriteMarker(&w, 0xD9, 0);
+  out.resize(jpegWriteDone(&w));
+  TEST_ASSERT_NOT_EQUAL(0, out.size());
+  return out;
+}
+
+static jpeg_err_t put_block(void *arg, int comp, uint16_t bx, uint16_t by, const int16_t *coef)
+{
+  image_t *img = (image_t *)arg;
+  for (int y = 0; y < 8; y++)
+  {
+    for (int x = 0; x < 8; x++)
+    {
+      float f = 0;
+      for (int v = 0; v < 8; v++)
+      {
+        for (int u = 0; u < 8; u++)
+        {
+          f += coef[v * 8 + u] * basis[u][x] * basis[v][y];
+        }
+      }
+      long s = lroundf(f) + 128;
+      img->plane[comp][(by * 8 + y) * img->pw[comp] + bx * 8 + x] = s < 0 ? 0 : s > 255 ? 255 : s;
+    }
+  }
+  return JPEG_OK;
+}
+
+static void decode(const bytes &jpg, image_t *img)
+{
+  static jpeg_info_t info;
+  TEST_ASSERT_EQUAL(JPEG_OK, jpegParse(jpg.data(), jpg.size(), &info));
+  img->width = info.width;
+  img->height = info.height;
+  img->comps = info.comps;
+  img->hmax = info.hmax;
+  img->vmax = info.vmax;
+  for (int c = 0; c < info.comps; c++)
+  {
+    img->h[c] = info.comp[c].h;
+    img->v[c] = info.comp[c].v;
+    img->pw[c] = info.mcus_x * info.comp[c].h * 8;
+    img->ph[c] = info.mcus_y * info.comp[c].v * 8;
+    img->plane[c].assign(img->pw[c] * img->ph[c], 0);
+  }
+  TEST_ASSERT_EQUAL(JPEG_OK, jpegDecodeBlocks(jpg.data(), jpg.size(), &info, put_block, img));
+}
+
+// Samples of component c that show in the frame
+static int visible(int size, int sampling, int max) { return (size * sampling + max - 1) / max; }
+
+// PSNR of out's component c against src's averaged over scale x scale
+static double box_psnr(const image_t *src, const image_t *out, int c, int scale)
+{
+  int w = visible(out->width, out->h[c], out->hmax), h = visible(out->height, out->v[c], out->vmax);
+  double err = 0;
+  for (int y = 0; y < h; y++)
+  {
+    for (int x = 0; x < w; x++)
+    {
+      int sum = 0;
+      for (int j = 0; j < scale; j++)
+      {
+        for (int i = 0; i < scale; i++)
+        {
+          int sx = x * scale + i, sy = y * scale + j;
+          sx = sx < src->pw[c] ? sx : src->pw[c] - 1;
+          sy = sy < src->ph[c] ? sy : src->ph[c] - 1;
+          sum += src->plane[c][sy * src->pw[c] + sx];
+        }
+      }
+      double d = out->plane[c][y * out->pw[c] + x] - (double)sum / (scale * scale);
+      err += d * d;
+    }
+  }
+  err /= w * h;
+  return err ? 10 * log10(255.0 * 255.0 / err) : 99;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+static void check_scale(int width, int height, int comps, int h, int v)
+{
+  bytes src = encode(width, height, comps, h, v);
+  static image_t src_img, out_img;
+  decode(src, &src_img);
+  static jpeg_scaler_t scaler;
+  TEST_ASSERT_EQUAL(JPEG_OK, jpegParse(src.data(), src.size(), &scaler.info));
+  for (int scale = 2; scale <= 8; scale *= 2)
+  {
+    bytes strip(jpegScaleStripSize(&scaler.info, scale)), out(src.size());
+    scaler.strip = strip.data();
+    scaler.strip_size = strip.size();
+    size_t len = 0;
+    TEST_ASSERT_EQUAL(JPEG_OK, jpegScale(&scaler, src.data(), src.size(), scale, out.data(), out.size(), &len));
+    out.resize(len);
+    decode(out, &out_img);
+    // rounded up, as libjpeg's scaled decode
+    TEST_ASSERT_EQUAL((width + scale - 1) / scale, out_img.width);
+    TEST_ASSERT_EQUAL((height + scale - 1) / scale, out_img.height);
+    TEST_ASSERT_EQUAL(comps, out_img.comps);
+    for (int c = 0; c < comps; c++)
+    {
+      TEST_ASSERT_EQUAL(src_img.h[c], out_img.h[c]);
+      TEST_ASSERT_EQUAL(src_img.v[c], out_img.v[c]);
+      double psnr = box_psnr(&src_img, &out_img, c, scale);
+      char msg[48];
+      snprintf(msg, sizeof(msg), "1/%d component %d: %.1f dB", scale, c, psnr);
+      TEST_ASSERT_TRUE_MESSAGE(psnr >= TEST_MIN_PSNR, msg);
+    }
+  }
+}
+
+// The OV2640's layout: 4:2:2
+static void test_scale_422()
+{
+  check_scale(320, 240, 3, 2, 1);
+}
+
+// libjpeg's default 4:2:0, with a size that leaves partial MCUs
+static void test_scale_420_partial_mcus()
+{
+  check_scale(300, 226, 3, 2, 2);
+}
+
+static void test_scale_gray()
+{
+  check_scale(320, 240, 1, 1, 1);
+}
+
+static void check_crop(const bytes &src, const image_t *src_img, int x, int y, int w, int h)
+{
+  static jpeg_cropper_t cropper;
+  static image_t out_img;
+  TEST_ASSERT_EQUAL(JPEG_OK, jpegParse(src.data(), src.size(), &cropper.info));
+  jpegCropRegion(&cropper, x, y, w, h);
+  bytes out(src.size());
+  size_t len = 0;
+  TEST_ASSERT_EQUAL(JPEG_OK, jpegCrop(&cropper, src.data(), src.size(), out.data(), out.size(), &len));
+  out.resize(len);
+  decode(out, &out_img);
+  TEST_ASSERT_EQUAL(cropper.width, out_img.width);
+  TEST_ASSERT_EQUAL(cropper.height, out_img.height);
+  // whole MCUs, inside the frame
+  TEST_ASSERT_EQUAL(0, cropper.x % (8 * src_img->hmax));
+  TEST_ASSERT_EQUAL(0, cropper.y % (8 * src_img->vmax));
+  TEST_ASSERT_TRUE(cropper.x + cropper.width <= src_img->width);
+  TEST_ASSERT_TRUE(cropper.y + cropper.height <= src_img->height);
+  for (int row = 0; row < out_img.height; row++)
+  {
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(&src_img->plane[0][(cropper.y + row) * src_img->pw[0] + cropper.x],
+                                  &out_img.plane[0][row * out_img.pw[0]], out_img.width);
+  }
+}
+
+static void test_crop_luma_exact()
+{
+  static image_t src_img;
+  bytes src = encode(320, 240, 3, 2, 1);
+  decode(src, &src_img);
+  check_crop(src, &src_img, 25, 25, 50, 50);
+  check_crop(src, &src_img, 0, 0, 100, 100);
+  check_crop(src, &src_img, 90, 95, 10, 5); // the bottom right MCU
+  check_crop(src, &src_img, 33, 10, 1, 1);  // widened to one MCU
+}
+
+// The first MCU column of a crop needs new DC differences, also where the
+// last row and column are partial
+static void test_crop_partial_mcus()
+{
+  static image_t src_img;
+  bytes src = encode(300, 226, 3, 2, 2);
+  decode(src, &src_img);
+  check_crop(src, &src_img, 37, 41, 63, 59);
+}
+
+int main()
+{
+  init_basis();
+  UNITY_BEGIN();
+  RUN_TEST(test_scale_422);
+  RUN_TEST(test_scale_420_partial_mcus);
+  RUN_TEST(test_scale_gray);
+  RUN_TEST(test_crop_luma_exact);
+  RUN_TEST(test_crop_partial_mcus);
+  return UNITY_END();
+}
@@ -0,0 +1,411 @@
+// Client for the binary control channel (see src/ctrl_proto.h). Keeps one
+// connection open for the whole command, so a batch or a benchmark pays the
+// TCP setup once.
+//
+//   camctl [-p port] [-n N] [-d depth] <host> <command> [args]
+//     names                    setting ids and names
+//     get NAME...              current values
+//     set NAME VALUE...        one SET, or a BATCH (one group hold) for
+//                              several pairs
+//     reg REG [MASK]           read a sensor register (hex)
+//     wreg REG MASK VAL        write a sensor register (hex)
+//     xclk MHZ                 change the sensor clock
+//     watch [seconds]          print change notifications as they arrive
+//     bench                    N GET requests, depth of them in flight
+//
+//     -p port   control port (default 82)
+//     -n N      bench requests (default 10000)
+//     -d depth  bench requests in flight (default 1)
+//
+// Build: g++ -O2 -std=c++17 -Isrc tools/camctl.cpp -o camctl
+// Against the native build: camctl -p 8082 127.0.0.1 bench
+//
+// Results are printed as JSON; a failed request exits with status 1.
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "ctrl_proto.h"
+
+#define IO_TIMEOUT_MS 5000
+
+struct message
+{
+  uint8_t op;
+  uint16_t id;
+  std::vector<uint8_t> body;
+};
+
+static int fd = -1;
+static uint16_t next_id = 1;
+static std::vector<uint8_t> rx;
+static std::map<std::string, int> setting_ids;
+static std::map<int, std::string> setting_names;
+
+static double now_s()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int16_t i16(const uint8_t *p)
+{
+  int16_t v;
+  memcpy(&v, p, 2);
+  return v;
+}
+
+static void connect_to(const char *host, int port)
+{
+  struct addrinfo hints = {}, *res;
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &res))
+  {
+    fprintf(stderr, "%s: unknown host\n", host);
+    exit(1);
+  }
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) < 0)
+  {
+    perror("connect");
+    exit(1);
+  }
+  freeaddrinfo(res);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// Queue a request in out; returns its id
+static uint16_t add(std::vector<uint8_t> &out, uint8_t op, const std::vector<uint8_t> &body)
+{
+  ctrl_hdr_t hdr = {(uint16_t)(sizeof(hdr) - 2 + body.size()), op, 0, next_id++};
+  const uint8_t *h = (const uint8_t *)&hdr;
+  out.insert(out.end(), h, h + sizeof(hdr));
+  out.insert(out.end(), body.begin(), body.end());
+  return hdr.id;
+}
+
+static void send_all(const std::vector<uint8_t> &out)
+{
+  size_t off = 0;
+  while (off < out.size())
+  {
+    ssize_t n = write(fd, out.data() + off, out.size() - off);
+    if (n <= 0)
+    {
+      perror("write");
+      exit(1);
+    }
+    off += n;
+  }
+}
+
+// Next message off the socket; false on timeout
+static bool receive(message *m, int timeout_ms)
+{
+  for (;;)
+  {
+    if (rx.size() >= 2)
+    {
+      size_t len = rx[0] | rx[1] << 8;
+      if (rx.size() >= 2 + len)
+      {
+        ctrl_hdr_t hdr;
+        memcpy(&hdr, rx.data(), sizeof(hdr));
+        m->op = hdr.op;
+        m->id = hdr.id;
+        m->body.assign(rx.begin() + sizeof(hdr), rx.begin() + 2 + len);
+        rx.erase(rx.begin(), rx.begin() + 2 + len);
+        return true;
+      }
+    }
+    struct pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, timeout_ms) <= 0)
+    {
+      return false;
+    }
+    uint8_t buf[4096];
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n <= 0)
+    {
+      fprintf(stderr, "connection closed\n");
+      exit(1);
+    }
+    rx.insert(rx.end(), buf, buf + n);
+  }
+}
+
+// Reply to request id, skipping notifications
+static message reply_to(uint16_t id)
+{
+  message m;
+  while (receive(&m, IO_TIMEOUT_MS))
+  {
+    if ((m.op & CTRL_REPLY) && m.id == id)
+    {
+      if (m.body.size() < 2)
+      {
+        fprintf(stderr, "short reply\n");
+        exit(1);
+      }
+      return m;
+    }
+  }
+  fprintf(stderr, "timed out\n");
+  exit(1);
+}
+
+static message call(uint8_t op, const std::vector<uint8_t> &body)
+{
+  std::vector<uint8_t> out;
+  uint16_t id = add(out, op, body);
+  send_all(out);
+  return reply_to(id);
+}
+
+static void load_names()
+{
+  message m = call(CTRL_NAMES, {});
+  size_t off = 3;
+  for (int i = 0; i < m.body[2] && off + 2 <= m.body.size(); i++)
+  {
+    int id = m.body[off], len = m.body[off + 1];
+    std::string name((const char *)m.body.data() + off + 2, len);
+    setting_ids[name] = id;
+    setting_names[id] = name;
+    off += 2 + len;
+  }
+}
+
+static uint8_t setting(const char *name)
+{
+  if (setting_ids.empty())
+  {
+    load_names();
+  }
+  auto it = setting_ids.find(name);
+  if (it == setting_ids.end())
+  {
+    fprintf(stderr, "%s: unknown setting\n", name);
+    exit(2);
+  }
+  return it->second;
+}
+
+static std::vector<uint8_t> le16(int v)
+{
+  return {(uint8_t)v, (uint8_t)(v >> 8)};
+}
+
+static int status_exit(const message &m)
+{
+  int16_t status = i16(m.body.data());
+  printf("{\"status\":%d}\n", status);
+  return status ? 1 : 0;
+}
+
+static int cmd_get(int argc, char **argv)
+{
+  int res = 0;
+  printf("{");
+  for (int i = 0; i < argc; i++)
+  {
+    message m = call(CTRL_GET, {setting(argv[i])});
+    int16_t status = i16(m.body.data());
+    if (status || m.body.size() < 4)
+    {
+      printf("%s\"%s\":null", i ? "," : "", argv[i]);
+      res = 1;
+      continue;
+    }
+    printf("%s\"%s\":%d", i ? "," : "", argv[i], i16(m.body.data() + 2));
+  }
+  printf("}\n");
+  return res;
+}
+
+static int cmd_set(int argc, char **argv)
+{
+  if (argc == 2)
+  {
+    std::vector<uint8_t> body = {setting(argv[0])}, v = le16(atoi(argv[1]));
+    body.insert(body.end(), v.begin(), v.end());
+    return status_exit(call(CTRL_SET, body));
+  }
+  std::vector<uint8_t> body = {(uint8_t)(argc / 2)};
+  for (int i = 0; i + 1 < argc; i += 2)
+  {
+    std::vector<uint8_t> v = le16(atoi(argv[i + 1]));
+    body.push_back(CTRL_SET);
+    body.push_back(setting(argv[i]));
+    body.insert(body.end(), v.begin(), v.end());
+  }
+  message m = call(CTRL_BATCH, body);
+  int16_t status = i16(m.body.data());
+  printf("{\"status\":%d,\"results\":[", status);
+  for (size_t off = 3; off + 2 <= m.body.size(); off += 2)
+  {
+    printf("%s%d", off > 3 ? "," : "", i16(m.body.data() + off));
+  }
+  printf("]}\n");
+  return status ? 1 : 0;
+}
+
+static int cmd_watch(double seconds)
+{
+  message m = call(CTRL_SUBSCRIBE, {1});
+  if (i16(m.body.data()))
+  {
+    return status_exit(m);
+  }
+  if (setting_names.empty())
+  {
+    load_names();
+  }
+  double end = seconds > 0 ? now_s() + seconds : 0;
+  while (!end || now_s() < end)
+  {
+    if (!receive(&m, 100) || m.op != CTRL_NOTIFY || m.body.size() < sizeof(ctrl_notify_t))
+    {
+      continue;
+    }
+    ctrl_notify_t n;
+    memcpy(&n, m.body.data(), sizeof(n));
+    if (n.kind == CTRL_N_SETTING)
+    {
+      printf("{\"setting\":\"%s\",\"value\":%d}\n", setting_names[n.key].c_str(), n.value);
+    }
+    else
+    {
+      printf("{\"reg\":\"0x%04x\",\"mask\":\"0x%02x\",\"value\":\"0x%02x\"}\n", n.key, n.mask, n.value);
+    }
+    fflush(stdout);
+  }
+  return 0;
+}
+
+static int cmd_bench(int count, int depth)
+{
+  std::vector<uint8_t> body = {setting("quality")};
+  std::map<uint16_t, double> sent;
+  std::vector<double> rtt;
+  int issued = 0, failed = 0;
+  double start = now_s();
+  while ((int)rtt.size() < count)
+  {
+    std::vector<uint8_t> out;
+    while (issued < count && (int)sent.size() < depth)
+    {
+      sent[add(out, CTRL_GET, body)] = now_s();
+      issued++;
+    }
+    send_all(out);
+    message m;
+    if (!receive(&m, IO_TIMEOUT_MS))
+    {
+      fprintf(stderr, "timed out\n");
+      return 1;
+    }
+    auto it = sent.find(m.id);
+    if (!(m.op & CTRL_REPLY) || it == sent.end())
+    {
+      continue;
+    }
+    rtt.push_back((now_s() - it->second) * 1000);
+    failed += m.body.size() < 2 || i16(m.body.data());
+    sent.erase(it);
+  }
+  double elapsed = now_s() - start;
+  std::sort(rtt.begin(), rtt.end());
+  printf("{\"requests\":%d,\"depth\":%d,\"failed\":%d,\"seconds\":%.3f,\"req_per_s\":%.0f,"
+         "\"rtt_ms\":{\"p50\":%.3f,\"p99\":%.3f,\"max\":%.3f}}\n",
+         count, depth, failed, elapsed, count / elapsed, rtt[rtt.size() / 2], rtt[rtt.size() * 99 / 100],
+         rtt.back());
+  return failed ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+  int port = CTRL_PORT, count = 10000, depth = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "p:n:d:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'p':
+      port = atoi(optarg);
+      break;
+    case 'n':
+      count = std::max(1, atoi(optarg));
+      break;
+    case 'd':
+      depth = std::max(1, atoi(optarg));
+      break;
+    default:
+      optind = argc + 1;
+    }
+  }
+  if (optind + 2 > argc)
+  {
+    fprintf(stderr, "usage: %s [-p port] [-n N] [-d depth] <host> names|get|set|reg|wreg|xclk|watch|bench [args]\n",
+            argv[0]);
+    return 2;
+  }
+  connect_to(argv[optind], port);
+  std::string cmd = argv[optind + 1];
+  int nargs = argc - optind - 2;
+  char **args = argv + optind + 2;
+
+  if (cmd == "names")
+  {
+    load_names();
+    printf("{");
+    for (auto &n : setting_names)
+    {
+      printf("%s\"%s\":%d", n.first ? "," : "", n.second.c_str(), n.first);
+    }
+    printf("}\n");
+    return 0;
+  }
+  if (cmd == "get" && nargs > 0)
+    return cmd_get(nargs, args);
+  if (cmd == "set" && nargs >= 2 && nargs % 2 == 0 && nargs / 2 <= 32)
+    return cmd_set(nargs, args);
+  if (cmd == "reg" && nargs >= 1)
+  {
+    std::vector<uint8_t> body = le16(strtol(args[0], NULL, 16));
+    body.push_back(nargs > 1 ? strtol(args[1], NULL, 16) : 0xff);
+    message m = call(CTRL_REG_READ, body);
+    if (i16(m.body.data()) || m.body.size() < 4)
+      return status_exit(m);
+    printf("{\"reg\":\"0x%04lx\",\"value\":\"0x%02x\"}\n", strtol(args[0], NULL, 16), i16(m.body.data() + 2));
+    return 0;
+  }
+  if (cmd == "wreg" && nargs == 3)
+  {
+    std::vector<uint8_t> body = le16(strtol(args[0], NULL, 16));
+    body.push_back(strtol(args[1], NULL, 16));
+    body.push_back(strtol(args[2], NULL, 16));
+    return status_exit(call(CTRL_REG_WRITE, body));
+  }
+  if (cmd == "xclk" && nargs == 1)
+    return status_exit(call(CTRL_XCLK, {(uint8_t)atoi(args[0])}));
+  if (cmd == "watch")
+    return cmd_watch(nargs ? atof(args[0]) : 0);
+  if (cmd == "bench")
+    return cmd_bench(count, depth);
+  fprintf(stderr, "%s: unknown command or wrong arguments\n", cmd.c_str());
+  return 2;
+}
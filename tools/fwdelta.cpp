@@ -0,0 +1,312 @@
+// Host tool for delta firmware updates (see src/fw_delta.h).
+//
+//   fwdelta diff  <old.bin> <new.bin> <patch>   make a patch
+//   fwdelta apply <old.bin> <patch> <new.bin>   rebuild with the device's decoder
+//
+// Build: g++ -O2 -std=c++17 -Isrc tools/fwdelta.cpp src/fw_delta.cpp -o fwdelta
+// Upload: gzip -9 the patch and POST it to /update like a firmware image,
+// with sha256= set to the digest of new.bin.
+//
+// The matching is Colin Percival's bsdiff: a suffix array of the old image
+// finds long approximate matches, stored as bytewise differences that are
+// mostly zero and compress well, with unmatched bytes as extra data.
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "fw_delta.h"
+
+typedef std::vector<uint8_t> bytes;
+
+static bool read_file(const char *path, bytes &out)
+{
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+  {
+    perror(path);
+    return false;
+  }
+  fseek(fp, 0, SEEK_END);
+  out.resize(ftell(fp));
+  fseek(fp, 0, SEEK_SET);
+  bool ok = fread(out.data(), 1, out.size(), fp) == out.size();
+  fclose(fp);
+  return ok;
+}
+
+static bool write_file(const char *path, const bytes &data)
+{
+  FILE *fp = fopen(path, "wb");
+  if (!fp)
+  {
+    perror(path);
+    return false;
+  }
+  bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+  return fclose(fp) == 0 && ok;
+}
+
+// SHA-256 for the base check in the header
+static void sha256(const uint8_t *data, size_t len, uint8_t out[32])
+{
+  static const uint32_t k[64] = {
+      0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+      0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+      0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+      0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+      0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+      0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+      0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+      0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+  uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  bytes msg(data, data + len);
+  msg.push_back(0x80);
+  while (msg.size() % 64 != 56)
+    msg.push_back(0);
+  for (int i = 7; i >= 0; i--)
+    msg.push_back((uint64_t)len * 8 >> (8 * i));
+  auto ror = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+  for (size_t off = 0; off < msg.size(); off += 64)
+  {
+    uint32_t w[64], s[8];
+    for (int i = 0; i < 16; i++)
+      w[i] = (uint32_t)msg[off + 4 * i] << 24 | msg[off + 4 * i + 1] << 16 | msg[off + 4 * i + 2] << 8 | msg[off + 4 * i + 3];
+    for (int i = 16; i < 64; i++)
+      w[i] = w[i - 16] + (ror(w[i - 15], 7) ^ ror(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 7] +
+             (ror(w[i - 2], 17) ^ ror(w[i - 2], 19) ^ (w[i - 2] >> 10));
+    memcpy(s, h, sizeof(s));
+    for (int i = 0; i < 64; i++)
+    {
+      uint32_t t1 = s[7] + (ror(s[4], 6) ^ ror(s[4], 11) ^ ror(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + k[i] + w[i];
+      uint32_t t2 = (ror(s[0], 2) ^ ror(s[0], 13) ^ ror(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+      memmove(s + 1, s, 7 * sizeof(uint32_t));
+      s[4] += t1;
+      s[0] = t1 + t2;
+    }
+    for (int i = 0; i < 8; i++)
+      h[i] += s[i];
+  }
+  for (int i = 0; i < 32; i++)
+    out[i] = h[i / 4] >> (24 - 8 * (i % 4));
+}
+
+// Suffix array by prefix doubling; sa[0] is the empty suffix
+static std::vector<int> suffix_array(const bytes &old)
+{
+  int n = old.size();
+  std::vector<int> sa(n + 1), rank(n + 1), tmp(n + 1);
+  for (int i = 0; i <= n; i++)
+  {
+    sa[i] = i;
+    rank[i] = i < n ? old[i] : -1;
+  }
+  for (int k = 1;; k *= 2)
+  {
+    auto key = [&](int i) { return std::make_pair(rank[i], i + k <= n ? rank[i + k] : -1); };
+    std::sort(sa.begin(), sa.end(), [&](int a, int b) { return key(a) < key(b); });
+    tmp[sa[0]] = 0;
+    for (int i = 1; i <= n; i++)
+      tmp[sa[i]] = tmp[sa[i - 1]] + (key(sa[i - 1]) < key(sa[i]));
+    rank.swap(tmp);
+    if (rank[sa[n]] == n)
+      break;
+  }
+  return sa;
+}
+
+static int match_len(const uint8_t *a, int alen, const uint8_t *b, int blen)
+{
+  int i = 0;
+  while (i < alen && i < blen && a[i] == b[i])
+    i++;
+  return i;
+}
+
+// Longest match of nw in old; position in *pos
+static int search(const std::vector<int> &sa, const bytes &old, const uint8_t *nw, int nlen, int st, int en, int *pos)
+{
+  int olen = old.size();
+  while (en - st >= 2)
+  {
+    int x = st + (en - st) / 2;
+    if (memcmp(old.data() + sa[x], nw, std::min(olen - sa[x], nlen)) < 0)
+      st = x;
+    else
+      en = x;
+  }
+  int a = match_len(old.data() + sa[st], olen - sa[st], nw, nlen);
+  int b = match_len(old.data() + sa[en], olen - sa[en], nw, nlen);
+  *pos = a > b ? sa[st] : sa[en];
+  return std::max(a, b);
+}
+
+static void put_u32(bytes &out, uint32_t v)
+{
+  for (int i = 0; i < 4; i++)
+    out.push_back(v >> (8 * i));
+}
+
+static bytes make_patch(const bytes &old, const bytes &nw)
+{
+  bytes out(FW_DELTA_MAGIC, FW_DELTA_MAGIC + 4);
+  put_u32(out, old.size());
+  put_u32(out, nw.size());
+  put_u32(out, 0);
+  uint8_t digest[32];
+  sha256(old.data(), old.size(), digest);
+  out.insert(out.end(), digest, digest + 32);
+
+  std::vector<int> sa = suffix_array(old);
+  int oldsize = old.size(), newsize = nw.size();
+  int scan = 0, len = 0, pos = 0, lastscan = 0, lastpos = 0, lastoffset = 0;
+  while (scan < newsize)
+  {
+    int oldscore = 0;
+    int scsc;
+    for (scsc = scan += len; scan < newsize; scan++)
+    {
+      len = search(sa, old, nw.data() + scan, newsize - scan, 0, oldsize, &pos);
+      for (; scsc < scan + len; scsc++)
+        if (scsc + lastoffset < oldsize && old[scsc + lastoffset] == nw[scsc])
+          oldscore++;
+      if ((len == oldscore && len != 0) || len > oldscore + 8)
+        break;
+      if (scan + lastoffset < oldsize && old[scan + lastoffset] == nw[scan])
+        oldscore--;
+    }
+    if (len == oldscore && scan != newsize)
+      continue;
+
+    // extend the previous match forwards and this one backwards
+    int s = 0, sf = 0, lenf = 0;
+    for (int i = 0; lastscan + i < scan && lastpos + i < oldsize;)
+    {
+      if (old[lastpos + i] == nw[lastscan + i])
+        s++;
+      i++;
+      if (s * 2 - i > sf * 2 - lenf)
+      {
+        sf = s;
+        lenf = i;
+      }
+    }
+    int lenb = 0;
+    if (scan < newsize)
+    {
+      int sb = 0;
+      s = 0;
+      for (int i = 1; scan >= lastscan + i && pos >= i; i++)
+      {
+        if (old[pos - i] == nw[scan - i])
+          s++;
+        if (s * 2 - i > sb * 2 - lenb)
+        {
+          sb = s;
+          lenb = i;
+        }
+      }
+    }
+    if (lastscan + lenf > scan - lenb)
+    {
+      int overlap = (lastscan + lenf) - (scan - lenb);
+      int ss = 0, lens = 0;
+      s = 0;
+      for (int i = 0; i < overlap; i++)
+      {
+        if (nw[lastscan + lenf - overlap + i] == old[lastpos + lenf - overlap + i])
+          s++;
+        if (nw[scan - lenb + i] == old[pos - lenb + i])
+          s--;
+        if (s > ss)
+        {
+          ss = s;
+          lens = i + 1;
+        }
+      }
+      lenf += lens - overlap;
+      lenb -= lens;
+    }
+
+    int extra = (scan - lenb) - (lastscan + lenf);
+    put_u32(out, lenf);
+    put_u32(out, extra);
+    put_u32(out, (uint32_t)((pos - lenb) - (lastpos + lenf)));
+    for (int i = 0; i < lenf; i++)
+      out.push_back(nw[lastscan + i] - old[lastpos + i]);
+    out.insert(out.end(), nw.begin() + lastscan + lenf, nw.begin() + scan - lenb);
+
+    lastscan = scan - lenb;
+    lastpos = pos - lenb;
+    lastoffset = pos - scan;
+  }
+  return out;
+}
+
+typedef struct
+{
+  const bytes *old;
+  bytes *out;
+} apply_ctx_t;
+
+static int check_base(void *ctx, const fw_delta_header_t *h)
+{
+  const bytes &old = *((apply_ctx_t *)ctx)->old;
+  uint8_t digest[32];
+  if (h->old_size > old.size())
+    return -1;
+  sha256(old.data(), h->old_size, digest);
+  return memcmp(digest, h->old_sha256, 32) ? -1 : 0;
+}
+
+static int read_base(void *ctx, uint32_t offset, uint8_t *dst, size_t len)
+{
+  const bytes &old = *((apply_ctx_t *)ctx)->old;
+  if (offset + len > old.size())
+    return -1;
+  memcpy(dst, old.data() + offset, len);
+  return 0;
+}
+
+static int write_out(void *ctx, const uint8_t *data, size_t len)
+{
+  bytes &out = *((apply_ctx_t *)ctx)->out;
+  out.insert(out.end(), data, data + len);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  if (argc != 5 || (strcmp(argv[1], "diff") && strcmp(argv[1], "apply")))
+  {
+    fprintf(stderr, "usage: %s diff <old.bin> <new.bin> <patch>\n"
+                    "       %s apply <old.bin> <patch> <new.bin>\n",
+            argv[0], argv[0]);
+    return 2;
+  }
+  bytes old, in;
+  if (!read_file(argv[2], old) || !read_file(argv[3], in))
+    return 1;
+  if (!strcmp(argv[1], "diff"))
+  {
+    bytes patch = make_patch(old, in);
+    printf("%zu -> %zu bytes, patch %zu\n", old.size(), in.size(), patch.size());
+    return write_file(argv[4], patch) ? 0 : 1;
+  }
+
+  bytes out;
+  apply_ctx_t ctx = {&old, &out};
+  fw_delta_io_t io = {check_base, read_base, write_out, &ctx};
+  fw_delta_t d;
+  fwDeltaInit(&d, &io);
+  // odd-sized pieces, like network chunks
+  int err = FW_DELTA_OK;
+  for (size_t off = 0; off < in.size() && !err; off += 1436)
+    err = fwDeltaWrite(&d, in.data() + off, std::min((size_t)1436, in.size() - off));
+  if (err || !fwDeltaDone(&d))
+  {
+    fprintf(stderr, "apply: %s\n", err ? fwDeltaError(err) : "truncated patch");
+    return 1;
+  }
+  return write_file(argv[4], out) ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+// Host check and benchmark for the compressed-domain JPEG transforms the
+// stream server applies per client (see src/jpeg_scale.h, src/jpeg_crop.h):
+// runs them over recorded JPEGs and reports the cost per frame and the
+// output size.
+//
+//   jpegbench [options] file.jpg...
+//     -s scale   1/2, 1/4 or 1/8 as 2, 4 or 8 (default 2)
+//     -c roi     crop instead: "x,y,w,h" in percent, as /stream?roi=
+//     -r N       passes over the files (default 1)
+//     -o dir     write each result there under the input's file name
+//
+// Build: g++ -O2 -std=c++17 -Isrc tools/jpegbench.cpp src/jpeg_scan.cpp src/jpeg_write.cpp src/jpeg_scale.cpp src/jpeg_crop.cpp -o jpegbench
+//
+// The written files are plain baseline JPEGs: compare them with what
+// "djpeg -scale 1/N" makes of the input, or for a crop with the same
+// pixels cut from the decoded input (the "crop" rectangle in the report).
+// test/test_jpeg makes those checks on generated frames (`pio test -e
+// native`): crops bit-exact, renditions close to the downscaled input.
+// Time is one host core and includes the header parse.
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "jpeg_crop.h"
+#include "jpeg_scale.h"
+
+static double now_us()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+static std::vector<uint8_t> load(const char *path)
+{
+  std::vector<uint8_t> data;
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+  {
+    perror(path);
+    exit(1);
+  }
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+  {
+    data.insert(data.end(), buf, buf + n);
+  }
+  fclose(fp);
+  return data;
+}
+
+static void save(const std::string &path, const uint8_t *data, size_t len)
+{
+  FILE *fp = fopen(path.c_str(), "wb");
+  if (!fp || fwrite(data, 1, len, fp) != len)
+  {
+    perror(path.c_str());
+    exit(1);
+  }
+  fclose(fp);
+}
+
+static double avg(const std::vector<double> &v)
+{
+  double sum = 0;
+  for (double x : v)
+  {
+    sum += x;
+  }
+  return v.empty() ? 0 : sum / v.size();
+}
+
+static double p99(std::vector<double> v)
+{
+  if (v.empty())
+  {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[v.size() * 99 / 100];
+}
+
+int main(int argc, char **argv)
+{
+  int scale = 2, passes = 1;
+  const char *out_dir = NULL;
+  int roi[4] = {0, 0, 0, 0};
+  bool crop = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:c:r:o:")) != -1)
+  {
+    switch (opt)
+    {
+    case 's':
+      scale = atoi(optarg);
+      break;
+    case 'c':
+      crop = sscanf(optarg, "%d,%d,%d,%d", &roi[0], &roi[1], &roi[2], &roi[3]) == 4;
+      if (!crop)
+      {
+        fprintf(stderr, "bad roi\n");
+        return 2;
+      }
+      break;
+    case 'r':
+      passes = std::max(1, atoi(optarg));
+      break;
+    case 'o':
+      out_dir = optarg;
+      break;
+    default:
+      optind = argc + 1;
+    }
+  }
+  if (optind >= argc || (scale != 2 && scale != 4 && scale != 8))
+  {
+    fprintf(stderr, "usage: %s [-s 2|4|8 | -c x,y,w,h] [-r passes] [-o dir] file.jpg...\n", argv[0]);
+    return 2;
+  }
+
+  static jpeg_scaler_t scaler;
+  static jpeg_cropper_t cropper;
+  std::vector<uint8_t> strip, out;
+  std::vector<double> us;
+  uint64_t in_bytes = 0, out_bytes = 0;
+  int errors = 0;
+  for (int pass = 0; pass < passes; pass++)
+  {
+    for (int i = optind; i < argc; i++)
+    {
+      std::vector<uint8_t> f = load(argv[i]);
+      out.resize(f.size() + 4096);
+      double t0 = now_us();
+      size_t len = 0;
+      jpeg_err_t res = jpegParse(f.data(), f.size(), crop ? &cropper.info : &scaler.info);
+      if (res == JPEG_OK && crop)
+      {
+        jpegCropRegion(&cropper, roi[0], roi[1], roi[2], roi[3]);
+        res = jpegCrop(&cropper, f.data(), f.size(), out.data(), out.size(), &len);
+      }
+      else if (res == JPEG_OK)
+      {
+        size_t need = jpegScaleStripSize(&scaler.info, scale);
+        if (strip.size() < need)
+        {
+          strip.resize(need);
+        }
+        scaler.strip = strip.data();
+        scaler.strip_size = strip.size();
+        res = jpegScale(&scaler, f.data(), f.size(), scale, out.data(), out.size(), &len);
+      }
+      double t1 = now_us();
+      if (res != JPEG_OK)
+      {
+        fprintf(stderr, "%s: error %d\n", argv[i], res);
+        errors++;
+        continue;
+      }
+      us.push_back(t1 - t0);
+      in_bytes += f.size();
+      out_bytes += len;
+      if (out_dir && pass == 0)
+      {
+        const char *base = strrchr(argv[i], '/');
+        save(std::string(out_dir) + "/" + (base ? base + 1 : argv[i]), out.data(), len);
+      }
+    }
+  }
+  size_t n = us.size();
+  char mode[64];
+  if (crop)
+  {
+    // of the last file
+    snprintf(mode, sizeof(mode), "\"crop\":[%u,%u,%u,%u]", cropper.x, cropper.y, cropper.width, cropper.height);
+  }
+  else
+  {
+    snprintf(mode, sizeof(mode), "\"scale\":%d", scale);
+  }
+  printf("{\"frames\":%zu,\"errors\":%d,%s,\"in_bytes_avg\":%.0f,\"out_bytes_avg\":%.0f,"
+         "\"us\":{\"avg\":%.1f,\"p99\":%.1f},\"fps\":%.0f}\n",
+         n, errors, mode, n ? (double)in_bytes / n : 0, n ? (double)out_bytes / n : 0, avg(us), p99(us),
+         avg(us) > 0 ? 1e6 / avg(us) : 0);
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,231 @@
+// Receiver for the multicast MJPEG feed (see src/mcast.h): joins the
+// group, reassembles frames from their fragments and writes them out,
+// dropping any frame that lost a fragment.
+//
+//   mcastrecv [options]
+//     -g group    multicast group (default 239.255.0.81)
+//     -p port     UDP port (default 5081)
+//     -i addr     local interface address to join on (default any)
+//     -m file     write a multipart stream with the parts /stream sends;
+//                 "-" for stdout
+//     -r file     write the bare JPEGs back to back ("-" for stdout), e.g.
+//                 mcastrecv -r - | ffplay -f mjpeg -
+//     -o dir      write each frame to dir/<seq>.jpg
+//     -t seconds  stop after this long (default: run until killed)
+//
+// Build: g++ -O2 -std=c++17 -Isrc tools/mcastrecv.cpp -o mcastrecv
+//
+// A summary goes to stderr at the end: frames written, frames dropped for
+// missing fragments, and frames lost in all (gaps in the feed sequence).
+#include <arpa/inet.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "mcast_proto.h"
+
+#define PART_BOUNDARY "123456789000000000000987654321"
+
+struct frame
+{
+  uint32_t len = 0;
+  int64_t ts_us = 0;
+  std::vector<uint8_t> data;
+  std::vector<bool> have;
+  uint16_t missing = 0;
+};
+
+static volatile bool stopping = false;
+static FILE *multipart = NULL, *raw = NULL;
+static const char *out_dir = NULL;
+static uint32_t written = 0, incomplete = 0, lost = 0, last_frame = 0;
+
+static double now_s()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static FILE *open_out(const char *path)
+{
+  FILE *fp = strcmp(path, "-") ? fopen(path, "wb") : stdout;
+  if (!fp)
+  {
+    perror(path);
+    exit(1);
+  }
+  return fp;
+}
+
+static void emit(uint32_t seq, const frame &f)
+{
+  if (last_frame && seq > last_frame + 1)
+  {
+    lost += seq - last_frame - 1;
+  }
+  last_frame = seq;
+  if (multipart)
+  {
+    fprintf(multipart,
+            "\r\n--" PART_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %lld.%06lld\r\n"
+            "X-Frame-Seq: %u\r\n\r\n",
+            f.len, (long long)(f.ts_us / 1000000), (long long)(f.ts_us % 1000000), seq);
+    fwrite(f.data.data(), 1, f.len, multipart);
+    fflush(multipart);
+  }
+  if (raw)
+  {
+    fwrite(f.data.data(), 1, f.len, raw);
+    fflush(raw);
+  }
+  if (out_dir)
+  {
+    std::string path = std::string(out_dir) + "/" + std::to_string(seq) + ".jpg";
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (fp)
+    {
+      fwrite(f.data.data(), 1, f.len, fp);
+      fclose(fp);
+    }
+  }
+  written++;
+}
+
+int main(int argc, char **argv)
+{
+  const char *group = MCAST_GROUP, *iface = NULL;
+  int port = MCAST_PORT;
+  double seconds = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "g:p:i:m:r:o:t:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'g':
+      group = optarg;
+      break;
+    case 'p':
+      port = atoi(optarg);
+      break;
+    case 'i':
+      iface = optarg;
+      break;
+    case 'm':
+      multipart = open_out(optarg);
+      break;
+    case 'r':
+      raw = open_out(optarg);
+      break;
+    case 'o':
+      out_dir = optarg;
+      break;
+    case 't':
+      seconds = atof(optarg);
+      break;
+    default:
+      optind = argc + 1;
+    }
+  }
+  if (optind != argc || (!multipart && !raw && !out_dir))
+  {
+    fprintf(stderr, "usage: %s [-g group] [-p port] [-i iface_addr] [-t seconds]\n"
+                    "       (-m multipart | -r raw | -o dir)...\n",
+            argv[0]);
+    return 2;
+  }
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  int rcvbuf = 1 << 20;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  struct sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(port);
+  if (fd < 0 || bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0)
+  {
+    perror("bind");
+    return 1;
+  }
+  struct ip_mreq mreq = {};
+  if (inet_aton(group, &mreq.imr_multiaddr) && IN_MULTICAST(ntohl(mreq.imr_multiaddr.s_addr)))
+  {
+    mreq.imr_interface.s_addr = iface ? inet_addr(iface) : htonl(INADDR_ANY);
+    if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+    {
+      perror("IP_ADD_MEMBERSHIP");
+      return 1;
+    }
+  }
+  signal(SIGINT, [](int) { stopping = true; });
+  signal(SIGTERM, [](int) { stopping = true; });
+
+  // frames being reassembled; fragments of two frames can interleave at most
+  std::map<uint32_t, frame> pending;
+  uint8_t buf[sizeof(mcast_hdr_t) + MCAST_PAYLOAD];
+  double end = seconds > 0 ? now_s() + seconds : 0;
+  while (!stopping && (!end || now_s() < end))
+  {
+    struct pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, 100) <= 0)
+    {
+      continue;
+    }
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    mcast_hdr_t hdr;
+    if (n < (ssize_t)sizeof(hdr))
+    {
+      continue;
+    }
+    memcpy(&hdr, buf, sizeof(hdr));
+    size_t payload = n - sizeof(hdr);
+    size_t off = (size_t)hdr.frag * MCAST_PAYLOAD;
+    if (hdr.magic != MCAST_MAGIC || hdr.frag >= hdr.frags || off + payload > hdr.len ||
+        (last_frame && hdr.frame <= last_frame))
+    {
+      continue; // malformed, or a frame already written or given up
+    }
+    frame &f = pending[hdr.frame];
+    if (f.have.empty())
+    {
+      f.len = hdr.len;
+      f.ts_us = hdr.ts_us;
+      f.data.resize(hdr.len);
+      f.have.assign(hdr.frags, false);
+      f.missing = hdr.frags;
+    }
+    if (f.len != hdr.len || f.have.size() != hdr.frags || f.have[hdr.frag])
+    {
+      continue;
+    }
+    memcpy(f.data.data() + off, buf + sizeof(hdr), payload);
+    f.have[hdr.frag] = true;
+    if (--f.missing == 0)
+    {
+      // everything older than a complete frame is not coming any more
+      while (pending.begin()->first != hdr.frame)
+      {
+        pending.erase(pending.begin());
+        incomplete++;
+      }
+      emit(hdr.frame, f);
+      pending.erase(pending.begin());
+    }
+    else if (pending.size() > 2)
+    {
+      pending.erase(pending.begin());
+      incomplete++;
+    }
+  }
+  incomplete += pending.size();
+  fprintf(stderr, "{\"frames\":%u,\"incomplete\":%u,\"lost\":%u}\n", written, incomplete, lost);
+  return 0;
+}
@@ -0,0 +1,185 @@
+// Host benchmark for the motion detector (see src/motion.h): runs the same
+// DC extraction and background model as the device over recorded JPEGs,
+// in the order given, and reports the cost per frame and what it found.
+//
+//   motionbench [options] file.jpg...
+//     -r N       passes over the files (default 1)
+//     -t thresh  motion_thresh (default 48, as on the device)
+//     -b blocks  motion_blocks (default 4)
+//     -m mask    motion_mask, "x,y,w,h;..." in percent
+//     -v         one line per frame on stderr: changed blocks and box
+//
+// Build: g++ -O2 -std=c++17 -Isrc tools/motionbench.cpp src/jpeg_scan.cpp src/motion_model.cpp -o motionbench
+//
+// Record frames with e.g. mcastrecv -o dir, or by saving /capture in a
+// loop. Time is one host core; the JSON report has per-frame averages and
+// the 99th percentile for the DC pass and the model update.
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "jpeg_scan.h"
+#include "motion_model.h"
+
+static double now_us()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+static std::vector<uint8_t> load(const char *path)
+{
+  std::vector<uint8_t> data;
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+  {
+    perror(path);
+    exit(1);
+  }
+  uint8_t buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+  {
+    data.insert(data.end(), buf, buf + n);
+  }
+  fclose(fp);
+  return data;
+}
+
+static void apply_mask(const char *spec, motion_model_t *m)
+{
+  while (spec && *spec)
+  {
+    int x, y, w, h, n = 0;
+    if (sscanf(spec, "%d,%d,%d,%d%n", &x, &y, &w, &h, &n) != 4)
+    {
+      fprintf(stderr, "bad mask\n");
+      exit(2);
+    }
+    motionModelMask(m, x, y, w, h);
+    spec += n + (spec[n] == ';');
+  }
+}
+
+static double avg(const std::vector<double> &v)
+{
+  double sum = 0;
+  for (double x : v)
+  {
+    sum += x;
+  }
+  return v.empty() ? 0 : sum / v.size();
+}
+
+static double p99(std::vector<double> v)
+{
+  if (v.empty())
+  {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[v.size() * 99 / 100];
+}
+
+int main(int argc, char **argv)
+{
+  motion_params_t params = {48, 4, 5, 10, 200};
+  int passes = 1;
+  const char *mask = NULL;
+  bool verbose = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "r:t:b:m:v")) != -1)
+  {
+    switch (opt)
+    {
+    case 'r':
+      passes = std::max(1, atoi(optarg));
+      break;
+    case 't':
+      params.threshold = atoi(optarg);
+      break;
+    case 'b':
+      params.min_blocks = atoi(optarg);
+      break;
+    case 'm':
+      mask = optarg;
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    default:
+      optind = argc + 1;
+    }
+  }
+  if (optind >= argc)
+  {
+    fprintf(stderr, "usage: %s [-r passes] [-t thresh] [-b blocks] [-m mask] [-v] file.jpg...\n", argv[0]);
+    return 2;
+  }
+  std::vector<std::vector<uint8_t>> files;
+  for (int i = optind; i < argc; i++)
+  {
+    files.push_back(load(argv[i]));
+  }
+
+  static jpeg_info_t info;
+  motion_model_t model = {};
+  std::vector<uint8_t> mem;
+  std::vector<int16_t> dc;
+  std::vector<double> dc_us, model_us;
+  uint64_t bytes = 0;
+  int errors = 0, motion_frames = 0, frame = 0;
+  for (int pass = 0; pass < passes; pass++)
+  {
+    for (const std::vector<uint8_t> &f : files)
+    {
+      double t0 = now_us();
+      if (jpegParse(f.data(), f.size(), &info) != JPEG_OK)
+      {
+        errors++;
+        continue;
+      }
+      if (info.luma_cols != model.cols || info.luma_rows != model.rows)
+      {
+        mem.resize(motionModelSize(info.luma_cols, info.luma_rows));
+        dc.resize((size_t)info.luma_cols * info.luma_rows);
+        motionModelInit(&model, info.luma_cols, info.luma_rows, mem.data());
+        apply_mask(mask, &model);
+      }
+      if (jpegLumaDc(f.data(), f.size(), &info, dc.data(), dc.size()) != JPEG_OK)
+      {
+        errors++;
+        continue;
+      }
+      double t1 = now_us();
+      motion_result_t r;
+      bool motion = motionModelUpdate(&model, dc.data(), &params, &r);
+      double t2 = now_us();
+      dc_us.push_back(t1 - t0);
+      model_us.push_back(t2 - t1);
+      bytes += f.size();
+      motion_frames += motion;
+      if (verbose)
+      {
+        fprintf(stderr, "%d changed=%u shift=%d%s", frame, r.changed, r.shift, motion ? " motion" : "");
+        if (r.changed)
+        {
+          fprintf(stderr, " box=%u,%u-%u,%u", r.x0, r.y0, r.x1, r.y1);
+        }
+        fprintf(stderr, "\n");
+      }
+      frame++;
+    }
+  }
+  size_t n = dc_us.size();
+  double per_frame = avg(dc_us) + avg(model_us);
+  printf("{\"frames\":%zu,\"errors\":%d,\"grid\":[%u,%u],\"bytes_avg\":%.0f,\"dc_us\":{\"avg\":%.1f,\"p99\":%.1f},"
+         "\"model_us\":{\"avg\":%.1f,\"p99\":%.1f},\"fps\":%.0f,\"motion_frames\":%d}\n",
+         n, errors, model.cols, model.rows, n ? (double)bytes / n : 0, avg(dc_us), p99(dc_us), avg(model_us),
+         p99(model_us), per_frame > 0 ? 1e6 / per_frame : 0, motion_frames);
+  return errors ? 1 : 0;
+}
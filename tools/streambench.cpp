@@ -0,0 +1,591 @@
+// Host load generator for the camera server: N /stream clients, M /capture
+// clients and an optional control-request probe, run concurrently for a
+// fixed time and reported as JSON.
+//
+//   streambench [options] <host>
+//     -P port     camera server (default 80)
+//     -S port     stream server (default 81)
+//     -n N        /stream clients (default 1)
+//     -c M        /capture clients, back to back requests (default 0)
+//     -t seconds  run time (default 10)
+//     -r rate     control requests per second while streaming (default 0)
+//     -u path     control request (default /status)
+//     -g ms       inter-frame gap counted as a stall (default 500)
+//     -o file     write the JSON report there instead of stdout
+//     -q query    /stream query string, e.g. "skip&hb=2" or "fps=5"
+//
+// Build: g++ -O2 -std=c++17 -pthread tools/streambench.cpp -o streambench
+// Against the native build: streambench -P 8080 -S 8081 127.0.0.1
+//
+// Latency is frame arrival (last byte off the socket) minus the frame's
+// X-Timestamp; queue_ms and device_latency_ms are what the device reports
+// per part (X-Queue-Us, X-Latency-Us), and dropped counts the frames the
+// X-Frame-Seq sequence skipped (with -q skip that includes the frames the
+// device left out as unchanged; heartbeats counts their empty parts). When
+// the device clock is not within a minute of the host's (no SNTP yet),
+// latency is reported relative to the fastest frame seen
+// ("latency_base":"min").
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define IO_TIMEOUT_MS 10000
+#define SYNC_WINDOW_S 60.0
+
+static std::atomic<bool> stopping(false);
+static const char *host = NULL;
+static int camera_port = 80;
+static int stream_port = 81;
+static double stall_ms = 500;
+static std::string stream_query;
+
+static double now_s()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// Buffered reader over a socket that gives up when the run is over
+class conn
+{
+public:
+  ~conn() { close(); }
+  bool open(int port)
+  {
+    struct addrinfo hints = {}, *res = NULL;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    char service[8];
+    snprintf(service, sizeof(service), "%d", port);
+    if (getaddrinfo(host, service, &hints, &res) != 0)
+    {
+      err = "resolve";
+      return false;
+    }
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, res->ai_addr, res->ai_addrlen) < 0)
+    {
+      err = "connect";
+      freeaddrinfo(res);
+      return false;
+    }
+    freeaddrinfo(res);
+    return true;
+  }
+  void close()
+  {
+    if (fd >= 0)
+    {
+      ::close(fd);
+      fd = -1;
+    }
+  }
+  bool send_get(const char *path)
+  {
+    std::string req = std::string("GET ") + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n";
+    return send(fd, req.data(), req.size(), MSG_NOSIGNAL) == (ssize_t)req.size();
+  }
+  bool fill()
+  {
+    if (pos > 0)
+    {
+      buf.erase(0, pos);
+      pos = 0;
+    }
+    for (int waited = 0; waited < IO_TIMEOUT_MS; waited += 100)
+    {
+      if (stopping)
+      {
+        return false;
+      }
+      struct pollfd p = {fd, POLLIN, 0};
+      if (poll(&p, 1, 100) > 0)
+      {
+        char tmp[16384];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0)
+        {
+          eof = true;
+          return false;
+        }
+        buf.append(tmp, n);
+        return true;
+      }
+    }
+    err = "timeout";
+    return false;
+  }
+  bool line(std::string &out)
+  {
+    size_t nl;
+    while ((nl = buf.find('\n', pos)) == std::string::npos)
+    {
+      if (!fill())
+      {
+        return false;
+      }
+    }
+    out = buf.substr(pos, nl - pos);
+    if (!out.empty() && out.back() == '\r')
+    {
+      out.pop_back();
+    }
+    pos = nl + 1;
+    return true;
+  }
+  bool skip(size_t len)
+  {
+    while (buf.size() - pos < len)
+    {
+      if (!fill())
+      {
+        return false;
+      }
+    }
+    pos += len;
+    return true;
+  }
+  // everything until the server closes
+  size_t drain()
+  {
+    while (fill())
+    {
+    }
+    return buf.size() - pos;
+  }
+
+  int fd = -1;
+  bool eof = false;
+  std::string err;
+
+private:
+  std::string buf;
+  size_t pos = 0;
+};
+
+static bool header_value(const std::string &line, const char *name, std::string &value)
+{
+  size_t n = strlen(name);
+  if (line.size() <= n || strncasecmp(line.c_str(), name, n) || line[n] != ':')
+  {
+    return false;
+  }
+  value = line.substr(n + 1);
+  value.erase(0, value.find_first_not_of(' '));
+  return true;
+}
+
+// Status line and headers; returns the status code, 0 on failure
+static int read_head(conn &c, std::vector<std::string> &headers)
+{
+  std::string l;
+  int code = 0;
+  if (!c.line(l) || sscanf(l.c_str(), "HTTP/%*s %d", &code) != 1)
+  {
+    return 0;
+  }
+  while (c.line(l) && !l.empty())
+  {
+    headers.push_back(l);
+  }
+  return code;
+}
+
+struct stats
+{
+  std::vector<double> v;
+  void add(double x) { v.push_back(x); }
+  double pct(double p) const
+  {
+    if (v.empty())
+    {
+      return 0;
+    }
+    std::vector<double> s(v);
+    std::sort(s.begin(), s.end());
+    return s[std::min(s.size() - 1, (size_t)(p / 100.0 * s.size()))];
+  }
+  double max() const { return v.empty() ? 0 : *std::max_element(v.begin(), v.end()); }
+  double mean() const
+  {
+    double sum = 0;
+    for (double x : v)
+      sum += x;
+    return v.empty() ? 0 : sum / v.size();
+  }
+  std::string json() const
+  {
+    char b[160];
+    snprintf(b, sizeof(b), "{\"n\":%zu,\"mean\":%.2f,\"p50\":%.2f,\"p90\":%.2f,\"p99\":%.2f,\"max\":%.2f}",
+             v.size(), mean(), pct(50), pct(90), pct(99), max());
+    return b;
+  }
+};
+
+struct stream_result
+{
+  uint32_t frames = 0;
+  uint64_t bytes = 0;
+  double first = 0, last = 0;
+  uint32_t stalls = 0;
+  double stalled_ms = 0;
+  stats interval_ms;
+  std::vector<double> skew; // arrival - X-Timestamp, seconds
+  uint32_t dropped = 0;     // gaps in X-Frame-Seq
+  uint32_t heartbeats = 0;  // empty parts
+  stats queue_ms, device_ms; // X-Queue-Us, X-Latency-Us
+  std::string err;
+};
+
+struct request_result
+{
+  uint32_t ok = 0, failed = 0;
+  uint64_t bytes = 0;
+  stats latency_ms;
+  std::vector<double> skew;
+  std::string err;
+};
+
+static bool parse_timestamp(const std::string &v, double *ts)
+{
+  long sec = 0, usec = 0;
+  if (sscanf(v.c_str(), "%ld.%ld", &sec, &usec) != 2)
+  {
+    return false;
+  }
+  *ts = sec + usec / 1e6;
+  return true;
+}
+
+static void stream_client(stream_result *r)
+{
+  conn c;
+  std::vector<std::string> headers;
+  if (!c.open(stream_port) || !c.send_get(("/stream" + stream_query).c_str()))
+  {
+    r->err = c.err.empty() ? "send" : c.err;
+    return;
+  }
+  int code = read_head(c, headers);
+  std::string boundary, v;
+  for (const std::string &h : headers)
+  {
+    if (header_value(h, "Content-Type", v) && v.find("boundary=") != std::string::npos)
+    {
+      boundary = "--" + v.substr(v.find("boundary=") + 9);
+    }
+  }
+  if (code != 200 || boundary.empty())
+  {
+    r->err = code ? "http " + std::to_string(code) : "no response";
+    return;
+  }
+  std::string l;
+  uint32_t last_seq = 0;
+  bool ok = true;
+  while (!stopping)
+  {
+    // the part boundary, then the part headers
+    while ((ok = c.line(l)) && l != boundary)
+    {
+      if (l == boundary + "--")
+      {
+        r->err = "stream ended";
+        return;
+      }
+    }
+    if (!ok)
+    {
+      break;
+    }
+    size_t len = 0;
+    double ts = 0;
+    bool has_ts = false;
+    while ((ok = c.line(l)) && !l.empty())
+    {
+      if (header_value(l, "Content-Length", v))
+        len = strtoul(v.c_str(), NULL, 10);
+      else if (header_value(l, "X-Timestamp", v))
+        has_ts = parse_timestamp(v, &ts);
+      else if (header_value(l, "X-Frame-Seq", v))
+      {
+        uint32_t seq = strtoul(v.c_str(), NULL, 10);
+        if (last_seq && seq > last_seq + 1)
+          r->dropped += seq - last_seq - 1;
+        last_seq = seq;
+      }
+      else if (header_value(l, "X-Queue-Us", v))
+        r->queue_ms.add(atof(v.c_str()) / 1000);
+      else if (header_value(l, "X-Latency-Us", v))
+        r->device_ms.add(atof(v.c_str()) / 1000);
+    }
+    // a failed read leaves the last header in l: the stream is gone, not
+    // at an empty heartbeat part
+    if (!ok)
+    {
+      break;
+    }
+    if (!len)
+    {
+      r->heartbeats++;
+      continue;
+    }
+    if (!c.skip(len))
+    {
+      break;
+    }
+    double t = now_s();
+    if (r->frames)
+    {
+      double gap = (t - r->last) * 1000;
+      r->interval_ms.add(gap);
+      if (gap > stall_ms)
+      {
+        r->stalls++;
+        r->stalled_ms += gap;
+      }
+    }
+    else
+    {
+      r->first = t;
+    }
+    r->last = t;
+    r->frames++;
+    r->bytes += len;
+    if (has_ts)
+    {
+      r->skew.push_back(t - ts);
+    }
+  }
+  if (!stopping)
+  {
+    r->err = c.eof ? "closed" : c.err;
+  }
+}
+
+static void request_client(const char *path, double rate, request_result *r)
+{
+  double next = now_s();
+  while (!stopping)
+  {
+    if (rate > 0)
+    {
+      double wait = next - now_s();
+      if (wait > 0)
+      {
+        usleep((useconds_t)(wait * 1e6));
+      }
+      next += 1.0 / rate;
+      if (stopping)
+      {
+        break;
+      }
+    }
+    double t0 = now_s();
+    conn c;
+    std::vector<std::string> headers;
+    int code = 0;
+    if (c.open(camera_port) && c.send_get(path))
+    {
+      code = read_head(c, headers);
+    }
+    size_t body = code ? c.drain() : 0;
+    if (stopping && !c.eof)
+    {
+      break; // cut off by the end of the run
+    }
+    double t = now_s();
+    if (code != 200)
+    {
+      r->failed++;
+      r->err = code ? "http " + std::to_string(code) : (c.err.empty() ? "no response" : c.err);
+      if (rate <= 0)
+      {
+        usleep(100000); // do not spin on a refusing server
+      }
+      continue;
+    }
+    r->ok++;
+    r->bytes += body;
+    r->latency_ms.add((t - t0) * 1000);
+    std::string v;
+    double ts;
+    for (const std::string &h : headers)
+    {
+      if (header_value(h, "X-Timestamp", v) && parse_timestamp(v, &ts))
+      {
+        r->skew.push_back(t - ts);
+      }
+    }
+  }
+}
+
+// Arrival minus capture time; relative to the best frame when clocks differ
+static stats latency(const std::vector<double> &skew, double offset)
+{
+  stats s;
+  for (double d : skew)
+  {
+    s.add((d - offset) * 1000);
+  }
+  return s;
+}
+
+int main(int argc, char **argv)
+{
+  int streams = 1, captures = 0;
+  double seconds = 10, rate = 0;
+  const char *control_path = "/status";
+  const char *out_path = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "P:S:n:c:t:r:u:g:o:q:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'P':
+      camera_port = atoi(optarg);
+      break;
+    case 'S':
+      stream_port = atoi(optarg);
+      break;
+    case 'n':
+      streams = atoi(optarg);
+      break;
+    case 'c':
+      captures = atoi(optarg);
+      break;
+    case 't':
+      seconds = atof(optarg);
+      break;
+    case 'r':
+      rate = atof(optarg);
+      break;
+    case 'u':
+      control_path = optarg;
+      break;
+    case 'g':
+      stall_ms = atof(optarg);
+      break;
+    case 'o':
+      out_path = optarg;
+      break;
+    case 'q':
+      stream_query = std::string("?") + optarg;
+      break;
+    default:
+      optind = argc + 1;
+    }
+  }
+  if (optind != argc - 1)
+  {
+    fprintf(stderr, "usage: %s [-P port] [-S port] [-n streams] [-c captures] [-t seconds]\n"
+                    "       [-r control/s] [-u path] [-g stall_ms] [-o report.json] [-q query] <host>\n",
+            argv[0]);
+    return 2;
+  }
+  host = argv[optind];
+
+  std::vector<stream_result> sr(streams);
+  std::vector<request_result> cr(captures);
+  request_result control;
+  std::vector<std::thread> threads;
+  double start = now_s();
+  for (int i = 0; i < streams; i++)
+    threads.emplace_back(stream_client, &sr[i]);
+  for (int i = 0; i < captures; i++)
+    threads.emplace_back(request_client, "/capture", 0.0, &cr[i]);
+  if (rate > 0)
+    threads.emplace_back(request_client, control_path, rate, &control);
+  usleep((useconds_t)(seconds * 1e6));
+  stopping = true;
+  for (std::thread &t : threads)
+    t.join();
+  double elapsed = now_s() - start;
+
+  // one clock offset for the whole run, so clients stay comparable
+  double min_skew = INFINITY;
+  for (const stream_result &r : sr)
+    for (double d : r.skew)
+      min_skew = std::min(min_skew, d);
+  for (const request_result &r : cr)
+    for (double d : r.skew)
+      min_skew = std::min(min_skew, d);
+  bool synced = std::isfinite(min_skew) && fabs(min_skew) < SYNC_WINDOW_S;
+  double offset = synced || !std::isfinite(min_skew) ? 0 : min_skew;
+
+  std::string j;
+  char b[512];
+  snprintf(b, sizeof(b), "{\"host\":\"%s\",\"camera_port\":%d,\"stream_port\":%d,\"duration_s\":%.3f,"
+                         "\"stall_ms\":%.0f,\"latency_base\":\"%s\",\"streams\":[",
+           host, camera_port, stream_port, elapsed, stall_ms, synced ? "absolute" : "min");
+  j += b;
+  uint32_t total_frames = 0;
+  double total_fps = 0;
+  for (int i = 0; i < streams; i++)
+  {
+    const stream_result &r = sr[i];
+    double span = r.frames > 1 ? r.last - r.first : 0;
+    double fps = span > 0 ? (r.frames - 1) / span : 0;
+    stats jitter;
+    double mean = r.interval_ms.mean();
+    for (double x : r.interval_ms.v)
+      jitter.add(fabs(x - mean));
+    snprintf(b, sizeof(b), "%s{\"id\":%d,\"frames\":%u,\"bytes\":%llu,\"fps\":%.2f,\"kbps\":%.1f,\"stalls\":%u,\"stalled_ms\":%.0f,"
+                           "\"dropped\":%u,\"heartbeats\":%u,",
+             i ? "," : "", i, r.frames, (unsigned long long)r.bytes, fps, span > 0 ? r.bytes * 8 / span / 1000 : 0,
+             r.stalls, r.stalled_ms, r.dropped, r.heartbeats);
+    j += b;
+    j += "\"interval_ms\":" + r.interval_ms.json() + ",\"jitter_ms\":" + jitter.json() +
+         ",\"latency_ms\":" + latency(r.skew, offset).json() + ",\"queue_ms\":" + r.queue_ms.json() +
+         ",\"device_latency_ms\":" + r.device_ms.json() + ",\"error\":\"" + r.err + "\"}";
+    total_frames += r.frames;
+    total_fps += fps;
+  }
+  j += "],\"captures\":[";
+  for (int i = 0; i < captures; i++)
+  {
+    const request_result &r = cr[i];
+    snprintf(b, sizeof(b), "%s{\"id\":%d,\"ok\":%u,\"failed\":%u,\"bytes\":%llu,\"per_s\":%.2f,",
+             i ? "," : "", i, r.ok, r.failed, (unsigned long long)r.bytes, r.ok / elapsed);
+    j += b;
+    j += "\"request_ms\":" + r.latency_ms.json() + ",\"latency_ms\":" + latency(r.skew, offset).json() +
+         ",\"error\":\"" + r.err + "\"}";
+  }
+  j += "]";
+  if (rate > 0)
+  {
+    snprintf(b, sizeof(b), ",\"control\":{\"path\":\"%s\",\"rate\":%.2f,\"ok\":%u,\"failed\":%u,",
+             control_path, rate, control.ok, control.failed);
+    j += b;
+    j += "\"request_ms\":" + control.latency_ms.json() + ",\"error\":\"" + control.err + "\"}";
+  }
+  snprintf(b, sizeof(b), ",\"total\":{\"frames\":%u,\"fps\":%.2f}}\n", total_frames, total_fps);
+  j += b;
+
+  FILE *out = out_path ? fopen(out_path, "w") : stdout;
+  if (!out)
+  {
+    perror(out_path);
+    return 1;
+  }
+  fputs(j.c_str(), out);
+  if (out != stdout)
+  {
+    fclose(out);
+  }
+  fprintf(stderr, "%d stream(s): %u frames, %.2f fps total; %d capture client(s); control %u ok %u failed\n",
+          streams, total_frames, total_fps, captures, control.ok, control.failed);
+  return 0;
+}
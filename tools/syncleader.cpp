@@ -0,0 +1,318 @@
+// Stand-in sync leader for a Linux host (see src/cam_sync.h): beacons,
+// answers the nodes' offset pings on Unix time, fires a series of triggers
+// and reports how far apart the triggered frames landed, as JSON.
+//
+//   syncleader [options]
+//     -b addr[:port]  where beacons and triggers go; repeatable
+//                     (default 255.255.255.255)
+//     -p port         node port when -b has none (default 3333)
+//     -n N            triggers (default 5)
+//     -i ms           between triggers (default 2000)
+//     -d ms           fire time ahead of the trigger (default 300)
+//     -w seconds      beacon only for this long first, so nodes lock (default 5)
+//     -o file         write the JSON report there instead of stdout
+//
+// Build: g++ -O2 -std=c++17 -Isrc tools/syncleader.cpp -o syncleader
+// Against native builds, which listen on port + NATIVE_PORT_OFFSET:
+//   syncleader -b 127.0.0.1:11333
+//
+// A frame's error is its shared-epoch timestamp minus the fire time; the
+// skew of a trigger is the spread of the frame times across the nodes.
+// Each frame is in the node's image store under the reported seq.
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "sync_proto.h"
+
+#define BEACON_MS 1000
+
+struct report
+{
+  int64_t frame_us, offset_us;
+  uint32_t bytes, seq;
+  uint8_t flags;
+};
+
+struct node
+{
+  uint32_t pings = 0;
+  std::map<uint32_t, report> reports; // by trigger id
+};
+
+static int fd = -1;
+static std::vector<struct sockaddr_in> targets;
+static std::map<std::string, node> nodes;
+
+static int64_t now_us()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static std::string addr_str(const struct sockaddr_in &a)
+{
+  char b[32];
+  snprintf(b, sizeof(b), "%s:%u", inet_ntoa(a.sin_addr), ntohs(a.sin_port));
+  return b;
+}
+
+static void broadcast(sync_msg_t *msg)
+{
+  msg->magic = SYNC_MAGIC;
+  for (const struct sockaddr_in &t : targets)
+  {
+    sendto(fd, msg, sizeof(*msg), 0, (const struct sockaddr *)&t, sizeof(t));
+  }
+}
+
+// Handle what arrives until deadline
+static void serve(int64_t deadline)
+{
+  for (;;)
+  {
+    int64_t left = deadline - now_us();
+    if (left <= 0)
+    {
+      return;
+    }
+    struct pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, (int)((left + 999) / 1000)) <= 0)
+    {
+      continue;
+    }
+    sync_msg_t msg;
+    struct sockaddr_in from = {};
+    socklen_t len = sizeof(from);
+    ssize_t n = recvfrom(fd, &msg, sizeof(msg), 0, (struct sockaddr *)&from, &len);
+    int64_t rx = now_us();
+    if (n != sizeof(msg) || msg.magic != SYNC_MAGIC)
+    {
+      continue;
+    }
+    node &nd = nodes[addr_str(from)];
+    if (msg.type == SYNC_PING)
+    {
+      msg.type = SYNC_PONG;
+      msg.t[1] = rx;
+      msg.t[2] = now_us();
+      sendto(fd, &msg, sizeof(msg), 0, (const struct sockaddr *)&from, len);
+      nd.pings++;
+    }
+    else if (msg.type == SYNC_REPORT)
+    {
+      nd.reports[msg.id] = report{msg.t[1], msg.t[2], msg.a, msg.b, msg.flags};
+    }
+  }
+}
+
+// Beacon on schedule while serving until deadline
+static void run_until(int64_t deadline, int64_t &next_beacon)
+{
+  while (now_us() < deadline)
+  {
+    if (now_us() >= next_beacon)
+    {
+      sync_msg_t msg = {};
+      msg.type = SYNC_BEACON;
+      broadcast(&msg);
+      next_beacon += BEACON_MS * 1000;
+    }
+    serve(std::min(deadline, next_beacon));
+  }
+}
+
+static const char *status(const report &r)
+{
+  if (r.flags & SYNC_F_UNSYNCED)
+    return "unsynced";
+  if (r.flags & SYNC_F_FAILED)
+    return "failed";
+  return "ok";
+}
+
+int main(int argc, char **argv)
+{
+  int port = SYNC_PORT, count = 5;
+  double interval_ms = 2000, lead_ms = 300, warmup_s = 5;
+  std::vector<std::string> dests;
+  const char *out_path = NULL;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:p:n:i:d:w:o:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'b':
+      dests.push_back(optarg);
+      break;
+    case 'p':
+      port = atoi(optarg);
+      break;
+    case 'n':
+      count = atoi(optarg);
+      break;
+    case 'i':
+      interval_ms = atof(optarg);
+      break;
+    case 'd':
+      lead_ms = atof(optarg);
+      break;
+    case 'w':
+      warmup_s = atof(optarg);
+      break;
+    case 'o':
+      out_path = optarg;
+      break;
+    default:
+      optind = argc + 1;
+    }
+  }
+  if (optind != argc)
+  {
+    fprintf(stderr, "usage: %s [-b addr[:port]]... [-p port] [-n triggers] [-i interval_ms]\n"
+                    "       [-d lead_ms] [-w warmup_s] [-o report.json]\n",
+            argv[0]);
+    return 2;
+  }
+  if (dests.empty())
+    dests.push_back("255.255.255.255");
+  for (const std::string &d : dests)
+  {
+    struct sockaddr_in a = {};
+    a.sin_family = AF_INET;
+    size_t colon = d.find(':');
+    a.sin_port = htons(colon == std::string::npos ? port : atoi(d.c_str() + colon + 1));
+    if (inet_aton(d.substr(0, colon).c_str(), &a.sin_addr) == 0)
+    {
+      fprintf(stderr, "bad address %s\n", d.c_str());
+      return 2;
+    }
+    targets.push_back(a);
+  }
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof(one));
+  struct sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  if (fd < 0 || bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0)
+  {
+    perror("socket");
+    return 1;
+  }
+
+  int64_t next_beacon = now_us();
+  run_until(now_us() + (int64_t)(warmup_s * 1e6), next_beacon);
+  std::vector<int64_t> fire(count);
+  for (int i = 0; i < count; i++)
+  {
+    sync_msg_t msg = {};
+    msg.type = SYNC_TRIGGER;
+    msg.id = i + 1;
+    msg.t[0] = fire[i] = now_us() + (int64_t)(lead_ms * 1000);
+    broadcast(&msg);
+    fprintf(stderr, "trigger %d\n", i + 1);
+    run_until(now_us() + (int64_t)(std::max(interval_ms, lead_ms + 1000) * 1000), next_beacon);
+  }
+
+  std::string j;
+  char b[512];
+  snprintf(b, sizeof(b), "{\"triggers\":%d,\"lead_ms\":%.0f,\"interval_ms\":%.0f,\"nodes\":[", count, lead_ms, interval_ms);
+  j += b;
+  bool first = true;
+  for (const auto &kv : nodes)
+  {
+    const node &nd = kv.second;
+    double sum = 0, worst = 0;
+    int ok = 0;
+    for (const auto &r : nd.reports)
+    {
+      if (r.first >= 1 && r.first <= (uint32_t)count && !strcmp(status(r.second), "ok"))
+      {
+        double e = r.second.frame_us - fire[r.first - 1];
+        sum += e;
+        worst = std::max(worst, fabs(e));
+        ok++;
+      }
+    }
+    snprintf(b, sizeof(b), "%s{\"addr\":\"%s\",\"pings\":%u,\"reports\":%zu,\"ok\":%d,\"mean_error_us\":%.0f,\"max_abs_error_us\":%.0f}",
+             first ? "" : ",", kv.first.c_str(), nd.pings, nd.reports.size(), ok, ok ? sum / ok : 0, worst);
+    j += b;
+    first = false;
+  }
+  j += "],\"frames\":[";
+  double skew_sum = 0, skew_max = 0;
+  int skew_n = 0, missing = 0;
+  for (int i = 0; i < count; i++)
+  {
+    uint32_t id = i + 1;
+    int64_t lo = INT64_MAX, hi = INT64_MIN;
+    snprintf(b, sizeof(b), "%s{\"id\":%u,\"fire_us\":%lld,\"nodes\":[", i ? "," : "", id, (long long)fire[i]);
+    j += b;
+    first = true;
+    for (const auto &kv : nodes)
+    {
+      auto it = kv.second.reports.find(id);
+      if (it == kv.second.reports.end())
+      {
+        missing++;
+        continue;
+      }
+      const report &r = it->second;
+      bool ok = !strcmp(status(r), "ok");
+      snprintf(b, sizeof(b), "%s{\"addr\":\"%s\",\"status\":\"%s\",\"frame_us\":%lld,\"error_us\":%lld,\"offset_us\":%lld,\"bytes\":%u",
+               first ? "" : ",", kv.first.c_str(), status(r), (long long)r.frame_us,
+               ok ? (long long)(r.frame_us - fire[i]) : 0LL, (long long)r.offset_us, r.bytes);
+      j += b;
+      if (r.flags & SYNC_F_STORED)
+      {
+        snprintf(b, sizeof(b), ",\"seq\":%u", r.seq);
+        j += b;
+      }
+      j += "}";
+      first = false;
+      if (ok)
+      {
+        lo = std::min(lo, r.frame_us);
+        hi = std::max(hi, r.frame_us);
+      }
+    }
+    long long skew = hi >= lo ? (long long)(hi - lo) : -1;
+    snprintf(b, sizeof(b), "],\"skew_us\":%lld}", skew);
+    j += b;
+    if (skew >= 0)
+    {
+      skew_sum += skew;
+      skew_max = std::max(skew_max, (double)skew);
+      skew_n++;
+    }
+  }
+  snprintf(b, sizeof(b), "],\"skew_us\":{\"mean\":%.0f,\"max\":%.0f},\"missing\":%d}\n",
+           skew_n ? skew_sum / skew_n : 0, skew_max, missing);
+  j += b;
+
+  FILE *out = out_path ? fopen(out_path, "w") : stdout;
+  if (!out)
+  {
+    perror(out_path);
+    return 1;
+  }
+  fputs(j.c_str(), out);
+  if (out != stdout)
+  {
+    fclose(out);
+  }
+  fprintf(stderr, "%zu node(s), %d trigger(s): skew mean %.0fus max %.0fus, %d report(s) missing\n",
+          nodes.size(), count, skew_n ? skew_sum / skew_n : 0, skew_max, missing);
+  return 0;
+}